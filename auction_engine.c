@@ -0,0 +1,814 @@
+/*
+ * =====================================================
+ * AUCTION_ENGINE.C - EMBEDDABLE AUCTION ENGINE (LIBAUCTION)
+ * =====================================================
+ * Business rules and persistence for one AuctionEngine context. Nothing
+ * here knows about connections or the wire protocol; see auction_engine.h
+ * for the locking rules and the callback interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "auction_engine.h"
+#include "io_backend.h"
+#include "trace.h"
+
+// =====================================================
+// LIFECYCLE
+// =====================================================
+
+static void engine_add_file(AuctionEngine *eng, int i, const char *name, void *base,
+                            size_t record_size, int capacity, int *count) {
+    EngineDataFile *df = &eng->files[i];
+    snprintf(df->path, sizeof(df->path), "%s/%s", eng->data_dir, name);
+    df->base = base;
+    df->record_size = record_size;
+    df->capacity = capacity;
+    df->count = count;
+    df->fd = -1;
+    df->file_size = 0;
+}
+
+AuctionEngine* engine_create(const EngineConfig *config) {
+    AuctionEngine *eng = calloc(1, sizeof(AuctionEngine));
+    if (eng == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&eng->lock, NULL);
+    lockprof_init(&eng->lock_prof, "engine");
+    eng->cb = config->callbacks;
+    eng->fixed_buffers = config->fixed_buffers;
+    clock_init_real(&eng->real_clock);
+    eng->clock = config->clock != NULL ? config->clock : &eng->real_clock;
+    if (config->data_dir != NULL) {
+        snprintf(eng->data_dir, sizeof(eng->data_dir), "%s", config->data_dir);
+    }
+
+    eng->max_users = config->max_users > 0 ? config->max_users : ENGINE_DEFAULT_MAX_USERS;
+    eng->max_rooms = config->max_rooms > 0 ? config->max_rooms : ENGINE_DEFAULT_MAX_ROOMS;
+    eng->max_auctions = config->max_auctions > 0 ? config->max_auctions : ENGINE_DEFAULT_MAX_AUCTIONS;
+    eng->max_bids = config->max_bids > 0 ? config->max_bids : ENGINE_DEFAULT_MAX_BIDS;
+
+    // calloc keeps untouched capacity out of RSS
+    eng->users = calloc(eng->max_users, sizeof(User));
+    eng->rooms = calloc(eng->max_rooms, sizeof(AuctionRoom));
+    eng->auctions = calloc(eng->max_auctions, sizeof(Auction));
+    eng->bids = calloc(eng->max_bids, sizeof(Bid));
+    eng->user_room = calloc(eng->max_users, sizeof(int));
+    if (eng->users == NULL || eng->rooms == NULL || eng->auctions == NULL ||
+        eng->bids == NULL || eng->user_room == NULL) {
+        engine_destroy(eng);
+        return NULL;
+    }
+
+    engine_add_file(eng, 0, "users.dat", eng->users, sizeof(User), eng->max_users, &eng->user_count);
+    engine_add_file(eng, 1, "rooms.dat", eng->rooms, sizeof(AuctionRoom), eng->max_rooms, &eng->room_count);
+    engine_add_file(eng, 2, "auctions.dat", eng->auctions, sizeof(Auction), eng->max_auctions,
+                    &eng->auction_count);
+    engine_add_file(eng, 3, "bids.dat", eng->bids, sizeof(Bid), eng->max_bids, &eng->bid_count);
+
+    return eng;
+}
+
+void engine_destroy(AuctionEngine *eng) {
+    if (eng == NULL) {
+        return;
+    }
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        if (eng->files[i].fd >= 0) {
+            close(eng->files[i].fd);
+        }
+    }
+    free(eng->users);
+    free(eng->rooms);
+    free(eng->auctions);
+    free(eng->bids);
+    free(eng->user_room);
+    pthread_mutex_destroy(&eng->lock);
+    free(eng);
+}
+
+void engine_lock_at(AuctionEngine *eng, const char *site) {
+    uint64_t span = trace_begin();
+    lockprof_lock(&eng->lock_prof, &eng->lock, site);
+    trace_end("engine_lock_wait", span);
+}
+
+void engine_unlock(AuctionEngine *eng) {
+    lockprof_unlock(&eng->lock_prof, &eng->lock);
+}
+
+time_t engine_now(AuctionEngine *eng) {
+    return clock_now(eng->clock);
+}
+
+int64_t engine_now_ms(AuctionEngine *eng) {
+    return clock_now_ms(eng->clock);
+}
+
+// =====================================================
+// FILE I/O FUNCTIONS
+// =====================================================
+
+void engine_load(AuctionEngine *eng) {
+    static const char *names[ENGINE_DATA_FILES] = { "users", "rooms", "auctions", "bids" };
+
+    if (eng->data_dir[0] == '\0') {
+        return;
+    }
+
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &eng->files[i];
+        FILE *fp = fopen(df->path, "rb");
+        if (fp != NULL) {
+            *df->count = fread(df->base, df->record_size, df->capacity, fp);
+            fclose(fp);
+            printf("[INFO] Loaded %d %s\n", *df->count, names[i]);
+        } else {
+            printf("[INFO] No %s file found, starting fresh\n", names[i]);
+            *df->count = 0;
+        }
+    }
+}
+
+// Data files stay open between saves; each save rewrites every table in
+// place with one batched submission instead of fopen/fwrite/fclose x4.
+static void open_data_files(AuctionEngine *eng) {
+    struct iovec bufs[ENGINE_DATA_FILES];
+    int opened = 0;
+
+    memset(bufs, 0, sizeof(bufs));
+    if (mkdir(eng->data_dir, 0755) != 0 && errno != EEXIST) {
+        printf("[WARNING] Could not create data directory: %s\n", strerror(errno));
+    }
+
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &eng->files[i];
+        struct stat st;
+
+        df->fd = open(df->path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (df->fd < 0) {
+            printf("[WARNING] Could not open %s: %s\n", df->path, strerror(errno));
+            continue;
+        }
+        df->file_size = (fstat(df->fd, &st) == 0) ? st.st_size : 0;
+
+        bufs[i].iov_base = df->base;
+        bufs[i].iov_len = df->record_size * df->capacity;
+        opened++;
+    }
+
+    // The tables never move, so they can be pinned once as fixed buffers.
+    // Buffer index = table index, so all tables or none.
+    if (eng->fixed_buffers && opened == ENGINE_DATA_FILES) {
+        eng->buffers_registered = (io_backend_register_buffers(IO_RING_DISK, bufs, ENGINE_DATA_FILES) == 0);
+    }
+    eng->files_open = 1;
+}
+
+void engine_save(AuctionEngine *eng) {
+    IoWrite ops[ENGINE_DATA_FILES];
+    EngineDataFile *files[ENGINE_DATA_FILES];
+    int n = 0;
+
+    if (eng->data_dir[0] == '\0') {
+        return;
+    }
+    uint64_t start = metrics_now_ns();
+    uint64_t span = trace_begin();
+    if (!eng->files_open) {
+        open_data_files(eng);
+    }
+
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &eng->files[i];
+        if (df->fd < 0) continue;
+
+        memset(&ops[n], 0, sizeof(IoWrite));
+        ops[n].fd = df->fd;
+        ops[n].buf = df->base;
+        ops[n].len = df->record_size * (*df->count);
+        ops[n].offset = 0;
+        ops[n].buf_index = eng->buffers_registered ? i : -1;
+        files[n] = df;
+        n++;
+    }
+
+    io_submit_writes(IO_RING_DISK, ops, n);
+
+    for (int i = 0; i < n; i++) {
+        EngineDataFile *df = files[i];
+        size_t done = ops[i].result > 0 ? (size_t)ops[i].result : 0;
+
+        // Short or failed write: finish the table synchronously
+        while (done < ops[i].len) {
+            ssize_t w = pwrite(df->fd, (const char*)df->base + done, ops[i].len - done, done);
+            if (w <= 0) {
+                printf("[WARNING] Could not write %s: %s\n", df->path, strerror(errno));
+                break;
+            }
+            done += w;
+        }
+
+        if ((off_t)ops[i].len < df->file_size && ftruncate(df->fd, ops[i].len) != 0) {
+            printf("[WARNING] Could not truncate %s: %s\n", df->path, strerror(errno));
+        }
+        df->file_size = ops[i].len;
+    }
+
+    trace_end("engine_save", span);
+    uint64_t elapsed = metrics_now_ns() - start;
+    latency_record(&eng->save_latency, elapsed);
+    if (eng->cb.saved != NULL) {
+        eng->cb.saved(eng->cb.ctx, elapsed);
+    }
+    printf("[INFO] All data saved to disk\n");
+}
+
+// =====================================================
+// LOOKUPS
+// =====================================================
+
+User* engine_find_user_by_username(AuctionEngine *eng, const char *username) {
+    for (int i = 0; i < eng->user_count; i++) {
+        if (strcmp(eng->users[i].username, username) == 0) {
+            return &eng->users[i];
+        }
+    }
+    return NULL;
+}
+
+User* engine_find_user(AuctionEngine *eng, int user_id) {
+    for (int i = 0; i < eng->user_count; i++) {
+        if (eng->users[i].user_id == user_id) {
+            return &eng->users[i];
+        }
+    }
+    return NULL;
+}
+
+Auction* engine_find_auction(AuctionEngine *eng, int auction_id) {
+    for (int i = 0; i < eng->auction_count; i++) {
+        if (eng->auctions[i].auction_id == auction_id) {
+            return &eng->auctions[i];
+        }
+    }
+    return NULL;
+}
+
+AuctionRoom* engine_find_room(AuctionEngine *eng, int room_id) {
+    for (int i = 0; i < eng->room_count; i++) {
+        if (eng->rooms[i].room_id == room_id) {
+            return &eng->rooms[i];
+        }
+    }
+    return NULL;
+}
+
+int engine_user_room(AuctionEngine *eng, int user_id) {
+    if (user_id <= 0 || user_id > eng->max_users) {
+        return 0;
+    }
+    return __atomic_load_n(&eng->user_room[user_id - 1], __ATOMIC_RELAXED);
+}
+
+static void set_user_room(AuctionEngine *eng, int user_id, int room_id) {
+    if (user_id > 0 && user_id <= eng->max_users) {
+        __atomic_store_n(&eng->user_room[user_id - 1], room_id, __ATOMIC_RELAXED);
+    }
+}
+
+static void room_changed(AuctionEngine *eng, int room_id) {
+    if (eng->cb.room_changed != NULL) {
+        eng->cb.room_changed(eng->cb.ctx, room_id);
+    }
+}
+
+static void auction_changed(AuctionEngine *eng, const Auction *auction, DeltaKind kind) {
+    if (eng->cb.auction_changed != NULL) {
+        eng->cb.auction_changed(eng->cb.ctx, auction, kind);
+    }
+}
+
+// =====================================================
+// ROOM MANAGEMENT FUNCTIONS
+// =====================================================
+
+int engine_create_room(AuctionEngine *eng, int creator_id, const char *name, const char *desc,
+                       int max_participants, int duration_minutes) {
+    engine_lock(eng);
+
+    if (eng->room_count >= eng->max_rooms) {
+        engine_unlock(eng);
+        return -1; // Room database full
+    }
+
+    // Check for duplicate room name
+    for (int i = 0; i < eng->room_count; i++) {
+        if (strcmp(eng->rooms[i].room_name, name) == 0 &&
+            strcmp(eng->rooms[i].status, "ended") != 0) {
+            engine_unlock(eng);
+            return -2; // Room name already exists
+        }
+    }
+
+    AuctionRoom *room = &eng->rooms[eng->room_count];
+    room->room_id = eng->room_count + 1;
+    strncpy(room->room_name, name, 99);
+    room->room_name[99] = '\0';
+    strncpy(room->description, desc, 199);
+    room->description[199] = '\0';
+    room->max_participants = max_participants;
+    room->current_participants = 0;
+    strcpy(room->status, "waiting");
+    room->start_time = engine_now(eng);
+    room->end_time = room->start_time + (time_t)duration_minutes * 60;
+    room->created_by = creator_id;
+    room->total_auctions = 0;
+
+    eng->room_count++;
+    room_changed(eng, room->room_id);
+
+    engine_save(eng);
+    engine_unlock(eng);
+
+    return room->room_id;
+}
+
+int engine_join_room(AuctionEngine *eng, int user_id, int room_id) {
+    engine_lock(eng);
+
+    AuctionRoom *room = engine_find_room(eng, room_id);
+
+    if (room == NULL) {
+        engine_unlock(eng);
+        printf("[ERROR] join_room: Room %d not found\n", room_id);
+        return -1; // Room not found
+    }
+
+    if (strcmp(room->status, "ended") == 0) {
+        engine_unlock(eng);
+        printf("[ERROR] join_room: Room %d has ended\n", room_id);
+        return -2; // Room has ended
+    }
+
+    if (room->current_participants >= room->max_participants) {
+        engine_unlock(eng);
+        printf("[ERROR] join_room: Room %d is full (%d/%d)\n",
+               room_id, room->current_participants, room->max_participants);
+        return -3; // Room is full
+    }
+
+    int current = engine_user_room(eng, user_id);
+    if (current > 0 && current != room_id) {
+        engine_unlock(eng);
+        printf("[ERROR] join_room: User %d already in room %d\n", user_id, current);
+        return -4; // Already in another room
+    }
+
+    set_user_room(eng, user_id, room_id);
+    room->current_participants++;
+    room_changed(eng, room_id);
+    printf("[DEBUG] join_room: Room %d participants: %d/%d\n",
+           room_id, room->current_participants, room->max_participants);
+
+    // Activate room if it was waiting
+    if (strcmp(room->status, "waiting") == 0) {
+        strcpy(room->status, "active");
+        printf("[DEBUG] join_room: Room %d activated\n", room_id);
+    }
+
+    engine_save(eng);
+    engine_unlock(eng);
+
+    printf("[INFO] User %d successfully joined room %d\n", user_id, room_id);
+    return 0; // Success
+}
+
+int engine_leave_room_locked(AuctionEngine *eng, int user_id) {
+    int old_room_id = engine_user_room(eng, user_id);
+
+    if (old_room_id == 0) {
+        printf("[DEBUG] leave_room: User %d not in any room\n", user_id);
+        return -1; // Not in any room
+    }
+
+    AuctionRoom *room = engine_find_room(eng, old_room_id);
+    if (room != NULL) {
+        room->current_participants--;
+        room_changed(eng, old_room_id);
+        printf("[DEBUG] leave_room: Room %d participants decreased to %d\n",
+               old_room_id, room->current_participants);
+    }
+
+    set_user_room(eng, user_id, 0);
+
+    printf("[INFO] User %d left room %d\n", user_id, old_room_id);
+    return 0; // Success
+}
+
+int engine_leave_room(AuctionEngine *eng, int user_id) {
+    engine_lock(eng);
+
+    int result = engine_leave_room_locked(eng, user_id);
+    if (result == 0) {
+        engine_save(eng);
+    }
+
+    engine_unlock(eng);
+
+    return result;
+}
+
+// =====================================================
+// USER MANAGEMENT FUNCTIONS
+// =====================================================
+
+int engine_register_user(AuctionEngine *eng, const char *username, const char *password, const char *email) {
+    engine_lock(eng);
+
+    if (engine_find_user_by_username(eng, username) != NULL) {
+        engine_unlock(eng);
+        return -1; // Username already exists
+    }
+
+    if (eng->user_count >= eng->max_users) {
+        engine_unlock(eng);
+        return -2; // Database full
+    }
+
+    User *user = &eng->users[eng->user_count];
+    user->user_id = eng->user_count + 1;
+    strncpy(user->username, username, 49);
+    user->username[49] = '\0';
+    strncpy(user->password, password, 255);
+    user->password[255] = '\0';
+    strncpy(user->email, email, 99);
+    user->email[99] = '\0';
+    strcpy(user->role, "user");
+    user->balance = 1000000; // Starting balance
+    strcpy(user->status, "active");
+    user->created_at = engine_now(eng);
+
+    eng->user_count++;
+
+    engine_save(eng);
+    engine_unlock(eng);
+
+    return user->user_id;
+}
+
+int engine_authenticate_user(AuctionEngine *eng, const char *username, const char *password) {
+    engine_lock(eng);
+
+    User *user = engine_find_user_by_username(eng, username);
+
+    if (user == NULL) {
+        engine_unlock(eng);
+        return -1; // User not found
+    }
+
+    if (strcmp(user->password, password) != 0) {
+        engine_unlock(eng);
+        return -2; // Wrong password
+    }
+
+    if (strcmp(user->status, "active") != 0) {
+        engine_unlock(eng);
+        return -3; // Account not active
+    }
+
+    int user_id = user->user_id;
+    engine_unlock(eng);
+
+    return user_id;
+}
+
+// =====================================================
+// AUCTION MANAGEMENT FUNCTIONS
+// =====================================================
+
+int engine_create_auction_locked(AuctionEngine *eng, int seller_id, int room_id, const char *title,
+                                 const char *desc, double start_price, double buy_now_price,
+                                 double min_increment, int duration_minutes) {
+
+    if (eng->auction_count >= eng->max_auctions) {
+        return -1; // Auction database full
+    }
+
+    // Validate room exists
+    AuctionRoom *room = engine_find_room(eng, room_id);
+    if (room == NULL) {
+        return -2; // Room not found
+    }
+
+    if (engine_user_room(eng, seller_id) != room_id) {
+        return -3; // Seller not in room
+    }
+
+    // CRITICAL: Only room creator can create auction
+    if (room->created_by != seller_id) {
+        return -4; // Not room creator
+    }
+
+    Auction *auction = &eng->auctions[eng->auction_count];
+    auction->auction_id = eng->auction_count + 1;
+    auction->seller_id = seller_id;
+    auction->room_id = room_id;
+    strncpy(auction->title, title, 199);
+    auction->title[199] = '\0';
+    strncpy(auction->description, desc, 499);
+    auction->description[499] = '\0';
+    auction->start_price = start_price;
+    auction->current_price = start_price;
+    auction->buy_now_price = buy_now_price;
+    auction->min_bid_increment = min_increment;
+    auction->start_time = engine_now(eng);
+    auction->end_time = auction->start_time + (time_t)duration_minutes * 60;
+    strcpy(auction->status, "active");
+    auction->winner_id = 0;
+    auction->total_bids = 0;
+
+    eng->auction_count++;
+    room->total_auctions++;
+    room_changed(eng, room_id);
+    auction_changed(eng, auction, DELTA_NEW);
+
+    return auction->auction_id;
+}
+
+int engine_create_auction(AuctionEngine *eng, int seller_id, int room_id, const char *title,
+                          const char *desc, double start_price, double buy_now_price,
+                          double min_increment, int duration_minutes) {
+    engine_lock(eng);
+    int result = engine_create_auction_locked(eng, seller_id, room_id, title, desc, start_price,
+                                              buy_now_price, min_increment, duration_minutes);
+    if (result > 0) {
+        engine_save(eng);
+    }
+    engine_unlock(eng);
+
+    return result;
+}
+
+int engine_place_bid_locked(AuctionEngine *eng, int auction_id, int user_id, double bid_amount) {
+
+    Auction *auction = engine_find_auction(eng, auction_id);
+
+    if (auction == NULL) {
+        return -1; // Auction not found
+    }
+
+    if (strcmp(auction->status, "active") != 0) {
+        return -2; // Auction not active
+    }
+
+    if (engine_user_room(eng, user_id) != auction->room_id) {
+        return -8; // Not in the same room
+    }
+
+    int64_t now_ms = engine_now_ms(eng);
+    time_t now = now_ms / 1000;
+    int64_t remaining_ms = (int64_t)auction->end_time * 1000 - now_ms;
+    if (remaining_ms < 0) {
+        return -3; // Auction ended
+    }
+
+    if (bid_amount < auction->current_price + auction->min_bid_increment) {
+        return -4; // Bid too low
+    }
+
+    if (auction->seller_id == user_id) {
+        return -5; // Can't bid on own auction
+    }
+
+    User *user = engine_find_user(eng, user_id);
+    if (user == NULL || user->balance < bid_amount) {
+        return -6; // Insufficient balance
+    }
+
+    // Create bid
+    if (eng->bid_count >= eng->max_bids) {
+        return -7; // Bids database full
+    }
+
+    Bid *bid = &eng->bids[eng->bid_count];
+    bid->bid_id = eng->bid_count + 1;
+    bid->auction_id = auction_id;
+    bid->user_id = user_id;
+    bid->bid_amount = bid_amount;
+    bid->bid_time = now;
+
+    eng->bid_count++;
+
+    // Update auction
+    auction->current_price = bid_amount;
+    auction->total_bids++;
+    auction->winner_id = user_id;
+
+    // Anti-snipe: If bid placed in last 30 seconds, extend by 30 seconds.
+    // end_time is stored in seconds; round up so the window is never short.
+    if (remaining_ms < ENGINE_ANTI_SNIPE_SECONDS * 1000 && remaining_ms > 0) {
+        auction->end_time = (now_ms + ENGINE_ANTI_SNIPE_SECONDS * 1000 + 999) / 1000;
+        printf("[INFO] Anti-snipe: Auction %d extended by 30 seconds\n", auction_id);
+    }
+    auction_changed(eng, auction, DELTA_BID);
+
+    return bid->bid_id;
+}
+
+int engine_place_bid(AuctionEngine *eng, int auction_id, int user_id, double bid_amount) {
+    engine_lock(eng);
+    int result = engine_place_bid_locked(eng, auction_id, user_id, bid_amount);
+    if (result > 0) {
+        engine_save(eng);
+    }
+    engine_unlock(eng);
+
+    return result;
+}
+
+int engine_buy_now(AuctionEngine *eng, int auction_id, int user_id) {
+    engine_lock(eng);
+
+    Auction *auction = engine_find_auction(eng, auction_id);
+
+    if (auction == NULL || strcmp(auction->status, "active") != 0) {
+        engine_unlock(eng);
+        return -1; // Auction not available
+    }
+
+    // Validate user is in the same room
+    if (engine_user_room(eng, user_id) != auction->room_id) {
+        engine_unlock(eng);
+        return -4; // Not in the same room
+    }
+
+    if (auction->buy_now_price <= 0) {
+        engine_unlock(eng);
+        return -2; // Buy now not available
+    }
+
+    User *user = engine_find_user(eng, user_id);
+    if (user == NULL || user->balance < auction->buy_now_price) {
+        engine_unlock(eng);
+        return -3; // Insufficient balance
+    }
+
+    // Process buy now
+    user->balance -= auction->buy_now_price;
+
+    User *seller = engine_find_user(eng, auction->seller_id);
+    if (seller != NULL) {
+        seller->balance += auction->buy_now_price;
+    }
+
+    auction->winner_id = user_id;
+    auction->current_price = auction->buy_now_price;
+    strcpy(auction->status, "ended");
+    auction_changed(eng, auction, DELTA_STATE);
+
+    engine_save(eng);
+    engine_unlock(eng);
+
+    return 0;
+}
+
+// Only auctions that have not started yet can be deleted
+int engine_delete_auction_locked(AuctionEngine *eng, int auction_id, int user_id) {
+
+    Auction *auction = engine_find_auction(eng, auction_id);
+
+    if (auction == NULL) {
+        return -1; // Auction not found
+    }
+
+    // Can only delete if status is "waiting" (not started yet)
+    if (strcmp(auction->status, "waiting") != 0) {
+        return -2; // Auction already started or ended
+    }
+
+    // Get room to check permissions
+    AuctionRoom *room = engine_find_room(eng, auction->room_id);
+    if (room == NULL) {
+        return -3; // Room not found
+    }
+
+    // Only seller or room creator can delete
+    if (auction->seller_id != user_id && room->created_by != user_id) {
+        return -4; // No permission
+    }
+
+    // Mark auction as deleted
+    strcpy(auction->status, "deleted");
+    room->total_auctions--;
+    room_changed(eng, room->room_id);
+    auction_changed(eng, auction, DELTA_STATE);
+
+    printf("[INFO] Auction %d deleted by user %d\n", auction_id, user_id);
+    return 0; // Success
+}
+
+int engine_delete_auction(AuctionEngine *eng, int auction_id, int user_id) {
+    engine_lock(eng);
+    int result = engine_delete_auction_locked(eng, auction_id, user_id);
+    if (result == 0) {
+        engine_save(eng);
+    }
+    engine_unlock(eng);
+
+    return result;
+}
+
+// =====================================================
+// AUCTION TIMER
+// =====================================================
+
+void engine_tick(AuctionEngine *eng, time_t now) {
+    engine_lock(eng);
+
+    for (int i = 0; i < eng->auction_count; i++) {
+        Auction *auction = &eng->auctions[i];
+        if (strcmp(auction->status, "active") != 0) {
+            continue;
+        }
+
+        int time_left = auction->end_time - now;
+        if (time_left <= 0) {
+            strcpy(auction->status, "ended");
+            auction_changed(eng, auction, DELTA_STATE);
+
+            const User *winner = auction->winner_id > 0 ? engine_find_user(eng, auction->winner_id) : NULL;
+            if (eng->cb.auction_ended != NULL) {
+                eng->cb.auction_ended(eng->cb.ctx, auction, winner);
+            }
+
+            printf("[INFO] Auction %d ended - Winner: %s, Price: %.2f, Bids: %d\n",
+                   auction->auction_id, winner ? winner->username : "No bids",
+                   auction->current_price, auction->total_bids);
+        } else if (time_left <= ENGINE_WARNING_SECONDS &&
+                   time_left > ENGINE_WARNING_SECONDS - ENGINE_TICK_SECONDS) {
+            if (eng->cb.auction_warning != NULL) {
+                eng->cb.auction_warning(eng->cb.ctx, auction, time_left);
+            }
+            printf("[INFO] Auction %d warning: %d seconds left\n", auction->auction_id, time_left);
+        }
+    }
+
+    engine_unlock(eng);
+}
+
+// =====================================================
+// ERROR MESSAGES
+// =====================================================
+
+const char* engine_create_auction_error(int result) {
+    switch(result) {
+        case -1: return "Database full";
+        case -2: return "Room not found";
+        case -3: return "You must be in the room to create auction";
+        case -4: return "Only room creator can create auction";
+        default: return "Unknown error";
+    }
+}
+
+const char* engine_place_bid_error(int result) {
+    switch(result) {
+        case -1: return "Auction not found";
+        case -2: return "Auction not active";
+        case -3: return "Auction ended";
+        case -4: return "Bid too low";
+        case -5: return "Cannot bid on own auction";
+        case -6: return "Insufficient balance";
+        case -7: return "Bid storage full";
+        case -8: return "Not in the same room";
+        default: return "Unknown error";
+    }
+}
+
+const char* engine_buy_now_error(int result) {
+    switch(result) {
+        case -1: return "Auction not available";
+        case -2: return "Buy now not available";
+        case -3: return "Insufficient balance";
+        case -4: return "Not in the same room";
+        default: return "Unknown error";
+    }
+}
+
+const char* engine_delete_auction_error(int result) {
+    switch(result) {
+        case -1: return "Auction not found";
+        case -2: return "Cannot delete - auction already started or ended";
+        case -3: return "Room not found";
+        case -4: return "No permission - only seller or room creator can delete";
+        default: return "Unknown error";
+    }
+}
@@ -0,0 +1,222 @@
+/*
+ * =====================================================
+ * AUCTION_ENGINE.H - EMBEDDABLE AUCTION ENGINE (LIBAUCTION)
+ * =====================================================
+ * Users, rooms, auctions and bids, their business rules and their
+ * persistence, behind an explicit AuctionEngine context: no globals and no
+ * sockets, so several engines can live in one process. The host (server.c,
+ * the benchmarks) learns about state changes through EngineCallbacks and
+ * decides how to deliver them.
+ *
+ * Locking: every engine_* mutation takes eng->lock itself. *_locked
+ * functions and direct reads of the tables need the caller to hold it
+ * (engine_lock/engine_unlock). Callbacks run with the lock held; they may
+ * read the engine but must not call engine functions that lock it.
+ */
+
+#ifndef AUCTION_ENGINE_H
+#define AUCTION_ENGINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "clock.h"
+#include "lockprof.h"
+#include "metrics.h"
+
+#define ENGINE_DEFAULT_MAX_USERS 1000
+#define ENGINE_DEFAULT_MAX_ROOMS 100
+#define ENGINE_DEFAULT_MAX_AUCTIONS 1000
+#define ENGINE_DEFAULT_MAX_BIDS 5000
+#define ENGINE_DATA_FILES 4
+#define ENGINE_ANTI_SNIPE_SECONDS 30       // decided to the millisecond
+#define ENGINE_WARNING_SECONDS 30
+#define ENGINE_TICK_SECONDS 5           // engine_tick period; one warning per auction
+
+typedef struct {
+    int user_id;
+    char username[50];
+    char password[256];
+    char email[100];
+    char role[20];
+    double balance;
+    char status[20];
+    time_t created_at;
+} User;
+
+typedef struct {
+    int room_id;
+    char room_name[100];
+    char description[200];
+    int max_participants;
+    int current_participants;
+    char status[20]; // "waiting", "active", "ended"
+    time_t start_time;
+    time_t end_time;
+    int created_by;
+    int total_auctions; // Số lượng auction trong room
+} AuctionRoom;
+
+typedef struct {
+    int auction_id;
+    int seller_id;
+    int room_id; // Auction belongs to a room
+    char title[200];
+    char description[500];
+    double start_price;
+    double current_price;
+    double buy_now_price;
+    double min_bid_increment;
+    time_t start_time;
+    time_t end_time;
+    char status[20];
+    int winner_id;
+    int total_bids;
+} Auction;
+
+typedef struct {
+    int bid_id;
+    int auction_id;
+    int user_id;
+    double bid_amount;
+    time_t bid_time;
+} Bid;
+
+// What changed about an auction
+typedef enum {
+    DELTA_NEW,      // auction created
+    DELTA_BID,      // price, bid count and (anti-snipe) end time
+    DELTA_STATE     // ended, sold or deleted
+} DeltaKind;
+
+// All optional; called with eng->lock held
+typedef struct {
+    void *ctx;
+    void (*auction_changed)(void *ctx, const Auction *auction, DeltaKind kind);
+    // A room's row (participants, auction count, status) changed
+    void (*room_changed)(void *ctx, int room_id);
+    // The timer ended an auction; winner is NULL when nobody bid
+    void (*auction_ended)(void *ctx, const Auction *auction, const User *winner);
+    // Once, on the tick that enters the last ENGINE_WARNING_SECONDS
+    void (*auction_warning)(void *ctx, const Auction *auction, int time_left);
+    // engine_save wrote the tables, taking elapsed_ns (also in save_latency)
+    void (*saved)(void *ctx, uint64_t elapsed_ns);
+} EngineCallbacks;
+
+typedef struct {
+    const char *data_dir;       // table files live here; NULL = no persistence
+    int max_users;              // 0 = ENGINE_DEFAULT_*
+    int max_rooms;
+    int max_auctions;
+    int max_bids;
+    int fixed_buffers;          // pin the tables as io_uring fixed buffers
+                                // (the ring holds one set per process)
+    Clock *clock;               // NULL = real time; must outlive the engine
+    EngineCallbacks callbacks;
+} EngineConfig;
+
+typedef struct {
+    char path[512];
+    void *base;
+    size_t record_size;
+    int capacity;
+    int *count;
+    int fd;
+    off_t file_size;
+} EngineDataFile;
+
+typedef struct {
+    pthread_mutex_t lock;
+    LockProfile lock_prof;      // wait/hold time per engine_lock caller
+    EngineCallbacks cb;
+    char data_dir[256];
+
+    User *users;
+    int user_count;
+    int max_users;
+
+    AuctionRoom *rooms;
+    int room_count;
+    int max_rooms;
+
+    Auction *auctions;
+    int auction_count;
+    int max_auctions;
+
+    Bid *bids;
+    int bid_count;
+    int max_bids;
+
+    // Room each user is in (0 = none), index user_id - 1. Not persisted:
+    // membership lasts as long as the user's session.
+    int *user_room;
+
+    EngineDataFile files[ENGINE_DATA_FILES];
+    int files_open;
+    int fixed_buffers;
+    int buffers_registered;
+    LatencyHist save_latency;   // engine_save duration (lock)
+
+    Clock *clock;
+    Clock real_clock;           // used when the config has no clock
+} AuctionEngine;
+
+// Lifecycle
+AuctionEngine* engine_create(const EngineConfig *config);
+void engine_destroy(AuctionEngine *eng);
+void engine_load(AuctionEngine *eng);           // read the tables from data_dir
+void engine_save(AuctionEngine *eng);           // caller holds the lock
+void engine_lock_at(AuctionEngine *eng, const char *site);
+void engine_unlock(AuctionEngine *eng);
+#define engine_lock(eng) engine_lock_at((eng), __func__)
+
+// The engine's clock, used for every timestamp and deadline it sets
+time_t engine_now(AuctionEngine *eng);
+int64_t engine_now_ms(AuctionEngine *eng);
+
+// Lookups; caller holds the lock
+User* engine_find_user_by_username(AuctionEngine *eng, const char *username);
+User* engine_find_user(AuctionEngine *eng, int user_id);
+Auction* engine_find_auction(AuctionEngine *eng, int auction_id);
+AuctionRoom* engine_find_room(AuctionEngine *eng, int room_id);
+
+// Room the user is in, 0 if none. Safe without the lock.
+int engine_user_room(AuctionEngine *eng, int user_id);
+
+// Users
+int engine_register_user(AuctionEngine *eng, const char *username, const char *password, const char *email);
+int engine_authenticate_user(AuctionEngine *eng, const char *username, const char *password);
+
+// Rooms
+int engine_create_room(AuctionEngine *eng, int creator_id, const char *name, const char *desc,
+                       int max_participants, int duration_minutes);
+int engine_join_room(AuctionEngine *eng, int user_id, int room_id);
+int engine_leave_room(AuctionEngine *eng, int user_id);
+int engine_leave_room_locked(AuctionEngine *eng, int user_id);
+
+// Auctions. The _locked variants do not save; the caller saves once after
+// a group of changes.
+int engine_create_auction(AuctionEngine *eng, int seller_id, int room_id, const char *title,
+                          const char *desc, double start_price, double buy_now_price,
+                          double min_increment, int duration_minutes);
+int engine_create_auction_locked(AuctionEngine *eng, int seller_id, int room_id, const char *title,
+                                 const char *desc, double start_price, double buy_now_price,
+                                 double min_increment, int duration_minutes);
+int engine_place_bid(AuctionEngine *eng, int auction_id, int user_id, double amount);
+int engine_place_bid_locked(AuctionEngine *eng, int auction_id, int user_id, double amount);
+int engine_buy_now(AuctionEngine *eng, int auction_id, int user_id);
+int engine_delete_auction(AuctionEngine *eng, int auction_id, int user_id);
+int engine_delete_auction_locked(AuctionEngine *eng, int auction_id, int user_id);
+
+// Ends expired auctions and raises warnings; call periodically
+void engine_tick(AuctionEngine *eng, time_t now);
+
+// Reasons for the negative results above
+const char* engine_create_auction_error(int result);
+const char* engine_place_bid_error(int result);
+const char* engine_buy_now_error(int result);
+const char* engine_delete_auction_error(int result);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * =====================================================
+ * CLOCK_CHECK.C - AUCTION TIMING ON A MANUAL CLOCK
+ * =====================================================
+ * Drives the engine through libauction with a manual Clock, so the
+ * timing rules can be checked to the millisecond without waiting:
+ *
+ *   anti-snipe  a bid with exactly 30 s left does not extend; one with
+ *               29.999 s left does, never to less than 30 s; a bid on
+ *               the last millisecond is taken, one after it is not
+ *   warning     ticking every ENGINE_TICK_SECONDS, whatever the phase,
+ *               warns once per auction
+ *   ending      the first tick at end_time ends the auction, reports the
+ *               winner once and closes it to bids
+ *
+ * Prints one "ok" / "FAIL" line per check; exit status 1 if any failed.
+ *
+ * Usage: clock_check   (or make check)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../auction_engine.h"
+
+#define START_MS 1700000000000LL    // a whole second
+#define SELLER_ID 1
+#define BIDDER_ID 2
+#define RIVAL_ID 3
+#define MAX_IDS 8
+
+static FILE *g_out;
+static int g_checks = 0;
+static int g_failed = 0;
+
+static Clock g_clock;
+static int g_warnings[MAX_IDS];
+static int g_ended[MAX_IDS];
+static int g_winner[MAX_IDS];
+
+static void check(int ok, const char *what) {
+    g_checks++;
+    g_failed += !ok;
+    fprintf(g_out, "%-4s %s\n", ok ? "ok" : "FAIL", what);
+}
+
+static void on_warning(void *ctx, const Auction *auction, int time_left) {
+    g_warnings[auction->auction_id]++;
+}
+
+static void on_ended(void *ctx, const Auction *auction, const User *winner) {
+    g_ended[auction->auction_id]++;
+    g_winner[auction->auction_id] = winner ? winner->user_id : 0;
+}
+
+// Fresh engine at START_MS: seller's room with everyone in it and one
+// auction of duration_minutes
+static AuctionEngine* setup(int duration_minutes) {
+    EngineConfig config;
+    memset(&config, 0, sizeof(config));
+    config.clock = &g_clock;
+    config.callbacks.auction_warning = on_warning;
+    config.callbacks.auction_ended = on_ended;
+
+    memset(g_warnings, 0, sizeof(g_warnings));
+    memset(g_ended, 0, sizeof(g_ended));
+    memset(g_winner, 0, sizeof(g_winner));
+    clock_init_manual(&g_clock, START_MS);
+
+    AuctionEngine *eng = engine_create(&config);
+    if (eng == NULL) {
+        fprintf(stderr, "engine_create failed\n");
+        exit(1);
+    }
+    engine_register_user(eng, "seller", "pw", "s@x");
+    engine_register_user(eng, "bidder", "pw", "b@x");
+    engine_register_user(eng, "rival", "pw", "r@x");
+    int room_id = engine_create_room(eng, SELLER_ID, "room", "desc", 10, 60);
+    engine_join_room(eng, SELLER_ID, room_id);
+    engine_join_room(eng, BIDDER_ID, room_id);
+    engine_join_room(eng, RIVAL_ID, room_id);
+    if (engine_create_auction(eng, SELLER_ID, room_id, "item", "desc", 100, 0, 10, duration_minutes) != 1) {
+        fprintf(stderr, "setup failed\n");
+        exit(1);
+    }
+    return eng;
+}
+
+static time_t end_time(AuctionEngine *eng) {
+    engine_lock(eng);
+    time_t end = engine_find_auction(eng, 1)->end_time;
+    engine_unlock(eng);
+    return end;
+}
+
+static int is_active(AuctionEngine *eng) {
+    engine_lock(eng);
+    int active = strcmp(engine_find_auction(eng, 1)->status, "active") == 0;
+    engine_unlock(eng);
+    return active;
+}
+
+static void tick(AuctionEngine *eng) {
+    engine_tick(eng, clock_now(&g_clock));
+}
+
+static void check_anti_snipe() {
+    AuctionEngine *eng = setup(1);
+    time_t end = end_time(eng);
+
+    clock_set_ms(&g_clock, (int64_t)end * 1000 - ENGINE_ANTI_SNIPE_SECONDS * 1000);
+    check(engine_place_bid(eng, 1, BIDDER_ID, 110) > 0 && end_time(eng) == end,
+          "anti-snipe: bid with exactly 30 s left does not extend");
+
+    clock_advance_ms(&g_clock, 1);
+    check(engine_place_bid(eng, 1, RIVAL_ID, 120) > 0 && end_time(eng) == end + 1,
+          "anti-snipe: bid with 29.999 s left extends to a full 30 s (rounded up)");
+    end = end_time(eng);
+
+    clock_set_ms(&g_clock, (int64_t)end * 1000);
+    check(engine_place_bid(eng, 1, BIDDER_ID, 130) > 0 && end_time(eng) == end,
+          "anti-snipe: bid on the last millisecond is taken without extending");
+
+    clock_advance_ms(&g_clock, 1);
+    check(engine_place_bid(eng, 1, RIVAL_ID, 140) == -3,
+          "anti-snipe: bid after end_time is rejected as ended");
+
+    engine_destroy(eng);
+}
+
+static void check_warning() {
+    char what[128];
+
+    for (int phase_ms = 0; phase_ms < ENGINE_TICK_SECONDS * 1000; phase_ms += 500) {
+        AuctionEngine *eng = setup(1);
+
+        clock_advance_ms(&g_clock, phase_ms);
+        for (int n = 0; g_ended[1] == 0 && n < 100; n++) {
+            tick(eng);
+            clock_advance_ms(&g_clock, ENGINE_TICK_SECONDS * 1000);
+        }
+        snprintf(what, sizeof(what), "warning: one per auction, ticks at +%d ms", phase_ms);
+        check(g_warnings[1] == 1 && g_ended[1] == 1, what);
+        engine_destroy(eng);
+    }
+}
+
+static void check_ending() {
+    AuctionEngine *eng = setup(1);
+    time_t end = end_time(eng);
+
+    engine_place_bid(eng, 1, BIDDER_ID, 150);
+
+    clock_set_ms(&g_clock, (int64_t)end * 1000 - 1);
+    tick(eng);
+    check(is_active(eng) && g_ended[1] == 0, "ending: still active 1 ms before end_time");
+
+    clock_set_ms(&g_clock, (int64_t)end * 1000);
+    tick(eng);
+    check(!is_active(eng) && g_ended[1] == 1 && g_winner[1] == BIDDER_ID,
+          "ending: first tick at end_time ends it with the high bidder as winner");
+
+    clock_advance_ms(&g_clock, ENGINE_TICK_SECONDS * 1000);
+    tick(eng);
+    check(g_ended[1] == 1, "ending: later ticks do not end it again");
+    check(engine_place_bid(eng, 1, RIVAL_ID, 500) == -2, "ending: closed to bids");
+
+    engine_destroy(eng);
+}
+
+int main(int argc, char *argv[]) {
+    // Results keep the real stdout; the engine's printf logging is dropped
+    g_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (g_out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+
+    check_anti_snipe();
+    check_warning();
+    check_ending();
+
+    fprintf(g_out, "%d checks, %d failed\n", g_checks, g_failed);
+    return g_failed > 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * =====================================================
+ * CODEC_BENCH.C - TEXT VS BIN1 ENCODE/DECODE COST
+ * =====================================================
+ * Round-trips the two hottest messages (PLACE_BID requests and NEW_BID
+ * notifications) through the sprintf/sscanf text format and through the
+ * binary codec, and reports ns per message and bytes on the wire.
+ *
+ * Usage: codec_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../protocol.h"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, int iterations, double elapsed, size_t bytes, long check) {
+    printf("%-22s %8.1f ns/msg  %4zu bytes  (check %ld)\n",
+           name, elapsed * 1e9 / iterations, bytes, check);
+}
+
+static void bench_new_bid(int iterations) {
+    char text[256];
+    unsigned char frame[256];
+    size_t bytes = 0;
+    long check = 0;
+
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        int len = sprintf(text, "NEW_BID|%d|%s|%.2f|%d\n", i & 1023, "bidder_42",
+                          1000.0 + (i & 4095) * 0.25, i & 255);
+        int auction_id, total_bids;
+        char bidder[50];
+        double amount;
+        sscanf(text + 8, "%d|%[^|]|%lf|%d", &auction_id, bidder, &amount, &total_bids);
+        check += auction_id + total_bids + (long)amount;
+        bytes = len;
+    }
+    report("NEW_BID text", iterations, now_sec() - start, bytes, check);
+
+    check = 0;
+    start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        ProtoNewBid in, out;
+        in.auction_id = i & 1023;
+        strcpy(in.bidder, "bidder_42");
+        in.amount = 1000.0 + (i & 4095) * 0.25;
+        in.total_bids = i & 255;
+        in.time_left = 0;
+
+        bytes = proto_encode_new_bid(frame, sizeof(frame), &in, 0);
+        ProtoHeader h;
+        proto_parse_header(frame, bytes, sizeof(frame), &h);
+        proto_decode_new_bid(frame + PROTO_HEADER_SIZE, h.len, &out);
+        check += out.auction_id + out.total_bids + (long)out.amount;
+    }
+    report("NEW_BID bin1", iterations, now_sec() - start, bytes, check);
+}
+
+static void bench_place_bid(int iterations) {
+    char text[256];
+    unsigned char frame[256];
+    size_t bytes = 0;
+    long check = 0;
+
+    double start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        int len = sprintf(text, "PLACE_BID|%d|%d|%.2f\n", i & 1023, i & 511, 1000.0 + (i & 4095) * 0.25);
+        int auction_id, user_id;
+        double amount;
+        sscanf(text + 10, "%d|%d|%lf", &auction_id, &user_id, &amount);
+        check += auction_id + user_id + (long)amount;
+        bytes = len;
+    }
+    report("PLACE_BID text", iterations, now_sec() - start, bytes, check);
+
+    check = 0;
+    start = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        ProtoPlaceBid in, out;
+        in.auction_id = i & 1023;
+        in.user_id = i & 511;
+        in.amount = 1000.0 + (i & 4095) * 0.25;
+        in.request_id[0] = '\0';
+
+        bytes = proto_encode_place_bid(frame, sizeof(frame), &in, i);
+        ProtoHeader h;
+        proto_parse_header(frame, bytes, sizeof(frame), &h);
+        proto_decode_place_bid(frame + PROTO_HEADER_SIZE, h.len, &out);
+        check += out.auction_id + out.user_id + (long)out.amount;
+    }
+    report("PLACE_BID bin1", iterations, now_sec() - start, bytes, check);
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+    if (iterations <= 0) {
+        printf("Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    printf("Codec round trip (encode + decode), %d iterations\n", iterations);
+    bench_new_bid(iterations);
+    bench_place_bid(iterations);
+    return 0;
+}
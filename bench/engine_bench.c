@@ -0,0 +1,386 @@
+/*
+ * =====================================================
+ * ENGINE_BENCH.C - BUSINESS LOGIC MICROBENCHMARKS
+ * =====================================================
+ * Drives one AuctionEngine through libauction, without sockets or threads:
+ * lookups, login, room/auction/bid mutations and persistence.
+ * list_auctions is the engine side of AUCTION_LIST (scan one room and
+ * format its rows under the lock), without the socket write.
+ *
+ * Every scale generates a synthetic dataset of that many users, auctions
+ * and bids (the engine is sized for the largest scale), then runs each
+ * benchmark for at least -t seconds. Results go to stdout as one JSON
+ * object per line, so two runs can be diffed or loaded into a notebook;
+ * the engine's own logging is discarded.
+ *
+ * Usage: engine_bench [-n scales] [-t seconds] [-l label] [-f filter]
+ *                     [-B io_backend] [-d dir]
+ *   e.g. engine_bench -n 1000,100000,10000000 -l before -f place_bid
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../auction_engine.h"
+#include "../io_backend.h"
+
+#define DEFAULT_SCALES "1000,10000,100000"
+#define KEY_POOL 1024               // pre-generated lookup keys
+#define MUTATION_HEADROOM 10000     // table slots left free for create/bid runs
+#define BENCH_USER_SELLER 1         // room 1 creator and seller of every auction
+#define BENCH_USER_BIDDER 2
+#define LIST_BUFFER_SIZE 65536
+
+typedef void (*BenchFn)(long i);
+
+static FILE *g_out;
+static double g_min_time = 0.5;
+static const char *g_label = "";
+static const char *g_filter = NULL;
+static int g_scale;
+
+static AuctionEngine *g_eng;
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull;
+static char g_names[KEY_POOL][50];
+static int g_user_keys[KEY_POOL];
+static int g_auction_keys[KEY_POOL];
+static int g_room_keys[KEY_POOL];
+static double g_next_bid;
+static char g_list_buf[LIST_BUFFER_SIZE];
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_next() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static int clamp(long v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : (int)v);
+}
+
+// =====================================================
+// DATASET GENERATION
+// =====================================================
+
+static void generate_dataset(int scale) {
+    AuctionEngine *eng = g_eng;
+    time_t now = time(NULL);
+
+    memset(eng->user_room, 0, sizeof(int) * eng->max_users);
+
+    eng->user_count = clamp(scale, 2, eng->max_users);
+    for (int i = 0; i < eng->user_count; i++) {
+        User *u = &eng->users[i];
+        memset(u, 0, sizeof(User));
+        u->user_id = i + 1;
+        snprintf(u->username, sizeof(u->username), "user%07d", i + 1);
+        snprintf(u->password, sizeof(u->password), "pw%d", i + 1);
+        snprintf(u->email, sizeof(u->email), "user%d@bench", i + 1);
+        strcpy(u->role, "user");
+        strcpy(u->status, "active");
+        u->balance = 1e12;
+        u->created_at = now;
+    }
+
+    // About 100 auctions per room
+    eng->room_count = clamp(scale / 100, 1, eng->max_rooms);
+    for (int i = 0; i < eng->room_count; i++) {
+        AuctionRoom *r = &eng->rooms[i];
+        memset(r, 0, sizeof(AuctionRoom));
+        r->room_id = i + 1;
+        snprintf(r->room_name, sizeof(r->room_name), "room %d", i + 1);
+        strcpy(r->description, "bench");
+        r->max_participants = INT_MAX;
+        strcpy(r->status, "active");
+        r->start_time = now;
+        r->end_time = now + 86400;
+        r->created_by = BENCH_USER_SELLER;
+    }
+
+    eng->auction_count = clamp(scale, 1, eng->max_auctions - MUTATION_HEADROOM);
+    for (int i = 0; i < eng->auction_count; i++) {
+        Auction *a = &eng->auctions[i];
+        memset(a, 0, sizeof(Auction));
+        a->auction_id = i + 1;
+        a->seller_id = BENCH_USER_SELLER;
+        a->room_id = i % eng->room_count + 1;
+        snprintf(a->title, sizeof(a->title), "item %d", i + 1);
+        strcpy(a->description, "bench item");
+        a->start_price = 100;
+        a->current_price = 100;
+        a->min_bid_increment = 1;
+        a->start_time = now;
+        a->end_time = now + 86400;
+        strcpy(a->status, "active");
+        eng->rooms[a->room_id - 1].total_auctions++;
+    }
+
+    eng->bid_count = clamp(scale, 0, eng->max_bids - MUTATION_HEADROOM);
+    for (int i = 0; i < eng->bid_count; i++) {
+        Bid *b = &eng->bids[i];
+        b->bid_id = i + 1;
+        b->auction_id = i % eng->auction_count + 1;
+        b->user_id = i % eng->user_count + 1;
+        b->bid_amount = 100 + i / eng->auction_count;
+        b->bid_time = now;
+        eng->auctions[b->auction_id - 1].total_bids++;
+    }
+
+    // Seller and bidder both sit in room 1
+    eng->user_room[BENCH_USER_SELLER - 1] = 1;
+    eng->user_room[BENCH_USER_BIDDER - 1] = 1;
+    eng->rooms[0].current_participants = 2;
+
+    for (int i = 0; i < KEY_POOL; i++) {
+        g_user_keys[i] = rng_next() % eng->user_count + 1;
+        g_auction_keys[i] = rng_next() % eng->auction_count + 1;
+        g_room_keys[i] = rng_next() % eng->room_count + 1;
+        snprintf(g_names[i], sizeof(g_names[i]), "user%07d", g_user_keys[i]);
+    }
+}
+
+// =====================================================
+// BENCHMARKS
+// =====================================================
+
+static volatile long g_sink;
+
+static void bench_find_user_by_username(long i) {
+    g_sink += engine_find_user_by_username(g_eng, g_names[i % KEY_POOL]) != NULL;
+}
+
+static void bench_find_user_by_id(long i) {
+    g_sink += engine_find_user(g_eng, g_user_keys[i % KEY_POOL]) != NULL;
+}
+
+static void bench_find_auction_by_id(long i) {
+    g_sink += engine_find_auction(g_eng, g_auction_keys[i % KEY_POOL]) != NULL;
+}
+
+static void bench_find_room_by_id(long i) {
+    g_sink += engine_find_room(g_eng, g_room_keys[i % KEY_POOL]) != NULL;
+}
+
+static void bench_authenticate_user(long i) {
+    char password[16];
+    int k = i % KEY_POOL;
+    snprintf(password, sizeof(password), "pw%d", g_user_keys[k]);
+    g_sink += engine_authenticate_user(g_eng, g_names[k], password);
+}
+
+// Rejoining the current room is allowed and still updates the room and
+// saves, like a real JOIN_ROOM
+static void bench_join_room(long i) {
+    g_sink += engine_join_room(g_eng, BENCH_USER_BIDDER, 1);
+}
+
+static void bench_create_auction(long i) {
+    g_sink += engine_create_auction(g_eng, BENCH_USER_SELLER, 1, "bench item", "created by engine_bench",
+                                    100, 0, 1, 60);
+}
+
+static void bench_place_bid(long i) {
+    g_sink += engine_place_bid(g_eng, 1, BENCH_USER_BIDDER, g_next_bid);
+    g_next_bid += 1;
+}
+
+// The bidder's room, rows as AUCTION_LIST formats them
+static void bench_list_auctions(long i) {
+    size_t len = 0;
+
+    engine_lock(g_eng);
+    int room_id = engine_user_room(g_eng, BENCH_USER_BIDDER);
+    time_t now = engine_now(g_eng);
+    for (int k = 0; k < g_eng->auction_count && len + 256 < sizeof(g_list_buf); k++) {
+        const Auction *a = &g_eng->auctions[k];
+        if (a->room_id == room_id && strcmp(a->status, "active") == 0 && a->end_time > now) {
+            len += snprintf(g_list_buf + len, sizeof(g_list_buf) - len, "%d;%s;%.2f;%.2f;%d;%d|",
+                            a->auction_id, a->title, a->current_price, a->buy_now_price,
+                            (int)(a->end_time - now), a->total_bids);
+        }
+    }
+    engine_unlock(g_eng);
+    g_sink += len;
+}
+
+static void bench_engine_save(long i) {
+    engine_lock(g_eng);
+    engine_save(g_eng);
+    engine_unlock(g_eng);
+}
+
+static void bench_engine_load(long i) {
+    engine_load(g_eng);
+}
+
+// Doubles the batch size until the run takes at least g_min_time or
+// max_ops is reached
+static void run_bench(const char *name, long records, BenchFn fn, long max_ops) {
+    if (g_filter != NULL && strstr(name, g_filter) == NULL) {
+        return;
+    }
+
+    long ops = 0, batch = 1;
+    double start = now_sec(), elapsed = 0;
+    while (elapsed < g_min_time && ops < max_ops) {
+        if (batch > max_ops - ops) batch = max_ops - ops;
+        for (long i = 0; i < batch; i++) {
+            fn(ops + i);
+        }
+        ops += batch;
+        batch *= 2;
+        elapsed = now_sec() - start;
+    }
+
+    fprintf(g_out, "{\"label\":\"%s\",\"bench\":\"%s\",\"scale\":%d,\"records\":%ld,"
+            "\"ops\":%ld,\"ns_per_op\":%.1f,\"ops_per_sec\":%.1f}\n",
+            g_label, name, g_scale, records, ops, elapsed * 1e9 / ops, ops / elapsed);
+    fflush(g_out);
+}
+
+static void run_scale(int scale) {
+    AuctionEngine *eng = g_eng;
+    g_scale = scale;
+    generate_dataset(scale);
+
+    run_bench("find_user_by_username", eng->user_count, bench_find_user_by_username, LONG_MAX);
+    run_bench("find_user_by_id", eng->user_count, bench_find_user_by_id, LONG_MAX);
+    run_bench("find_auction_by_id", eng->auction_count, bench_find_auction_by_id, LONG_MAX);
+    run_bench("find_room_by_id", eng->room_count, bench_find_room_by_id, LONG_MAX);
+    run_bench("authenticate_user", eng->user_count, bench_authenticate_user, LONG_MAX);
+    run_bench("list_auctions", eng->auction_count, bench_list_auctions, LONG_MAX);
+
+    // Mutations save every table, so they are measured against the full
+    // dataset and rolled back afterwards
+    int auctions = eng->auction_count;
+    run_bench("create_auction", auctions, bench_create_auction, MUTATION_HEADROOM);
+    eng->auction_count = auctions;
+    eng->rooms[0].total_auctions = (auctions + eng->room_count - 1) / eng->room_count;
+
+    int bids = eng->bid_count;
+    g_next_bid = eng->auctions[0].current_price + 1;
+    run_bench("place_bid", bids, bench_place_bid, MUTATION_HEADROOM);
+    eng->bid_count = bids;
+
+    run_bench("join_room", eng->room_count, bench_join_room, LONG_MAX);
+
+    long rows = (long)eng->user_count + eng->room_count + eng->auction_count + eng->bid_count;
+    // Named after the pre-engine functions so older results still line up
+    run_bench("save_all_data", rows, bench_engine_save, LONG_MAX);
+    run_bench("init_data_storage", rows, bench_engine_load, LONG_MAX);
+}
+
+// =====================================================
+// MAIN
+// =====================================================
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n scales] [-t seconds] [-l label] [-f filter] "
+            "[-B auto|uring|posix] [-d dir]\n", prog);
+}
+
+static void remove_workdir(const char *dir) {
+    char path[512];
+    for (int i = 0; g_eng != NULL && i < ENGINE_DATA_FILES; i++) {
+        unlink(g_eng->files[i].path);
+    }
+    snprintf(path, sizeof(path), "%s/data", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv) {
+    char scales[256] = DEFAULT_SCALES;
+    const char *backend = "auto";
+    char dir[256] = "/tmp/engine_bench.XXXXXX";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:l:f:B:d:")) != -1) {
+        switch (opt) {
+            case 'n': snprintf(scales, sizeof(scales), "%s", optarg); break;
+            case 't': g_min_time = atof(optarg); break;
+            case 'l': g_label = optarg; break;
+            case 'f': g_filter = optarg; break;
+            case 'B': backend = optarg; break;
+            case 'd': snprintf(dir, sizeof(dir), "%s/engine_bench.XXXXXX", optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+
+    // Results keep the real stdout; the engine's printf logging is dropped
+    g_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (g_out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+
+    // Size the engine for the largest scale
+    int max_scale = 0;
+    char list[256];
+    snprintf(list, sizeof(list), "%s", scales);
+    for (char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (atoi(tok) > max_scale) max_scale = atoi(tok);
+    }
+    if (max_scale <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Could not create work directory %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    if (io_backend_init(backend) != 0) {
+        remove_workdir(dir);
+        return 1;
+    }
+
+    char data_dir[300];
+    EngineConfig config;
+    memset(&config, 0, sizeof(config));
+    snprintf(data_dir, sizeof(data_dir), "%s/data", dir);
+    config.data_dir = data_dir;
+    config.max_users = max_scale < 2 ? 2 : max_scale;
+    config.max_rooms = max_scale / 100 < 1 ? 1 : max_scale / 100;
+    config.max_auctions = max_scale + MUTATION_HEADROOM;
+    config.max_bids = max_scale + MUTATION_HEADROOM;
+    config.fixed_buffers = 1;
+    g_eng = engine_create(&config);
+    if (g_eng == NULL) {
+        fprintf(stderr, "Could not allocate an engine for scale %d\n", max_scale);
+        remove_workdir(dir);
+        return 1;
+    }
+    // The first save opens and registers the data files; keep it out of
+    // the timings
+    engine_save(g_eng);
+
+    fprintf(stderr, "engine_bench: capacities users=%d rooms=%d auctions=%d bids=%d, io backend %s\n",
+            g_eng->max_users, g_eng->max_rooms, g_eng->max_auctions, g_eng->max_bids, io_backend_name());
+
+    for (char *tok = strtok(scales, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int scale = atoi(tok);
+        if (scale <= 0) {
+            usage(argv[0]);
+            break;
+        }
+        run_scale(scale);
+    }
+
+    remove_workdir(dir);
+    engine_destroy(g_eng);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * =====================================================
+ * FUZZ_COMMANDS.C - MALFORMED ARGUMENTS FOR EVERY COMMAND
+ * =====================================================
+ * Runs generated command lines through the server's text dispatcher, for
+ * every entry of the command registry, on two local connections: one
+ * anonymous and one logged in (in a room with a few auctions, so the ids
+ * it guesses are often real). Each line is one of
+ *
+ *   template   the command's argument count, every field drawn from a
+ *              pool of hostile values (empty, huge, negative, nan, "%n",
+ *              long runs, stray separators)
+ *   truncated  a template line cut at a random byte
+ *   random     random bytes, high ones included, no newline
+ *
+ * The check is that nothing crashes or trips a sanitizer: build with
+ * make fuzz CFLAGS="-Wall -pthread -g -fsanitize=address,undefined"
+ * (make clean first so libauction is rebuilt too). A crash prints the
+ * line being run. server.c is compiled in (SERVER_NO_MAIN) and the engine
+ * is linked from libauction, as for replay; the server's log goes to
+ * /dev/null and its activity log to a temporary directory.
+ *
+ * Prints one JSON line with the number of lines run per second.
+ *
+ * Usage: fuzz_commands [-n lines_per_command] [-s seed] [-l label]
+ */
+
+#include "../server.c"
+
+#define DEFAULT_LINES 2000
+#define FUZZ_LINE_MAX 1024
+#define FUZZ_OUTQ_BYTES (256 * 1024 * 1024)     // never evict a fuzz connection
+
+static FILE *g_out;
+static const char *g_label = "";
+static uint64_t g_rng;
+static int g_peers[2];
+static volatile char g_current[FUZZ_LINE_MAX];   // for the crash report
+
+static const char *g_values[] = {
+    "", "0", "1", "2", "3", "-1", "2147483647", "-2147483648", "4294967296",
+    "99999999999999999999", "1e308", "-1e308", "nan", "inf", "0.001", "1.5",
+    "abc", "%s%n%x", " ", "STREAM", "RESET", "ROOM", "AUCTION", "BIN1",
+    "a b c", ";", ",", "||", "@1 ", "0123456789abcdef0123456789abcdef0"
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_next() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+// Reads and discards every reply and event the server sends
+static void* drain_thread(void *arg) {
+    char buf[65536];
+    struct pollfd fds[2] = { { g_peers[0], POLLIN, 0 }, { g_peers[1], POLLIN, 0 } };
+
+    while (poll(fds, 2, -1) >= 0) {
+        for (int i = 0; i < 2; i++) {
+            while (recv(fds[i].fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+    return NULL;
+}
+
+static Connection* fuzz_conn_open(int *peer) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        fprintf(stderr, "socketpair: %s\n", strerror(errno));
+        exit(1);
+    }
+    *peer = sv[1];
+    return conn_open(sv[0], "127.0.0.1");
+}
+
+static void run_line(Connection *conn, const char *text) {
+    char line[FUZZ_LINE_MAX];
+    snprintf(line, sizeof(line), "%s", text);
+    for (int i = 0; line[i] != '\0' && i < FUZZ_LINE_MAX - 1; i++) {
+        g_current[i] = line[i];
+        g_current[i + 1] = '\0';
+    }
+    conn_cork(conn);
+    dispatch_text_line(conn, line);
+    conn_uncork(conn);
+}
+
+static void on_crash(int sig) {
+    static const char prefix[] = "fuzz_commands: crashed on line: ";
+    const char *line = (const char*)g_current;
+    if (write(STDERR_FILENO, prefix, sizeof(prefix) - 1) < 0 ||
+        write(STDERR_FILENO, line, strlen(line)) < 0 ||
+        write(STDERR_FILENO, "\n", 1) < 0) {
+        // nothing left to report with
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Fields in the registry's argument spec, e.g. "auction_id,user_id,amount"
+static int arg_count(const CommandInfo *cmd) {
+    int n = cmd->args[0] != '\0';
+    for (const char *p = cmd->args; *p; p++) {
+        n += *p == ',';
+    }
+    return n;
+}
+
+static void make_line(const CommandInfo *cmd, char *line, size_t size) {
+    int kind = rng_next() % 3;
+    size_t len = snprintf(line, size, "%s|", cmd->name);
+
+    if (kind == 2) {
+        size_t n = rng_next() % (size - len);
+        for (size_t i = 0; i < n; i++) {
+            char c = (char)(rng_next() % 255 + 1);
+            line[len++] = c == '\n' ? '|' : c;
+        }
+        line[len] = '\0';
+        return;
+    }
+
+    int fields = arg_count(cmd) + (int)(rng_next() % 3) - 1;
+    for (int i = 0; i < fields && len + 1 < size; i++) {
+        const char *v = g_values[rng_next() % (sizeof(g_values) / sizeof(g_values[0]))];
+        if (rng_next() % 16 == 0) {
+            int run = rng_next() % (size - len);
+            memset(line + len, 'A', run);
+            len += run;
+            line[len] = '\0';
+        } else {
+            len += snprintf(line + len, size - len, "%s", v);
+        }
+        if (len + 1 < size && i + 1 < fields) {
+            line[len++] = rng_next() % 4 == 0 ? ' ' : '|';
+            line[len] = '\0';
+        }
+        if (len >= size) len = size - 1;
+    }
+    if (kind == 1 && len > 0) {
+        line[rng_next() % len] = '\0';
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n lines_per_command] [-s seed] [-l label]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    long lines = DEFAULT_LINES;
+    unsigned long long seed = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:l:")) != -1) {
+        switch (opt) {
+            case 'n': lines = atol(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 0); break;
+            case 'l': g_label = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (lines <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    g_rng = (seed + 1) * 0x9E3779B97F4A7C15ull;     // xorshift needs a non-zero state
+
+    // The activity log is written to the working directory
+    char dir[] = "/tmp/fuzz_commands.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        fprintf(stderr, "Could not create work directory: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // The handlers log to stdout; keep it for the result
+    g_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (g_out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGSEGV, on_crash);
+    signal(SIGBUS, on_crash);
+    signal(SIGFPE, on_crash);
+    signal(SIGABRT, on_crash);
+    clock_init_manual(&g_clock, clock_wall_ms());
+
+    if (io_backend_init("auto") != 0 || command_registry_init() != 0 ||
+        server_engine_init(NULL) != 0 || flusher_init() != 0) {
+        fprintf(stderr, "Could not set up the server\n");
+        return 1;
+    }
+    memset(g_clients, 0, sizeof(g_clients));
+    conn_table_init();
+    resp_cache_init();
+    g_outq_max_bytes = FUZZ_OUTQ_BYTES;
+    g_replaying = 1;
+
+    Connection *anon = fuzz_conn_open(&g_peers[0]);
+    Connection *user = fuzz_conn_open(&g_peers[1]);
+    pthread_t flusher, drainer;
+    pthread_create(&flusher, NULL, io_flusher, NULL);
+    pthread_create(&drainer, NULL, drain_thread, NULL);
+
+    run_line(user, "REGISTER|fuzz pw fuzz@x");
+    run_line(user, "LOGIN|fuzz pw");
+    run_line(user, "CREATE_ROOM|1|room|desc|10|60");
+    run_line(user, "JOIN_ROOM|1|1");
+    for (int i = 0; i < 3; i++) {
+        run_line(user, "CREATE_AUCTION|1|1|item|desc|100|500|1|10");
+    }
+
+    char line[FUZZ_LINE_MAX];
+    long total = 0;
+    double start = now_sec();
+    for (int id = 0; id < CMD_COUNT; id++) {
+        const CommandInfo *cmd = &g_commands[id];
+        if (cmd->handler == NULL) {
+            continue;   // QUIT only closes the connection
+        }
+        for (long i = 0; i < lines; i++) {
+            make_line(cmd, line, sizeof(line));
+            // A BATCH line makes the next ones its items, which is fuzzed too
+            run_line(i % 2 ? user : anon, line);
+            total++;
+            if (i % 100 == 99) {
+                run_line(user, "JOIN_ROOM|1|1");    // undo a fuzzed LEAVE_ROOM
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    fprintf(g_out, "{\"label\":\"%s\",\"bench\":\"fuzz_commands\",\"seed\":%llu,\"commands\":%d,"
+            "\"lines\":%ld,\"elapsed_s\":%.3f,\"lines_per_sec\":%.1f}\n",
+            g_label, seed, CMD_COUNT, total, elapsed, total / elapsed);
+    fflush(g_out);
+
+    unlink(ACTIVITY_LOG_FILE);
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
@@ -0,0 +1,805 @@
+/*
+ * =====================================================
+ * LOADGEN.C - HEADLESS LOAD GENERATOR
+ * =====================================================
+ * Logs in a seller per room and N simulated bidders, creates the rooms
+ * and auctions, then drives open-loop traffic: requests are scheduled at
+ * the target rate (Poisson arrivals) whether or not earlier ones have been
+ * answered, and latency is measured from the scheduled send time, so a
+ * stalled server shows up as latency instead of a lower request rate.
+ *
+ * Bids pick an auction of the bidder's room with a Zipf(s) distribution
+ * over auction rank; s = 0 is uniform, larger s concentrates bids on a
+ * few hot auctions.
+ *
+ * Usage: loadgen [-h host] [-p port] [-c bidders] [-R rooms] [-a auctions]
+ *                [-r rate] [-d seconds] [-s zipf_s] [-m read_pct]
+ *                [-t threads] [-u user_prefix] [-b]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "../protocol.h"
+
+#define DEFAULT_PORT 8888
+#define MAX_WORKERS 64
+#define MAX_LG_AUCTIONS 1000
+#define MAX_INFLIGHT 4096           // per connection; beyond this a send is dropped
+#define RX_SIZE (256 * 1024)
+#define DRAIN_SECONDS 5
+#define MAX_FAIL_REASONS 16
+
+// Log-linear histogram of microseconds: exact below 128, then 64 buckets
+// per power of two (under 1.6% error), up to about 2^40 us
+#define HIST_SUB 64
+#define HIST_BUCKETS (128 + 34 * HIST_SUB)
+
+typedef enum {
+    LG_REGISTER,
+    LG_LOGIN,
+    LG_CREATE_ROOM,
+    LG_JOIN_ROOM,
+    LG_CREATE_AUCTION,
+    LG_PLACE_BID,
+    LG_LIST_AUCTIONS,
+    LG_COMMANDS
+} LgCommand;
+
+static const char *lg_command_names[LG_COMMANDS] = {
+    "REGISTER", "LOGIN", "CREATE_ROOM", "JOIN_ROOM", "CREATE_AUCTION", "PLACE_BID", "LIST_AUCTIONS"
+};
+
+typedef struct {
+    unsigned long counts[HIST_BUCKETS];
+    unsigned long total;
+    unsigned long ok;
+    unsigned long fail;
+    uint64_t max_us;
+} Histogram;
+
+typedef struct {
+    uint32_t id;
+    int cmd;
+    double intended;            // scheduled send time
+} Inflight;
+
+typedef struct {
+    int fd;
+    int user_id;
+    int room;                   // index into g_room_ids
+    uint32_t next_id;
+    Inflight inflight[MAX_INFLIGHT];
+    unsigned head;
+    unsigned count;
+    char rx[RX_SIZE];
+    size_t rx_len;
+} LgConn;
+
+typedef struct {
+    char reason[64];
+    unsigned long count;
+} FailReason;
+
+typedef struct {
+    int index;
+    LgConn **conns;
+    int nconns;
+    double rate;                // requests per second for this worker
+    uint64_t rng;
+    Histogram hist[LG_COMMANDS];
+    FailReason fails[MAX_FAIL_REASONS];
+    unsigned long dropped;      // inflight window full
+    unsigned long sent;
+} Worker;
+
+// Options
+static const char *g_host = "127.0.0.1";
+static int g_port = DEFAULT_PORT;
+static int g_bidders = 50;
+static int g_rooms = 1;
+static int g_auctions = 10;
+static double g_rate = 500;
+static int g_duration = 10;
+static double g_zipf_s = 1.0;
+static int g_read_pct = 0;
+static int g_threads = 4;
+static const char *g_prefix = "lg";
+static int g_binary = 0;
+
+static int g_room_ids[MAX_LG_AUCTIONS];
+static int g_auction_ids[MAX_LG_AUCTIONS];      // grouped by room
+static int g_auction_count = 0;
+static long g_price_cents[MAX_LG_AUCTIONS + 1]; // last seen price, by auction id
+static double *g_zipf_cdf;                       // over auction rank within a room
+static int g_per_room;
+
+static Histogram g_setup_hist[LG_COMMANDS];
+static volatile int g_sending = 1;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *s = x;
+}
+
+static double rng_uniform(uint64_t *s) {
+    return (rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// =====================================================
+// HISTOGRAM
+// =====================================================
+
+static int hist_index(uint64_t us) {
+    if (us < 128) {
+        return (int)us;
+    }
+    int e = 63 - __builtin_clzll(us);              // >= 7
+    int i = 128 + (e - 7) * HIST_SUB + (int)((us >> (e - 6)) - HIST_SUB);
+    return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+// Upper edge of a bucket, so percentiles never understate
+static uint64_t hist_value(int i) {
+    if (i < 128) {
+        return i;
+    }
+    int e = (i - 128) / HIST_SUB + 7;
+    uint64_t m = (i - 128) % HIST_SUB + HIST_SUB;
+    return ((m + 1) << (e - 6)) - 1;
+}
+
+static void hist_record(Histogram *h, double seconds, int ok) {
+    uint64_t us = seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+    h->counts[hist_index(us)]++;
+    h->total++;
+    if (ok) h->ok++; else h->fail++;
+    if (us > h->max_us) h->max_us = us;
+}
+
+static void hist_merge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    into->ok += from->ok;
+    into->fail += from->fail;
+    if (from->max_us > into->max_us) into->max_us = from->max_us;
+}
+
+static double hist_percentile_ms(const Histogram *h, double p) {
+    unsigned long target = (unsigned long)ceil(h->total * p / 100.0);
+    unsigned long seen = 0;
+    if (target == 0) target = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t v = hist_value(i);
+            return (v < h->max_us ? v : h->max_us) / 1000.0;
+        }
+    }
+    return h->max_us / 1000.0;
+}
+
+static void print_hist_row(const char *name, const Histogram *h, double elapsed) {
+    if (h->total == 0) {
+        return;
+    }
+    char rate[16] = "-";
+    if (elapsed > 0) {
+        snprintf(rate, sizeof(rate), "%.0f", h->total / elapsed);
+    }
+    printf("%-15s %9lu %9lu %7lu %9s %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+           name, h->total, h->ok, h->fail, rate,
+           hist_percentile_ms(h, 50), hist_percentile_ms(h, 90), hist_percentile_ms(h, 99),
+           hist_percentile_ms(h, 99.9), h->max_us / 1000.0);
+}
+
+// =====================================================
+// CONNECTIONS
+// =====================================================
+
+static int send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static LgConn* lg_connect() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    if (inet_pton(AF_INET, g_host, &addr.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    LgConn *c = calloc(1, sizeof(LgConn));
+    if (c == NULL) {
+        close(fd);
+        return NULL;
+    }
+    c->fd = fd;
+    c->next_id = 1;
+
+    if (g_binary) {
+        char reply[64];
+        send_all(fd, PROTO_HELLO "\n", strlen(PROTO_HELLO) + 1);
+        ssize_t n = recv(fd, reply, sizeof(reply) - 1, 0);
+        if (n <= 0 || strncmp(reply, "HELLO_OK|BIN1", 13) != 0) {
+            printf("[ERROR] Server refused BIN1\n");
+            close(fd);
+            free(c);
+            return NULL;
+        }
+    }
+    return c;
+}
+
+// Send one request line (without '\n') tagged with a fresh correlation id
+static uint32_t lg_send(LgConn *c, const char *line) {
+    uint32_t id = c->next_id++;
+    char buf[PROTO_HEADER_SIZE + 1024];
+    size_t len;
+
+    if (!g_binary) {
+        len = snprintf(buf, sizeof(buf), "@%u %s\n", id, line);
+    } else {
+        ProtoPlaceBid bid;
+        bid.request_id[0] = '\0';
+        if (sscanf(line, "PLACE_BID|%d|%d|%lf", &bid.auction_id, &bid.user_id, &bid.amount) == 3) {
+            len = proto_encode_place_bid(buf, sizeof(buf), &bid, id);
+        } else {
+            len = proto_encode_text(buf, sizeof(buf), line, strlen(line), id);
+        }
+    }
+
+    if (len == 0 || len >= sizeof(buf) || send_all(c->fd, buf, len) < 0) {
+        return 0;
+    }
+    return id;
+}
+
+static void track_price(int auction_id, double amount) {
+    if (auction_id <= 0 || auction_id > MAX_LG_AUCTIONS) {
+        return;
+    }
+    long cents = llround(amount * 100);
+    long seen = __atomic_load_n(&g_price_cents[auction_id], __ATOMIC_RELAXED);
+    while (cents > seen &&
+           !__atomic_compare_exchange_n(&g_price_cents[auction_id], &seen, cents, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Pushed lines only matter for price tracking
+static void handle_event(const char *line) {
+    int auction_id;
+    double amount;
+    char bidder[64];
+    if (sscanf(line, "NEW_BID|%d|%63[^|]|%lf", &auction_id, bidder, &amount) == 3 ||
+        sscanf(line, "NEW_BID_WARNING|%d|%63[^|]|%lf", &auction_id, bidder, &amount) == 3) {
+        track_price(auction_id, amount);
+    }
+}
+
+// Pull complete messages out of c->rx. Calls on_reply(id, text) for every
+// correlated reply and returns the number handled, -1 on a protocol error.
+typedef void (*ReplyFn)(void *ctx, LgConn *c, uint32_t id, const char *text);
+
+static int lg_parse(LgConn *c, ReplyFn on_reply, void *ctx) {
+    size_t start = 0;
+    int handled = 0;
+
+    while (start < c->rx_len) {
+        char *msg;
+        uint32_t id = 0;
+        size_t used;
+
+        if (g_binary) {
+            ProtoHeader h;
+            int ready = proto_parse_header(c->rx + start, c->rx_len - start, RX_SIZE - PROTO_HEADER_SIZE - 1, &h);
+            if (ready < 0) return -1;
+            if (ready == 0 || c->rx_len - start < PROTO_HEADER_SIZE + h.len) break;
+            used = PROTO_HEADER_SIZE + h.len;
+            if (h.opcode == OP_NEW_BID) {
+                ProtoNewBid nb;
+                if (proto_decode_new_bid(c->rx + start + PROTO_HEADER_SIZE, h.len, &nb) == 0) {
+                    track_price(nb.auction_id, nb.amount);
+                }
+                start += used;
+                continue;
+            }
+            // Terminate the text in place; the byte after it belongs to the
+            // next frame's header, so save and restore it
+            char *text = c->rx + start + PROTO_HEADER_SIZE;
+            char saved = text[h.len];
+            text[h.len] = '\0';
+            if (h.corr_id != 0) {
+                on_reply(ctx, c, h.corr_id, text);
+                handled++;
+            } else {
+                handle_event(text);
+            }
+            text[h.len] = saved;
+            start += used;
+            continue;
+        }
+
+        char *nl = memchr(c->rx + start, '\n', c->rx_len - start);
+        if (nl == NULL) break;
+        *nl = '\0';
+        msg = c->rx + start;
+        used = nl - msg + 1;
+
+        if (msg[0] == '@') {
+            char *body;
+            id = strtoul(msg + 1, &body, 10);
+            if (*body == ' ') body++;
+            on_reply(ctx, c, id, body);
+            handled++;
+        } else {
+            handle_event(msg);
+        }
+        start += used;
+    }
+
+    c->rx_len -= start;
+    memmove(c->rx, c->rx + start, c->rx_len);
+    return handled;
+}
+
+// recv() once into c->rx; -1 when the connection is gone
+static int lg_recv(LgConn *c, int flags) {
+    if (c->rx_len >= RX_SIZE - 1) {
+        return -1;
+    }
+    ssize_t n = recv(c->fd, c->rx + c->rx_len, RX_SIZE - 1 - c->rx_len, flags);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return 0;
+    }
+    if (n <= 0) {
+        return -1;
+    }
+    c->rx_len += n;
+    return (int)n;
+}
+
+// =====================================================
+// SETUP (CLOSED LOOP)
+// =====================================================
+
+typedef struct {
+    uint32_t want;
+    int done;
+    char reply[1024];
+} SyncCtx;
+
+static void sync_reply(void *ctx, LgConn *c, uint32_t id, const char *text) {
+    SyncCtx *s = ctx;
+    if (id == s->want) {
+        snprintf(s->reply, sizeof(s->reply), "%s", text);
+        s->done = 1;
+    }
+}
+
+// Send and wait for the reply; records the latency under cmd
+static int lg_call(LgConn *c, LgCommand cmd, const char *line, char *reply, size_t size,
+                   const char *ok_prefix) {
+    SyncCtx s = { 0 };
+    double start = now_sec();
+
+    s.want = lg_send(c, line);
+    if (s.want == 0) {
+        return -1;
+    }
+    while (!s.done) {
+        if (lg_recv(c, 0) < 0 || lg_parse(c, sync_reply, &s) < 0) {
+            return -1;
+        }
+    }
+
+    int ok = strncmp(s.reply, ok_prefix, strlen(ok_prefix)) == 0;
+    hist_record(&g_setup_hist[cmd], now_sec() - start, ok);
+    if (reply != NULL) {
+        snprintf(reply, size, "%s", s.reply);
+    }
+    return ok ? 0 : -1;
+}
+
+// Register (an existing account is fine) and log in; returns the user id
+static int lg_login(LgConn *c, const char *name) {
+    char line[256], reply[1024];
+    int user_id;
+
+    snprintf(line, sizeof(line), "REGISTER|%s pw %s@loadgen", name, name);
+    lg_call(c, LG_REGISTER, line, NULL, 0, "REGISTER_SUCCESS");
+
+    snprintf(line, sizeof(line), "LOGIN|%s pw", name);
+    if (lg_call(c, LG_LOGIN, line, reply, sizeof(reply), "LOGIN_SUCCESS") < 0 ||
+        sscanf(reply, "LOGIN_SUCCESS|%d", &user_id) != 1) {
+        printf("[ERROR] Login failed for %s: %s\n", name, reply);
+        return -1;
+    }
+    return user_id;
+}
+
+static int setup(LgConn **sellers, LgConn **bidders) {
+    char name[64], line[512], reply[1024];
+    int minutes = g_duration / 60 + 10;
+
+    g_per_room = g_auctions / g_rooms;
+    if (g_per_room == 0) {
+        g_per_room = 1;
+    }
+
+    for (int r = 0; r < g_rooms; r++) {
+        sellers[r] = lg_connect();
+        snprintf(name, sizeof(name), "%s_seller%d", g_prefix, r);
+        if (sellers[r] == NULL || (sellers[r]->user_id = lg_login(sellers[r], name)) < 0) {
+            printf("[ERROR] Seller %d could not connect/login\n", r);
+            return -1;
+        }
+
+        snprintf(line, sizeof(line), "CREATE_ROOM|%d|%s_room%d|loadgen|%d|%d",
+                 sellers[r]->user_id, g_prefix, r, g_bidders + 1, minutes);
+        if (lg_call(sellers[r], LG_CREATE_ROOM, line, reply, sizeof(reply), "CREATE_ROOM_SUCCESS") < 0 ||
+            sscanf(reply, "CREATE_ROOM_SUCCESS|%d", &g_room_ids[r]) != 1) {
+            printf("[ERROR] CREATE_ROOM failed: %s\n", reply);
+            return -1;
+        }
+
+        for (int i = 0; i < g_per_room && g_auction_count < MAX_LG_AUCTIONS; i++) {
+            int auction_id;
+            snprintf(line, sizeof(line), "CREATE_AUCTION|%d|%d|item %d-%d|loadgen|100|0|1|%d",
+                     sellers[r]->user_id, g_room_ids[r], r, i, minutes);
+            if (lg_call(sellers[r], LG_CREATE_AUCTION, line, reply, sizeof(reply),
+                        "CREATE_AUCTION_SUCCESS") < 0 ||
+                sscanf(reply, "CREATE_AUCTION_SUCCESS|%d", &auction_id) != 1) {
+                printf("[ERROR] CREATE_AUCTION failed: %s\n", reply);
+                return -1;
+            }
+            g_auction_ids[g_auction_count++] = auction_id;
+            if (auction_id <= MAX_LG_AUCTIONS) {
+                g_price_cents[auction_id] = 100 * 100;
+            }
+        }
+    }
+
+    for (int b = 0; b < g_bidders; b++) {
+        bidders[b] = lg_connect();
+        snprintf(name, sizeof(name), "%s_bidder%d", g_prefix, b);
+        if (bidders[b] == NULL || (bidders[b]->user_id = lg_login(bidders[b], name)) < 0) {
+            printf("[ERROR] Bidder %d could not connect/login (server connection limit?)\n", b);
+            return -1;
+        }
+
+        bidders[b]->room = b % g_rooms;
+        snprintf(line, sizeof(line), "JOIN_ROOM|%d|%d", bidders[b]->user_id, g_room_ids[bidders[b]->room]);
+        if (lg_call(bidders[b], LG_JOIN_ROOM, line, reply, sizeof(reply), "JOIN_ROOM_SUCCESS") < 0) {
+            printf("[ERROR] JOIN_ROOM failed: %s\n", reply);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void build_zipf() {
+    g_zipf_cdf = malloc(sizeof(double) * g_per_room);
+    double sum = 0;
+    for (int k = 0; k < g_per_room; k++) {
+        sum += 1.0 / pow(k + 1, g_zipf_s);
+        g_zipf_cdf[k] = sum;
+    }
+    for (int k = 0; k < g_per_room; k++) {
+        g_zipf_cdf[k] /= sum;
+    }
+}
+
+static int zipf_rank(uint64_t *rng) {
+    double u = rng_uniform(rng);
+    int lo = 0, hi = g_per_room - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_zipf_cdf[mid] < u) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+// =====================================================
+// OPEN-LOOP TRAFFIC
+// =====================================================
+
+static void record_fail_reason(Worker *w, const char *text) {
+    const char *bar = strchr(text, '|');
+    const char *reason = bar ? bar + 1 : text;
+    for (int i = 0; i < MAX_FAIL_REASONS; i++) {
+        if (w->fails[i].count == 0) {
+            snprintf(w->fails[i].reason, sizeof(w->fails[i].reason), "%s", reason);
+        }
+        if (strncmp(w->fails[i].reason, reason, sizeof(w->fails[i].reason) - 1) == 0) {
+            w->fails[i].count++;
+            return;
+        }
+    }
+}
+
+static void traffic_reply(void *ctx, LgConn *c, uint32_t id, const char *text) {
+    Worker *w = ctx;
+
+    // Replies come back in request order; the id check guards against bugs
+    if (c->count == 0 || c->inflight[c->head].id != id) {
+        return;
+    }
+    Inflight *f = &c->inflight[c->head];
+    c->head = (c->head + 1) % MAX_INFLIGHT;
+    c->count--;
+
+    int ok;
+    if (f->cmd == LG_PLACE_BID) {
+        int auction_id;
+        double amount;
+        ok = sscanf(text, "BID_SUCCESS|%d|%lf", &auction_id, &amount) == 2;
+        if (ok) {
+            track_price(auction_id, amount);
+        } else {
+            record_fail_reason(w, text);
+        }
+    } else {
+        ok = strncmp(text, "AUCTION_LIST", 12) == 0;
+    }
+    hist_record(&w->hist[f->cmd], now_sec() - f->intended, ok);
+}
+
+static void issue_request(Worker *w, double intended) {
+    LgConn *c = w->conns[rng_next(&w->rng) % w->nconns];
+    char line[256];
+    int cmd;
+
+    if (c->count == MAX_INFLIGHT) {
+        w->dropped++;
+        return;
+    }
+
+    if (g_read_pct > 0 && (int)(rng_next(&w->rng) % 100) < g_read_pct) {
+        cmd = LG_LIST_AUCTIONS;
+        snprintf(line, sizeof(line), "LIST_AUCTIONS|%d", c->user_id);
+    } else {
+        cmd = LG_PLACE_BID;
+        int auction_id = g_auction_ids[c->room * g_per_room + zipf_rank(&w->rng)];
+        long cents = __atomic_load_n(&g_price_cents[auction_id], __ATOMIC_RELAXED);
+        long step = 100 * (1 + rng_next(&w->rng) % 3);
+        snprintf(line, sizeof(line), "PLACE_BID|%d|%d|%.2f", auction_id, c->user_id,
+                 (cents + step) / 100.0);
+    }
+
+    uint32_t id = lg_send(c, line);
+    if (id == 0) {
+        w->dropped++;
+        return;
+    }
+    Inflight *f = &c->inflight[(c->head + c->count) % MAX_INFLIGHT];
+    f->id = id;
+    f->cmd = cmd;
+    f->intended = intended;
+    c->count++;
+    w->sent++;
+}
+
+static unsigned long worker_inflight(Worker *w) {
+    unsigned long n = 0;
+    for (int i = 0; i < w->nconns; i++) {
+        n += w->conns[i]->count;
+    }
+    return n;
+}
+
+static void* worker_main(void *arg) {
+    Worker *w = arg;
+    int ep = epoll_create1(0);
+    struct epoll_event events[64];
+
+    for (int i = 0; i < w->nconns; i++) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w->conns[i] };
+        epoll_ctl(ep, EPOLL_CTL_ADD, w->conns[i]->fd, &ev);
+    }
+
+    double next = now_sec();
+    double drain_deadline = 0;
+
+    for (;;) {
+        double now = now_sec();
+
+        if (g_sending) {
+            while (next <= now) {
+                issue_request(w, next);
+                next += -log(1.0 - rng_uniform(&w->rng)) / w->rate;
+            }
+        } else {
+            if (drain_deadline == 0) drain_deadline = now + DRAIN_SECONDS;
+            if (worker_inflight(w) == 0 || now >= drain_deadline) break;
+        }
+
+        int timeout = 10;
+        if (g_sending) {
+            double wait = (next - now_sec()) * 1000;
+            timeout = wait <= 0 ? 0 : (int)wait;
+        }
+
+        int n = epoll_wait(ep, events, 64, timeout);
+        for (int i = 0; i < n; i++) {
+            LgConn *c = events[i].data.ptr;
+            if (lg_recv(c, MSG_DONTWAIT) < 0 || lg_parse(c, traffic_reply, w) < 0) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+            }
+        }
+    }
+
+    close(ep);
+    return NULL;
+}
+
+// =====================================================
+// MAIN
+// =====================================================
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-h host] [-p port] [-c bidders] [-R rooms] [-a auctions]\n"
+           "          [-r rate] [-d seconds] [-s zipf_s] [-m read_pct] [-t threads]\n"
+           "          [-u user_prefix] [-b]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:R:a:r:d:s:m:t:u:b")) != -1) {
+        switch (opt) {
+            case 'h': g_host = optarg; break;
+            case 'p': g_port = atoi(optarg); break;
+            case 'c': g_bidders = atoi(optarg); break;
+            case 'R': g_rooms = atoi(optarg); break;
+            case 'a': g_auctions = atoi(optarg); break;
+            case 'r': g_rate = atof(optarg); break;
+            case 'd': g_duration = atoi(optarg); break;
+            case 's': g_zipf_s = atof(optarg); break;
+            case 'm': g_read_pct = atoi(optarg); break;
+            case 't': g_threads = atoi(optarg); break;
+            case 'u': g_prefix = optarg; break;
+            case 'b': g_binary = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (g_bidders <= 0 || g_rooms <= 0 || g_rooms > g_bidders || g_auctions < g_rooms ||
+        g_auctions > MAX_LG_AUCTIONS || g_rate <= 0 || g_duration <= 0 ||
+        g_read_pct < 0 || g_read_pct > 100 || g_zipf_s < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (g_threads <= 0) g_threads = 1;
+    if (g_threads > MAX_WORKERS) g_threads = MAX_WORKERS;
+    if (g_threads > g_bidders) g_threads = g_bidders;
+
+    printf("Load: %d bidders in %d room(s), %d auctions, target %.0f req/s for %ds, "
+           "zipf s=%.2f, %d%% reads, %s, %d threads\n",
+           g_bidders, g_rooms, g_auctions, g_rate, g_duration, g_zipf_s, g_read_pct,
+           g_binary ? "BIN1" : "text", g_threads);
+
+    LgConn **sellers = calloc(g_rooms, sizeof(LgConn*));
+    LgConn **bidders = calloc(g_bidders, sizeof(LgConn*));
+    double setup_start = now_sec();
+    if (setup(sellers, bidders) < 0) {
+        return 1;
+    }
+    build_zipf();
+    printf("Setup done in %.2fs\n", now_sec() - setup_start);
+
+    Worker *workers = calloc(g_threads, sizeof(Worker));
+    pthread_t threads[MAX_WORKERS];
+    for (int t = 0; t < g_threads; t++) {
+        Worker *w = &workers[t];
+        w->index = t;
+        w->conns = calloc(g_bidders, sizeof(LgConn*));
+        for (int b = t; b < g_bidders; b += g_threads) {
+            w->conns[w->nconns++] = bidders[b];
+        }
+        w->rate = g_rate / g_threads;
+        w->rng = 0x9E3779B97F4A7C15ull ^ ((uint64_t)(t + 1) * 0xBF58476D1CE4E5B9ull) ^ (uint64_t)getpid();
+    }
+
+    double start = now_sec();
+    for (int t = 0; t < g_threads; t++) {
+        pthread_create(&threads[t], NULL, worker_main, &workers[t]);
+    }
+    sleep(g_duration);
+    g_sending = 0;
+    double elapsed = now_sec() - start;
+    for (int t = 0; t < g_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    Histogram total[LG_COMMANDS];
+    FailReason fails[MAX_FAIL_REASONS];
+    unsigned long sent = 0, dropped = 0, unanswered = 0;
+    memset(total, 0, sizeof(total));
+    memset(fails, 0, sizeof(fails));
+    for (int t = 0; t < g_threads; t++) {
+        Worker *w = &workers[t];
+        for (int k = 0; k < LG_COMMANDS; k++) {
+            hist_merge(&total[k], &w->hist[k]);
+        }
+        for (int i = 0; i < MAX_FAIL_REASONS && w->fails[i].count > 0; i++) {
+            for (int j = 0; j < MAX_FAIL_REASONS; j++) {
+                if (fails[j].count == 0) {
+                    fails[j] = w->fails[i];
+                    break;
+                }
+                if (strcmp(fails[j].reason, w->fails[i].reason) == 0) {
+                    fails[j].count += w->fails[i].count;
+                    break;
+                }
+            }
+        }
+        sent += w->sent;
+        dropped += w->dropped;
+        unanswered += worker_inflight(w);
+    }
+
+    printf("\n%-15s %9s %9s %7s %9s %8s %8s %8s %8s %8s\n", "command", "count", "ok", "fail",
+           "req/s", "p50", "p90", "p99", "p99.9", "max(ms)");
+    for (int k = 0; k < LG_PLACE_BID; k++) {
+        print_hist_row(lg_command_names[k], &g_setup_hist[k], 0);
+    }
+    for (int k = LG_PLACE_BID; k < LG_COMMANDS; k++) {
+        print_hist_row(lg_command_names[k], &total[k], elapsed);
+    }
+
+    printf("\nSent %lu requests in %.2fs (%.0f req/s of %.0f target), %lu dropped (window full), "
+           "%lu unanswered\n", sent, elapsed, sent / elapsed, g_rate, dropped, unanswered);
+    for (int i = 0; i < MAX_FAIL_REASONS && fails[i].count > 0; i++) {
+        printf("  BID_FAIL %-40s %lu\n", fails[i].reason, fails[i].count);
+    }
+
+    for (int r = 0; r < g_rooms; r++) {
+        send_all(sellers[r]->fd, "QUIT|\n", 6);
+        close(sellers[r]->fd);
+    }
+    for (int b = 0; b < g_bidders; b++) {
+        send_all(bidders[b]->fd, "QUIT|\n", 6);
+        close(bidders[b]->fd);
+    }
+    return 0;
+}
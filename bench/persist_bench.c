@@ -0,0 +1,657 @@
+/*
+ * =====================================================
+ * PERSIST_BENCH.C - WHAT DOES A BID COST ON DISK?
+ * =====================================================
+ * Replays the same synthetic bid stream (random auction, price + 1)
+ * against several durability strategies over the engine's record layout:
+ *
+ *   full_rewrite      engine_place_bid as the server runs it: every bid
+ *                     rewrites all four tables (engine_save), no fsync
+ *   record            pwrite only the changed auction and the new bid
+ *   record_fdatasync  same, fdatasync after every bid
+ *   log_nosync        append a 24-byte redo record, no fsync
+ *   log_fsync_each    append + fdatasync per bid
+ *   log_fsync_100     append, fdatasync every 100 bids (group commit)
+ *   log_fsync_10ms    append, fdatasync when 10 ms passed since the last
+ *   mmap_nosync       tables mapped MAP_SHARED, kernel writeback only
+ *   mmap_msync        mapped, msync(MS_SYNC) of the touched pages per bid
+ *
+ * Commit latency is the persistence step of one bid. app bytes are what
+ * the strategy hands to the kernel (whole pages for mmap); disk bytes come
+ * from /proc/self/io write_bytes and include a final fsync of every file,
+ * so write-back that the page cache absorbed is not counted. Recovery is
+ * the time to rebuild the auction and bid tables from the files (warm
+ * page cache) and is checked against the in-memory state.
+ *
+ * Results are JSON lines on stdout, like engine_bench.
+ *
+ * Usage: persist_bench [-n scales] [-b bids] [-s strategies] [-l label] [-d dir]
+ *   e.g. persist_bench -n 1000,100000 -b 2000 -s record,log_fsync_100
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include "../auction_engine.h"
+#include "../io_backend.h"
+
+#define DEFAULT_SCALES "1000,10000,100000"
+#define DEFAULT_BIDS 2000
+#define BIDDER_ID 2
+#define SELLER_ID 1
+#define GROUP_COMMIT_BIDS 100
+#define GROUP_COMMIT_SECONDS 0.010
+#define PAGE 4096
+
+typedef enum {
+    SYNC_NONE,
+    SYNC_EACH,
+    SYNC_GROUP,
+    SYNC_INTERVAL
+} SyncPolicy;
+
+typedef struct {
+    const char *name;
+    int kind;                   // STRAT_*
+    SyncPolicy sync;
+} Strategy;
+
+enum { STRAT_FULL, STRAT_RECORD, STRAT_LOG, STRAT_MMAP };
+
+static const Strategy g_strategies[] = {
+    { "full_rewrite",     STRAT_FULL,   SYNC_NONE },
+    { "record",           STRAT_RECORD, SYNC_NONE },
+    { "record_fdatasync", STRAT_RECORD, SYNC_EACH },
+    { "log_nosync",       STRAT_LOG,    SYNC_NONE },
+    { "log_fsync_each",   STRAT_LOG,    SYNC_EACH },
+    { "log_fsync_100",    STRAT_LOG,    SYNC_GROUP },
+    { "log_fsync_10ms",   STRAT_LOG,    SYNC_INTERVAL },
+    { "mmap_nosync",      STRAT_MMAP,   SYNC_NONE },
+    { "mmap_msync",       STRAT_MMAP,   SYNC_EACH },
+};
+
+#define STRATEGY_COUNT (int)(sizeof(g_strategies) / sizeof(g_strategies[0]))
+
+// Redo record for the append log
+typedef struct {
+    int32_t auction_id;
+    int32_t user_id;
+    int64_t price_cents;
+    int64_t bid_time;
+} LogRecord;
+
+// Tables for the non-engine strategies (same record layout as the engine)
+typedef struct {
+    Auction *auctions;
+    int auction_count;
+    Bid *bids;
+    int bid_count;
+    int bid_capacity;
+} Tables;
+
+static const char *g_label = "";
+static FILE *g_out;             // results; stdout carries the engine's logs
+static char g_dir[256];
+static uint64_t g_rng;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_next() {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static long disk_write_bytes() {
+    char line[128];
+    long value = 0;
+    FILE *fp = fopen("/proc/self/io", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "write_bytes: %ld", &value) == 1) break;
+    }
+    fclose(fp);
+    return value;
+}
+
+static const char* fs_name(const char *path) {
+    struct statfs st;
+    if (statfs(path, &st) != 0) return "unknown";
+    switch ((unsigned long)st.f_type) {
+        case 0xEF53: return "ext4";
+        case 0x58465342: return "xfs";
+        case 0x9123683E: return "btrfs";
+        case 0x01021994: return "tmpfs";
+        case 0x794c7630: return "overlay";
+        default: return "other";
+    }
+}
+
+static void path_of(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s/%s", g_dir, name);
+}
+
+// Is name one of the entries of a comma-separated list?
+static int in_list(const char *list, const char *name) {
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ',') && (p[len] == '\0' || p[len] == ',')) return 1;
+    }
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(double *sorted, int n, double p) {
+    int i = (int)(p / 100.0 * n);
+    if (i >= n) i = n - 1;
+    return sorted[i] * 1e6;
+}
+
+// =====================================================
+// DATASET
+// =====================================================
+
+static void fill_auction(Auction *a, int id, time_t now) {
+    memset(a, 0, sizeof(Auction));
+    a->auction_id = id;
+    a->seller_id = SELLER_ID;
+    a->room_id = 1;
+    snprintf(a->title, sizeof(a->title), "item %d", id);
+    strcpy(a->description, "persist bench");
+    a->start_price = 100;
+    a->current_price = 100;
+    a->min_bid_increment = 1;
+    a->start_time = now;
+    a->end_time = now + 86400;
+    strcpy(a->status, "active");
+}
+
+static void fill_tables(Tables *t, int scale, int bids) {
+    time_t now = time(NULL);
+    t->auction_count = scale;
+    t->auctions = calloc(scale, sizeof(Auction));
+    t->bid_capacity = scale + bids;
+    t->bids = calloc(t->bid_capacity, sizeof(Bid));
+    for (int i = 0; i < scale; i++) {
+        fill_auction(&t->auctions[i], i + 1, now);
+    }
+    t->bid_count = scale;
+    for (int i = 0; i < scale; i++) {
+        Bid *b = &t->bids[i];
+        b->bid_id = i + 1;
+        b->auction_id = i + 1;
+        b->user_id = BIDDER_ID;
+        b->bid_amount = 100;
+        b->bid_time = now;
+    }
+}
+
+static void free_tables(Tables *t) {
+    free(t->auctions);
+    free(t->bids);
+}
+
+// Bid on a random auction in memory; returns the auction index
+static int apply_bid(Tables *t) {
+    int i = rng_next() % t->auction_count;
+    Auction *a = &t->auctions[i];
+    a->current_price += 1;
+    a->total_bids++;
+    a->winner_id = BIDDER_ID;
+
+    Bid *b = &t->bids[t->bid_count];
+    b->bid_id = t->bid_count + 1;
+    b->auction_id = a->auction_id;
+    b->user_id = BIDDER_ID;
+    b->bid_amount = a->current_price;
+    b->bid_time = time(NULL);
+    t->bid_count++;
+    return i;
+}
+
+static int write_file(const char *name, const void *buf, size_t len) {
+    char path[512];
+    path_of(path, sizeof(path), name);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    const char *p = buf;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, p + done, len - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    fsync(fd);
+    return fd;
+}
+
+static int read_file(const char *name, void *buf, size_t cap) {
+    char path[512];
+    path_of(path, sizeof(path), name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t done = 0;
+    ssize_t n;
+    while (done < cap && (n = read(fd, (char*)buf + done, cap - done)) > 0) {
+        done += n;
+    }
+    close(fd);
+    return (int)done;
+}
+
+static void fsync_dir_files() {
+    static const char *names[] = { "users.dat", "rooms.dat", "auctions.dat", "bids.dat", "bids.log" };
+    char path[512];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        path_of(path, sizeof(path), names[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+}
+
+static void remove_files() {
+    static const char *names[] = { "users.dat", "rooms.dat", "auctions.dat", "bids.dat", "bids.log" };
+    char path[512];
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        path_of(path, sizeof(path), names[i]);
+        unlink(path);
+    }
+}
+
+// =====================================================
+// STRATEGIES
+// =====================================================
+
+typedef struct {
+    double *latency;            // per bid, seconds
+    int bids;
+    double elapsed;
+    long app_bytes;
+    long disk_bytes;
+    double recovery;
+    int recovered_ok;
+} RunResult;
+
+static int sync_due(SyncPolicy policy, int bid, double *last_sync) {
+    switch (policy) {
+        case SYNC_EACH: return 1;
+        case SYNC_GROUP: return (bid + 1) % GROUP_COMMIT_BIDS == 0;
+        case SYNC_INTERVAL:
+            if (now_sec() - *last_sync >= GROUP_COMMIT_SECONDS) {
+                *last_sync = now_sec();
+                return 1;
+            }
+            return 0;
+        default: return 0;
+    }
+}
+
+static void run_full_rewrite(int scale, RunResult *r) {
+    EngineConfig config;
+    memset(&config, 0, sizeof(config));
+    config.data_dir = g_dir;
+    config.max_users = 2;
+    config.max_rooms = 1;
+    config.max_auctions = scale;
+    config.max_bids = scale + r->bids;
+    config.fixed_buffers = 1;
+
+    AuctionEngine *eng = engine_create(&config);
+    Tables t;
+    fill_tables(&t, scale, 0);
+    memcpy(eng->auctions, t.auctions, sizeof(Auction) * scale);
+    memcpy(eng->bids, t.bids, sizeof(Bid) * scale);
+    free_tables(&t);
+    eng->auction_count = scale;
+    eng->bid_count = scale;
+
+    eng->user_count = 2;
+    for (int i = 0; i < 2; i++) {
+        eng->users[i].user_id = i + 1;
+        snprintf(eng->users[i].username, sizeof(eng->users[i].username), "user%d", i + 1);
+        strcpy(eng->users[i].status, "active");
+        eng->users[i].balance = 1e15;
+        eng->user_room[i] = 1;
+    }
+    eng->room_count = 1;
+    eng->rooms[0].room_id = 1;
+    eng->rooms[0].created_by = SELLER_ID;
+    strcpy(eng->rooms[0].status, "active");
+
+    engine_lock(eng);
+    engine_save(eng);           // opens and registers the files
+    engine_unlock(eng);
+
+    long disk_start = disk_write_bytes();
+    double start = now_sec();
+    for (int i = 0; i < r->bids; i++) {
+        Auction *a = &eng->auctions[rng_next() % scale];
+        double t0 = now_sec();
+        if (engine_place_bid(eng, a->auction_id, BIDDER_ID, a->current_price + 1) <= 0) {
+            fprintf(stderr, "full_rewrite: bid %d rejected\n", i);
+        }
+        r->latency[i] = now_sec() - t0;
+        r->app_bytes += (long)eng->user_count * sizeof(User) + (long)eng->room_count * sizeof(AuctionRoom) +
+                        (long)eng->auction_count * sizeof(Auction) + (long)eng->bid_count * sizeof(Bid);
+    }
+    r->elapsed = now_sec() - start;
+    fsync_dir_files();
+    r->disk_bytes = disk_write_bytes() - disk_start;
+
+    // Recovery: a fresh engine over the same files
+    config.fixed_buffers = 0;
+    AuctionEngine *fresh = engine_create(&config);
+    double t0 = now_sec();
+    engine_load(fresh);
+    r->recovery = now_sec() - t0;
+    r->recovered_ok = fresh->bid_count == eng->bid_count &&
+        memcmp(fresh->auctions, eng->auctions, sizeof(Auction) * scale) == 0;
+
+    engine_destroy(fresh);
+    engine_destroy(eng);
+}
+
+static void run_record(int scale, const Strategy *s, RunResult *r) {
+    Tables t;
+    fill_tables(&t, scale, r->bids);
+    int afd = write_file("auctions.dat", t.auctions, sizeof(Auction) * t.auction_count);
+    int bfd = write_file("bids.dat", t.bids, sizeof(Bid) * t.bid_count);
+
+    long disk_start = disk_write_bytes();
+    double start = now_sec();
+    for (int i = 0; i < r->bids; i++) {
+        int a = apply_bid(&t);
+        double t0 = now_sec();
+        int ok = pwrite(afd, &t.auctions[a], sizeof(Auction), (off_t)a * sizeof(Auction)) == sizeof(Auction);
+        ok &= pwrite(bfd, &t.bids[t.bid_count - 1], sizeof(Bid),
+                     (off_t)(t.bid_count - 1) * sizeof(Bid)) == sizeof(Bid);
+        if (s->sync == SYNC_EACH) {
+            fdatasync(afd);
+            fdatasync(bfd);
+        }
+        r->latency[i] = now_sec() - t0;
+        if (!ok) fprintf(stderr, "record: short write\n");
+        r->app_bytes += sizeof(Auction) + sizeof(Bid);
+    }
+    r->elapsed = now_sec() - start;
+    fsync(afd);
+    fsync(bfd);
+    r->disk_bytes = disk_write_bytes() - disk_start;
+    close(afd);
+    close(bfd);
+
+    Auction *auctions = malloc(sizeof(Auction) * scale);
+    Bid *bids = malloc(sizeof(Bid) * t.bid_capacity);
+    double t0 = now_sec();
+    read_file("auctions.dat", auctions, sizeof(Auction) * scale);
+    int n = read_file("bids.dat", bids, sizeof(Bid) * t.bid_capacity) / sizeof(Bid);
+    r->recovery = now_sec() - t0;
+    r->recovered_ok = n == t.bid_count && memcmp(auctions, t.auctions, sizeof(Auction) * scale) == 0;
+
+    free(auctions);
+    free(bids);
+    free_tables(&t);
+}
+
+static void run_log(int scale, const Strategy *s, RunResult *r) {
+    char path[512];
+    Tables t;
+    fill_tables(&t, scale, r->bids);
+
+    // Snapshot + redo log; a real system would checkpoint and truncate
+    close(write_file("auctions.dat", t.auctions, sizeof(Auction) * t.auction_count));
+    close(write_file("bids.dat", t.bids, sizeof(Bid) * t.bid_count));
+    path_of(path, sizeof(path), "bids.log");
+    int lfd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+    long disk_start = disk_write_bytes();
+    double last_sync = now_sec();
+    double start = now_sec();
+    for (int i = 0; i < r->bids; i++) {
+        int a = apply_bid(&t);
+        LogRecord rec;
+        rec.auction_id = t.auctions[a].auction_id;
+        rec.user_id = BIDDER_ID;
+        rec.price_cents = (int64_t)(t.auctions[a].current_price * 100 + 0.5);
+        rec.bid_time = t.bids[t.bid_count - 1].bid_time;
+
+        double t0 = now_sec();
+        if (write(lfd, &rec, sizeof(rec)) != sizeof(rec)) {
+            fprintf(stderr, "log: short write\n");
+        }
+        if (sync_due(s->sync, i, &last_sync)) {
+            fdatasync(lfd);
+        }
+        r->latency[i] = now_sec() - t0;
+        r->app_bytes += sizeof(rec);
+    }
+    r->elapsed = now_sec() - start;
+    fsync(lfd);
+    r->disk_bytes = disk_write_bytes() - disk_start;
+    close(lfd);
+
+    // Recovery: load the snapshot, then replay the log over it
+    Tables rec;
+    rec.auctions = malloc(sizeof(Auction) * scale);
+    rec.bids = malloc(sizeof(Bid) * t.bid_capacity);
+    double t0 = now_sec();
+    rec.auction_count = read_file("auctions.dat", rec.auctions, sizeof(Auction) * scale) / sizeof(Auction);
+    rec.bid_count = read_file("bids.dat", rec.bids, sizeof(Bid) * t.bid_capacity) / sizeof(Bid);
+    FILE *fp = fopen(path, "rb");
+    LogRecord lr;
+    while (fp != NULL && fread(&lr, sizeof(lr), 1, fp) == 1) {
+        Auction *a = &rec.auctions[lr.auction_id - 1];
+        a->current_price = lr.price_cents / 100.0;
+        a->total_bids++;
+        a->winner_id = lr.user_id;
+        Bid *b = &rec.bids[rec.bid_count];
+        b->bid_id = rec.bid_count + 1;
+        b->auction_id = lr.auction_id;
+        b->user_id = lr.user_id;
+        b->bid_amount = a->current_price;
+        b->bid_time = lr.bid_time;
+        rec.bid_count++;
+    }
+    if (fp != NULL) fclose(fp);
+    r->recovery = now_sec() - t0;
+    r->recovered_ok = rec.bid_count == t.bid_count &&
+        memcmp(rec.auctions, t.auctions, sizeof(Auction) * scale) == 0;
+
+    free_tables(&rec);
+    free_tables(&t);
+}
+
+static void* map_file(const char *name, size_t len, int *fd_out) {
+    char path[512];
+    path_of(path, sizeof(path), name);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || ftruncate(fd, len) != 0) return NULL;
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    *fd_out = fd;
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void msync_range(void *base, size_t offset, size_t len) {
+    size_t start = offset & ~(size_t)(PAGE - 1);
+    msync((char*)base + start, offset + len - start, MS_SYNC);
+}
+
+static void run_mmap(int scale, const Strategy *s, RunResult *r) {
+    Tables t;
+    fill_tables(&t, scale, r->bids);
+    close(write_file("auctions.dat", t.auctions, sizeof(Auction) * t.auction_count));
+    close(write_file("bids.dat", t.bids, sizeof(Bid) * t.bid_count));
+
+    int afd, bfd;
+    size_t alen = sizeof(Auction) * scale, blen = sizeof(Bid) * t.bid_capacity;
+    Auction *ma = map_file("auctions.dat", alen, &afd);
+    Bid *mb = map_file("bids.dat", blen, &bfd);
+    if (ma == NULL || mb == NULL) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        free_tables(&t);
+        return;
+    }
+
+    long disk_start = disk_write_bytes();
+    double start = now_sec();
+    for (int i = 0; i < r->bids; i++) {
+        int a = apply_bid(&t);
+        int b = t.bid_count - 1;
+        double t0 = now_sec();
+        ma[a] = t.auctions[a];
+        mb[b] = t.bids[b];
+        if (s->sync == SYNC_EACH) {
+            msync_range(ma, (size_t)a * sizeof(Auction), sizeof(Auction));
+            msync_range(mb, (size_t)b * sizeof(Bid), sizeof(Bid));
+        }
+        r->latency[i] = now_sec() - t0;
+        // Write-back is per page; a record can straddle two
+        r->app_bytes += PAGE * (((a * sizeof(Auction)) / PAGE != ((a + 1) * sizeof(Auction) - 1) / PAGE) + 1) +
+                        PAGE * (((b * sizeof(Bid)) / PAGE != ((b + 1) * sizeof(Bid) - 1) / PAGE) + 1);
+    }
+    r->elapsed = now_sec() - start;
+    msync(ma, alen, MS_SYNC);
+    msync(mb, blen, MS_SYNC);
+    r->disk_bytes = disk_write_bytes() - disk_start;
+    munmap(ma, alen);
+    munmap(mb, blen);
+    close(afd);
+    close(bfd);
+
+    // Recovery: map again and find the end of the bid table
+    double t0 = now_sec();
+    ma = map_file("auctions.dat", alen, &afd);
+    mb = map_file("bids.dat", blen, &bfd);
+    int n = 0;
+    while (n < t.bid_capacity && mb[n].bid_id != 0) n++;
+    r->recovery = now_sec() - t0;
+    r->recovered_ok = n == t.bid_count && memcmp(ma, t.auctions, alen) == 0;
+    munmap(ma, alen);
+    munmap(mb, blen);
+    close(afd);
+    close(bfd);
+
+    free_tables(&t);
+}
+
+// =====================================================
+// MAIN
+// =====================================================
+
+static void run_strategy(const Strategy *s, int scale, int bids) {
+    RunResult r;
+    memset(&r, 0, sizeof(r));
+    r.bids = bids;
+    r.latency = calloc(bids, sizeof(double));
+    g_rng = 0x9E3779B97F4A7C15ull;
+
+    switch (s->kind) {
+        case STRAT_FULL: run_full_rewrite(scale, &r); break;
+        case STRAT_RECORD: run_record(scale, s, &r); break;
+        case STRAT_LOG: run_log(scale, s, &r); break;
+        case STRAT_MMAP: run_mmap(scale, s, &r); break;
+    }
+    remove_files();
+
+    if (r.elapsed > 0) {
+        qsort(r.latency, bids, sizeof(double), compare_double);
+        fprintf(g_out, "{\"label\":\"%s\",\"bench\":\"persist\",\"strategy\":\"%s\",\"scale\":%d,\"bids\":%d,"
+               "\"bids_per_sec\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+               "\"app_bytes_per_bid\":%.1f,\"disk_bytes_per_bid\":%.1f,\"recovery_ms\":%.3f,"
+               "\"recovered\":%s,\"fs\":\"%s\"}\n",
+               g_label, s->name, scale, bids, bids / r.elapsed,
+               percentile_us(r.latency, bids, 50), percentile_us(r.latency, bids, 99),
+               percentile_us(r.latency, bids, 99.9),
+               (double)r.app_bytes / bids, (double)r.disk_bytes / bids, r.recovery * 1000,
+               r.recovered_ok ? "true" : "false", fs_name(g_dir));
+        fflush(g_out);
+    }
+    free(r.latency);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n scales] [-b bids] [-s strategies] [-l label] [-d dir]\n"
+            "Strategies:", prog);
+    for (int i = 0; i < STRATEGY_COUNT; i++) {
+        fprintf(stderr, " %s", g_strategies[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv) {
+    char scales[256] = DEFAULT_SCALES;
+    const char *only = NULL;
+    const char *base = "/tmp";
+    int bids = DEFAULT_BIDS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:b:s:l:d:")) != -1) {
+        switch (opt) {
+            case 'n': snprintf(scales, sizeof(scales), "%s", optarg); break;
+            case 'b': bids = atoi(optarg); break;
+            case 's': only = optarg; break;
+            case 'l': g_label = optarg; break;
+            case 'd': base = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (bids <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    snprintf(g_dir, sizeof(g_dir), "%s/persist_bench.XXXXXX", base);
+    if (mkdtemp(g_dir) == NULL) {
+        fprintf(stderr, "Could not create %s: %s\n", g_dir, strerror(errno));
+        return 1;
+    }
+    // The engine logs every save; keep stdout for results
+    g_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (g_out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+    if (io_backend_init("auto") != 0) {
+        rmdir(g_dir);
+        return 1;
+    }
+    fprintf(stderr, "persist_bench: %d bids per run in %s (%s), io backend %s\n",
+            bids, g_dir, fs_name(g_dir), io_backend_name());
+
+    for (char *tok = strtok(scales, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int scale = atoi(tok);
+        if (scale <= 0) {
+            usage(argv[0]);
+            break;
+        }
+        for (int i = 0; i < STRATEGY_COUNT; i++) {
+            if (only != NULL && !in_list(only, g_strategies[i].name)) continue;
+            run_strategy(&g_strategies[i], scale, bids);
+        }
+    }
+
+    rmdir(g_dir);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * =====================================================
+ * PIPELINE_BENCH.C - PIPELINED REQUEST THROUGHPUT
+ * =====================================================
+ * Sends the same read-only command N times, DEPTH requests per write,
+ * and waits for DEPTH reply lines before sending the next window.
+ * Depth 1 is the classic one-request-per-round-trip client.
+ *
+ * Usage: pipeline_bench [-h host] [-p port] [-n requests] [-d depth,...]
+ *                       [-c command]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define DEFAULT_PORT 8888
+#define RECV_SIZE 65536
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server(const char *host, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return sock;
+}
+
+static int send_all(int sock, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, buf, len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Read until `lines` complete replies have arrived
+static int recv_lines(int sock, int lines) {
+    static char buf[RECV_SIZE];
+
+    while (lines > 0) {
+        ssize_t n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return -1;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] == '\n') {
+                lines--;
+            }
+        }
+    }
+    return 0;
+}
+
+static int run_depth(const char *host, int port, const char *command, int requests, int depth) {
+    int sock = connect_server(host, port);
+    if (sock < 0) {
+        printf("[ERROR] Cannot connect to %s:%d\n", host, port);
+        return -1;
+    }
+
+    size_t cmd_len = strlen(command);
+    char *window = malloc(cmd_len * depth);
+    for (int i = 0; i < depth; i++) {
+        memcpy(window + i * cmd_len, command, cmd_len);
+    }
+
+    double start = now_sec();
+    int done = 0;
+    while (done < requests) {
+        int batch = requests - done < depth ? requests - done : depth;
+        if (send_all(sock, window, cmd_len * batch) < 0 || recv_lines(sock, batch) < 0) {
+            printf("[ERROR] Connection lost after %d requests\n", done);
+            break;
+        }
+        done += batch;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("depth=%-4d requests=%-8d time=%.3fs throughput=%.0f req/s\n",
+           depth, done, elapsed, done / elapsed);
+
+    send_all(sock, "QUIT|\n", 6);
+    free(window);
+    close(sock);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *host = "127.0.0.1";
+    int port = DEFAULT_PORT;
+    int requests = 20000;
+    char depths[128] = "1,8,32,128";
+    char command[256] = "LIST_ROOMS|";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:d:c:")) != -1) {
+        switch (opt) {
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'n': requests = atoi(optarg); break;
+            case 'd': snprintf(depths, sizeof(depths), "%s", optarg); break;
+            case 'c': snprintf(command, sizeof(command), "%s", optarg); break;
+            default:
+                printf("Usage: %s [-h host] [-p port] [-n requests] [-d depth,...] [-c command]\n",
+                       argv[0]);
+                return 1;
+        }
+    }
+    strncat(command, "\n", sizeof(command) - strlen(command) - 1);
+
+    printf("Pipelined throughput: %d x %.*s against %s:%d\n",
+           requests, (int)strlen(command) - 1, command, host, port);
+
+    for (char *tok = strtok(depths, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        int depth = atoi(tok);
+        if (depth <= 0) continue;
+        if (run_depth(host, port, command, requests, depth) < 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * =====================================================
+ * REPLAY.C - DETERMINISTIC REPLAY OF RECORDED TRAFFIC
+ * =====================================================
+ * Feeds a capture written by `server --record=FILE` back through the
+ * server's own dispatcher and engine, one event at a time and in recorded
+ * order. server.c is compiled in (SERVER_NO_MAIN) for the dispatcher and
+ * the engine is linked from libauction; connections are socketpairs whose
+ * replies are read and discarded.
+ *
+ * The capture starts with a snapshot of the tables, so no data directory
+ * is needed. The server runs on a manual clock set to the recorded time of
+ * every event whatever the replay speed, and the auction timer
+ * runs exactly at the recorded ticks, so replaying a capture twice, or with
+ * two builds, gives the same tables. State that depends on the order in
+ * which racing connections got the engine lock can differ from the live
+ * server's.
+ *
+ * Prints one JSON line: throughput, table sizes and a digest of the final
+ * tables; -o also writes them as data files for cmp against data/.
+ *
+ * Usage: replay [-x speed] [-o dir] [-l label] capture.bin
+ *   -x 0   as fast as possible (default); 1 = recorded pace, 10 = 10x
+ */
+
+#include "../server.c"
+
+#define REPLAY_MAX_EVENTS_HINT 4096
+#define REPLAY_OUTQ_BYTES (256 * 1024 * 1024)   // never evict a replay connection
+
+typedef struct {
+    uint32_t id;
+    Connection *conn;
+} ReplayConn;
+
+static FILE *g_out;
+static const char *g_label = "";
+
+static char *g_capture_buf;
+static size_t g_capture_len;
+static size_t *g_events;            // offset of every record
+static int g_event_count;
+static int g_event_pos;             // record being replayed
+
+static ReplayConn g_replay_conns[MAX_CONNECTIONS];
+static int g_drain_epoll = -1;
+static unsigned long g_reply_bytes;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const CaptureRecord* event_at(int i) {
+    return (const CaptureRecord*)(g_capture_buf + g_events[i]);
+}
+
+static char* event_payload(int i) {
+    return g_capture_buf + g_events[i] + sizeof(CaptureRecord);
+}
+
+static int load_capture(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    g_capture_buf = malloc(size > 0 ? size : 1);
+    g_capture_len = fread(g_capture_buf, 1, size, fp);
+    fclose(fp);
+
+    if (g_capture_len < sizeof(CAPTURE_MAGIC) ||
+        memcmp(g_capture_buf, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        fprintf(stderr, "%s is not a capture file\n", path);
+        return -1;
+    }
+
+    int cap = REPLAY_MAX_EVENTS_HINT;
+    g_events = malloc(cap * sizeof(size_t));
+    size_t off = sizeof(CAPTURE_MAGIC);
+    while (off + sizeof(CaptureRecord) <= g_capture_len) {
+        const CaptureRecord *rec = (const CaptureRecord*)(g_capture_buf + off);
+        if (off + sizeof(CaptureRecord) + rec->len > g_capture_len) {
+            break;      // cut short by a crash; replay what is complete
+        }
+        if (g_event_count == cap) {
+            cap *= 2;
+            g_events = realloc(g_events, cap * sizeof(size_t));
+        }
+        g_events[g_event_count++] = off;
+        off += sizeof(CaptureRecord) + rec->len;
+    }
+    return 0;
+}
+
+// =====================================================
+// CONNECTIONS
+// =====================================================
+
+static Connection* replay_conn_find(uint32_t id) {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_replay_conns[i].conn != NULL && g_replay_conns[i].id == id) {
+            return g_replay_conns[i].conn;
+        }
+    }
+    return NULL;
+}
+
+// The drain thread owns the peer ends once they are registered
+static void replay_conn_open(uint32_t id, const char *ip) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) {
+        fprintf(stderr, "socketpair: %s\n", strerror(errno));
+        return;
+    }
+
+    Connection *conn = conn_open(sv[0], ip);
+    if (conn == NULL) {
+        close(sv[0]);
+        close(sv[1]);
+        return;         // the live server was full too
+    }
+    conn->capture_id = id;
+
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_replay_conns[i].conn == NULL) {
+            g_replay_conns[i].id = id;
+            g_replay_conns[i].conn = conn;
+            break;
+        }
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = sv[1];
+    epoll_ctl(g_drain_epoll, EPOLL_CTL_ADD, sv[1], &ev);
+}
+
+static void replay_conn_close(uint32_t id, int dropped) {
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (g_replay_conns[i].conn != NULL && g_replay_conns[i].id == id) {
+            remove_client(g_replay_conns[i].conn, dropped);
+            conn_close(g_replay_conns[i].conn);
+            g_replay_conns[i].conn = NULL;
+            return;
+        }
+    }
+}
+
+// Reads and discards every reply and event the server sends
+static void* drain_thread(void *arg) {
+    struct epoll_event events[64];
+    char buf[65536];
+
+    while (1) {
+        int n = epoll_wait(g_drain_epoll, events, 64, -1);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            ssize_t r;
+            while ((r = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                __atomic_add_fetch(&g_reply_bytes, r, __ATOMIC_RELAXED);
+            }
+            if (r == 0 || (r < 0 && errno != EAGAIN)) {
+                epoll_ctl(g_drain_epoll, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+// The token the live server issued next on this connection
+static int replay_token(Connection *conn, char *out) {
+    for (int i = g_event_pos + 1; i < g_event_count; i++) {
+        const CaptureRecord *rec = event_at(i);
+        if (rec->kind == CAP_TOKEN && rec->conn_id == conn->capture_id &&
+            rec->len == RESUME_TOKEN_LEN) {
+            memcpy(out, event_payload(i), RESUME_TOKEN_LEN);
+            out[RESUME_TOKEN_LEN] = '\0';
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// =====================================================
+// REPLAY
+// =====================================================
+
+static void load_snapshot(const CaptureRecord *rec, const char *data) {
+    if (rec->flag >= ENGINE_DATA_FILES) {
+        return;
+    }
+    EngineDataFile *df = &g_engine->files[rec->flag];
+    int count = rec->len / df->record_size;
+    if (count > df->capacity) {
+        fprintf(stderr, "Snapshot of %s has %d records, engine holds %d\n", df->path, count, df->capacity);
+        count = df->capacity;
+    }
+    memcpy(df->base, data, count * df->record_size);
+    *df->count = count;
+}
+
+static int replay_event(int i) {
+    const CaptureRecord *rec = event_at(i);
+    char *payload = event_payload(i);
+    char line[MAX_FRAME_SIZE + 1];
+    char ip[INET_ADDRSTRLEN];
+    Connection *conn;
+    ProtoHeader h;
+
+    clock_set_ms(&g_clock, rec->wall_ms);
+
+    switch (rec->kind) {
+        case CAP_SNAPSHOT:
+            load_snapshot(rec, payload);
+            return 0;
+        case CAP_OPEN:
+            snprintf(ip, sizeof(ip), "%.*s", (int)rec->len, payload);
+            replay_conn_open(rec->conn_id, ip);
+            return 0;
+        case CAP_TEXT:
+            conn = replay_conn_find(rec->conn_id);
+            if (conn == NULL || rec->len > MAX_FRAME_SIZE) return 0;
+            memcpy(line, payload, rec->len);
+            line[rec->len] = '\0';
+            conn_cork(conn);
+            dispatch_text_line(conn, line);
+            conn_uncork(conn);
+            return 1;
+        case CAP_FRAME:
+            conn = replay_conn_find(rec->conn_id);
+            if (conn == NULL || proto_parse_header(payload, rec->len, PROTO_MAX_PAYLOAD, &h) <= 0) return 0;
+            conn_cork(conn);
+            dispatch_frame(conn, &h, payload + PROTO_HEADER_SIZE);
+            conn_uncork(conn);
+            return 1;
+        case CAP_CLOSE:
+            replay_conn_close(rec->conn_id, rec->flag);
+            return 0;
+        case CAP_TICK:
+            engine_tick(g_engine, clock_now(&g_clock));
+            expire_detached_sessions();
+            return 0;
+        default:
+            return 0;   // CAP_TOKEN is read ahead by replay_token
+    }
+}
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int write_tables(const char *dir) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &g_engine->files[i];
+        char path[512];
+        snprintf(path, sizeof(path), "%s%s", dir, strrchr(df->path, '/'));
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+            fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+        fwrite(df->base, df->record_size, *df->count, fp);
+        fclose(fp);
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-x speed] [-o dir] [-l label] capture.bin\n"
+            "  -x 0 replays as fast as possible, 1 at the recorded pace\n", prog);
+}
+
+int main(int argc, char **argv) {
+    double speed = 0;
+    const char *out_dir = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:o:l:")) != -1) {
+        switch (opt) {
+            case 'x': speed = atof(optarg); break;
+            case 'o': out_dir = optarg; break;
+            case 'l': g_label = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1 || speed < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *path = argv[optind];
+    if (load_capture(path) != 0) {
+        return 1;
+    }
+
+    // The handlers log to stdout; keep it for the result
+    g_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (g_out == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        perror("stdout");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    clock_init_manual(&g_clock, g_event_count > 0 ? event_at(0)->wall_ms : clock_wall_ms());
+
+    if (io_backend_init("auto") != 0 || command_registry_init() != 0 ||
+        server_engine_init(NULL) != 0 || flusher_init() != 0) {
+        fprintf(stderr, "Could not set up the server\n");
+        return 1;
+    }
+    memset(g_clients, 0, sizeof(g_clients));
+    conn_table_init();
+    resp_cache_init();
+    g_outq_max_bytes = REPLAY_OUTQ_BYTES;
+    g_resume_token_source = replay_token;
+    g_replaying = 1;
+
+    g_drain_epoll = epoll_create1(EPOLL_CLOEXEC);
+    pthread_t flusher, drainer;
+    pthread_create(&flusher, NULL, io_flusher, NULL);
+    pthread_create(&drainer, NULL, drain_thread, NULL);
+
+    long commands = 0;
+    int connections = 0;
+    double start = now_sec();
+    for (g_event_pos = 0; g_event_pos < g_event_count; g_event_pos++) {
+        const CaptureRecord *rec = event_at(g_event_pos);
+        if (speed > 0) {
+            double wait = start + rec->t_us / 1e6 / speed - now_sec();
+            if (wait > 0) {
+                usleep((useconds_t)(wait * 1e6));
+            }
+        }
+        connections += rec->kind == CAP_OPEN;
+        commands += replay_event(g_event_pos);
+    }
+    double elapsed = now_sec() - start;
+    double span = g_event_count > 0 ? event_at(g_event_count - 1)->t_us / 1e6 : 0;
+
+    uint64_t digest = 0xcbf29ce484222325ULL;
+    engine_lock(g_engine);
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &g_engine->files[i];
+        digest = fnv1a(digest, df->base, df->record_size * (*df->count));
+    }
+    int rc = out_dir != NULL ? write_tables(out_dir) : 0;
+    engine_unlock(g_engine);
+
+    fprintf(g_out, "{\"label\":\"%s\",\"bench\":\"replay\",\"capture\":\"%s\",\"events\":%d,"
+            "\"commands\":%ld,\"connections\":%d,\"speed\":%g,\"capture_s\":%.3f,\"elapsed_s\":%.3f,"
+            "\"commands_per_sec\":%.1f,\"reply_bytes\":%lu,\"users\":%d,\"rooms\":%d,\"auctions\":%d,"
+            "\"bids\":%d,\"state_digest\":\"%016llx\"}\n",
+            g_label, path, g_event_count, commands, connections, speed, span, elapsed,
+            elapsed > 0 ? commands / elapsed : 0.0,
+            __atomic_load_n(&g_reply_bytes, __ATOMIC_RELAXED),
+            g_engine->user_count, g_engine->room_count, g_engine->auction_count,
+            g_engine->bid_count, (unsigned long long)digest);
+    fflush(g_out);
+
+    return rc == 0 ? 0 : 1;
+}
@@ -17,10 +17,23 @@
 #include <errno.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "protocol.h"
 
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 8888
 #define BUFFER_SIZE 4096
+#define PAGE_SIZE 20
+#define RESUME_ATTEMPTS 5
+#define REQUEST_TIMEOUT_MS 10000
+#define RETRY_ATTEMPTS 5            // bids and buy-now are safe to resend
+#define RETRY_TIMEOUT_MS 2000
+#define MAX_PENDING 64              // requests in flight at once
+#define EVENT_QUEUE_MAX 1024        // undisplayed notifications kept
+#define MAX_LIVE_AUCTIONS 100
+#define RX_PENDING_SIZE (BUFFER_SIZE * 128)     // largest room snapshot
 
 // =====================================================
 // GLOBAL VARIABLES
@@ -34,9 +47,64 @@ double current_balance = 0.0;
 int current_room_id = 0;
 char current_room_name[100] = "None";
 int running = 1;
+int use_binary = 0;         // BIN1 negotiated with --binary
+int want_binary = 0;
+char resume_token[64] = "";
+volatile int connection_lost = 0;   // dropped while logged in, resume pending
+volatile int reader_running = 0;
+
+int resume_session();       // SESSION RESUME, used by send_request
 
 pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Requests waiting for their reply. Only the reader thread reads the
+// socket; it hands each reply to the slot with the matching correlation
+// id ("@<id> " on text lines, the header corr_id on BIN1 frames).
+typedef struct {
+    uint32_t id;            // 0 = free
+    int done;
+    char *reply;            // the reply line, '\n' included
+} PendingRequest;
+
+PendingRequest pending[MAX_PENDING];
+uint32_t next_corr_id = 1;
+uint32_t last_request_id = 0;       // send_request -> receive_response
+pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+
+// Pushed lines (bids, joins, auction ends) for the event thread to display
+typedef struct EventNode {
+    struct EventNode *next;
+    char line[];
+} EventNode;
+
+EventNode *event_head = NULL;
+EventNode *event_tail = NULL;
+int event_count = 0;
+pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t event_cond = PTHREAD_COND_INITIALIZER;
+
+// Local replica of the subscribed room, kept by the listener thread while
+// the live view is open
+typedef struct {
+    int id;
+    char title[200];
+    double current_price;
+    double buy_now_price;
+    int total_bids;
+    long end_time;          // server clock
+} LiveAuction;
+
+LiveAuction live_auctions[MAX_LIVE_AUCTIONS];
+int live_count = 0;
+int live_active = 0;        // listener routes SNAPSHOT/DELTA lines here
+int live_synced = 0;        // snapshot applied and no sequence gap since
+int live_need_snapshot = 0; // gap seen, view must subscribe again
+int live_failed = 0;
+unsigned long live_seq = 0;
+long live_clock_offset = 0; // server time - local time
+pthread_mutex_t live_mutex = PTHREAD_MUTEX_INITIALIZER;   // replica and rx_pending
+
 // =====================================================
 // UTILITY FUNCTIONS
 // =====================================================
@@ -56,6 +124,28 @@ void print_separator() {
     printf("-------------------------------------------\n");
 }
 
+// Paged listings end with an "END;<next cursor>|" token (0 = last page).
+// Returns 1 if token is that trailer.
+int parse_page_end(const char *token, int *next_cursor) {
+    if (strncmp(token, "END;", 4) != 0) {
+        return 0;
+    }
+    *next_cursor = atoi(token + 4);
+    return 1;
+}
+
+// Called with the newline after the menu choice already consumed.
+// Returns 1 if the user asked for the next page.
+int prompt_next_page() {
+    char line[16];
+    printf("\n[n] Next page, [Enter] Back: ");
+    fflush(stdout);
+    if (fgets(line, sizeof(line), stdin) == NULL) {
+        return 0;
+    }
+    return line[0] == 'n' || line[0] == 'N';
+}
+
 void safe_print(const char *format, ...) {
     pthread_mutex_lock(&print_mutex);
     va_list args;
@@ -70,290 +160,909 @@ void safe_print(const char *format, ...) {
 // NETWORK FUNCTIONS
 // =====================================================
 
+// Write one request line. In binary mode it is translated to a frame
+// (PLACE_BID typed, everything else tunnelled); in text mode a non-zero
+// corr_id is sent as an "@<id> " prefix.
+static int send_raw(const char *request, uint32_t corr_id) {
+    unsigned char frame[PROTO_HEADER_SIZE + BUFFER_SIZE];
+    size_t len = strlen(request);
+    size_t frame_len;
+    ProtoPlaceBid bid;
+
+    if (!use_binary) {
+        if (corr_id == 0) {
+            return send(client_socket, request, len, MSG_NOSIGNAL);
+        }
+        frame_len = snprintf((char*)frame, sizeof(frame), "@%u %s", corr_id, request);
+        if (frame_len >= sizeof(frame)) {
+            return -1;
+        }
+        return send(client_socket, frame, frame_len, MSG_NOSIGNAL);
+    }
+
+    if (len > 0 && request[len - 1] == '\n') {
+        len--;
+    }
+
+    bid.request_id[0] = '\0';
+    if (sscanf(request, "PLACE_BID|%d|%d|%lf|%32[^|\n]", &bid.auction_id, &bid.user_id,
+               &bid.amount, bid.request_id) >= 3) {
+        frame_len = proto_encode_place_bid(frame, sizeof(frame), &bid, corr_id);
+    } else {
+        frame_len = proto_encode_text(frame, sizeof(frame), request, len, corr_id);
+    }
+
+    if (frame_len == 0) {
+        return -1;
+    }
+    return send(client_socket, frame, frame_len, MSG_NOSIGNAL);
+}
+
+// Caller holds pending_mutex
+static PendingRequest* pending_find(uint32_t id) {
+    for (int i = 0; i < MAX_PENDING; i++) {
+        if (pending[i].id == id) {
+            return &pending[i];
+        }
+    }
+    return NULL;
+}
+
+void request_release(uint32_t id) {
+    pthread_mutex_lock(&pending_mutex);
+    PendingRequest *p = pending_find(id);
+    if (p != NULL) {
+        free(p->reply);
+        p->reply = NULL;
+        p->id = 0;
+    }
+    pthread_mutex_unlock(&pending_mutex);
+}
+
+// Send a request and reserve a slot for its reply. Several requests can be
+// in flight; collect each with request_wait(). Returns 0 on failure.
+uint32_t request_send(const char *request) {
+    // A request typed after the connection dropped goes to the resumed one
+    if (connection_lost && !resume_session()) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pending_mutex);
+    uint32_t id = next_corr_id++;
+    if (next_corr_id == 0) {
+        next_corr_id = 1;
+    }
+    PendingRequest *p = pending_find(0);
+    if (p != NULL) {
+        p->id = id;
+        p->done = 0;
+        p->reply = NULL;
+    }
+    pthread_mutex_unlock(&pending_mutex);
+
+    if (p == NULL) {
+        return 0;
+    }
+    if (send_raw(request, id) <= 0) {
+        request_release(id);
+        return 0;
+    }
+    return id;
+}
+
+// Returns the reply length, -1 if the connection dropped and -2 on timeout.
+// The slot is released either way.
+int request_wait(uint32_t id, char *buffer, int size, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    buffer[0] = '\0';
+    pthread_mutex_lock(&pending_mutex);
+    PendingRequest *p = id != 0 ? pending_find(id) : NULL;
+    int wait_rc = 0;
+    while (p != NULL && !p->done && running && !connection_lost && wait_rc != ETIMEDOUT) {
+        wait_rc = pthread_cond_timedwait(&pending_cond, &pending_mutex, &deadline);
+    }
+
+    int bytes = -1;
+    if (p != NULL && p->done) {
+        bytes = snprintf(buffer, size, "%s", p->reply);
+        if (bytes >= size) {
+            bytes = size - 1;
+        }
+    } else if (p != NULL && running && !connection_lost) {
+        bytes = -2;
+    }
+    if (p != NULL) {
+        free(p->reply);
+        p->reply = NULL;
+        p->id = 0;
+    }
+    pthread_mutex_unlock(&pending_mutex);
+
+    return bytes;
+}
+
+// Called by the reader; returns 0 if nobody is waiting for this id
+static int pending_complete(uint32_t id, const char *line) {
+    pthread_mutex_lock(&pending_mutex);
+    PendingRequest *p = pending_find(id);
+    int taken = p != NULL && !p->done;
+    if (taken) {
+        size_t len = strlen(line);
+        p->reply = malloc(len + 2);
+        if (p->reply != NULL) {
+            memcpy(p->reply, line, len);
+            p->reply[len] = '\n';
+            p->reply[len + 1] = '\0';
+        }
+        p->done = p->reply != NULL;
+        pthread_cond_broadcast(&pending_cond);
+    }
+    pthread_mutex_unlock(&pending_mutex);
+    return taken;
+}
+
+// Requests are always built as text lines. The reply is picked up by the
+// next receive_response().
 int send_request(const char *request) {
-    return send(client_socket, request, strlen(request), 0);
+    if (last_request_id != 0) {
+        request_release(last_request_id);   // reply never waited for
+    }
+    last_request_id = request_send(request);
+    return last_request_id != 0 ? (int)strlen(request) : -1;
 }
 
-int receive_response(char *buffer, int size) {
-    memset(buffer, 0, size);
-    
-    // Set timeout for recv
-    struct timeval tv;
-    tv.tv_sec = 10;  // 10 second timeout
-    tv.tv_usec = 0;
-    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    
-    int bytes = recv(client_socket, buffer, size - 1, 0);
-    
+// For requests whose reply nobody reads (subscriptions, leaving, QUIT);
+// untagged replies go to the notification path, which ignores them
+int send_oneway(const char *request) {
+    if (connection_lost && !resume_session()) {
+        return -1;
+    }
+    return send_raw(request, 0);
+}
+
+static int recv_exact(void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        int n = recv(client_socket, (char*)buf + got, len - got, 0);
+        if (n <= 0) {
+            return n;
+        }
+        got += n;
+    }
+    return got;
+}
+
+// Receive the next message as text (reader thread only). In binary mode
+// exactly one frame is read and translated back, a reply getting the same
+// "@<id> " prefix the text protocol uses, so demultiplexing is shared.
+int recv_message(char *buffer, int size) {
+    if (!use_binary) {
+        return recv(client_socket, buffer, size - 1, 0);
+    }
+
+    static unsigned char *payload = NULL;
+    static size_t payload_cap = 0;
+    unsigned char header[PROTO_HEADER_SIZE];
+    ProtoHeader h;
+
+    int bytes = recv_exact(header, PROTO_HEADER_SIZE);
+    if (bytes > 0 && proto_parse_header(header, PROTO_HEADER_SIZE, PROTO_MAX_REPLY, &h) < 0) {
+        errno = EPROTO;
+        bytes = -1;
+    }
+    if (bytes > 0 && h.len > payload_cap) {
+        unsigned char *grown = realloc(payload, h.len);
+        if (grown == NULL) {
+            errno = ENOMEM;
+            bytes = -1;
+        } else {
+            payload = grown;
+            payload_cap = h.len;
+        }
+    }
+    if (bytes > 0 && h.len > 0) {
+        bytes = recv_exact(payload, h.len);
+    }
+
+    if (bytes <= 0) {
+        return bytes;
+    }
+
+    if (h.opcode == OP_TEXT) {
+        int n = 0;
+        if (h.corr_id != 0) {
+            n = snprintf(buffer, size, "@%u ", h.corr_id);
+        }
+        int text = (int)h.len < size - n - 2 ? (int)h.len : size - n - 2;
+        memcpy(buffer + n, payload, text);
+        buffer[n + text] = '\n';
+        buffer[n + text + 1] = '\0';
+        return n + text + 1;
+    }
+
+    ProtoNewBid bid;
+    if (h.opcode == OP_NEW_BID && proto_decode_new_bid(payload, h.len, &bid) == 0) {
+        if (h.flags & PROTO_FLAG_WARNING) {
+            return snprintf(buffer, size, "NEW_BID_WARNING|%d|%s|%.2f|%d|%d\n",
+                            bid.auction_id, bid.bidder, bid.amount, bid.total_bids, bid.time_left);
+        }
+        return snprintf(buffer, size, "NEW_BID|%d|%s|%.2f|%d\n",
+                        bid.auction_id, bid.bidder, bid.amount, bid.total_bids);
+    }
+
+    return snprintf(buffer, size, "ERROR|Unknown opcode %u\n", h.opcode);
+}
+
+// Ask the server for BIN1; stays on text if the server declines.
+// Runs before the reader thread is started on this connection.
+void negotiate_binary() {
+    char buffer[256];
+
+    send(client_socket, PROTO_HELLO "\n", strlen(PROTO_HELLO) + 1, MSG_NOSIGNAL);
+    int bytes = recv(client_socket, buffer, sizeof(buffer) - 1, 0);
     if (bytes > 0) {
         buffer[bytes] = '\0';
-    } else if (bytes == 0) {
-        // Connection closed
-        printf("\n[ERROR] Server disconnected!\n");
-        running = 0;
-    } else {
-        // Error or timeout
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            printf("\n[ERROR] Request timeout! Server may be busy.\n");
-        } else {
-            printf("\n[ERROR] Connection error!\n");
-            running = 0;
+        if (strncmp(buffer, "HELLO_OK|BIN1", 13) == 0) {
+            use_binary = 1;
+            printf("Using binary protocol.\n");
+            return;
         }
+    }
+    printf("[WARNING] Server does not support the binary protocol, using text.\n");
+}
+
+int connect_to_server() {
+    struct sockaddr_in server_addr;
+
+    client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client_socket < 0) {
+        return -1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+
+    if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        close(client_socket);
+        return -1;
+    }
+    return 0;
+}
+
+// Let requests in flight notice that no reply will come
+void wake_waiters() {
+    pthread_mutex_lock(&pending_mutex);
+    pthread_cond_broadcast(&pending_cond);
+    pthread_mutex_unlock(&pending_mutex);
+}
+
+// A logged-in session is resumed on the next request; otherwise give up
+void connection_dropped() {
+    if (logged_in && resume_token[0] != '\0') {
+        connection_lost = 1;
+    } else {
+        running = 0;
+    }
+    wake_waiters();
+}
+
+// Wait for the reply to the last send_request(). Returns the reply length,
+// -1 if the connection dropped and -2 on timeout.
+int receive_response_within(char *buffer, int size, int timeout_ms) {
+    uint32_t id = last_request_id;
+    last_request_id = 0;
+    return request_wait(id, buffer, size, timeout_ms);
+}
+
+int receive_response(char *buffer, int size) {
+    int bytes = receive_response_within(buffer, size, REQUEST_TIMEOUT_MS);
+    if (bytes == -2) {
+        printf("\n[ERROR] Request timeout! Server may be busy.\n");
         bytes = -1;
     }
-    
     return bytes;
 }
 
+// Send a bid or buy-now tagged with a fresh request id and resend it on a
+// short timeout. The server answers a repeated id with the original result,
+// so a retry can never bid or buy twice; replies to abandoned attempts are
+// dropped by the reader. Returns the reply length or -1.
+int request_idempotent(const char *request, char *response, int size) {
+    static unsigned request_seq = 0;
+    char tagged[512];
+    int len = strlen(request);
+
+    if (len > 0 && request[len - 1] == '\n') {
+        len--;
+    }
+    snprintf(tagged, sizeof(tagged), "%.*s|u%d-%lx-%u\n", len, request,
+             current_user_id, (long)time(NULL), ++request_seq);
+
+    for (int attempt = 1; attempt <= RETRY_ATTEMPTS && running; attempt++) {
+        send_request(tagged);
+
+        int bytes = receive_response_within(response, size, RETRY_TIMEOUT_MS);
+        if (bytes > 0) {
+            return bytes;
+        }
+        if (bytes == -2 && attempt < RETRY_ATTEMPTS) {
+            printf("[INFO] No reply yet, retrying (%d/%d)...\n", attempt + 1, RETRY_ATTEMPTS);
+        }
+    }
+
+    printf("\n[ERROR] Request timeout! Server may be busy.\n");
+    response[0] = '\0';
+    return -1;
+}
+
 // =====================================================
-// NOTIFICATION LISTENER THREAD
+// LIVE AUCTION REPLICA
 // =====================================================
 
-void* notification_listener(void *arg) {
-    char buffer[BUFFER_SIZE];
-    fd_set read_fds;
-    struct timeval tv;
+// Caller holds live_mutex
+static LiveAuction* live_find(int auction_id) {
+    for (int i = 0; i < live_count; i++) {
+        if (live_auctions[i].id == auction_id) {
+            return &live_auctions[i];
+        }
+    }
+    return NULL;
+}
 
-    while (running) {
-        FD_ZERO(&read_fds);
-        FD_SET(client_socket, &read_fds);
+// row = id;title;price;buy_now;min_increment;total_bids;end_time;status
+static void live_add_row(const char *row) {
+    LiveAuction a;
+    double min_increment;
+    char status[20];
 
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+    if (sscanf(row, "%d;%199[^;];%lf;%lf;%lf;%d;%ld;%19[^|]", &a.id, a.title,
+               &a.current_price, &a.buy_now_price, &min_increment,
+               &a.total_bids, &a.end_time, status) != 8 ||
+        strcmp(status, "active") != 0 || live_count >= MAX_LIVE_AUCTIONS) {
+        return;
+    }
+    live_auctions[live_count++] = a;
+}
 
-        int activity = select(client_socket + 1, &read_fds, NULL, NULL, &tv);
+static void live_apply_snapshot(char *data) {
+    char *save;
+    char *token = strtok_r(data, "|", &save);   // room id
+    token = token ? strtok_r(NULL, "|", &save) : NULL;
+    if (token == NULL) return;
+    live_seq = strtoul(token, NULL, 10);
+    token = strtok_r(NULL, "|", &save);
+    if (token == NULL) return;
+    live_clock_offset = atol(token) - (long)time(NULL);
+
+    live_count = 0;
+    while ((token = strtok_r(NULL, "|", &save)) != NULL) {
+        live_add_row(token);
+    }
+    live_synced = 1;
+}
 
-        if (activity < 0) {
-            continue;
-        }
+static void live_apply_delta(char *data) {
+    int room_id;
+    unsigned long seq;
+    char kind[16];
+    int consumed = 0;
 
-        if (activity == 0) {
-            continue;
+    if (!live_synced ||
+        sscanf(data, "%d|%lu|%15[^|]|%n", &room_id, &seq, kind, &consumed) < 3 || consumed == 0 ||
+        seq <= live_seq) {
+        return;
+    }
+    if (seq != live_seq + 1) {
+        // Missed a delta: the replica can't be trusted until a new snapshot
+        live_synced = 0;
+        live_need_snapshot = 1;
+        return;
+    }
+    live_seq = seq;
+
+    char *body = data + consumed;
+    if (strcmp(kind, "NEW") == 0) {
+        live_add_row(body);
+    } else if (strcmp(kind, "BID") == 0) {
+        int auction_id, total_bids;
+        double price;
+        long end_time;
+        if (sscanf(body, "%d|%lf|%d|%ld", &auction_id, &price, &total_bids, &end_time) == 4) {
+            LiveAuction *a = live_find(auction_id);
+            if (a != NULL) {
+                a->current_price = price;
+                a->total_bids = total_bids;
+                a->end_time = end_time;
+            }
         }
+    } else if (strcmp(kind, "STATE") == 0) {
+        LiveAuction *a = live_find(atoi(body));
+        if (a != NULL) {
+            *a = live_auctions[--live_count];
+        }
+    }
+}
 
-        if (FD_ISSET(client_socket, &read_fds)) {
-            int bytes = recv(client_socket, buffer, BUFFER_SIZE - 1, MSG_DONTWAIT);
+void live_reset() {
+    pthread_mutex_lock(&live_mutex);
+    live_count = 0;
+    live_synced = 0;
+    live_need_snapshot = 0;
+    live_failed = 0;
+    live_seq = 0;
+    pthread_mutex_unlock(&live_mutex);
+}
 
-            if (bytes <= 0) {
-                if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
-                    running = 0;
-                    safe_print("\n[ERROR] Connection lost to server!\n");
-                    break;
-                }
-                continue;
-            }
+// =====================================================
+// READER AND NOTIFICATION THREADS
+// =====================================================
 
-            buffer[bytes] = '\0';
-
-            // Ignore response messages
-            if (strstr(buffer, "_SUCCESS") != NULL ||
-                strstr(buffer, "_FAIL") != NULL ||
-                strstr(buffer, "AUCTION_LIST") != NULL ||
-                strstr(buffer, "AUCTION_DETAIL") != NULL ||
-                strstr(buffer, "BID_HISTORY") != NULL ||
-                strstr(buffer, "MY_AUCTIONS") != NULL ||
-                strstr(buffer, "ROOM_LIST") != NULL ||
-                strstr(buffer, "ROOM_DETAIL") != NULL ||
-                strstr(buffer, "MY_ROOM") != NULL) {
-                continue;
-            }
+// Show one server-initiated message. Returns -1 on FORCE_LOGOUT.
+int handle_notification(const char *msg) {
+    // Ignore response messages
+    if (strstr(msg, "_SUCCESS") != NULL ||
+        strstr(msg, "_FAIL") != NULL ||
+        strstr(msg, "AUCTION_LIST") != NULL ||
+        strstr(msg, "AUCTION_DETAIL") != NULL ||
+        strstr(msg, "BID_HISTORY") != NULL ||
+        strstr(msg, "MY_AUCTIONS") != NULL ||
+        strstr(msg, "ROOM_LIST") != NULL ||
+        strstr(msg, "ROOM_DETAIL") != NULL ||
+        strstr(msg, "MY_ROOM") != NULL) {
+        return 0;
+    }
 
-            // Handle force logout
-            if (strncmp(buffer, "FORCE_LOGOUT|", 13) == 0) {
-                char reason[256];
-                sscanf(buffer + 13, "%[^\n]", reason);
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║          ⚠️  FORCE LOGOUT ⚠️                          ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ Reason: %s\n", reason);
-                safe_print("║ You have been logged out.                              ║\n");
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                running = 0;
-                break;
-            }
+    // Handle force logout
+    if (strncmp(msg, "FORCE_LOGOUT|", 13) == 0) {
+        char reason[256];
+        sscanf(msg + 13, "%[^\n]", reason);
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║          ⚠️  FORCE LOGOUT ⚠️                          ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ Reason: %s\n", reason);
+        safe_print("║ You have been logged out.                              ║\n");
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        return -1;
+    }
 
-            // Handle room notifications
-            if (strncmp(buffer, "NEW_ROOM|", 9) == 0) {
-                int room_id, max_participants;
-                char room_name[100], creator[50];
-                sscanf(buffer + 9, "%d|%[^|]|%[^|]|%d", 
-                       &room_id, room_name, creator, &max_participants);
-                
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║          🏠 NEW ROOM CREATED! 🏠                      ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ Room ID:         %-5d                                ║\n", room_id);
-                safe_print("║ Room Name:       %-40s ║\n", room_name);
-                safe_print("║ Created By:      %-40s ║\n", creator);
-                safe_print("║ Max Participants: %-3d                                 ║\n", max_participants);
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-            }
-            else if (strncmp(buffer, "USER_JOINED|", 12) == 0) {
-                char username[50];
-                int room_id;
-                sscanf(buffer + 12, "%[^|]|%d", username, &room_id);
-                
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║          👤 USER JOINED ROOM 👤                       ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ User: %-48s ║\n", username);
-                safe_print("║ Room ID: %-5d                                        ║\n", room_id);
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-            } 
-            else if (strncmp(buffer, "USER_LEFT|", 10) == 0) {
-                char username[50];
-                int room_id;
-                sscanf(buffer + 10, "%[^|]|%d", username, &room_id);
-                
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║          👋 USER LEFT ROOM 👋                         ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ User: %-48s ║\n", username);
-                safe_print("║ Room ID: %-5d                                        ║\n", room_id);
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-            }
-            // Handle auction notifications
-            else if (strncmp(buffer, "NEW_AUCTION|", 12) == 0) {
-                int auction_id, time_left;
-                char title[200];
-                double start_price, buy_now_price, min_increment;
-
-                if (sscanf(buffer + 12, "%d|%[^|]|%lf|%lf|%lf|%d",
-                          &auction_id, title, &start_price, &buy_now_price,
-                          &min_increment, &time_left) == 6) {
-
-                    safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                    safe_print("║          🔔 NEW AUCTION CREATED! 🔔                   ║\n");
-                    safe_print("╠════════════════════════════════════════════════════════╣\n");
-                    safe_print("║ ID:              %-5d                                ║\n", auction_id);
-                    safe_print("║ Title:           %-40s ║\n", title);
-                    safe_print("║ Starting Price:  %12.2f VND                   ║\n", start_price);
-                    safe_print("║ Buy Now Price:   %12.2f VND                   ║\n", buy_now_price);
-                    safe_print("║ Min Increment:   %12.2f VND                   ║\n", min_increment);
-                    safe_print("║ Duration:        %3d hours %2d minutes               ║\n",
-                              time_left / 3600, (time_left % 3600) / 60);
-                    safe_print("╚════════════════════════════════════════════════════════╝\n");
-                    safe_print(">> ");
-                }
+    // Handle room notifications
+    if (strncmp(msg, "NEW_ROOM|", 9) == 0) {
+        int room_id, max_participants;
+        char room_name[100], creator[50];
+        sscanf(msg + 9, "%d|%[^|]|%[^|]|%d", 
+               &room_id, room_name, creator, &max_participants);
+        
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║          🏠 NEW ROOM CREATED! 🏠                      ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ Room ID:         %-5d                                ║\n", room_id);
+        safe_print("║ Room Name:       %-40s ║\n", room_name);
+        safe_print("║ Created By:      %-40s ║\n", creator);
+        safe_print("║ Max Participants: %-3d                                 ║\n", max_participants);
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+    }
+    else if (strncmp(msg, "USER_JOINED|", 12) == 0) {
+        char username[50];
+        int room_id;
+        sscanf(msg + 12, "%[^|]|%d", username, &room_id);
+        
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║          👤 USER JOINED ROOM 👤                       ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ User: %-48s ║\n", username);
+        safe_print("║ Room ID: %-5d                                        ║\n", room_id);
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+    } 
+    else if (strncmp(msg, "USER_LEFT|", 10) == 0) {
+        char username[50];
+        int room_id;
+        sscanf(msg + 10, "%[^|]|%d", username, &room_id);
+        
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║          👋 USER LEFT ROOM 👋                         ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ User: %-48s ║\n", username);
+        safe_print("║ Room ID: %-5d                                        ║\n", room_id);
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+    }
+    // Handle auction notifications
+    else if (strncmp(msg, "NEW_AUCTION|", 12) == 0) {
+        int auction_id, time_left;
+        char title[200];
+        double start_price, buy_now_price, min_increment;
+
+        if (sscanf(msg + 12, "%d|%[^|]|%lf|%lf|%lf|%d",
+                  &auction_id, title, &start_price, &buy_now_price,
+                  &min_increment, &time_left) == 6) {
+
+            safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+            safe_print("║          🔔 NEW AUCTION CREATED! 🔔                   ║\n");
+            safe_print("╠════════════════════════════════════════════════════════╣\n");
+            safe_print("║ ID:              %-5d                                ║\n", auction_id);
+            safe_print("║ Title:           %-40s ║\n", title);
+            safe_print("║ Starting Price:  %12.2f VND                   ║\n", start_price);
+            safe_print("║ Buy Now Price:   %12.2f VND                   ║\n", buy_now_price);
+            safe_print("║ Min Increment:   %12.2f VND                   ║\n", min_increment);
+            safe_print("║ Duration:        %3d hours %2d minutes               ║\n",
+                      time_left / 3600, (time_left % 3600) / 60);
+            safe_print("╚════════════════════════════════════════════════════════╝\n");
+            safe_print(">> ");
+        }
 
-            } else if (strncmp(buffer, "NEW_BID_WARNING|", 16) == 0) {
-                int auction_id, total_bids, time_left;
-                char bidder[50];
-                double bid_amount;
-                sscanf(buffer + 16, "%d|%[^|]|%lf|%d|%d", 
-                       &auction_id, bidder, &bid_amount, &total_bids, &time_left);
-
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║      ⚠️  WARNING: LAST 30 SECONDS! ⚠️                ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║          💰 NEW BID PLACED! 💰                        ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
-                safe_print("║ Bidder:          %-40s ║\n", bidder);
-                safe_print("║ Bid Amount:      %12.2f VND                   ║\n", bid_amount);
-                safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
-                safe_print("║ ⏰ Time Left:     %2d seconds (EXTENDED!)             ║\n", time_left);
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-
-            } else if (strncmp(buffer, "NEW_BID|", 8) == 0) {
-                int auction_id, total_bids;
-                char bidder[50];
-                double bid_amount;
-                sscanf(buffer + 8, "%d|%[^|]|%lf|%d", 
-                       &auction_id, bidder, &bid_amount, &total_bids);
-
-                safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║          💰 NEW BID PLACED! 💰                        ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
-                safe_print("║ Bidder:          %-40s ║\n", bidder);
-                safe_print("║ Bid Amount:      %12.2f VND                   ║\n", bid_amount);
-                safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-
-            } else if (strncmp(buffer, "AUCTION_WARNING|", 16) == 0) {
-                int auction_id, time_left;
-                char title[200];
-                double current_price;
-                sscanf(buffer + 16, "%d|%[^|]|%lf|%d", 
-                       &auction_id, title, &current_price, &time_left);
-
-                safe_print("\n");
-                safe_print("╔════════════════════════════════════════════════════════╗\n");
-                safe_print("║                                                        ║\n");
-                safe_print("║      ⏰⏰⏰ URGENT: 30 SECONDS LEFT! ⏰⏰⏰          ║\n");
-                safe_print("║                                                        ║\n");
-                safe_print("╠════════════════════════════════════════════════════════╣\n");
-                safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
-                safe_print("║ Title:           %-38s   ║\n", title);
-                safe_print("║ Current Price:   %12.2f VND                   ║\n", current_price);
-                safe_print("║ Time Left:       %-2d SECONDS! HURRY!                 ║\n", time_left);
+    } else if (strncmp(msg, "NEW_BID_WARNING|", 16) == 0) {
+        int auction_id, total_bids, time_left;
+        char bidder[50];
+        double bid_amount;
+        sscanf(msg + 16, "%d|%[^|]|%lf|%d|%d", 
+               &auction_id, bidder, &bid_amount, &total_bids, &time_left);
+
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║      ⚠️  WARNING: LAST 30 SECONDS! ⚠️                ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║          💰 NEW BID PLACED! 💰                        ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
+        safe_print("║ Bidder:          %-40s ║\n", bidder);
+        safe_print("║ Bid Amount:      %12.2f VND                   ║\n", bid_amount);
+        safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
+        safe_print("║ ⏰ Time Left:     %2d seconds (EXTENDED!)             ║\n", time_left);
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+
+    } else if (strncmp(msg, "NEW_BID|", 8) == 0) {
+        int auction_id, total_bids;
+        char bidder[50];
+        double bid_amount;
+        sscanf(msg + 8, "%d|%[^|]|%lf|%d", 
+               &auction_id, bidder, &bid_amount, &total_bids);
+
+        safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║          💰 NEW BID PLACED! 💰                        ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
+        safe_print("║ Bidder:          %-40s ║\n", bidder);
+        safe_print("║ Bid Amount:      %12.2f VND                   ║\n", bid_amount);
+        safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+
+    } else if (strncmp(msg, "AUCTION_WARNING|", 16) == 0) {
+        int auction_id, time_left;
+        char title[200];
+        double current_price;
+        sscanf(msg + 16, "%d|%[^|]|%lf|%d", 
+               &auction_id, title, &current_price, &time_left);
+
+        safe_print("\n");
+        safe_print("╔════════════════════════════════════════════════════════╗\n");
+        safe_print("║                                                        ║\n");
+        safe_print("║      ⏰⏰⏰ URGENT: 30 SECONDS LEFT! ⏰⏰⏰          ║\n");
+        safe_print("║                                                        ║\n");
+        safe_print("╠════════════════════════════════════════════════════════╣\n");
+        safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
+        safe_print("║ Title:           %-38s   ║\n", title);
+        safe_print("║ Current Price:   %12.2f VND                   ║\n", current_price);
+        safe_print("║ Time Left:       %-2d SECONDS! HURRY!                 ║\n", time_left);
+        safe_print("║                                                        ║\n");
+        safe_print("║          🔥 LAST CHANCE TO BID! 🔥                    ║\n");
+        safe_print("║                                                        ║\n");
+        safe_print("╚════════════════════════════════════════════════════════╝\n");
+        safe_print(">> ");
+
+    } else if (strncmp(msg, "AUCTION_ENDED|", 14) == 0) {
+        int auction_id, total_bids;
+        char title[200], winner_name[50];
+        double final_price;
+        
+        // Parse: AUCTION_ENDED|auction_id|title|winner|price|total_bids
+        if (sscanf(msg + 14, "%d|%[^|]|%[^|]|%lf|%d", 
+                   &auction_id, title, winner_name, &final_price, &total_bids) == 5) {
+            
+            safe_print("\n");
+            safe_print("╔════════════════════════════════════════════════════════╗\n");
+            safe_print("║                                                        ║\n");
+            safe_print("║          🏆🏆🏆 AUCTION ENDED! 🏆🏆🏆              ║\n");
+            safe_print("║                                                        ║\n");
+            safe_print("╠════════════════════════════════════════════════════════╣\n");
+            safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
+            safe_print("║ Title:           %-38s   ║\n", title);
+            safe_print("╠════════════════════════════════════════════════════════╣\n");
+            
+            if (strcmp(winner_name, "No bids") == 0) {
                 safe_print("║                                                        ║\n");
-                safe_print("║          🔥 LAST CHANCE TO BID! 🔥                    ║\n");
+                safe_print("║          ❌ NO WINNER - NO BIDS PLACED ❌            ║\n");
                 safe_print("║                                                        ║\n");
-                safe_print("╚════════════════════════════════════════════════════════╝\n");
-                safe_print(">> ");
-
-            } else if (strncmp(buffer, "AUCTION_ENDED|", 14) == 0) {
-                int auction_id, total_bids;
-                char title[200], winner_name[50];
-                double final_price;
-                
-                // Parse: AUCTION_ENDED|auction_id|title|winner|price|total_bids
-                if (sscanf(buffer + 14, "%d|%[^|]|%[^|]|%lf|%d", 
-                           &auction_id, title, winner_name, &final_price, &total_bids) == 5) {
-                    
-                    safe_print("\n");
-                    safe_print("╔════════════════════════════════════════════════════════╗\n");
+                safe_print("║ Starting Price:  %12.2f VND                   ║\n", final_price);
+            } else {
+                // Check if current user is the winner
+                if (strcmp(winner_name, current_username) == 0) {
                     safe_print("║                                                        ║\n");
-                    safe_print("║          🏆🏆🏆 AUCTION ENDED! 🏆🏆🏆              ║\n");
+                    safe_print("║     🎉🎉🎉 CONGRATULATIONS! YOU WON! 🎉🎉🎉       ║\n");
                     safe_print("║                                                        ║\n");
-                    safe_print("╠════════════════════════════════════════════════════════╣\n");
-                    safe_print("║ Auction ID:      #%-5d                              ║\n", auction_id);
-                    safe_print("║ Title:           %-38s   ║\n", title);
-                    safe_print("╠════════════════════════════════════════════════════════╣\n");
-                    
-                    if (strcmp(winner_name, "No bids") == 0) {
-                        safe_print("║                                                        ║\n");
-                        safe_print("║          ❌ NO WINNER - NO BIDS PLACED ❌            ║\n");
-                        safe_print("║                                                        ║\n");
-                        safe_print("║ Starting Price:  %12.2f VND                   ║\n", final_price);
-                    } else {
-                        // Check if current user is the winner
-                        if (strcmp(winner_name, current_username) == 0) {
-                            safe_print("║                                                        ║\n");
-                            safe_print("║     🎉🎉🎉 CONGRATULATIONS! YOU WON! 🎉🎉🎉       ║\n");
-                            safe_print("║                                                        ║\n");
-                        } else {
-                            safe_print("║                                                        ║\n");
-                            safe_print("║               🏆 WINNER ANNOUNCED! 🏆                 ║\n");
-                            safe_print("║                                                        ║\n");
-                        }
-                        safe_print("║ Winner:          %-38s   ║\n", winner_name);
-                        safe_print("║ Final Price:     %12.2f VND                   ║\n", final_price);
-                        safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
-                    }
-                    
-                    safe_print("╚════════════════════════════════════════════════════════╝\n");
                 } else {
-                    // Fallback for old format
-                    safe_print("\n╔════════════════════════════════════════════════════════╗\n");
-                    safe_print("║          🏁 AUCTION ENDED! 🏁                         ║\n");
-                    safe_print("╚════════════════════════════════════════════════════════╝\n");
+                    safe_print("║                                                        ║\n");
+                    safe_print("║               🏆 WINNER ANNOUNCED! 🏆                 ║\n");
+                    safe_print("║                                                        ║\n");
                 }
-                safe_print(">> ");
+                safe_print("║ Winner:          %-38s   ║\n", winner_name);
+                safe_print("║ Final Price:     %12.2f VND                   ║\n", final_price);
+                safe_print("║ Total Bids:      %-5d                                ║\n", total_bids);
             }
+            
+            safe_print("╚════════════════════════════════════════════════════════╝\n");
+        } else {
+            // Fallback for old format
+            safe_print("\n╔════════════════════════════════════════════════════════╗\n");
+            safe_print("║          🏁 AUCTION ENDED! 🏁                         ║\n");
+            safe_print("╚════════════════════════════════════════════════════════╝\n");
         }
+        safe_print(">> ");
     }
 
+    return 0;
+}
+
+static char rx_pending[RX_PENDING_SIZE];
+static int rx_pending_len = 0;
+
+// Forget a partial line left over from a dropped connection
+void rx_reset() {
+    pthread_mutex_lock(&live_mutex);
+    rx_pending_len = 0;
+    pthread_mutex_unlock(&live_mutex);
+}
+
+// Queue a pushed line for the event thread; the reader never blocks on
+// the terminal
+static void event_push(const char *line) {
+    size_t len = strlen(line);
+    EventNode *node = malloc(sizeof(EventNode) + len + 1);
+    if (node == NULL) {
+        return;
+    }
+    node->next = NULL;
+    memcpy(node->line, line, len + 1);
+
+    pthread_mutex_lock(&event_mutex);
+    if (event_count >= EVENT_QUEUE_MAX) {
+        pthread_mutex_unlock(&event_mutex);
+        free(node);
+        return;
+    }
+    if (event_tail != NULL) {
+        event_tail->next = node;
+    } else {
+        event_head = node;
+    }
+    event_tail = node;
+    event_count++;
+    pthread_cond_signal(&event_cond);
+    pthread_mutex_unlock(&event_mutex);
+}
+
+// Feed raw bytes from the socket. A tagged line goes to the request
+// waiting for it; the rest go to the replica or the event queue. A partial
+// line waits for the next read.
+void dispatch_incoming(const char *data, int len) {
+    pthread_mutex_lock(&live_mutex);
+
+    if (rx_pending_len + len >= RX_PENDING_SIZE) {
+        // Line longer than we can hold: drop it and resync
+        rx_pending_len = 0;
+        live_synced = 0;
+        live_need_snapshot = 1;
+        pthread_mutex_unlock(&live_mutex);
+        return;
+    }
+    memcpy(rx_pending + rx_pending_len, data, len);
+    rx_pending_len += len;
+    rx_pending[rx_pending_len] = '\0';
+
+    char *line = rx_pending;
+    char *nl;
+    while ((nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        if (line[0] == '@') {
+            char *body;
+            uint32_t id = strtoul(line + 1, &body, 10);
+            if (*body == ' ') {
+                body++;
+            }
+            // A reply whose requester gave up is handled like a push
+            if (pending_complete(id, body)) {
+                line = nl + 1;
+                continue;
+            }
+            line = body;
+        }
+
+        if (strncmp(line, "SNAPSHOT|ROOM|", 14) == 0) {
+            live_apply_snapshot(line + 14);
+        } else if (strncmp(line, "DELTA|ROOM|", 11) == 0) {
+            live_apply_delta(line + 11);
+        } else if (strncmp(line, "SUBSCRIBE_FAIL|", 15) == 0) {
+            live_failed = 1;
+        } else if (!live_active) {
+            // The live view redraws the whole screen; no pop-ups over it
+            event_push(line);
+        }
+        line = nl + 1;
+    }
+
+    rx_pending_len -= line - rx_pending;
+    memmove(rx_pending, line, rx_pending_len);
+    pthread_mutex_unlock(&live_mutex);
+}
+
+// The only thread that reads the socket. Runs once per connection and
+// exits when the connection drops.
+void* socket_reader(void *arg) {
+    static char buffer[RX_PENDING_SIZE];     // a BIN1 snapshot arrives as one frame
+
+    while (running) {
+        int bytes = recv_message(buffer, sizeof(buffer));
+        if (bytes <= 0) {
+            if (bytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if (!connection_lost) {
+                safe_print("\n[ERROR] Connection lost to server!\n");
+            }
+            connection_dropped();
+            break;
+        }
+
+        buffer[bytes] = '\0';
+        dispatch_incoming(buffer, bytes);
+    }
+
+    reader_running = 0;
     return NULL;
 }
 
+// Shows pushed notifications in arrival order
+void* event_thread(void *arg) {
+    while (running) {
+        pthread_mutex_lock(&event_mutex);
+        while (event_head == NULL && running) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+            pthread_cond_timedwait(&event_cond, &event_mutex, &deadline);
+        }
+        EventNode *node = event_head;
+        if (node != NULL) {
+            event_head = node->next;
+            if (event_head == NULL) {
+                event_tail = NULL;
+            }
+            event_count--;
+        }
+        pthread_mutex_unlock(&event_mutex);
+
+        if (node == NULL) {
+            continue;
+        }
+        int rc = handle_notification(node->line);
+        free(node);
+        if (rc < 0) {
+            running = 0;
+            wake_waiters();
+        }
+    }
+    return NULL;
+}
+
+static int start_thread(void *(*fn)(void *)) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, fn, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int start_reader() {
+    reader_running = 1;
+    if (start_thread(socket_reader) != 0) {
+        reader_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+int start_event_thread() {
+    return start_thread(event_thread);
+}
+
+// =====================================================
+// SESSION RESUME
+// =====================================================
+
+// Reconnect and continue the same session: still logged in, still in the
+// room, and an open live view catches up from the server's replay instead
+// of reloading everything. If the session has expired the user is logged
+// out on the new connection. Returns 0 only if the server is unreachable.
+int resume_session() {
+    // Wake the reader if the old socket is only half dead
+    shutdown(client_socket, SHUT_RDWR);
+    for (int i = 0; i < 30 && reader_running; i++) {
+        usleep(100000);
+    }
+
+    close(client_socket);
+    rx_reset();
+    use_binary = 0;
+
+    int connected = 0;
+    for (int attempt = 1; attempt <= RESUME_ATTEMPTS && !connected; attempt++) {
+        printf("\n[INFO] Reconnecting to server (attempt %d/%d)...\n", attempt, RESUME_ATTEMPTS);
+        connected = connect_to_server() == 0;
+        if (!connected) {
+            sleep(attempt);
+        }
+    }
+    if (!connected) {
+        printf("[ERROR] Could not reach the server.\n");
+        running = 0;
+        return 0;
+    }
+    if (want_binary) {
+        negotiate_binary();
+    }
+    connection_lost = 0;
+    start_reader();
+
+    pthread_mutex_lock(&live_mutex);
+    unsigned long last_seq = live_active && live_synced ? live_seq : 0;
+    pthread_mutex_unlock(&live_mutex);
+
+    char request[128];
+    snprintf(request, sizeof(request), "RESUME|%s|%lu\n", resume_token, last_seq);
+    send_request(request);
+
+    char response[BUFFER_SIZE];
+    if (receive_response(response, BUFFER_SIZE) <= 0) {
+        running = 0;
+        return 0;
+    }
+
+    int room_id;
+    if (sscanf(response, "RESUME_SUCCESS|%d|%49[^|]|%lf|%d|%63[^|\n]", &current_user_id,
+               current_username, &current_balance, &room_id, resume_token) == 5) {
+        if (room_id != current_room_id) {
+            current_room_id = room_id;
+            strcpy(current_room_name, room_id > 0 ? "?" : "None");
+        }
+        printf("[SUCCESS] Session resumed.\n");
+        return 1;
+    }
+
+    printf("[WARNING] Session expired, please log in again.\n");
+    logged_in = 0;
+    current_user_id = 0;
+    current_room_id = 0;
+    memset(current_username, 0, sizeof(current_username));
+    strcpy(current_room_name, "None");
+    current_balance = 0.0;
+    resume_token[0] = '\0';
+    sleep(1);
+    return 1;
+}
+
 // =====================================================
 // MENU FUNCTIONS
 // =====================================================
@@ -472,22 +1181,33 @@ void create_room() {
 
 void list_rooms() {
     print_header("AVAILABLE ROOMS");
+    getchar();  // newline left by the menu choice
 
-    send_request("LIST_ROOMS|\n");
+    char request[256];
+    int cursor = 0;
+    int count = 0;
 
-    char response[BUFFER_SIZE * 4];
-    receive_response(response, BUFFER_SIZE * 4);
+    printf("\n%-5s %-25s %-12s %-12s %-10s %-10s %s\n",
+           "ID", "Name", "Participants", "Max", "Status", "Time Left", "Auctions");
+    print_separator();
+
+    do {
+        sprintf(request, "LIST_ROOMS|%d|%d\n", cursor, PAGE_SIZE);
+        send_request(request);
+
+        char response[BUFFER_SIZE * 4];
+        if (receive_response(response, BUFFER_SIZE * 4) <= 0 ||
+            strncmp(response, "ROOM_LIST|", 10) != 0) {
+            break;
+        }
 
-    if (strncmp(response, "ROOM_LIST|", 10) == 0) {
         char *data = response + 10;
         char *token = strtok(data, "|");
-
-        int count = 0;
-        printf("\n%-5s %-25s %-12s %-12s %-10s %-10s %s\n",
-               "ID", "Name", "Participants", "Max", "Status", "Time Left", "Auctions");
-        print_separator();
+        cursor = 0;
 
         while (token != NULL) {
+            if (parse_page_end(token, &cursor)) break;
+
             int id, current_part, max_part, time_left, total_auctions;
             char name[100], desc[200], status[20];
 
@@ -506,17 +1226,16 @@ void list_rooms() {
 
             token = strtok(NULL, "|");
         }
+    } while (cursor > 0 && prompt_next_page());
 
-        if (count == 0) {
-            printf("No rooms available.\n");
-        } else {
-            printf("\nTotal: %d room(s)\n", count);
-        }
+    if (count == 0) {
+        printf("No rooms available.\n");
+    } else {
+        printf("\nShown: %d room(s)\n", count);
     }
 
     printf("\nPress Enter to continue...");
     getchar();
-    getchar();
 }
 
 void join_room() {
@@ -838,23 +1557,15 @@ void login_user() {
     printf("[INFO] Received response: %.50s...\n", response);
 
     if (strncmp(response, "LOGIN_SUCCESS", 13) == 0) {
-        if (sscanf(response, "LOGIN_SUCCESS|%d|%[^|]|%lf",
-               &current_user_id, current_username, &current_balance) == 3) {
+        resume_token[0] = '\0';
+        if (sscanf(response, "LOGIN_SUCCESS|%d|%[^|]|%lf|%63[^|\n]",
+               &current_user_id, current_username, &current_balance, resume_token) >= 3) {
 
             logged_in = 1;
 
             printf("\n[SUCCESS] Login successful!\n");
             printf("Welcome, %s! Your balance: %.2f VND\n",
                    current_username, current_balance);
-
-            // Start notification listener
-            pthread_t listener_thread;
-            if (pthread_create(&listener_thread, NULL, notification_listener, NULL) == 0) {
-                pthread_detach(listener_thread);
-                printf("[INFO] Notification listener started\n");
-            } else {
-                printf("[WARNING] Failed to start notification listener\n");
-            }
         } else {
             printf("\n[ERROR] Failed to parse login response!\n");
         }
@@ -889,80 +1600,75 @@ void view_live_auctions() {
         getchar();
         return;
     }
+    getchar();
 
-    printf("\n🔴 LIVE VIEW - Press Ctrl+C to exit\n\n");
-    
-    // Store auction data
-    typedef struct {
-        int id;
-        char title[200];
-        double current_price;
-        double buy_now_price;
-        int time_left;
-        int total_bids;
-    } AuctionDisplay;
-    
-    AuctionDisplay auctions[100];
-    int auction_count = 0;
-
-    while (1) {
-        // Fetch fresh data
-        char request[256];
-        sprintf(request, "LIST_AUCTIONS|%d\n", current_user_id);
-        send_request(request);
+    // One snapshot, then the listener applies pushed deltas to the replica;
+    // the countdown itself is computed locally every second
+    char request[64];
+    sprintf(request, "SUBSCRIBE_ROOM|%d\n", current_room_id);
+    live_reset();
+    live_active = 1;
+    send_oneway(request);
 
-        char response[BUFFER_SIZE * 4];
-        int bytes = receive_response(response, BUFFER_SIZE * 4);
-        
-        if (bytes <= 0) break;
-
-        auction_count = 0;
-        if (strncmp(response, "AUCTION_LIST|", 13) == 0) {
-            char *data = response + 13;
-            char *token = strtok(data, "|");
-
-            while (token != NULL && auction_count < 100) {
-                if (sscanf(token, "%d;%[^;];%lf;%lf;%d;%d",
-                          &auctions[auction_count].id,
-                          auctions[auction_count].title,
-                          &auctions[auction_count].current_price,
-                          &auctions[auction_count].buy_now_price,
-                          &auctions[auction_count].time_left,
-                          &auctions[auction_count].total_bids) == 6) {
-                    auction_count++;
-                }
-                token = strtok(NULL, "|");
+    while (running) {
+        // After a reconnect the server replays what the replica missed;
+        // a view that had no snapshot yet just subscribes again
+        if (connection_lost) {
+            if (!resume_session() || !logged_in) {
+                break;
             }
+            pthread_mutex_lock(&live_mutex);
+            live_need_snapshot |= !live_synced;
+            pthread_mutex_unlock(&live_mutex);
+        }
+
+        pthread_mutex_lock(&live_mutex);
+        int failed = live_failed;
+        int resubscribe = live_need_snapshot;
+        live_need_snapshot = 0;
+        pthread_mutex_unlock(&live_mutex);
+
+        if (failed) {
+            printf("\n[ERROR] Could not subscribe to this room.\n");
+            break;
+        }
+        if (resubscribe) {
+            send_oneway(request);
         }
 
-        // Clear screen and display
+        pthread_mutex_lock(&live_mutex);
+        long now = (long)time(NULL) + live_clock_offset;
+
+        pthread_mutex_lock(&print_mutex);
         printf("\033[2J\033[H"); // Clear screen
         printf("╔════════════════════════════════════════════════════════╗\n");
         printf("║          🔴 LIVE AUCTIONS - COUNTDOWN VIEW 🔴         ║\n");
         printf("╚════════════════════════════════════════════════════════╝\n\n");
 
-        if (auction_count == 0) {
+        if (!live_synced) {
+            printf("Loading...\n");
+        } else if (live_count == 0) {
             printf("No active auctions in this room.\n");
-            sleep(2);
-            break;
         }
 
-        for (int i = 0; i < auction_count; i++) {
-            int hours = auctions[i].time_left / 3600;
-            int minutes = (auctions[i].time_left % 3600) / 60;
-            int seconds = auctions[i].time_left % 60;
-            
+        for (int i = 0; live_synced && i < live_count; i++) {
+            LiveAuction *a = &live_auctions[i];
+            int time_left = a->end_time > now ? (int)(a->end_time - now) : 0;
+            int hours = time_left / 3600;
+            int minutes = (time_left % 3600) / 60;
+            int seconds = time_left % 60;
+
             printf("┌────────────────────────────────────────────────────────┐\n");
-            printf("│ #%-3d %-48s │\n", auctions[i].id, auctions[i].title);
+            printf("│ #%-3d %-48s │\n", a->id, a->title);
             printf("├────────────────────────────────────────────────────────┤\n");
             printf("│ Price: %12.2f VND | Bids: %-3d                 │\n",
-                   auctions[i].current_price, auctions[i].total_bids);
-            
+                   a->current_price, a->total_bids);
+
             // Color-coded countdown
-            if (auctions[i].time_left <= 30) {
+            if (time_left <= 30) {
                 printf("│ ⚠️  TIME: %02d:%02d:%02d ⚠️  ENDING SOON!                  │\n",
                        hours, minutes, seconds);
-            } else if (auctions[i].time_left <= 300) {
+            } else if (time_left <= 300) {
                 printf("│ ⏰ TIME: %02d:%02d:%02d - HURRY UP!                       │\n",
                        hours, minutes, seconds);
             } else {
@@ -972,13 +1678,24 @@ void view_live_auctions() {
             printf("└────────────────────────────────────────────────────────┘\n\n");
         }
 
-        printf("Press Ctrl+C to return to menu...\n");
-        
-        sleep(3); // Update every 3 seconds
+        printf("Press Enter to return to menu...\n");
+        fflush(stdout);
+        pthread_mutex_unlock(&print_mutex);
+        pthread_mutex_unlock(&live_mutex);
+
+        fd_set read_fds;
+        struct timeval tv = {1, 0};
+        FD_ZERO(&read_fds);
+        FD_SET(STDIN_FILENO, &read_fds);
+        if (select(STDIN_FILENO + 1, &read_fds, NULL, NULL, &tv) > 0) {
+            char line[16];
+            fgets(line, sizeof(line), stdin);
+            break;
+        }
     }
 
-    printf("\nPress Enter to continue...");
-    getchar();
+    live_active = 0;
+    send_oneway("UNSUBSCRIBE|ROOM\n");
 }
 
 void list_auctions() {
@@ -1047,24 +1764,33 @@ void list_auctions() {
 
 void view_my_auctions() {
     print_header("MY AUCTIONS");
+    getchar();  // newline left by the menu choice
 
     char request[256];
-    sprintf(request, "MY_AUCTIONS|%d\n", current_user_id);
-    send_request(request);
+    int cursor = 0;
+    int count = 0;
 
-    char response[BUFFER_SIZE * 4];
-    receive_response(response, BUFFER_SIZE * 4);
+    printf("\n%-5s %-30s %-15s %-15s %-12s %-10s %s\n",
+           "ID", "Title", "Current Price", "Buy Now", "Time Left", "Status", "Bids");
+    print_separator();
+
+    do {
+        sprintf(request, "MY_AUCTIONS|%d|%d|%d\n", current_user_id, cursor, PAGE_SIZE);
+        send_request(request);
+
+        char response[BUFFER_SIZE * 4];
+        if (receive_response(response, BUFFER_SIZE * 4) <= 0 ||
+            strncmp(response, "MY_AUCTIONS|", 12) != 0) {
+            break;
+        }
 
-    if (strncmp(response, "MY_AUCTIONS|", 12) == 0) {
         char *data = response + 12;
         char *token = strtok(data, "|");
-
-        int count = 0;
-        printf("\n%-5s %-30s %-15s %-15s %-12s %-10s %s\n",
-               "ID", "Title", "Current Price", "Buy Now", "Time Left", "Status", "Bids");
-        print_separator();
+        cursor = 0;
 
         while (token != NULL) {
+            if (parse_page_end(token, &cursor)) break;
+
             int id, time_left, total_bids;
             char title[200], status[20];
             double current_price, buy_now_price;
@@ -1084,17 +1810,16 @@ void view_my_auctions() {
 
             token = strtok(NULL, "|");
         }
+    } while (cursor > 0 && prompt_next_page());
 
-        if (count == 0) {
-            printf("You have no auctions.\n");
-        } else {
-            printf("\nTotal: %d auction(s)\n", count);
-        }
+    if (count == 0) {
+        printf("You have no auctions.\n");
+    } else {
+        printf("\nShown: %d auction(s)\n", count);
     }
 
     printf("\nPress Enter to continue...");
     getchar();
-    getchar();
 }
 
 void view_auction_detail() {
@@ -1239,10 +1964,8 @@ void place_bid() {
     sprintf(request, "PLACE_BID|%d|%d|%.2f\n",
             auction_id, current_user_id, bid_amount);
 
-    send_request(request);
-
     char response[BUFFER_SIZE];
-    receive_response(response, BUFFER_SIZE);
+    request_idempotent(request, response, BUFFER_SIZE);
 
     if (strncmp(response, "BID_SUCCESS", 11) == 0) {
         int aid, total_bids, time_left;
@@ -1310,10 +2033,8 @@ void buy_now() {
     char request[256];
     sprintf(request, "BUY_NOW|%d|%d\n", auction_id, current_user_id);
 
-    send_request(request);
-
     char response[BUFFER_SIZE];
-    receive_response(response, BUFFER_SIZE);
+    request_idempotent(request, response, BUFFER_SIZE);
 
     if (strncmp(response, "BUY_NOW_SUCCESS", 15) == 0) {
         int aid;
@@ -1498,24 +2219,33 @@ void view_bid_history() {
 
 void view_auction_history() {
     print_header("AUCTION HISTORY (COMPLETED AUCTIONS)");
+    getchar();  // newline left by the menu choice
 
     char request[256];
-    sprintf(request, "AUCTION_HISTORY|%d\n", current_user_id);
-    send_request(request);
+    int cursor = 0;
+    int count = 0;
 
-    char response[BUFFER_SIZE * 4];
-    receive_response(response, BUFFER_SIZE * 4);
+    printf("\n%-5s %-35s %-15s %-20s %s\n",
+           "ID", "Title", "Final Price", "Winner", "Method");
+    print_separator();
+
+    do {
+        sprintf(request, "AUCTION_HISTORY|%d|%d|%d\n", current_user_id, cursor, PAGE_SIZE);
+        send_request(request);
+
+        char response[BUFFER_SIZE * 4];
+        if (receive_response(response, BUFFER_SIZE * 4) <= 0 ||
+            strncmp(response, "AUCTION_HISTORY|", 16) != 0) {
+            break;
+        }
 
-    if (strncmp(response, "AUCTION_HISTORY|", 16) == 0) {
         char *data = response + 16;
         char *token = strtok(data, "|");
-
-        int count = 0;
-        printf("\n%-5s %-35s %-15s %-20s %s\n",
-               "ID", "Title", "Final Price", "Winner", "Method");
-        print_separator();
+        cursor = 0;
 
         while (token != NULL) {
+            if (parse_page_end(token, &cursor)) break;
+
             int id;
             char title[200], winner[50], method[20];
             double final_price;
@@ -1539,57 +2269,55 @@ void view_auction_history() {
 
             token = strtok(NULL, "|");
         }
+    } while (cursor > 0 && prompt_next_page());
 
-        if (count == 0) {
-            printf("No completed auctions found.\n");
-        } else {
-            printf("\nTotal: %d completed auction(s)\n", count);
-        }
+    if (count == 0) {
+        printf("No completed auctions found.\n");
+    } else {
+        printf("\nShown: %d completed auction(s)\n", count);
     }
 
     printf("\nPress Enter to continue...");
     getchar();
-    getchar();
 }
 
 // =====================================================
 // MAIN FUNCTION
 // =====================================================
 
-int main() {
-    struct sockaddr_in server_addr;
-
-    // Create socket
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_socket < 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Setup server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
-        perror("Invalid address");
-        exit(EXIT_FAILURE);
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--binary") == 0) {
+            want_binary = 1;
+        } else {
+            printf("Usage: %s [--binary]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
     }
 
     // Connect to server
     printf("Connecting to server %s:%d...\n", SERVER_IP, SERVER_PORT);
 
-    if (connect(client_socket, (struct sockaddr*)&server_addr,
-                sizeof(server_addr)) < 0) {
+    if (connect_to_server() < 0) {
         perror("Connection failed");
         exit(EXIT_FAILURE);
     }
 
     printf("Connected successfully!\n");
+    if (want_binary) {
+        negotiate_binary();
+    }
+    if (start_reader() != 0 || start_event_thread() != 0) {
+        printf("[ERROR] Failed to start the reader thread\n");
+        exit(EXIT_FAILURE);
+    }
     sleep(1);
 
     // Main loop
     while (running) {
+        if (connection_lost && !resume_session()) {
+            break;
+        }
         clear_screen();
 
         if (!logged_in) {
@@ -1673,7 +2401,7 @@ int main() {
                     if (current_room_id > 0) {
                         char request[256];
                         sprintf(request, "LEAVE_ROOM|%d\n", current_user_id);
-                        send_request(request);
+                        send_oneway(request);
                     }
                     
                     logged_in = 0;
@@ -1693,7 +2421,7 @@ int main() {
     }
 
     // Cleanup
-    send_request("QUIT|\n");
+    send_oneway("QUIT|\n");
     close(client_socket);
 
     return 0;
@@ -0,0 +1,55 @@
+/*
+ * =====================================================
+ * CLOCK.H - INJECTABLE TIME SOURCE
+ * =====================================================
+ * Every timestamp and deadline the engine and server set comes from a
+ * Clock instead of time(NULL), so auction timing can be driven by hand:
+ *
+ *   real     the system clock
+ *   manual   stands still until clock_set_ms/clock_advance_ms (tests, replay)
+ *   scaled   starts at a given time and runs `speed` times faster than real
+ *            time (server --clock-speed)
+ *
+ * clock_now() is the cheap, coarse (kernel tick) one for hot paths;
+ * clock_now_ms() is precise to the millisecond. clock_mono_ms() is real
+ * monotonic time for intervals and latencies and ignores the Clock.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    CLOCK_MODE_REAL,
+    CLOCK_MODE_MANUAL,
+    CLOCK_MODE_SCALED
+} ClockMode;
+
+typedef struct {
+    ClockMode mode;
+    int64_t now_ms;             // manual: current time; scaled: time at base_mono_ms
+    int64_t base_mono_ms;       // scaled: clock_mono_ms() when started
+    double speed;               // scaled: clock ms per real ms
+} Clock;
+
+void clock_init_real(Clock *c);
+void clock_init_manual(Clock *c, int64_t start_ms);
+void clock_init_scaled(Clock *c, int64_t start_ms, double speed);
+
+// Epoch time in milliseconds / seconds
+int64_t clock_now_ms(const Clock *c);
+time_t clock_now(const Clock *c);
+
+// Manual clocks only; safe while other threads read the clock
+void clock_set_ms(Clock *c, int64_t ms);
+void clock_advance_ms(Clock *c, int64_t ms);
+
+// Sleep for ms of clock time (shorter on a fast scaled clock)
+void clock_sleep_ms(const Clock *c, int64_t ms);
+
+int64_t clock_mono_ms(void);
+int64_t clock_wall_ms(void);
+
+#endif
@@ -0,0 +1,436 @@
+/*
+ * =====================================================
+ * IO_BACKEND.C - BATCHED WRITE BACKEND (IO_URING / POSIX)
+ * =====================================================
+ * io_uring is driven through the raw syscalls so the server does not
+ * depend on liburing. The backend is probed once at startup; when the
+ * kernel does not support it (or it is disabled) every ring falls back
+ * to plain pwrite()/send() calls.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "io_backend.h"
+
+#define IO_RING_ENTRIES 256
+
+typedef struct {
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+    int has_fixed_buffers;
+    struct msghdr *msgs;        // per-slot sendmsg headers for vectored socket writes
+    pthread_mutex_t lock;
+} IoRing;
+
+// Written under a ring's lock on fallback, read by every submitter:
+// always through backend_get / backend_set
+static IoBackendKind g_backend = IO_BACKEND_POSIX;
+static IoRing g_rings[IO_RING_COUNT];
+
+static IoBackendKind backend_get(void) {
+    return __atomic_load_n(&g_backend, __ATOMIC_ACQUIRE);
+}
+
+static void backend_set(IoBackendKind kind) {
+    __atomic_store_n(&g_backend, kind, __ATOMIC_RELEASE);
+}
+
+// =====================================================
+// RAW IO_URING SYSCALLS
+// =====================================================
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// =====================================================
+// RING SETUP
+// =====================================================
+
+static void ring_unmap(IoRing *r) {
+    if (r->sqes != NULL) munmap(r->sqes, r->sqes_size);
+    if (r->cq_ptr != NULL && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+    if (r->sq_ptr != NULL) munmap(r->sq_ptr, r->sq_size);
+    if (r->fd >= 0) close(r->fd);
+    free(r->msgs);
+    r->sqes = NULL;
+    r->cq_ptr = NULL;
+    r->sq_ptr = NULL;
+    r->msgs = NULL;
+    r->fd = -1;
+}
+
+static int ring_setup(IoRing *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    r->fd = sys_io_uring_setup(entries, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        ring_unmap(r);
+        return -1;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            r->cq_ptr = NULL;
+            ring_unmap(r);
+            return -1;
+        }
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        ring_unmap(r);
+        return -1;
+    }
+
+    char *sq = r->sq_ptr;
+    char *cq = r->cq_ptr;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+
+    r->msgs = calloc(p.sq_entries, sizeof(struct msghdr));
+    if (r->msgs == NULL) {
+        ring_unmap(r);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Make sure the kernel knows every opcode we are going to submit
+static int ring_supports_ops(IoRing *r) {
+    static const int needed[] = {
+        IORING_OP_WRITE, IORING_OP_WRITEV, IORING_OP_WRITE_FIXED,
+        IORING_OP_SEND, IORING_OP_SENDMSG
+    };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe == NULL) return 0;
+
+    int ok = sys_io_uring_register(r->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(needed) / sizeof(needed[0]); i++) {
+        if (needed[i] > probe->last_op ||
+            !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ok = 0;
+        }
+    }
+
+    free(probe);
+    return ok;
+}
+
+int io_backend_init(const char *mode) {
+    for (int i = 0; i < IO_RING_COUNT; i++) {
+        memset(&g_rings[i], 0, sizeof(IoRing));
+        g_rings[i].fd = -1;
+        pthread_mutex_init(&g_rings[i].lock, NULL);
+    }
+
+    backend_set(IO_BACKEND_POSIX);
+    if (mode != NULL && strcmp(mode, "posix") == 0) {
+        printf("[INFO] I/O backend: posix (forced)\n");
+        return 0;
+    }
+
+    int ok = 1;
+    for (int i = 0; i < IO_RING_COUNT && ok; i++) {
+        if (ring_setup(&g_rings[i], IO_RING_ENTRIES) != 0 || !ring_supports_ops(&g_rings[i])) {
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        int err = errno;
+        for (int i = 0; i < IO_RING_COUNT; i++) ring_unmap(&g_rings[i]);
+        if (mode != NULL && strcmp(mode, "uring") == 0) {
+            printf("[ERROR] io_uring requested but unavailable: %s\n", strerror(err));
+            return -1;
+        }
+        printf("[INFO] I/O backend: posix (io_uring unavailable)\n");
+        return 0;
+    }
+
+    backend_set(IO_BACKEND_URING);
+    printf("[INFO] I/O backend: io_uring (%u entries per ring)\n", g_rings[0].sq_entries);
+    return 0;
+}
+
+void io_backend_shutdown(void) {
+    // First, so a submitter that takes a ring lock after us sees posix
+    backend_set(IO_BACKEND_POSIX);
+    for (int i = 0; i < IO_RING_COUNT; i++) {
+        pthread_mutex_lock(&g_rings[i].lock);
+        ring_unmap(&g_rings[i]);
+        pthread_mutex_unlock(&g_rings[i].lock);
+    }
+}
+
+IoBackendKind io_backend_kind(void) {
+    return backend_get();
+}
+
+const char* io_backend_name(void) {
+    return backend_get() == IO_BACKEND_URING ? "io_uring" : "posix";
+}
+
+int io_backend_register_buffers(IoRingId ring, const struct iovec *bufs, int count) {
+    if (backend_get() != IO_BACKEND_URING) {
+        return -1;
+    }
+
+    IoRing *r = &g_rings[ring];
+    pthread_mutex_lock(&r->lock);
+    if (r->fd < 0) {
+        pthread_mutex_unlock(&r->lock);
+        return -1;
+    }
+    if (r->has_fixed_buffers) {
+        sys_io_uring_register(r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        r->has_fixed_buffers = 0;
+    }
+    int rc = sys_io_uring_register(r->fd, IORING_REGISTER_BUFFERS, bufs, count);
+    if (rc == 0) {
+        r->has_fixed_buffers = 1;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return rc == 0 ? 0 : -1;
+}
+
+// =====================================================
+// SUBMISSION
+// =====================================================
+
+static ssize_t posix_write_one(IoWrite *op) {
+    ssize_t n;
+    if (op->offset >= 0) {
+        if (op->iov != NULL) {
+            n = pwritev(op->fd, op->iov, op->iovcnt, op->offset);
+        } else {
+            n = pwrite(op->fd, op->buf, op->len, op->offset);
+        }
+    } else {
+        if (op->iov != NULL) {
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = (struct iovec*)op->iov;
+            msg.msg_iovlen = op->iovcnt;
+            n = sendmsg(op->fd, &msg, MSG_NOSIGNAL | op->send_flags);
+        } else {
+            n = send(op->fd, op->buf, op->len, MSG_NOSIGNAL | op->send_flags);
+        }
+    }
+    return n < 0 ? -errno : n;
+}
+
+static void ring_prep(IoRing *r, struct io_uring_sqe *sqe, unsigned slot, IoWrite *op, unsigned idx) {
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->fd;
+    sqe->user_data = idx;
+
+    if (op->offset < 0) {
+        if (op->iov != NULL) {
+            struct msghdr *msg = &r->msgs[slot];
+            memset(msg, 0, sizeof(*msg));
+            msg->msg_iov = (struct iovec*)op->iov;
+            msg->msg_iovlen = op->iovcnt;
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = (unsigned long)msg;
+            sqe->len = 1;
+        } else {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = (unsigned long)op->buf;
+            sqe->len = op->len;
+        }
+        sqe->msg_flags = MSG_NOSIGNAL | op->send_flags;
+        return;
+    }
+
+    sqe->off = op->offset;
+    if (op->iov != NULL) {
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->addr = (unsigned long)op->iov;
+        sqe->len = op->iovcnt;
+    } else if (op->buf_index >= 0 && r->has_fixed_buffers) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->addr = (unsigned long)op->buf;
+        sqe->len = op->len;
+        sqe->buf_index = op->buf_index;
+    } else {
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->addr = (unsigned long)op->buf;
+        sqe->len = op->len;
+    }
+}
+
+static int ring_reap(IoRing *r, IoWrite *ops, int base) {
+    int reaped = 0;
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        ops[base + cqe->user_data].result = cqe->res;
+        head++;
+        reaped++;
+    }
+
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+// After a failed io_uring_enter: wait out the writes the kernel already
+// took, since it may still read their buffers, and drop the SQEs it did
+// not take so a later enter cannot pick them up. Those keep -EIO.
+static void ring_drain(IoRing *r, IoWrite *ops, int base, int in_flight) {
+    int err = errno;
+
+    while (in_flight > 0) {
+        if (sys_io_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            sched_yield();
+        }
+        in_flight -= ring_reap(r, ops, base);
+    }
+    __atomic_store_n(r->sq_tail, __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+
+    errno = err;
+}
+
+// Submit one chunk (at most sq_entries writes) and wait for all of it
+static int ring_submit_chunk(IoRing *r, IoWrite *ops, int base, int count) {
+    unsigned tail = *r->sq_tail;
+    unsigned mask = *r->sq_mask;
+
+    for (int i = 0; i < count; i++) {
+        unsigned slot = tail & mask;
+        ops[base + i].result = -EIO;
+        ring_prep(r, &r->sqes[slot], slot, &ops[base + i], i);
+        r->sq_array[slot] = slot;
+        tail++;
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submitted = 0;
+    int completed = 0;
+    while (completed < count) {
+        unsigned to_submit = count - submitted;
+        int rc = sys_io_uring_enter(r->fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                completed += ring_reap(r, ops, base);
+                continue;
+            }
+            ring_drain(r, ops, base, submitted - completed);
+            return -1;
+        }
+        submitted += rc;
+        completed += ring_reap(r, ops, base);
+    }
+
+    return 0;
+}
+
+int io_submit_writes(IoRingId ring, IoWrite *ops, int count) {
+    int failed = 0;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    if (backend_get() != IO_BACKEND_URING) {
+        for (int i = 0; i < count; i++) {
+            ops[i].result = posix_write_one(&ops[i]);
+            if (ops[i].result < 0) failed++;
+        }
+        return failed;
+    }
+
+    IoRing *r = &g_rings[ring];
+    pthread_mutex_lock(&r->lock);
+
+    int base = 0;
+    while (base < count && backend_get() == IO_BACKEND_URING) {
+        int chunk = count - base;
+        if (chunk > (int)r->sq_entries) chunk = r->sq_entries;
+
+        if (ring_submit_chunk(r, ops, base, chunk) != 0) {
+            // Writes the ring never completed are reported as -EIO, never resent
+            printf("[WARNING] io_uring submission failed (%s), switching to posix\n",
+                   strerror(errno));
+            backend_set(IO_BACKEND_POSIX);
+        }
+        base += chunk;
+    }
+
+    pthread_mutex_unlock(&r->lock);
+
+    for (int i = base; i < count; i++) {
+        ops[i].result = posix_write_one(&ops[i]);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ops[i].result < 0) failed++;
+    }
+    return failed;
+}
@@ -0,0 +1,53 @@
+/*
+ * =====================================================
+ * IO_BACKEND.H - BATCHED WRITE BACKEND (IO_URING / POSIX)
+ * =====================================================
+ * Submits a batch of writes (data files or client sockets) in one go.
+ * With io_uring the whole batch costs a single io_uring_enter(); the
+ * POSIX fallback issues one pwrite()/send() per entry.
+ */
+
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+typedef enum {
+    IO_BACKEND_POSIX = 0,
+    IO_BACKEND_URING = 1
+} IoBackendKind;
+
+// Each ring has its own lock so disk commits never wait behind socket sends
+typedef enum {
+    IO_RING_DISK = 0,
+    IO_RING_NET  = 1,
+    IO_RING_COUNT
+} IoRingId;
+
+typedef struct {
+    int fd;
+    const void *buf;            // single buffer (used when iov == NULL)
+    size_t len;
+    const struct iovec *iov;    // vectored write
+    int iovcnt;
+    off_t offset;               // file offset, or -1 for a socket send
+    int buf_index;              // registered buffer slot, or -1
+    int send_flags;             // extra MSG_* flags for socket sends
+    ssize_t result;             // bytes written or -errno
+} IoWrite;
+
+// mode: "auto" (probe io_uring, fall back to POSIX), "uring" or "posix"
+int io_backend_init(const char *mode);
+void io_backend_shutdown(void);
+IoBackendKind io_backend_kind(void);
+const char* io_backend_name(void);
+
+// Register fixed buffers on a ring (io_uring only). Returns 0 on success.
+int io_backend_register_buffers(IoRingId ring, const struct iovec *bufs, int count);
+
+// Submit all writes and wait for every completion. Results are stored in
+// ops[i].result. Returns the number of writes that failed.
+int io_submit_writes(IoRingId ring, IoWrite *ops, int count);
+
+#endif
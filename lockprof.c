@@ -0,0 +1,111 @@
+/*
+ * =====================================================
+ * LOCKPROF.C - MUTEX WAIT / HOLD TIME PROFILING
+ * =====================================================
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "lockprof.h"
+
+void lockprof_init(LockProfile *p, const char *name) {
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    p->sites[LOCKPROF_MAX_SITES].site = "other";
+}
+
+#ifndef NO_LOCK_PROFILE
+
+// Sites are __func__ pointers, so pointer equality is enough
+static LockSite* find_site(LockProfile *p, const char *site) {
+    for (int i = 0; i < p->nsites; i++) {
+        if (p->sites[i].site == site) {
+            return &p->sites[i];
+        }
+    }
+    if (p->nsites < LOCKPROF_MAX_SITES) {
+        p->sites[p->nsites].site = site;
+        return &p->sites[p->nsites++];
+    }
+    return &p->sites[LOCKPROF_MAX_SITES];
+}
+
+void lockprof_lock(LockProfile *p, pthread_mutex_t *m, const char *site) {
+    uint64_t start = 0;
+    int contended = pthread_mutex_trylock(m) != 0;
+    if (contended) {
+        start = metrics_now_ns();
+        pthread_mutex_lock(m);
+    }
+    uint64_t now = metrics_now_ns();
+
+    LockSite *s = find_site(p, site);
+    s->acquisitions++;
+    s->contended += contended;
+    latency_record(&s->wait, contended ? now - start : 0);
+    p->acquired_ns = now;
+    p->holder = s;
+    if (contended && p->on_wait != NULL) {
+        p->on_wait(now - start);
+    }
+}
+
+void lockprof_unlock(LockProfile *p, pthread_mutex_t *m) {
+    latency_record(&p->holder->hold, metrics_now_ns() - p->acquired_ns);
+    p->holder = NULL;
+    pthread_mutex_unlock(m);
+}
+
+#endif
+
+void lockprof_snapshot(LockProfile *p, pthread_mutex_t *m, LockProfile *out) {
+    pthread_mutex_lock(m);
+    memcpy(out, p, sizeof(*out));
+    pthread_mutex_unlock(m);
+}
+
+void lockprof_reset(LockProfile *p, pthread_mutex_t *m) {
+    pthread_mutex_lock(m);
+    void (*on_wait)(uint64_t) = p->on_wait;
+    lockprof_init(p, p->name);
+    p->on_wait = on_wait;
+    pthread_mutex_unlock(m);
+}
+
+size_t lockprof_format(const LockProfile *p, char sep, char *buf, size_t len, size_t size) {
+    int order[LOCKPROF_MAX_SITES + 1];
+    int n = 0;
+
+    for (int i = 0; i <= LOCKPROF_MAX_SITES; i++) {
+        if (p->sites[i].acquisitions > 0) {
+            order[n++] = i;
+        }
+    }
+    // Busiest first (total hold time); at most LOCKPROF_MAX_SITES + 1 entries
+    for (int i = 1; i < n; i++) {
+        int site = order[i];
+        int j = i;
+        while (j > 0 && p->sites[order[j - 1]].hold.total_ns < p->sites[site].hold.total_ns) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = site;
+    }
+
+    for (int k = 0; k < n && len + 160 < size; k++) {
+        const LockSite *s = &p->sites[order[k]];
+        len += snprintf(buf + len, size - len,
+                        "%c%s;%s;%lu;%lu;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f",
+                        sep, p->name, s->site,
+                        (unsigned long)s->acquisitions, (unsigned long)s->contended,
+                        latency_percentile_ns(&s->wait, 50) / 1000.0,
+                        latency_percentile_ns(&s->wait, 99) / 1000.0,
+                        s->wait.max_ns / 1000.0,
+                        latency_percentile_ns(&s->hold, 50) / 1000.0,
+                        latency_percentile_ns(&s->hold, 99) / 1000.0,
+                        s->hold.max_ns / 1000.0,
+                        s->hold.total_ns / 1e6);
+    }
+    return len;
+}
@@ -0,0 +1,67 @@
+/*
+ * =====================================================
+ * LOCKPROF.H - MUTEX WAIT / HOLD TIME PROFILING
+ * =====================================================
+ * A LockProfile sits next to a pthread mutex and records, per call site,
+ * how long callers waited to get the lock and how long they held it, in
+ * log2 nanosecond histograms. The site is the calling function's name
+ * (__func__), passed in by the lock macros of the lock's owner.
+ *
+ * Statistics are only written by the thread that holds the mutex, so the
+ * mutex itself protects them. An uncontended acquire costs a trylock and
+ * two clock reads (acquire and release).
+ *
+ * Building with -DNO_LOCK_PROFILE (make LOCK_PROFILE=0) turns the lock
+ * wrappers back into plain pthread calls.
+ */
+
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "metrics.h"
+
+#define LOCKPROF_MAX_SITES 64       // later sites are counted under "other"
+
+typedef struct {
+    const char *site;
+    uint64_t acquisitions;
+    uint64_t contended;             // trylock failed, caller had to wait
+    LatencyHist wait;
+    LatencyHist hold;
+} LockSite;
+
+typedef struct {
+    const char *name;
+    // Optional; the acquiring thread reports each contended wait here
+    void (*on_wait)(uint64_t wait_ns);
+    uint64_t acquired_ns;           // holder's acquire time
+    LockSite *holder;               // holder's site
+    int nsites;
+    LockSite sites[LOCKPROF_MAX_SITES + 1];
+} LockProfile;
+
+void lockprof_init(LockProfile *p, const char *name);
+
+#ifdef NO_LOCK_PROFILE
+#define lockprof_lock(p, m, site)   pthread_mutex_lock(m)
+#define lockprof_unlock(p, m)       pthread_mutex_unlock(m)
+#else
+void lockprof_lock(LockProfile *p, pthread_mutex_t *m, const char *site);
+void lockprof_unlock(LockProfile *p, pthread_mutex_t *m);
+#endif
+
+// Copies the statistics out (takes m) / clears them, keeping name and
+// on_wait (takes m)
+void lockprof_snapshot(LockProfile *p, pthread_mutex_t *m, LockProfile *out);
+void lockprof_reset(LockProfile *p, pthread_mutex_t *m);
+
+// Appends "lock;site;acquisitions;contended;wait p50/p99/max us;
+// hold p50/p99/max us;hold total ms" records, busiest site first, each
+// prefixed with sep. Returns the new length of buf.
+size_t lockprof_format(const LockProfile *p, char sep, char *buf, size_t len, size_t size);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * =====================================================
+ * METRICS.C - PER-THREAD COUNTERS AND LATENCY HISTOGRAMS
+ * =====================================================
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "metrics.h"
+
+typedef struct {
+    int in_use;                 // owned by a live thread (metrics_mutex)
+    uint64_t *counters;
+    LatencyHist *hists;
+} MetricsShard;
+
+static int g_counters = 0;
+static int g_histograms = 0;
+static MetricsShard *g_shards[METRICS_MAX_SHARDS];
+static MetricsShard g_overflow;             // shared, atomic updates
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_shard_key;
+
+static __thread MetricsShard *t_shard;
+
+// =====================================================
+// HISTOGRAMS
+// =====================================================
+
+static int bucket_of(uint64_t ns) {
+    int i = ns > 0 ? 63 - __builtin_clzll(ns) : 0;
+    return i < LATENCY_BUCKETS ? i : LATENCY_BUCKETS - 1;
+}
+
+void latency_record(LatencyHist *h, uint64_t ns) {
+    h->counts[bucket_of(ns)]++;
+    h->total_ns += ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+}
+
+uint64_t latency_count(const LatencyHist *h) {
+    uint64_t count = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        count += h->counts[i];
+    }
+    return count;
+}
+
+uint64_t latency_bucket_ns(int i) {
+    return (2ULL << i) - 1;
+}
+
+uint64_t latency_percentile_ns(const LatencyHist *h, double p) {
+    uint64_t target = (uint64_t)(latency_count(h) * p / 100.0 + 0.999999);
+    uint64_t seen = 0;
+    if (target == 0) target = 1;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t edge = latency_bucket_ns(i);
+            return edge < h->max_ns ? edge : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// =====================================================
+// SHARDS
+// =====================================================
+
+static int shard_alloc(MetricsShard *s) {
+    s->counters = calloc(g_counters > 0 ? g_counters : 1, sizeof(uint64_t));
+    s->hists = calloc(g_histograms > 0 ? g_histograms : 1, sizeof(LatencyHist));
+    return s->counters != NULL && s->hists != NULL ? 0 : -1;
+}
+
+// Thread exit: the shard (and its totals) stays for the next thread
+static void shard_release(void *arg) {
+    MetricsShard *s = arg;
+    pthread_mutex_lock(&metrics_mutex);
+    s->in_use = 0;
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+static MetricsShard* shard_acquire() {
+    MetricsShard *s = NULL;
+
+    pthread_mutex_lock(&metrics_mutex);
+    for (int i = 0; i < METRICS_MAX_SHARDS; i++) {
+        if (g_shards[i] == NULL) {
+            MetricsShard *fresh = calloc(1, sizeof(MetricsShard));
+            if (fresh == NULL || shard_alloc(fresh) != 0) {
+                break;
+            }
+            __atomic_store_n(&g_shards[i], fresh, __ATOMIC_RELEASE);
+        }
+        if (!g_shards[i]->in_use) {
+            s = g_shards[i];
+            s->in_use = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&metrics_mutex);
+
+    if (s == NULL) {
+        return &g_overflow;
+    }
+    pthread_setspecific(g_shard_key, s);
+    return s;
+}
+
+void metrics_init(int counters, int histograms) {
+    g_counters = counters;
+    g_histograms = histograms;
+    pthread_key_create(&g_shard_key, shard_release);
+    shard_alloc(&g_overflow);
+}
+
+void metrics_add(int counter, uint64_t n) {
+    if (counter >= g_counters) {
+        return;                 // metrics_init not called (tools, benches)
+    }
+    MetricsShard *s = t_shard != NULL ? t_shard : (t_shard = shard_acquire());
+    if (s == &g_overflow) {
+        __atomic_fetch_add(&s->counters[counter], n, __ATOMIC_RELAXED);
+        return;
+    }
+    // Only this thread writes the shard: a plain add, published for readers
+    __atomic_store_n(&s->counters[counter], s->counters[counter] + n, __ATOMIC_RELAXED);
+}
+
+void metrics_observe_ns(int histogram, uint64_t ns) {
+    if (histogram >= g_histograms) {
+        return;
+    }
+    MetricsShard *s = t_shard != NULL ? t_shard : (t_shard = shard_acquire());
+    LatencyHist *h = &s->hists[histogram];
+    if (s == &g_overflow) {
+        pthread_mutex_lock(&metrics_mutex);
+        latency_record(h, ns);
+        pthread_mutex_unlock(&metrics_mutex);
+        return;
+    }
+    int i = bucket_of(ns);
+    __atomic_store_n(&h->counts[i], h->counts[i] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->total_ns, h->total_ns + ns, __ATOMIC_RELAXED);
+    if (ns > h->max_ns) {
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+static void add_shard(const MetricsShard *s, int counter, int histogram, uint64_t *sum, LatencyHist *out) {
+    if (counter >= 0) {
+        *sum += __atomic_load_n(&s->counters[counter], __ATOMIC_RELAXED);
+    }
+    if (histogram >= 0) {
+        const LatencyHist *h = &s->hists[histogram];
+        for (int i = 0; i < LATENCY_BUCKETS; i++) {
+            out->counts[i] += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        }
+        out->total_ns += __atomic_load_n(&h->total_ns, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+        if (max > out->max_ns) out->max_ns = max;
+    }
+}
+
+// Shards are only ever added, so no lock is needed to walk them
+static void sum_shards(int counter, int histogram, uint64_t *sum, LatencyHist *out) {
+    for (int i = 0; i < METRICS_MAX_SHARDS; i++) {
+        MetricsShard *s = __atomic_load_n(&g_shards[i], __ATOMIC_ACQUIRE);
+        if (s == NULL) {
+            break;
+        }
+        add_shard(s, counter, histogram, sum, out);
+    }
+    pthread_mutex_lock(&metrics_mutex);
+    add_shard(&g_overflow, counter, histogram, sum, out);
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+uint64_t metrics_counter(int counter) {
+    uint64_t sum = 0;
+    if (g_counters > 0) {
+        sum_shards(counter, -1, &sum, NULL);
+    }
+    return sum;
+}
+
+void metrics_histogram(int histogram, LatencyHist *out) {
+    memset(out, 0, sizeof(*out));
+    if (g_histograms > 0) {
+        sum_shards(-1, histogram, NULL, out);
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * =====================================================
+ * METRICS.H - PER-THREAD COUNTERS AND LATENCY HISTOGRAMS
+ * =====================================================
+ * The host declares how many counters and histograms it has (metrics_init)
+ * and refers to them by index. Every thread updates its own shard with
+ * plain stores, so the hot path has no locked instructions and no shared
+ * cache lines; readers add the shards up. A shard outlives its thread and
+ * is handed to the next one, so totals never go backwards.
+ *
+ * Histograms are log2 of nanoseconds: bucket i counts [2^i, 2^(i+1)) ns.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#define LATENCY_BUCKETS 32          // last bucket is open-ended (>= ~2 s)
+#define METRICS_MAX_SHARDS 256
+
+typedef struct {
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total_ns;
+    uint64_t max_ns;
+} LatencyHist;
+
+// Single-writer histograms (caller serializes updates)
+void latency_record(LatencyHist *h, uint64_t ns);
+uint64_t latency_count(const LatencyHist *h);
+// Upper edge of the bucket holding the p-th percentile (capped at max), in ns
+uint64_t latency_percentile_ns(const LatencyHist *h, double p);
+// Upper edge of bucket i, the Prometheus "le" bound, in ns
+uint64_t latency_bucket_ns(int i);
+
+uint64_t metrics_now_ns(void);
+
+// Call once before any thread records
+void metrics_init(int counters, int histograms);
+
+void metrics_add(int counter, uint64_t n);
+void metrics_observe_ns(int histogram, uint64_t ns);
+
+uint64_t metrics_counter(int counter);
+void metrics_histogram(int histogram, LatencyHist *out);
+
+#endif
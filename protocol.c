@@ -0,0 +1,227 @@
+/*
+ * =====================================================
+ * PROTOCOL.C - BINARY WIRE PROTOCOL (BIN1) CODEC
+ * =====================================================
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "protocol.h"
+
+// =====================================================
+// WRITER
+// =====================================================
+
+void proto_writer_init(ProtoWriter *w, void *buf, size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->error = 0;
+}
+
+static unsigned char* writer_reserve(ProtoWriter *w, size_t n) {
+    if (w->error || w->cap - w->len < n) {
+        w->error = 1;
+        return NULL;
+    }
+    unsigned char *p = w->buf + w->len;
+    w->len += n;
+    return p;
+}
+
+void proto_put_u16(ProtoWriter *w, uint16_t v) {
+    unsigned char *p = writer_reserve(w, 2);
+    if (p == NULL) return;
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+void proto_put_u32(ProtoWriter *w, uint32_t v) {
+    unsigned char *p = writer_reserve(w, 4);
+    if (p == NULL) return;
+    for (int i = 0; i < 4; i++) {
+        p[i] = (v >> (8 * i)) & 0xff;
+    }
+}
+
+void proto_put_i64(ProtoWriter *w, int64_t v) {
+    unsigned char *p = writer_reserve(w, 8);
+    if (p == NULL) return;
+    uint64_t u = (uint64_t)v;
+    for (int i = 0; i < 8; i++) {
+        p[i] = (u >> (8 * i)) & 0xff;
+    }
+}
+
+void proto_put_str(ProtoWriter *w, const char *s, size_t len) {
+    if (len > 0xffff) {
+        w->error = 1;
+        return;
+    }
+    proto_put_u16(w, (uint16_t)len);
+    unsigned char *p = writer_reserve(w, len);
+    if (p == NULL) return;
+    memcpy(p, s, len);
+}
+
+void proto_put_price(ProtoWriter *w, double price) {
+    proto_put_i64(w, llround(price * PROTO_PRICE_SCALE));
+}
+
+// =====================================================
+// READER
+// =====================================================
+
+void proto_reader_init(ProtoReader *r, const void *buf, size_t len) {
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    r->error = 0;
+}
+
+static const unsigned char* reader_take(ProtoReader *r, size_t n) {
+    if (r->error || r->len - r->pos < n) {
+        r->error = 1;
+        return NULL;
+    }
+    const unsigned char *p = r->buf + r->pos;
+    r->pos += n;
+    return p;
+}
+
+uint16_t proto_get_u16(ProtoReader *r) {
+    const unsigned char *p = reader_take(r, 2);
+    if (p == NULL) return 0;
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+uint32_t proto_get_u32(ProtoReader *r) {
+    const unsigned char *p = reader_take(r, 4);
+    if (p == NULL) return 0;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int64_t proto_get_i64(ProtoReader *r) {
+    const unsigned char *p = reader_take(r, 8);
+    if (p == NULL) return 0;
+    uint64_t u = 0;
+    for (int i = 7; i >= 0; i--) {
+        u = (u << 8) | p[i];
+    }
+    return (int64_t)u;
+}
+
+// Copies the string NUL-terminated, truncating to cap - 1 bytes
+size_t proto_get_str(ProtoReader *r, char *out, size_t cap) {
+    size_t len = proto_get_u16(r);
+    const unsigned char *p = reader_take(r, len);
+    if (p == NULL || cap == 0) {
+        if (cap > 0) out[0] = '\0';
+        return 0;
+    }
+    size_t n = len < cap - 1 ? len : cap - 1;
+    memcpy(out, p, n);
+    out[n] = '\0';
+    return n;
+}
+
+double proto_get_price(ProtoReader *r) {
+    return (double)proto_get_i64(r) / PROTO_PRICE_SCALE;
+}
+
+// =====================================================
+// FRAMES
+// =====================================================
+
+int proto_parse_header(const void *buf, size_t avail, size_t max_payload, ProtoHeader *h) {
+    if (avail < PROTO_HEADER_SIZE) {
+        return 0;
+    }
+
+    ProtoReader r;
+    proto_reader_init(&r, buf, PROTO_HEADER_SIZE);
+    h->len = proto_get_u32(&r);
+    h->opcode = proto_get_u16(&r);
+    h->flags = proto_get_u16(&r);
+    h->corr_id = proto_get_u32(&r);
+
+    return h->len > max_payload ? -1 : 1;
+}
+
+static void frame_begin(ProtoWriter *w, void *out, size_t cap, uint16_t opcode,
+                        uint16_t flags, uint32_t corr_id) {
+    proto_writer_init(w, out, cap);
+    proto_put_u32(w, 0);    // patched by frame_end
+    proto_put_u16(w, opcode);
+    proto_put_u16(w, flags);
+    proto_put_u32(w, corr_id);
+}
+
+static size_t frame_end(ProtoWriter *w) {
+    if (w->error) {
+        return 0;
+    }
+
+    size_t total = w->len;
+    w->len = 0;
+    proto_put_u32(w, (uint32_t)(total - PROTO_HEADER_SIZE));
+    return total;
+}
+
+size_t proto_encode_text(void *out, size_t cap, const char *text, size_t len, uint32_t corr_id) {
+    ProtoWriter w;
+    frame_begin(&w, out, cap, OP_TEXT, 0, corr_id);
+    unsigned char *p = writer_reserve(&w, len);
+    if (p != NULL) {
+        memcpy(p, text, len);
+    }
+    return frame_end(&w);
+}
+
+size_t proto_encode_place_bid(void *out, size_t cap, const ProtoPlaceBid *bid, uint32_t corr_id) {
+    ProtoWriter w;
+    frame_begin(&w, out, cap, OP_PLACE_BID, 0, corr_id);
+    proto_put_u32(&w, bid->auction_id);
+    proto_put_u32(&w, bid->user_id);
+    proto_put_price(&w, bid->amount);
+    if (bid->request_id[0] != '\0') {
+        proto_put_str(&w, bid->request_id, strlen(bid->request_id));
+    }
+    return frame_end(&w);
+}
+
+size_t proto_encode_new_bid(void *out, size_t cap, const ProtoNewBid *bid, uint16_t flags) {
+    ProtoWriter w;
+    frame_begin(&w, out, cap, OP_NEW_BID, flags, 0);
+    proto_put_u32(&w, bid->auction_id);
+    proto_put_str(&w, bid->bidder, strlen(bid->bidder));
+    proto_put_price(&w, bid->amount);
+    proto_put_u32(&w, bid->total_bids);
+    proto_put_u32(&w, bid->time_left);
+    return frame_end(&w);
+}
+
+int proto_decode_place_bid(const void *payload, size_t len, ProtoPlaceBid *bid) {
+    ProtoReader r;
+    proto_reader_init(&r, payload, len);
+    bid->auction_id = (int)proto_get_u32(&r);
+    bid->user_id = (int)proto_get_u32(&r);
+    bid->amount = proto_get_price(&r);
+    bid->request_id[0] = '\0';
+    if (!r.error && r.pos < r.len) {
+        proto_get_str(&r, bid->request_id, sizeof(bid->request_id));
+    }
+    return r.error ? -1 : 0;
+}
+
+int proto_decode_new_bid(const void *payload, size_t len, ProtoNewBid *bid) {
+    ProtoReader r;
+    proto_reader_init(&r, payload, len);
+    bid->auction_id = (int)proto_get_u32(&r);
+    proto_get_str(&r, bid->bidder, sizeof(bid->bidder));
+    bid->amount = proto_get_price(&r);
+    bid->total_bids = (int)proto_get_u32(&r);
+    bid->time_left = (int)proto_get_u32(&r);
+    return r.error ? -1 : 0;
+}
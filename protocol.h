@@ -0,0 +1,107 @@
+/*
+ * =====================================================
+ * PROTOCOL.H - BINARY WIRE PROTOCOL (BIN1)
+ * =====================================================
+ * Negotiated per connection: the client sends the text line
+ * "HELLO|BIN1\n", the server answers "HELLO_OK|BIN1\n" and every frame
+ * after that, in both directions, is binary:
+ *
+ *   u32 payload length | u16 opcode | u16 flags | u32 correlation id
+ *
+ * All integers are little-endian, strings are u16 length + bytes (no
+ * terminator) and prices are i64 hundredths. Commands without a typed
+ * encoding travel as OP_TEXT: the text line without its '\n'.
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROTO_HELLO "HELLO|BIN1"
+#define PROTO_HEADER_SIZE 12
+#define PROTO_MAX_PAYLOAD 4096                  // client -> server frames
+#define PROTO_MAX_REPLY (16 * 1024 * 1024)      // server -> client (listings)
+#define PROTO_PRICE_SCALE 100
+#define PROTO_REQUEST_ID_LEN 32                 // idempotency key, see PLACE_BID
+
+typedef enum {
+    PROTO_TEXT = 0,
+    PROTO_BIN1 = 1
+} ProtoVersion;
+
+typedef enum {
+    OP_TEXT      = 1,   // tunnelled text command or reply
+    OP_PLACE_BID = 2,   // client -> server
+    OP_NEW_BID   = 3    // server -> client notification
+} ProtoOpcode;
+
+#define PROTO_FLAG_WARNING 0x0001   // OP_NEW_BID inside the last 30 seconds
+
+typedef struct {
+    uint32_t len;
+    uint16_t opcode;
+    uint16_t flags;
+    uint32_t corr_id;
+} ProtoHeader;
+
+typedef struct {
+    int auction_id;
+    int user_id;
+    double amount;
+    char request_id[PROTO_REQUEST_ID_LEN + 1];  // optional trailing field, "" = none
+} ProtoPlaceBid;
+
+typedef struct {
+    int auction_id;
+    char bidder[50];
+    double amount;
+    int total_bids;
+    int time_left;      // only meaningful with PROTO_FLAG_WARNING
+} ProtoNewBid;
+
+// Bounds-checked cursors; any overflow sets error and further calls are no-ops
+typedef struct {
+    unsigned char *buf;
+    size_t cap;
+    size_t len;
+    int error;
+} ProtoWriter;
+
+typedef struct {
+    const unsigned char *buf;
+    size_t len;
+    size_t pos;
+    int error;
+} ProtoReader;
+
+void proto_writer_init(ProtoWriter *w, void *buf, size_t cap);
+void proto_put_u16(ProtoWriter *w, uint16_t v);
+void proto_put_u32(ProtoWriter *w, uint32_t v);
+void proto_put_i64(ProtoWriter *w, int64_t v);
+void proto_put_str(ProtoWriter *w, const char *s, size_t len);
+void proto_put_price(ProtoWriter *w, double price);
+
+void proto_reader_init(ProtoReader *r, const void *buf, size_t len);
+uint16_t proto_get_u16(ProtoReader *r);
+uint32_t proto_get_u32(ProtoReader *r);
+int64_t proto_get_i64(ProtoReader *r);
+size_t proto_get_str(ProtoReader *r, char *out, size_t cap);
+double proto_get_price(ProtoReader *r);
+
+// Returns 1 if a complete header is available, 0 if more bytes are needed
+// and -1 if the payload length exceeds max_payload.
+int proto_parse_header(const void *buf, size_t avail, size_t max_payload, ProtoHeader *h);
+
+// Frame encoders write header + payload and return the frame size,
+// or 0 if it does not fit in cap.
+size_t proto_encode_text(void *out, size_t cap, const char *text, size_t len, uint32_t corr_id);
+size_t proto_encode_place_bid(void *out, size_t cap, const ProtoPlaceBid *bid, uint32_t corr_id);
+size_t proto_encode_new_bid(void *out, size_t cap, const ProtoNewBid *bid, uint16_t flags);
+
+// Payload decoders return 0 on success, -1 on a malformed payload
+int proto_decode_place_bid(const void *payload, size_t len, ProtoPlaceBid *bid);
+int proto_decode_new_bid(const void *payload, size_t len, ProtoNewBid *bid);
+
+#endif
@@ -2,8 +2,14 @@
  * =====================================================
  * SERVER.C - ONLINE AUCTION SYSTEM SERVER (WITH ROOM MANAGEMENT)
  * =====================================================
- * Compile: gcc server.c -o server -lpthread
- * Run: ./server
+ * Compile: make server
+ * Run: ./server [--io-backend=auto|uring|posix] [--slow-consumer=drop|disconnect]
+ *             [--record=capture.bin] [--clock-speed=X] [--trace-sample=N]
+ *             [--metrics-port=N] [--slow-ms=N]
+ *
+ * Network front-end: connections, sessions and the wire protocol. Users,
+ * rooms, auctions, bids and their persistence live in auction_engine.c;
+ * engine events come back through the callbacks in ENGINE EVENTS.
  */
 
 #include <stdio.h>
@@ -12,81 +18,225 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <time.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "auction_engine.h"
+#include "clock.h"
+#include "lockprof.h"
+#include "metrics.h"
+#include "trace.h"
+#include "io_backend.h"
+#include "protocol.h"
 
 #define PORT 8888
 #define MAX_CLIENTS 100
 #define BUFFER_SIZE 4096
-#define MAX_USERS 1000
-#define MAX_ROOMS 100
-#define MAX_AUCTIONS 1000
-#define MAX_BIDS 5000
+#define MAX_FRAME_SIZE BUFFER_SIZE          // longest accepted command line
+#define INBUF_SIZE (BUFFER_SIZE * 4)
+#define MAX_USERS ENGINE_DEFAULT_MAX_USERS
+#define MAX_ROOMS ENGINE_DEFAULT_MAX_ROOMS
+#define MAX_AUCTIONS ENGINE_DEFAULT_MAX_AUCTIONS
+#define MAX_BIDS ENGINE_DEFAULT_MAX_BIDS
+#define DATA_DIR "data"
+#define MAX_CONNECTIONS MAX_CLIENTS
 #define ACTIVITY_LOG_FILE "activity_log.txt"
 
+#define OUTQ_DEFAULT_MAX_BYTES (256 * 1024)
+#define FLUSH_BATCH_SIZE 64
+#define FLUSH_IOV_MAX 64
+#define OUTQ_INITIAL_CAP 16
+#define OUTQ_STATS_INTERVAL 60
+#define CORK_FLUSH_BYTES (64 * 1024)        // flush batched replies early past this
+#define RESUME_GRACE_SECONDS 60             // detached sessions can RESUME this long
+#define RESUME_TOKEN_LEN 32
+#define ROOM_EVENT_RING 256                 // room deltas kept for RESUME replay
+#define RESP_CACHE_SLOTS 256
+#define BATCH_MAX_ITEMS 100                 // sub-commands per BATCH
+#define DEDUP_SLOTS 4096                    // remembered request ids, power of two
+#define DEDUP_PROBE 8
+#define DEDUP_TTL_SECONDS 600
+#define DEDUP_REPLY_LEN 192
+#define CAPTURE_MAGIC "AUCAP1\n"             // 8 bytes with the NUL
+#define CAPTURE_BUFFER_SIZE (1 << 20)
+#define TRACE_DEFAULT_FILE "trace.json"
+
 // =====================================================
 // DATA STRUCTURES
 // =====================================================
 
+// Message classes decide what a slow consumer may lose
+typedef enum {
+    MSG_REPLY,      // response to the client's own command - never dropped
+    MSG_EVENT,      // room notification - may be dropped under SLOW_POLICY_DROP
+    MSG_TERMINAL    // final state change (auction ended/deleted) - never dropped
+} MsgClass;
+
+// Conflatable price updates: a queued, unsent update for the same auction
+// is replaced in place by the newer one
+typedef enum {
+    CONFLATE_NONE    = 0,
+    CONFLATE_PRICE   = 1,   // NEW_BID / NEW_BID_WARNING
+    CONFLATE_WARNING = 2    // AUCTION_WARNING
+} ConflateKind;
+
+#define CONFLATE_KEY(kind, auction_id) (((unsigned)(auction_id) << 2) | (unsigned)(kind))
+
+typedef enum {
+    SLOW_POLICY_DROP,        // drop droppable events once the queue is full
+    SLOW_POLICY_DISCONNECT   // evict the connection once the queue is full
+} SlowConsumerPolicy;
+
+// Immutable, refcounted wire message. A broadcast is serialized once and
+// every member's queue holds a reference to the same bytes.
 typedef struct {
-    int user_id;
-    char username[50];
-    char password[256];
-    char email[100];
-    char role[20];
-    double balance;
-    char status[20];
-    time_t created_at;
-} User;
+    int refcount;
+    size_t len;
+    char data[];
+} SharedMsg;
 
+// One notification in both wire formats; the binary form is only built
+// if a BIN1 connection actually receives it
 typedef struct {
-    int room_id;
-    char room_name[100];
-    char description[200];
-    int max_participants;
-    int current_participants;
-    char status[20]; // "waiting", "active", "ended"
-    time_t start_time;
-    time_t end_time;
-    int created_by;
-    int total_auctions; // Số lượng auction trong room
-} AuctionRoom;
+    SharedMsg *text;
+    SharedMsg *bin;
+} WireMsg;
 
 typedef struct {
-    int auction_id;
-    int seller_id;
-    int room_id; // Auction belongs to a room
-    char title[200];
-    char description[500];
-    double start_price;
-    double current_price;
-    double buy_now_price;
-    double min_bid_increment;
-    time_t start_time;
-    time_t end_time;
-    char status[20];
-    int winner_id;
-    int total_bids;
-} Auction;
+    SharedMsg *msg;
+    MsgClass cls;
+    unsigned conflate_key;      // 0 = never conflated
+} OutEntry;
 
+// A room delta kept for replay to resuming sessions
 typedef struct {
-    int bid_id;
-    int auction_id;
-    int user_id;
-    double bid_amount;
-    time_t bid_time;
-} Bid;
+    unsigned long seq;
+    WireMsg msg;
+} RoomEvent;
 
+// Sub-command lines collected after a BATCH|n header (reader thread only)
+typedef struct {
+    int expected;
+    int count;
+    uint32_t corr_id;           // of the BATCH header, echoed on BATCH_RESULT
+    char *items[BATCH_MAX_ITEMS];
+} Batch;
+
+// One per TCP connection. Only the flusher (or the owning thread, while
+// holding out_lock) ever writes to the socket, and always non-blocking.
 typedef struct {
     int socket;
+    int in_use;
+    unsigned generation;        // bumped on reuse so stale flush requests are ignored
+    char ip[INET_ADDRSTRLEN];
+
+    pthread_mutex_t out_lock;
+    OutEntry *outq;             // ring of queued messages, capacity is a power of two
+    unsigned outq_cap;
+    unsigned outq_head;
+    unsigned outq_count;
+    size_t head_sent;           // bytes of the head message already written
+    size_t out_bytes;
+    int dirty;                  // queued for the flusher
+    int waiting_writable;       // EAGAIN seen, EPOLLOUT armed
+    int epoll_registered;
+    int close_after_flush;
+    int closing;
+    int corked;                 // replies batched until the current input is processed
+    int proto;                  // ProtoVersion, switched by HELLO
+    uint32_t corr_id;           // correlation id of the command being run, 0 = none
+    int user_id;                // logged-in user, 0 before LOGIN (client_mutex)
+    int sub_room_id;            // live subscriptions, 0 = none (engine lock)
+    int sub_auction_id;
+    Batch *batch;               // non-NULL while a BATCH is being collected
+    uint32_t capture_id;        // connection id in a --record capture
+} Connection;
+
+// Reassembles newline-delimited commands from the byte stream. Owned by the
+// connection's reader thread.
+typedef struct {
+    char data[INBUF_SIZE];
+    size_t len;
+    int discarding;             // inside an oversized command, skip to the next '\n'
+} InBuf;
+
+typedef struct {
+    Connection *conn;           // NULL while detached
     int user_id;
     char username[50];
     int is_active;
     time_t login_time;
-    int current_room_id; // User can only join one room at a time
+    char resume_token[RESUME_TOKEN_LEN + 1];
+    time_t detached_at;         // connection dropped, kept for RESUME_GRACE_SECONDS
 } ClientSession;
 
+typedef struct {
+    unsigned long enqueued;
+    unsigned long dropped;
+    unsigned long conflated;
+    unsigned long evictions;
+    unsigned long bytes_written;
+    unsigned long high_water_bytes;
+} OutqStats;
+
+// Counters kept per thread (metrics.h) and added up by STATS and
+// --metrics-port. Histograms are one per command, indexed by command id.
+#define BID_REJECT_REASONS 8    // engine_place_bid codes -1..-8
+
+typedef enum {
+    MET_BIDS_ACCEPTED,
+    MET_BIDS_REJECTED,          // + (-code - 1)
+    MET_BROADCASTS = MET_BIDS_REJECTED + BID_REJECT_REASONS,
+    MET_BROADCAST_RECIPIENTS,
+    MET_DELTAS,                 // DELTA pushes to subscribers
+    MET_DELTA_RECIPIENTS,
+    MET_COUNTERS
+} MetricCounter;
+
+// What the request running on this thread has cost so far, for the slow
+// log. Lock waits come from the lock profiles (0 under NO_LOCK_PROFILE),
+// disk writes from the engine's saved callback.
+typedef struct {
+    uint64_t start_ns;
+    uint64_t parse_ns;
+    uint64_t lock_wait_ns;
+    uint64_t save_ns;
+    uint64_t bytes_sent;
+    uint32_t recipients;        // broadcast / delta fan-out
+} RequestCost;
+
+// Traffic capture (--record): CAPTURE_MAGIC, then records in host byte
+// order, each followed by len payload bytes. Read back by bench/replay.
+typedef enum {
+    CAP_SNAPSHOT,       // flag = engine table index, payload = its records
+    CAP_OPEN,           // payload = peer ip
+    CAP_TEXT,           // one command line as received (with any "@id ")
+    CAP_FRAME,          // one BIN1 frame, header included
+    CAP_CLOSE,          // flag = 1 if dropped (resumable), 0 on QUIT
+    CAP_TICK,           // auction timer ran engine_tick at wall_ms
+    CAP_TOKEN           // resume token the server issued on this connection
+} CaptureKind;
+
+typedef struct {
+    uint64_t t_us;              // since the capture started, monotonic
+    int64_t wall_ms;            // wall clock at the event
+    uint32_t conn_id;
+    uint16_t kind;
+    uint16_t flag;
+    uint32_t len;
+} CaptureRecord;
+
 // ✅ NEW: Activity Log structure
 typedef struct {
     time_t timestamp;
@@ -101,110 +251,72 @@ typedef struct {
 // GLOBAL VARIABLES
 // =====================================================
 
-User g_users[MAX_USERS];
-int g_user_count = 0;
-
-AuctionRoom g_rooms[MAX_ROOMS];
-int g_room_count = 0;
-
-Auction g_auctions[MAX_AUCTIONS];
-int g_auction_count = 0;
-
-Bid g_bids[MAX_BIDS];
-int g_bid_count = 0;
+AuctionEngine *g_engine;
+Clock g_clock;                  // zeroed = real time; --clock-speed scales it
 
 ClientSession g_clients[MAX_CLIENTS];
 int g_client_count = 0;
 
-pthread_mutex_t data_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t client_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-int server_socket;
-int server_running = 1;
-
-// =====================================================
-// FILE I/O FUNCTIONS
-// =====================================================
-
-void init_data_storage() {
-    FILE *fp;
-
-    // Load users
-    fp = fopen("data/users.dat", "rb");
-    if (fp != NULL) {
-        g_user_count = fread(g_users, sizeof(User), MAX_USERS, fp);
-        fclose(fp);
-        printf("[INFO] Loaded %d users\n", g_user_count);
-    } else {
-        printf("[INFO] No users file found, starting fresh\n");
-        g_user_count = 0;
-    }
-
-    // Load rooms
-    fp = fopen("data/rooms.dat", "rb");
-    if (fp != NULL) {
-        g_room_count = fread(g_rooms, sizeof(AuctionRoom), MAX_ROOMS, fp);
-        fclose(fp);
-        printf("[INFO] Loaded %d rooms\n", g_room_count);
-    } else {
-        printf("[INFO] No rooms file found, starting fresh\n");
-        g_room_count = 0;
-    }
-
-    // Load auctions
-    fp = fopen("data/auctions.dat", "rb");
-    if (fp != NULL) {
-        g_auction_count = fread(g_auctions, sizeof(Auction), MAX_AUCTIONS, fp);
-        fclose(fp);
-        printf("[INFO] Loaded %d auctions\n", g_auction_count);
-    } else {
-        printf("[INFO] No auctions file found, starting fresh\n");
-        g_auction_count = 0;
-    }
+Connection g_conns[MAX_CONNECTIONS];
+OutqStats g_outq_stats;
 
-    // Load bids
-    fp = fopen("data/bids.dat", "rb");
-    if (fp != NULL) {
-        g_bid_count = fread(g_bids, sizeof(Bid), MAX_BIDS, fp);
-        fclose(fp);
-        printf("[INFO] Loaded %d bids\n", g_bid_count);
-    } else {
-        printf("[INFO] No bids file found, starting fresh\n");
-        g_bid_count = 0;
-    }
-}
+// Per-stream delta sequence numbers (engine lock); id N at index N - 1
+unsigned long g_room_seq[MAX_ROOMS];
+unsigned long g_auction_seq[MAX_AUCTIONS];
 
-void save_all_data() {
-    FILE *fp;
+// Bumped under the engine lock by every room mutation, read lock-free by the
+// response cache: one counter per room (ROOM_DETAIL) and one for the table
+// (LIST_ROOMS)
+unsigned long g_room_version[MAX_ROOMS];
+unsigned long g_rooms_version = 0;
 
-    system("mkdir -p data");
+// Last ROOM_EVENT_RING room deltas, slot seq % ROOM_EVENT_RING (engine lock).
+// Allocated on a room's first delta.
+RoomEvent *g_room_events[MAX_ROOMS];
 
-    fp = fopen("data/users.dat", "wb");
-    if (fp != NULL) {
-        fwrite(g_users, sizeof(User), g_user_count, fp);
-        fclose(fp);
-    }
+int g_epoll_fd = -1;
+int g_wake_fd = -1;
 
-    fp = fopen("data/rooms.dat", "wb");
-    if (fp != NULL) {
-        fwrite(g_rooms, sizeof(AuctionRoom), g_room_count, fp);
-        fclose(fp);
-    }
+__thread RequestCost t_request_cost;
 
-    fp = fopen("data/auctions.dat", "wb");
-    if (fp != NULL) {
-        fwrite(g_auctions, sizeof(Auction), g_auction_count, fp);
-        fclose(fp);
-    }
+pthread_mutex_t client_mutex = PTHREAD_MUTEX_INITIALIZER;
+LockProfile g_client_lock_prof = { .name = "client", .sites[LOCKPROF_MAX_SITES] = { .site = "other" } };
 
-    fp = fopen("data/bids.dat", "wb");
-    if (fp != NULL) {
-        fwrite(g_bids, sizeof(Bid), g_bid_count, fp);
-        fclose(fp);
-    }
+#define client_lock()   lockprof_lock(&g_client_lock_prof, &client_mutex, __func__)
+#define client_unlock() lockprof_unlock(&g_client_lock_prof, &client_mutex)
 
-    printf("[INFO] All data saved to disk\n");
-}
+int server_socket;
+int server_running = 1;
+int g_shutdown_fd = -1;         // eventfd the signal handler pokes to stop accept
+
+pthread_mutex_t dirty_mutex = PTHREAD_MUTEX_INITIALIZER;
+unsigned long g_dirty_list[MAX_CONNECTIONS * 2];
+int g_dirty_count = 0;
+int g_dirty_overflow = 0;
+
+// Command line options
+const char *g_io_backend_mode = "auto";
+size_t g_outq_max_bytes = OUTQ_DEFAULT_MAX_BYTES;
+SlowConsumerPolicy g_slow_policy = SLOW_POLICY_DISCONNECT;
+int g_conflation_enabled = 1;
+const char *g_record_path = NULL;
+double g_clock_speed = 0;       // 0 = real time
+unsigned g_trace_sample = 0;    // trace 1 request in N, 0 = off
+const char *g_trace_path = TRACE_DEFAULT_FILE;
+volatile sig_atomic_t g_trace_dump_requested = 0;
+int g_metrics_port = 0;         // Prometheus listener on 127.0.0.1, 0 = off
+double g_bids_per_sec = 0;      // over the last timer tick
+double g_slow_ms = 0;           // slow log threshold, 0 = off
+
+FILE *g_capture = NULL;
+pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct timespec g_capture_start;
+uint32_t g_capture_next_id = 0;
+
+// Set by bench/replay: hands out the tokens the live server issued, so
+// recorded RESUMEs still match. Returns 0 if it filled out.
+int (*g_resume_token_source)(Connection *conn, char *out) = NULL;
+int g_replaying = 0;            // no real peers: skip waits meant for them
 
 // =====================================================
 // ACTIVITY LOGGING
@@ -217,7 +329,7 @@ void log_activity(int user_id, const char* username, const char* action, const c
         return;
     }
     
-    time_t now = time(NULL);
+    time_t now = clock_now(&g_clock);
     char time_str[64];
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&now));
     
@@ -228,45 +340,82 @@ void log_activity(int user_id, const char* username, const char* action, const c
 }
 
 // =====================================================
-// BUSINESS LOGIC FUNCTIONS
+// TRAFFIC CAPTURE
 // =====================================================
+// Every inbound command with its connection and time, in the order the
+// reader threads saw them. Commands from different connections that race
+// for the engine lock may run in a different order than recorded.
 
-User* find_user_by_username(const char *username) {
-    for (int i = 0; i < g_user_count; i++) {
-        if (strcmp(g_users[i].username, username) == 0) {
-            return &g_users[i];
-        }
+void capture_record(Connection *conn, CaptureKind kind, int flag, const void *data, size_t len) {
+    if (g_capture == NULL) {
+        return;
     }
-    return NULL;
+
+    CaptureRecord rec;
+    struct timespec mono;
+
+    pthread_mutex_lock(&capture_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    memset(&rec, 0, sizeof(rec));
+    rec.t_us = (mono.tv_sec - g_capture_start.tv_sec) * 1000000ULL +
+               (mono.tv_nsec - g_capture_start.tv_nsec) / 1000;
+    rec.wall_ms = clock_now_ms(&g_clock);
+    rec.conn_id = conn != NULL ? conn->capture_id : 0;
+    rec.kind = kind;
+    rec.flag = flag;
+    rec.len = len;
+    fwrite(&rec, sizeof(rec), 1, g_capture);
+    if (len > 0) {
+        fwrite(data, 1, len, g_capture);
+    }
+    pthread_mutex_unlock(&capture_mutex);
 }
 
-User* find_user_by_id(int user_id) {
-    for (int i = 0; i < g_user_count; i++) {
-        if (g_users[i].user_id == user_id) {
-            return &g_users[i];
-        }
+void capture_open(Connection *conn) {
+    if (g_capture == NULL) {
+        return;
     }
-    return NULL;
+    conn->capture_id = __atomic_add_fetch(&g_capture_next_id, 1, __ATOMIC_RELAXED);
+    capture_record(conn, CAP_OPEN, 0, conn->ip, strlen(conn->ip));
 }
 
-Auction* find_auction_by_id(int auction_id) {
-    for (int i = 0; i < g_auction_count; i++) {
-        if (g_auctions[i].auction_id == auction_id) {
-            return &g_auctions[i];
-        }
+// Opens the capture and snapshots the tables, so a replay starts from the
+// same state
+int capture_start(const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("[ERROR] Could not open capture file %s: %s\n", path, strerror(errno));
+        return -1;
     }
-    return NULL;
+    setvbuf(fp, NULL, _IOFBF, CAPTURE_BUFFER_SIZE);
+    fwrite(CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), fp);
+    clock_gettime(CLOCK_MONOTONIC, &g_capture_start);
+
+    engine_lock(g_engine);
+    g_capture = fp;
+    for (int i = 0; i < ENGINE_DATA_FILES; i++) {
+        EngineDataFile *df = &g_engine->files[i];
+        capture_record(NULL, CAP_SNAPSHOT, i, df->base, df->record_size * (*df->count));
+    }
+    engine_unlock(g_engine);
+
+    printf("[INFO] Recording inbound traffic to %s\n", path);
+    return 0;
 }
 
-AuctionRoom* find_room_by_id(int room_id) {
-    for (int i = 0; i < g_room_count; i++) {
-        if (g_rooms[i].room_id == room_id) {
-            return &g_rooms[i];
-        }
+void capture_flush() {
+    if (g_capture == NULL) {
+        return;
     }
-    return NULL;
+    pthread_mutex_lock(&capture_mutex);
+    fflush(g_capture);
+    pthread_mutex_unlock(&capture_mutex);
 }
 
+// =====================================================
+// SESSION LOOKUP
+// =====================================================
+
 ClientSession* find_client_by_user_id(int user_id) {
     // NOTE: Caller must hold client_mutex!
     // Removed internal lock to prevent deadlock
@@ -279,447 +428,691 @@ ClientSession* find_client_by_user_id(int user_id) {
 }
 
 // =====================================================
-// ROOM MANAGEMENT FUNCTIONS
+// CONNECTIONS & OUTBOUND QUEUES
 // =====================================================
 
-int create_room(int creator_id, const char *name, const char *desc, int max_participants, int duration_minutes) {
-    pthread_mutex_lock(&data_mutex);
+void conn_table_init() {
+    memset(g_conns, 0, sizeof(g_conns));
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        g_conns[i].socket = -1;
+        pthread_mutex_init(&g_conns[i].out_lock, NULL);
+    }
+}
+
+static unsigned long conn_token(Connection *conn) {
+    return ((unsigned long)conn->generation << 32) | (unsigned long)(conn - g_conns);
+}
+
+// Resolve a flush token; returns the connection with out_lock held, or NULL
+static Connection* conn_lock_token(unsigned long token) {
+    unsigned idx = (unsigned)(token & 0xffffffffUL);
+    if (idx >= MAX_CONNECTIONS) return NULL;
 
-    if (g_room_count >= MAX_ROOMS) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Room database full
+    Connection *conn = &g_conns[idx];
+    pthread_mutex_lock(&conn->out_lock);
+    if (conn->socket < 0 || conn->generation != (unsigned)(token >> 32)) {
+        pthread_mutex_unlock(&conn->out_lock);
+        return NULL;
     }
+    return conn;
+}
 
-    // Check for duplicate room name
-    for (int i = 0; i < g_room_count; i++) {
-        if (strcmp(g_rooms[i].room_name, name) == 0 && 
-            strcmp(g_rooms[i].status, "ended") != 0) {
-            pthread_mutex_unlock(&data_mutex);
-            return -2; // Room name already exists
+Connection* conn_open(int socket, const char *ip) {
+    Connection *conn = NULL;
+
+    client_lock();
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (!g_conns[i].in_use) {
+            conn = &g_conns[i];
+            conn->in_use = 1;
+            break;
         }
     }
+    client_unlock();
 
-    AuctionRoom *room = &g_rooms[g_room_count];
-    room->room_id = g_room_count + 1;
-    strncpy(room->room_name, name, 99);
-    room->room_name[99] = '\0';
-    strncpy(room->description, desc, 199);
-    room->description[199] = '\0';
-    room->max_participants = max_participants;
-    room->current_participants = 0;
-    strcpy(room->status, "waiting");
-    room->start_time = time(NULL);
-    room->end_time = time(NULL) + (duration_minutes * 60);
-    room->created_by = creator_id;
-    room->total_auctions = 0;
-
-    g_room_count++;
+    if (conn == NULL) {
+        return NULL;
+    }
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+    pthread_mutex_lock(&conn->out_lock);
+    conn->generation++;
+    conn->socket = socket;
+    strncpy(conn->ip, ip, sizeof(conn->ip) - 1);
+    conn->ip[sizeof(conn->ip) - 1] = '\0';
+    conn->outq_head = 0;
+    conn->outq_count = 0;
+    conn->head_sent = 0;
+    conn->out_bytes = 0;
+    conn->dirty = 0;
+    conn->waiting_writable = 0;
+    conn->epoll_registered = 0;
+    conn->close_after_flush = 0;
+    conn->closing = 0;
+    conn->corked = 0;
+    conn->proto = PROTO_TEXT;
+    conn->corr_id = 0;
+    conn->user_id = 0;
+    pthread_mutex_unlock(&conn->out_lock);
+
+    return conn;
+}
 
-    return room->room_id;
+SharedMsg* shared_msg_new(const char *data, size_t len) {
+    SharedMsg *m = malloc(sizeof(SharedMsg) + len);
+    if (m == NULL) {
+        return NULL;
+    }
+    m->refcount = 1;
+    m->len = len;
+    memcpy(m->data, data, len);
+    return m;
 }
 
-int join_room(int user_id, int room_id) {
-    pthread_mutex_lock(&data_mutex);
+static SharedMsg* shared_msg_retain(SharedMsg *m) {
+    __atomic_fetch_add(&m->refcount, 1, __ATOMIC_RELAXED);
+    return m;
+}
 
-    AuctionRoom *room = find_room_by_id(room_id);
-    
-    if (room == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        printf("[ERROR] join_room: Room %d not found\n", room_id);
-        return -1; // Room not found
+void shared_msg_release(SharedMsg *m) {
+    if (m != NULL && __atomic_sub_fetch(&m->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(m);
     }
+}
 
-    if (strcmp(room->status, "ended") == 0) {
-        pthread_mutex_unlock(&data_mutex);
-        printf("[ERROR] join_room: Room %d has ended\n", room_id);
-        return -2; // Room has ended
+// Wrap a text line (with its '\n') as an OP_TEXT frame
+static SharedMsg* shared_msg_bin_text(const char *text, size_t len, uint32_t corr_id) {
+    if (len > 0 && text[len - 1] == '\n') {
+        len--;
     }
 
-    if (room->current_participants >= room->max_participants) {
-        pthread_mutex_unlock(&data_mutex);
-        printf("[ERROR] join_room: Room %d is full (%d/%d)\n", 
-               room_id, room->current_participants, room->max_participants);
-        return -3; // Room is full
+    SharedMsg *m = malloc(sizeof(SharedMsg) + PROTO_HEADER_SIZE + len);
+    if (m == NULL) {
+        return NULL;
     }
+    m->refcount = 1;
+    m->len = proto_encode_text(m->data, PROTO_HEADER_SIZE + len, text, len, corr_id);
+    return m;
+}
 
-    // Check if user already in a room - need client_mutex
-    pthread_mutex_lock(&client_mutex);
-    ClientSession *client = find_client_by_user_id(user_id);
-    
-    if (client != NULL && client->current_room_id > 0 && client->current_room_id != room_id) {
-        pthread_mutex_unlock(&client_mutex);
-        pthread_mutex_unlock(&data_mutex);
-        printf("[ERROR] join_room: User %d already in room %d\n", user_id, client->current_room_id);
-        return -4; // Already in another room
-    }
+// A text reply to an "@<id> " tagged command carries the same tag
+static SharedMsg* shared_msg_tagged(const char *text, size_t len, uint32_t corr_id) {
+    char tag[16];
+    int tag_len = snprintf(tag, sizeof(tag), "@%u ", corr_id);
 
-    // Join room
-    if (client != NULL) {
-        client->current_room_id = room_id;
-        printf("[DEBUG] join_room: Set user %d current_room_id to %d\n", user_id, room_id);
-    } else {
-        printf("[WARNING] join_room: Client session not found for user %d\n", user_id);
-    }
-    pthread_mutex_unlock(&client_mutex);
-    
-    room->current_participants++;
-    printf("[DEBUG] join_room: Room %d participants: %d/%d\n", 
-           room_id, room->current_participants, room->max_participants);
-    
-    // Activate room if it was waiting
-    if (strcmp(room->status, "waiting") == 0) {
-        strcpy(room->status, "active");
-        printf("[DEBUG] join_room: Room %d activated\n", room_id);
+    SharedMsg *m = malloc(sizeof(SharedMsg) + tag_len + len);
+    if (m == NULL) {
+        return NULL;
     }
+    m->refcount = 1;
+    m->len = tag_len + len;
+    memcpy(m->data, tag, tag_len);
+    memcpy(m->data + tag_len, text, len);
+    return m;
+}
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+WireMsg wire_msg_text(const char *text) {
+    WireMsg w;
+    w.text = shared_msg_new(text, strlen(text));
+    w.bin = NULL;
+    return w;
+}
 
-    printf("[INFO] User %d successfully joined room %d\n", user_id, room_id);
-    return 0; // Success
+void wire_msg_release(WireMsg *w) {
+    shared_msg_release(w->text);
+    shared_msg_release(w->bin);
+    w->text = NULL;
+    w->bin = NULL;
 }
 
-// Internal function - caller must hold BOTH data_mutex AND client_mutex!
-int _leave_room_unsafe(int user_id) {
-    ClientSession *client = find_client_by_user_id(user_id);
-    
-    if (client == NULL || client->current_room_id == 0) {
-        printf("[DEBUG] _leave_room_unsafe: User %d not in any room\n", user_id);
-        return -1; // Not in any room
+// Encoding for one connection. Only the broadcasting thread touches w.
+static SharedMsg* wire_msg_for(WireMsg *w, int proto) {
+    if (proto == PROTO_TEXT) {
+        return w->text;
     }
-
-    int old_room_id = client->current_room_id;
-    AuctionRoom *room = find_room_by_id(old_room_id);
-    if (room != NULL) {
-        room->current_participants--;
-        printf("[DEBUG] _leave_room_unsafe: Room %d participants decreased to %d\n", 
-               old_room_id, room->current_participants);
+    if (w->bin == NULL && w->text != NULL) {
+        w->bin = shared_msg_bin_text(w->text->data, w->text->len, 0);
     }
-
-    client->current_room_id = 0;
-
-    printf("[INFO] User %d left room %d (unsafe)\n", user_id, old_room_id);
-    return 0; // Success
+    return w->bin;
 }
 
-int leave_room(int user_id) {
-    pthread_mutex_lock(&data_mutex);
-    pthread_mutex_lock(&client_mutex);
+static OutEntry* outq_at(Connection *conn, unsigned i) {
+    return &conn->outq[(conn->outq_head + i) & (conn->outq_cap - 1)];
+}
 
-    int result = _leave_room_unsafe(user_id);
+// Caller must hold conn->out_lock. Drops the head entry.
+static void outq_pop(Connection *conn) {
+    OutEntry *e = outq_at(conn, 0);
+    conn->out_bytes -= e->msg->len;
+    shared_msg_release(e->msg);
+    e->msg = NULL;
+    conn->outq_head = (conn->outq_head + 1) & (conn->outq_cap - 1);
+    conn->outq_count--;
+    conn->head_sent = 0;
+}
 
-    pthread_mutex_unlock(&client_mutex);
-    
-    if (result == 0) {
-        save_all_data();
+// Caller must hold conn->out_lock
+static void outq_clear(Connection *conn) {
+    while (conn->outq_count > 0) {
+        outq_pop(conn);
     }
-    
-    pthread_mutex_unlock(&data_mutex);
-
-    return result;
+    conn->outq_head = 0;
+    conn->out_bytes = 0;
 }
 
-// =====================================================
-// USER MANAGEMENT FUNCTIONS
-// =====================================================
+// Caller must hold conn->out_lock. Doubles the ring, keeping queue order.
+static int outq_grow(Connection *conn) {
+    unsigned cap = conn->outq_cap ? conn->outq_cap * 2 : OUTQ_INITIAL_CAP;
+    OutEntry *ring = malloc(sizeof(OutEntry) * cap);
+    if (ring == NULL) {
+        return -1;
+    }
+    for (unsigned i = 0; i < conn->outq_count; i++) {
+        ring[i] = *outq_at(conn, i);
+    }
+    free(conn->outq);
+    conn->outq = ring;
+    conn->outq_cap = cap;
+    conn->outq_head = 0;
+    return 0;
+}
 
-int register_user(const char *username, const char *password, const char *email) {
-    pthread_mutex_lock(&data_mutex);
+// Caller must hold conn->out_lock. The reader thread sees EOF and does the
+// real cleanup; shutdown() keeps the fd number from being reused meanwhile.
+static void conn_shutdown_locked(Connection *conn) {
+    outq_clear(conn);
+    conn->closing = 1;
+    shutdown(conn->socket, SHUT_RDWR);
+}
 
-    if (find_user_by_username(username) != NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Username already exists
+void batch_free(Connection *conn) {
+    Batch *b = conn->batch;
+    if (b == NULL) {
+        return;
+    }
+    for (int i = 0; i < b->count; i++) {
+        free(b->items[i]);
     }
+    free(b);
+    conn->batch = NULL;
+}
 
-    if (g_user_count >= MAX_USERS) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Database full
+// Called by the connection's own thread once it stops reading
+void conn_close(Connection *conn) {
+    engine_lock(g_engine);
+    conn->sub_room_id = 0;
+    conn->sub_auction_id = 0;
+    engine_unlock(g_engine);
+
+    batch_free(conn);
+
+    pthread_mutex_lock(&conn->out_lock);
+    outq_clear(conn);
+    free(conn->outq);
+    conn->outq = NULL;
+    conn->outq_cap = 0;
+    if (conn->epoll_registered) {
+        epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, conn->socket, NULL);
     }
+    int fd = conn->socket;
+    conn->socket = -1;
+    conn->closing = 1;
+    pthread_mutex_unlock(&conn->out_lock);
 
-    User *user = &g_users[g_user_count];
-    user->user_id = g_user_count + 1;
-    strncpy(user->username, username, 49);
-    user->username[49] = '\0';
-    strncpy(user->password, password, 255);
-    user->password[255] = '\0';
-    strncpy(user->email, email, 99);
-    user->email[99] = '\0';
-    strcpy(user->role, "user");
-    user->balance = 1000000; // Starting balance
-    strcpy(user->status, "active");
-    user->created_at = time(NULL);
+    close(fd);
 
-    g_user_count++;
+    client_lock();
+    conn->in_use = 0;
+    client_unlock();
+}
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+// Caller must hold conn->out_lock. Point a queued, not yet started update
+// with the same key at the new message, keeping its place in the queue.
+// Returns 1 if replaced.
+static int outq_conflate_locked(Connection *conn, SharedMsg *msg, unsigned conflate_key) {
+    for (unsigned i = conn->head_sent > 0 ? 1 : 0; i < conn->outq_count; i++) {
+        OutEntry *e = outq_at(conn, i);
+        if (e->conflate_key != conflate_key) {
+            continue;
+        }
 
-    return user->user_id;
-}
+        conn->out_bytes = conn->out_bytes - e->msg->len + msg->len;
+        shared_msg_release(e->msg);
+        e->msg = shared_msg_retain(msg);
 
-int authenticate_user(const char *username, const char *password) {
-    pthread_mutex_lock(&data_mutex);
+        __atomic_fetch_add(&g_outq_stats.conflated, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
 
-    User *user = find_user_by_username(username);
+    return 0;
+}
 
-    if (user == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // User not found
+// Caller must hold conn->out_lock. Takes its own reference on msg.
+// Returns 0 if queued.
+static int outq_push_locked(Connection *conn, SharedMsg *msg, MsgClass cls, unsigned conflate_key) {
+    if (conn->socket < 0 || conn->closing) {
+        return -1;
     }
 
-    if (strcmp(user->password, password) != 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Wrong password
+    if (conflate_key != 0 && g_conflation_enabled && conn->outq_count > 0 &&
+        outq_conflate_locked(conn, msg, conflate_key)) {
+        return 0;
     }
 
-    if (strcmp(user->status, "active") != 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -3; // Account not active
+    if (conn->out_bytes + msg->len > g_outq_max_bytes) {
+        // Over budget, events follow the slow-consumer policy. Replies and
+        // terminal events may use up to twice the budget under either
+        // policy, and one into an empty queue is always taken, so a big
+        // listing never evicts a client that is keeping up.
+        int overdraft = cls != MSG_EVENT &&
+                        (conn->out_bytes == 0 || conn->out_bytes + msg->len <= g_outq_max_bytes * 2);
+        if (g_slow_policy == SLOW_POLICY_DROP && cls == MSG_EVENT) {
+            __atomic_fetch_add(&g_outq_stats.dropped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
+        if (!overdraft) {
+            printf("[WARNING] Evicting slow consumer on socket %d (%zu bytes / %u messages queued)\n",
+                   conn->socket, conn->out_bytes, conn->outq_count);
+            __atomic_fetch_add(&g_outq_stats.evictions, 1, __ATOMIC_RELAXED);
+            conn_shutdown_locked(conn);
+            return -1;
+        }
     }
 
-    int user_id = user->user_id;
-    pthread_mutex_unlock(&data_mutex);
+    if (conn->outq_count == conn->outq_cap && outq_grow(conn) != 0) {
+        return -1;
+    }
 
-    return user_id;
-}
+    OutEntry *e = outq_at(conn, conn->outq_count);
+    e->msg = shared_msg_retain(msg);
+    e->cls = cls;
+    e->conflate_key = conflate_key;
+    conn->outq_count++;
+    conn->out_bytes += msg->len;
+
+    __atomic_fetch_add(&g_outq_stats.enqueued, 1, __ATOMIC_RELAXED);
+    unsigned long depth = conn->out_bytes;
+    unsigned long high = __atomic_load_n(&g_outq_stats.high_water_bytes, __ATOMIC_RELAXED);
+    while (depth > high &&
+           !__atomic_compare_exchange_n(&g_outq_stats.high_water_bytes, &high, depth, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
 
-// =====================================================
-// AUCTION MANAGEMENT FUNCTIONS
-// =====================================================
+    return 0;
+}
 
-int create_auction(int seller_id, int room_id, const char *title, const char *desc,
-                   double start_price, double buy_now_price,
-                   double min_increment, int duration_minutes) {
-    pthread_mutex_lock(&data_mutex);
+// Caller must hold conn->out_lock. Arm a one-shot EPOLLOUT for the flusher.
+static void conn_arm_writable(Connection *conn) {
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.u64 = conn_token(conn);
 
-    if (g_auction_count >= MAX_AUCTIONS) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Auction database full
+    int op = conn->epoll_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(g_epoll_fd, op, conn->socket, &ev) == 0) {
+        conn->epoll_registered = 1;
+        conn->waiting_writable = 1;
+    } else {
+        conn_shutdown_locked(conn);
     }
+}
 
-    // Validate room exists
-    AuctionRoom *room = find_room_by_id(room_id);
-    if (room == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Room not found
+// Caller must hold conn->out_lock. Fill iov with the unsent part of up to
+// max queued messages; returns the number of entries used.
+static int outq_fill_iov(Connection *conn, struct iovec *iov, int max) {
+    int n = 0;
+    for (unsigned i = 0; i < conn->outq_count && n < max; i++) {
+        SharedMsg *m = outq_at(conn, i)->msg;
+        size_t skip = i == 0 ? conn->head_sent : 0;
+        iov[n].iov_base = m->data + skip;
+        iov[n].iov_len = m->len - skip;
+        n++;
     }
+    return n;
+}
 
-    // Validate seller is in the room - need client_mutex
-    pthread_mutex_lock(&client_mutex);
-    ClientSession *client = find_client_by_user_id(seller_id);
-    int seller_current_room = (client != NULL) ? client->current_room_id : 0;
-    pthread_mutex_unlock(&client_mutex);
-    
-    if (seller_current_room != room_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -3; // Seller not in room
+// Caller must hold conn->out_lock. Applies one (possibly vectored) write
+// result to the queue; returns 1 if the caller may keep writing.
+static int outq_complete_write(Connection *conn, ssize_t result) {
+    if (result == -EAGAIN || result == -EWOULDBLOCK) {
+        conn_arm_writable(conn);
+        return 0;
     }
-
-    // CRITICAL: Only room creator can create auction
-    if (room->created_by != seller_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -4; // Not room creator
+    if (result < 0) {
+        // Peer is gone; the reader thread notices and cleans up
+        conn_shutdown_locked(conn);
+        return 0;
     }
 
-    Auction *auction = &g_auctions[g_auction_count];
-    auction->auction_id = g_auction_count + 1;
-    auction->seller_id = seller_id;
-    auction->room_id = room_id;
-    strncpy(auction->title, title, 199);
-    auction->title[199] = '\0';
-    strncpy(auction->description, desc, 499);
-    auction->description[499] = '\0';
-    auction->start_price = start_price;
-    auction->current_price = start_price;
-    auction->buy_now_price = buy_now_price;
-    auction->min_bid_increment = min_increment;
-    auction->start_time = time(NULL);
-    auction->end_time = time(NULL) + (duration_minutes * 60);
-    strcpy(auction->status, "active");
-    auction->winner_id = 0;
-    auction->total_bids = 0;
+    __atomic_fetch_add(&g_outq_stats.bytes_written, result, __ATOMIC_RELAXED);
+    size_t left = result;
+    while (left > 0 && conn->outq_count > 0) {
+        size_t remaining = outq_at(conn, 0)->msg->len - conn->head_sent;
+        if (left < remaining) {
+            conn->head_sent += left;
+            break;
+        }
+        left -= remaining;
+        outq_pop(conn);
+    }
 
-    g_auction_count++;
-    room->total_auctions++;
+    if (conn->outq_count == 0 && conn->close_after_flush) {
+        conn_shutdown_locked(conn);
+        return 0;
+    }
+    return conn->outq_count > 0;
+}
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+// Caller must hold conn->out_lock. Non-blocking, never waits for the peer.
+static void outq_flush_locked(Connection *conn) {
+    struct iovec iov[FLUSH_IOV_MAX];
+    struct msghdr msg;
+
+    while (conn->outq_count > 0 && !conn->waiting_writable && !conn->closing) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = outq_fill_iov(conn, iov, FLUSH_IOV_MAX);
+        ssize_t n = sendmsg(conn->socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (!outq_complete_write(conn, n < 0 ? -errno : n)) {
+            break;
+        }
+    }
+}
 
-    return auction->auction_id;
+static void flusher_wake() {
+    uint64_t one = 1;
+    if (write(g_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        printf("[WARNING] Could not wake flusher: %s\n", strerror(errno));
+    }
 }
 
-int place_bid(int auction_id, int user_id, double bid_amount) {
-    pthread_mutex_lock(&data_mutex);
+// Queue a reference to msg in the connection's wire format; the flusher
+// thread writes it. Never blocks on
+// the peer, so it is safe to call while holding the engine lock or client_mutex.
+// Returns 1 if the flusher needs a wake-up.
+int conn_enqueue(Connection *conn, WireMsg *wire, MsgClass cls, unsigned conflate_key) {
+    int need_wake = 0;
+
+    pthread_mutex_lock(&conn->out_lock);
+    SharedMsg *msg = wire_msg_for(wire, conn->proto);
+    if (msg != NULL && outq_push_locked(conn, msg, cls, conflate_key) == 0 &&
+        !conn->dirty && !conn->waiting_writable) {
+        conn->dirty = 1;
+        pthread_mutex_lock(&dirty_mutex);
+        if (g_dirty_count < MAX_CONNECTIONS * 2) {
+            g_dirty_list[g_dirty_count++] = conn_token(conn);
+        } else {
+            g_dirty_overflow = 1;   // flusher falls back to a full scan
+        }
+        pthread_mutex_unlock(&dirty_mutex);
+        need_wake = 1;
+    }
+    pthread_mutex_unlock(&conn->out_lock);
 
-    Auction *auction = find_auction_by_id(auction_id);
+    return need_wake;
+}
 
-    if (auction == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Auction not found
+// Reply to the connection's own command: queue behind anything pending and
+// write immediately from the calling thread when the socket allows it.
+// While the connection is corked (pipelined input), replies are written
+// together by conn_uncork().
+void send_response_len(Connection *conn, const char *response, size_t len) {
+    uint64_t span = trace_begin();
+    t_request_cost.bytes_sent += len;
+    pthread_mutex_lock(&conn->out_lock);
+    SharedMsg *msg;
+    if (conn->proto == PROTO_BIN1) {
+        msg = shared_msg_bin_text(response, len, conn->corr_id);
+    } else if (conn->corr_id != 0) {
+        msg = shared_msg_tagged(response, len, conn->corr_id);
+    } else {
+        msg = shared_msg_new(response, len);
     }
-
-    if (strcmp(auction->status, "active") != 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Auction not active
+    if (msg != NULL && outq_push_locked(conn, msg, MSG_REPLY, 0) == 0 &&
+        (!conn->corked || conn->out_bytes >= CORK_FLUSH_BYTES)) {
+        outq_flush_locked(conn);
     }
+    pthread_mutex_unlock(&conn->out_lock);
 
-    // Validate user is in the same room as auction - need client_mutex
-    pthread_mutex_lock(&client_mutex);
-    ClientSession *client = find_client_by_user_id(user_id);
-    int user_room_id = (client != NULL) ? client->current_room_id : 0;
-    pthread_mutex_unlock(&client_mutex);
-    
-    if (user_room_id != auction->room_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -8; // Not in the same room
-    }
+    shared_msg_release(msg);
+    trace_end("reply", span);
+}
 
-    time_t now = time(NULL);
-    if (now > auction->end_time) {
-        pthread_mutex_unlock(&data_mutex);
-        return -3; // Auction ended
-    }
+void send_response(Connection *conn, const char *response) {
+    send_response_len(conn, response, strlen(response));
+}
 
-    if (bid_amount < auction->current_price + auction->min_bid_increment) {
-        pthread_mutex_unlock(&data_mutex);
-        return -4; // Bid too low
+// Queue an already serialized text reply without copying it. BIN1 replies
+// carry the request's correlation id, so they are framed per request.
+void send_response_msg(Connection *conn, SharedMsg *msg) {
+    if (conn->proto == PROTO_BIN1 || conn->corr_id != 0) {
+        send_response_len(conn, msg->data, msg->len);
+        return;
     }
 
-    if (auction->seller_id == user_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -5; // Can't bid on own auction
+    uint64_t span = trace_begin();
+    t_request_cost.bytes_sent += msg->len;
+    pthread_mutex_lock(&conn->out_lock);
+    if (outq_push_locked(conn, msg, MSG_REPLY, 0) == 0 &&
+        (!conn->corked || conn->out_bytes >= CORK_FLUSH_BYTES)) {
+        outq_flush_locked(conn);
     }
+    pthread_mutex_unlock(&conn->out_lock);
+    trace_end("reply", span);
+}
 
-    User *user = find_user_by_id(user_id);
-    if (user == NULL || user->balance < bid_amount) {
-        pthread_mutex_unlock(&data_mutex);
-        return -6; // Insufficient balance
-    }
+void conn_cork(Connection *conn) {
+    pthread_mutex_lock(&conn->out_lock);
+    conn->corked = 1;
+    pthread_mutex_unlock(&conn->out_lock);
+}
 
-    // Create bid
-    if (g_bid_count >= MAX_BIDS) {
-        pthread_mutex_unlock(&data_mutex);
-        return -7; // Bids database full
+// Write all batched replies with as few syscalls as possible
+void conn_uncork(Connection *conn) {
+    pthread_mutex_lock(&conn->out_lock);
+    conn->corked = 0;
+    if (conn->socket >= 0 && !conn->closing) {
+        outq_flush_locked(conn);
     }
+    pthread_mutex_unlock(&conn->out_lock);
+}
 
-    Bid *bid = &g_bids[g_bid_count];
-    bid->bid_id = g_bid_count + 1;
-    bid->auction_id = auction_id;
-    bid->user_id = user_id;
-    bid->bid_amount = bid_amount;
-    bid->bid_time = time(NULL);
+// Send whatever is queued, then close the connection
+void conn_close_after_flush(Connection *conn) {
+    pthread_mutex_lock(&conn->out_lock);
+    if (conn->socket >= 0 && !conn->closing) {
+        conn->close_after_flush = 1;
+        if (conn->outq_count == 0) {
+            conn_shutdown_locked(conn);
+        } else {
+            outq_flush_locked(conn);
+        }
+    }
+    pthread_mutex_unlock(&conn->out_lock);
+}
 
-    g_bid_count++;
+// Write one round for a batch of connections: everything pending on each
+// socket goes out as a single vectored send, and the whole batch is
+// submitted together through the I/O backend. Only the flusher thread
+// calls this, so the iovec scratch space can be static.
+static int flush_round(Connection **conns, int count) {
+    static struct iovec iovs[FLUSH_BATCH_SIZE][FLUSH_IOV_MAX];
+    IoWrite ops[FLUSH_BATCH_SIZE];
+    Connection *owners[FLUSH_BATCH_SIZE];
+    int n = 0;
+    int more = 0;
+
+    for (int i = 0; i < count; i++) {
+        Connection *conn = conns[i];
+        if (conn == NULL) continue;
+        if (conn->outq_count == 0 || conn->waiting_writable || conn->closing) continue;
+
+        memset(&ops[n], 0, sizeof(IoWrite));
+        ops[n].fd = conn->socket;
+        ops[n].iov = iovs[n];
+        ops[n].iovcnt = outq_fill_iov(conn, iovs[n], FLUSH_IOV_MAX);
+        ops[n].offset = -1;
+        ops[n].buf_index = -1;
+        ops[n].send_flags = MSG_DONTWAIT;
+        owners[n] = conn;
+        n++;
+    }
 
-    // Update auction
-    auction->current_price = bid_amount;
-    auction->total_bids++;
-    auction->winner_id = user_id;
+    io_submit_writes(IO_RING_NET, ops, n);
 
-    // Anti-snipe: If bid placed in last 30 seconds, extend by 30 seconds
-    int time_remaining = auction->end_time - now;
-    if (time_remaining < 30 && time_remaining > 0) {
-        auction->end_time = now + 30;
-        printf("[INFO] Anti-snipe: Auction %d extended by 30 seconds\n", auction_id);
+    for (int i = 0; i < n; i++) {
+        if (outq_complete_write(owners[i], ops[i].result)) {
+            more = 1;
+        }
     }
 
-    save_all_data();
-    
-    int bid_id = bid->bid_id;
-    
-    pthread_mutex_unlock(&data_mutex);
-
-    return bid_id;
+    return more;
 }
 
-int buy_now(int auction_id, int user_id) {
-    pthread_mutex_lock(&data_mutex);
+// Flush a list of tokens; connections are locked in slot order
+static void flush_tokens(unsigned long *tokens, int count) {
+    Connection *batch[FLUSH_BATCH_SIZE];
 
-    Auction *auction = find_auction_by_id(auction_id);
+    for (int base = 0; base < count; base += FLUSH_BATCH_SIZE) {
+        int n = count - base;
+        if (n > FLUSH_BATCH_SIZE) n = FLUSH_BATCH_SIZE;
 
-    if (auction == NULL || strcmp(auction->status, "active") != 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Auction not available
-    }
+        for (int i = 0; i < n; i++) {
+            batch[i] = conn_lock_token(tokens[base + i]);
+            if (batch[i] != NULL) {
+                batch[i]->dirty = 0;
+            }
+        }
 
-    // Validate user is in the same room
-    ClientSession *client = find_client_by_user_id(user_id);
-    if (client == NULL || client->current_room_id != auction->room_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -4; // Not in the same room
-    }
+        while (flush_round(batch, n)) {
+        }
 
-    if (auction->buy_now_price <= 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Buy now not available
+        for (int i = 0; i < n; i++) {
+            if (batch[i] != NULL) {
+                pthread_mutex_unlock(&batch[i]->out_lock);
+            }
+        }
     }
+}
 
-    User *user = find_user_by_id(user_id);
-    if (user == NULL || user->balance < auction->buy_now_price) {
-        pthread_mutex_unlock(&data_mutex);
-        return -3; // Insufficient balance
-    }
+// Slot order first, then generation, so the newest token of a slot is last
+static int compare_tokens(const void *a, const void *b) {
+    unsigned long x = *(const unsigned long*)a;
+    unsigned long y = *(const unsigned long*)b;
+    unsigned long xi = x & 0xffffffffUL, yi = y & 0xffffffffUL;
+    if (xi != yi) return (xi > yi) - (xi < yi);
+    return (x > y) - (x < y);
+}
 
-    // Process buy now
-    user->balance -= auction->buy_now_price;
+void outq_log_stats() {
+    size_t depth = 0;
+    unsigned queued = 0;
 
-    User *seller = find_user_by_id(auction->seller_id);
-    if (seller != NULL) {
-        seller->balance += auction->buy_now_price;
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        pthread_mutex_lock(&g_conns[i].out_lock);
+        if (g_conns[i].socket >= 0) {
+            depth += g_conns[i].out_bytes;
+            queued += g_conns[i].outq_count;
+        }
+        pthread_mutex_unlock(&g_conns[i].out_lock);
     }
 
-    auction->winner_id = user_id;
-    auction->current_price = auction->buy_now_price;
-    strcpy(auction->status, "ended");
+    printf("[STATS] Outbound queues: depth=%zu bytes/%u msgs, high_water=%lu, enqueued=%lu, "
+           "written=%lu bytes, conflated=%lu, dropped=%lu, evictions=%lu\n",
+           depth, queued,
+           __atomic_load_n(&g_outq_stats.high_water_bytes, __ATOMIC_RELAXED),
+           __atomic_load_n(&g_outq_stats.enqueued, __ATOMIC_RELAXED),
+           __atomic_load_n(&g_outq_stats.bytes_written, __ATOMIC_RELAXED),
+           __atomic_load_n(&g_outq_stats.conflated, __ATOMIC_RELAXED),
+           __atomic_load_n(&g_outq_stats.dropped, __ATOMIC_RELAXED),
+           __atomic_load_n(&g_outq_stats.evictions, __ATOMIC_RELAXED));
+}
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+int flusher_init() {
+    g_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_epoll_fd < 0 || g_wake_fd < 0) {
+        return -1;
+    }
 
-    return 0;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = ~0UL;
+    return epoll_ctl(g_epoll_fd, EPOLL_CTL_ADD, g_wake_fd, &ev);
 }
 
-// ✅ NEW FEATURE: Delete auction (only if not started yet)
-int delete_auction(int auction_id, int user_id) {
-    pthread_mutex_lock(&data_mutex);
+// Single I/O thread: drains dirty queues and resumes writes on EPOLLOUT
+void* io_flusher(void *arg) {
+    struct epoll_event events[FLUSH_BATCH_SIZE];
+    unsigned long tokens[MAX_CONNECTIONS * 3 + FLUSH_BATCH_SIZE];
+    unsigned long last_enqueued = 0;
+    int64_t last_stats = clock_mono_ms();
 
-    Auction *auction = find_auction_by_id(auction_id);
+    trace_thread_name("flusher");
 
-    if (auction == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -1; // Auction not found
-    }
+    while (server_running) {
+        int count = 0;
+        int n = epoll_wait(g_epoll_fd, events, FLUSH_BATCH_SIZE, 1000);
 
-    // Can only delete if status is "waiting" (not started yet)
-    if (strcmp(auction->status, "waiting") != 0) {
-        pthread_mutex_unlock(&data_mutex);
-        return -2; // Auction already started or ended
-    }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u64 == ~0UL) {
+                uint64_t value;
+                while (read(g_wake_fd, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
 
-    // Get room to check permissions
-    AuctionRoom *room = find_room_by_id(auction->room_id);
-    if (room == NULL) {
-        pthread_mutex_unlock(&data_mutex);
-        return -3; // Room not found
-    }
+            Connection *conn = conn_lock_token(events[i].data.u64);
+            if (conn != NULL) {
+                conn->waiting_writable = 0;
+                pthread_mutex_unlock(&conn->out_lock);
+                tokens[count++] = events[i].data.u64;
+            }
+        }
 
-    // Only seller or room creator can delete
-    if (auction->seller_id != user_id && room->created_by != user_id) {
-        pthread_mutex_unlock(&data_mutex);
-        return -4; // No permission
-    }
+        pthread_mutex_lock(&dirty_mutex);
+        for (int i = 0; i < g_dirty_count; i++) {
+            tokens[count++] = g_dirty_list[i];
+        }
+        int full_scan = g_dirty_overflow;
+        g_dirty_count = 0;
+        g_dirty_overflow = 0;
+        pthread_mutex_unlock(&dirty_mutex);
+
+        if (full_scan) {
+            for (int i = 0; i < MAX_CONNECTIONS; i++) {
+                pthread_mutex_lock(&g_conns[i].out_lock);
+                if (g_conns[i].socket >= 0 && g_conns[i].outq_count > 0) {
+                    tokens[count++] = conn_token(&g_conns[i]);
+                }
+                pthread_mutex_unlock(&g_conns[i].out_lock);
+            }
+        }
 
-    // Mark auction as deleted
-    strcpy(auction->status, "deleted");
-    room->total_auctions--;
+        if (count > 0) {
+            qsort(tokens, count, sizeof(unsigned long), compare_tokens);
+            // One token per slot (the newest) so no connection is locked twice
+            int unique = 0;
+            for (int i = 0; i < count; i++) {
+                if (unique > 0 && (tokens[i] & 0xffffffffUL) == (tokens[unique - 1] & 0xffffffffUL)) {
+                    tokens[unique - 1] = tokens[i];
+                } else {
+                    tokens[unique++] = tokens[i];
+                }
+            }
+            uint64_t req = trace_request_begin();
+            flush_tokens(tokens, unique);
+            trace_request_end("flush", req);
+        }
 
-    save_all_data();
-    pthread_mutex_unlock(&data_mutex);
+        int64_t now = clock_mono_ms();
+        unsigned long enqueued = __atomic_load_n(&g_outq_stats.enqueued, __ATOMIC_RELAXED);
+        if (now - last_stats >= OUTQ_STATS_INTERVAL * 1000 && enqueued != last_enqueued) {
+            outq_log_stats();
+            last_stats = now;
+            last_enqueued = enqueued;
+        }
+    }
 
-    printf("[INFO] Auction %d deleted by user %d\n", auction_id, user_id);
-    return 0; // Success
+    return NULL;
 }
 
 // =====================================================
@@ -727,155 +1120,973 @@ int delete_auction(int auction_id, int user_id) {
 // =====================================================
 
 int is_user_logged_in(int user_id) {
-    pthread_mutex_lock(&client_mutex);
+    client_lock();
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (g_clients[i].is_active && g_clients[i].user_id == user_id) {
-            pthread_mutex_unlock(&client_mutex);
+            client_unlock();
             return 1;
         }
     }
 
-    pthread_mutex_unlock(&client_mutex);
+    client_unlock();
     return 0;
 }
 
+// Caller must hold the engine lock and client_mutex. Leaves the room (so the
+// participant count stays right) and frees the session slot.
+static void session_end_locked(ClientSession *client) {
+    if (engine_user_room(g_engine, client->user_id) > 0) {
+        engine_leave_room_locked(g_engine, client->user_id);
+    }
+    client->is_active = 0;
+    client->conn = NULL;
+    client->detached_at = 0;
+    g_client_count--;
+}
+
 void force_logout_user(int user_id) {
-    pthread_mutex_lock(&client_mutex);
+    engine_lock(g_engine);
+    client_lock();
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (g_clients[i].is_active && g_clients[i].user_id == user_id) {
-            char msg[] = "FORCE_LOGOUT|Another login detected\n";
-            send(g_clients[i].socket, msg, strlen(msg), 0);
-            g_clients[i].is_active = 0;
-            g_client_count--;
-            close(g_clients[i].socket);
-            printf("[INFO] Force logout user %s from socket %d\n",
-                   g_clients[i].username, g_clients[i].socket);
+            Connection *conn = g_clients[i].conn;
+            if (conn != NULL) {
+                WireMsg msg = wire_msg_text("FORCE_LOGOUT|Another login detected\n");
+                conn_enqueue(conn, &msg, MSG_TERMINAL, 0);
+                wire_msg_release(&msg);
+                __atomic_store_n(&conn->user_id, 0, __ATOMIC_RELAXED);
+                conn_close_after_flush(conn);
+                printf("[INFO] Force logout user %s from socket %d\n",
+                       g_clients[i].username, conn->socket);
+            } else {
+                printf("[INFO] Dropping detached session of user %s\n", g_clients[i].username);
+            }
+            session_end_locked(&g_clients[i]);
+            engine_save(g_engine);
         }
     }
 
-    pthread_mutex_unlock(&client_mutex);
+    client_unlock();
+    engine_unlock(g_engine);
+}
+
+// 128 random bits as hex; only has to be unguessable, not secret-grade
+static void make_resume_token(char *out) {
+    unsigned char raw[RESUME_TOKEN_LEN / 2];
+
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0 || read(fd, raw, sizeof(raw)) != (ssize_t)sizeof(raw)) {
+        for (size_t i = 0; i < sizeof(raw); i++) {
+            raw[i] = rand() & 0xff;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        sprintf(out + i * 2, "%02x", raw[i]);
+    }
+}
+
+// New token for a session on conn; recorded so replay can hand out the same
+static void issue_resume_token(Connection *conn, char *out) {
+    if (g_resume_token_source == NULL || g_resume_token_source(conn, out) != 0) {
+        make_resume_token(out);
+    }
+    capture_record(conn, CAP_TOKEN, 0, out, strlen(out));
 }
 
-void add_client(int socket, int user_id, const char *username) {
-    pthread_mutex_lock(&client_mutex);
+// Returns the new session's resume token in token_out
+void add_client(Connection *conn, int user_id, const char *username, char *token_out) {
+    client_lock();
 
+    token_out[0] = '\0';
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (!g_clients[i].is_active) {
-            g_clients[i].socket = socket;
+            g_clients[i].conn = conn;
             g_clients[i].user_id = user_id;
             strncpy(g_clients[i].username, username, 49);
             g_clients[i].username[49] = '\0';
             g_clients[i].is_active = 1;
-            g_clients[i].login_time = time(NULL);
-            g_clients[i].current_room_id = 0; // Not in any room initially
+            g_clients[i].login_time = clock_now(&g_clock);
+            g_clients[i].detached_at = 0;
+            issue_resume_token(conn, g_clients[i].resume_token);
+            strcpy(token_out, g_clients[i].resume_token);
             g_client_count++;
+            __atomic_store_n(&conn->user_id, user_id, __ATOMIC_RELAXED);
             break;
         }
     }
 
-    pthread_mutex_unlock(&client_mutex);
+    client_unlock();
 }
 
-void remove_client(int socket) {
-    pthread_mutex_lock(&client_mutex);
+// detach: the connection dropped rather than QUIT, so keep the session and
+// its room for RESUME_GRACE_SECONDS instead of logging the user out
+void remove_client(Connection *conn, int detach) {
+    int user_id = 0;
+    int room_id = 0;
+
+    engine_lock(g_engine);
+    client_lock();
 
-    int user_id_to_remove = 0;
-    int room_id_to_leave = 0;
-    
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (g_clients[i].is_active && g_clients[i].socket == socket) {
-            user_id_to_remove = g_clients[i].user_id;
-            room_id_to_leave = g_clients[i].current_room_id;
-            
-            g_clients[i].is_active = 0;
-            g_client_count--;
-            printf("[INFO] Client disconnected: socket=%d, user_id=%d\n", socket, user_id_to_remove);
+        if (g_clients[i].is_active && g_clients[i].conn == conn) {
+            user_id = g_clients[i].user_id;
+            room_id = engine_user_room(g_engine, g_clients[i].user_id);
+            __atomic_store_n(&conn->user_id, 0, __ATOMIC_RELAXED);
+
+            if (detach) {
+                g_clients[i].conn = NULL;
+                g_clients[i].detached_at = clock_now(&g_clock);
+                printf("[INFO] Session of user %d detached, resumable for %d seconds\n",
+                       user_id, RESUME_GRACE_SECONDS);
+            } else {
+                session_end_locked(&g_clients[i]);
+                if (room_id > 0) {
+                    engine_save(g_engine);
+                }
+                printf("[INFO] Client disconnected: socket=%d, user_id=%d\n", conn->socket, user_id);
+            }
             break;
         }
     }
 
-    pthread_mutex_unlock(&client_mutex);
-    
+    client_unlock();
+    engine_unlock(g_engine);
+
     // Auto leave room when disconnect
-    if (user_id_to_remove > 0 && room_id_to_leave > 0) {
-        pthread_mutex_lock(&data_mutex);
-        pthread_mutex_lock(&client_mutex);
-        
-        _leave_room_unsafe(user_id_to_remove);
-        save_all_data();
-        
-        pthread_mutex_unlock(&client_mutex);
-        pthread_mutex_unlock(&data_mutex);
-        
-        printf("[INFO] User %d auto-left room %d on disconnect\n", user_id_to_remove, room_id_to_leave);
-        
+    if (!detach && user_id > 0 && room_id > 0) {
+        printf("[INFO] User %d auto-left room %d on disconnect\n", user_id, room_id);
+
         // ✅ Log disconnect and auto-leave
-        User *user = find_user_by_id(user_id_to_remove);
+        User *user = engine_find_user(g_engine, user_id);
         if (user != NULL) {
             char details[256];
-            sprintf(details, "Disconnected and auto-left room %d", room_id_to_leave);
-            log_activity(user_id_to_remove, user->username, "DISCONNECT", details, "127.0.0.1");
+            sprintf(details, "Disconnected and auto-left room %d", room_id);
+            log_activity(user_id, user->username, "DISCONNECT", details, "127.0.0.1");
         }
     }
 }
 
-void broadcast_message_to_room(const char *message, int room_id, int exclude_socket) {
-    pthread_mutex_lock(&client_mutex);
+// Called periodically by the auction timer: log out sessions whose client
+// did not come back in time
+void expire_detached_sessions() {
+    time_t now = clock_now(&g_clock);
+    int expired = 0;
+
+    engine_lock(g_engine);
+    client_lock();
 
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (g_clients[i].is_active && 
-            g_clients[i].current_room_id == room_id && 
-            g_clients[i].socket != exclude_socket) {
-            send(g_clients[i].socket, message, strlen(message), 0);
+        if (g_clients[i].is_active && g_clients[i].conn == NULL &&
+            now - g_clients[i].detached_at >= RESUME_GRACE_SECONDS) {
+            printf("[INFO] Detached session of user %d expired (room %d)\n",
+                   g_clients[i].user_id, engine_user_room(g_engine, g_clients[i].user_id));
+            session_end_locked(&g_clients[i]);
+            expired++;
         }
     }
 
-    pthread_mutex_unlock(&client_mutex);
-}
-
-// =====================================================
-// PROTOCOL HANDLERS
-// =====================================================
-
-void handle_register(int client_socket, char *data) {
-    char username[50], password[256], email[100];
-    sscanf(data, "%s %s %s", username, password, email);
-
-    int user_id = register_user(username, password, email);
-
-    char response[BUFFER_SIZE];
-    if (user_id > 0) {
-        sprintf(response, "REGISTER_SUCCESS|%d|%s\n", user_id, username);
-    } else if (user_id == -1) {
-        sprintf(response, "REGISTER_FAIL|Username already exists\n");
-    } else {
-        sprintf(response, "REGISTER_FAIL|Database full\n");
+    if (expired > 0) {
+        engine_save(g_engine);
     }
 
-    send(client_socket, response, strlen(response), 0);
+    client_unlock();
+    engine_unlock(g_engine);
 }
 
-void handle_login(int client_socket, char *data) {
-    char username[50], password[256];
-    sscanf(data, "%s %s", username, password);
+// Only queues the message; the flusher thread does the socket writes, so a
+// stalled member can never hold up the caller (or the locks it holds).
+// Each encoding is built once and shared by every member's queue.
+void broadcast_wire_to_room(WireMsg *msg, int room_id, Connection *exclude,
+                            MsgClass cls, unsigned conflate_key) {
+    int need_wake = 0;
+    int recipients = 0;
 
-    int user_id = authenticate_user(username, password);
+    if (msg->text == NULL) {
+        return;
+    }
+
+    uint64_t span = trace_begin();
+    client_lock();
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (g_clients[i].is_active && g_clients[i].conn != NULL &&
+            engine_user_room(g_engine, g_clients[i].user_id) == room_id && 
+            g_clients[i].conn != exclude) {
+            need_wake |= conn_enqueue(g_clients[i].conn, msg, cls, conflate_key);
+            recipients++;
+        }
+    }
+
+    client_unlock();
+    trace_end("broadcast", span);
+    metrics_add(MET_BROADCASTS, 1);
+    metrics_add(MET_BROADCAST_RECIPIENTS, recipients);
+    t_request_cost.recipients += recipients;
+
+    if (need_wake) {
+        flusher_wake();
+    }
+}
+
+void broadcast_message_to_room(const char *message, int room_id, Connection *exclude,
+                               MsgClass cls, unsigned conflate_key) {
+    WireMsg msg = wire_msg_text(message);
+    broadcast_wire_to_room(&msg, room_id, exclude, cls, conflate_key);
+    wire_msg_release(&msg);
+}
+
+void broadcast_message_to_all(const char *message, Connection *exclude, MsgClass cls) {
+    WireMsg msg = wire_msg_text(message);
+    int need_wake = 0;
+    int recipients = 0;
+
+    if (msg.text == NULL) {
+        return;
+    }
+
+    uint64_t span = trace_begin();
+    client_lock();
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (g_clients[i].is_active && g_clients[i].conn != NULL && g_clients[i].conn != exclude) {
+            need_wake |= conn_enqueue(g_clients[i].conn, &msg, cls, 0);
+            recipients++;
+        }
+    }
+
+    client_unlock();
+    wire_msg_release(&msg);
+    trace_end("broadcast", span);
+    metrics_add(MET_BROADCASTS, 1);
+    metrics_add(MET_BROADCAST_RECIPIENTS, recipients);
+    t_request_cost.recipients += recipients;
+
+    if (need_wake) {
+        flusher_wake();
+    }
+}
+
+// =====================================================
+// RESPONSE BUILDER
+// =====================================================
+
+#define RESP_INITIAL_CAP BUFFER_SIZE
+
+// Append-pointer reply buffer. Every thread reuses its own storage, so
+// building a listing is linear and only allocates when a reply outgrows
+// every earlier one.
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;         // out of memory: text was dropped, resp_send sends an error
+} RespBuf;
+
+static __thread RespBuf t_resp;
+
+static int resp_reserve(RespBuf *r, size_t extra) {
+    if (r->len + extra + 1 <= r->cap) {
+        return 0;
+    }
+
+    size_t cap = r->cap ? r->cap : RESP_INITIAL_CAP;
+    while (cap < r->len + extra + 1) {
+        cap *= 2;
+    }
+    char *data = realloc(r->data, cap);
+    if (data == NULL) {
+        r->failed = 1;
+        return -1;
+    }
+    r->data = data;
+    r->cap = cap;
+    return 0;
+}
+
+void resp_append(RespBuf *r, const char *s, size_t len) {
+    if (r->failed || resp_reserve(r, len) != 0) {
+        return;
+    }
+    memcpy(r->data + r->len, s, len);
+    r->len += len;
+    r->data[r->len] = '\0';
+}
+
+void resp_vappendf(RespBuf *r, const char *fmt, va_list args) {
+    va_list retry;
+
+    if (r->failed || resp_reserve(r, 256) != 0) {
+        return;
+    }
+
+    va_copy(retry, args);
+    int n = vsnprintf(r->data + r->len, r->cap - r->len, fmt, args);
+
+    if (n >= 0 && (size_t)n >= r->cap - r->len) {
+        if (resp_reserve(r, n) != 0) {
+            n = -1;
+        } else {
+            vsnprintf(r->data + r->len, r->cap - r->len, fmt, retry);
+        }
+    }
+    va_end(retry);
+
+    if (n < 0) {
+        r->data[r->len] = '\0';
+        return;
+    }
+    r->len += n;
+}
+
+void resp_appendf(RespBuf *r, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    resp_vappendf(r, fmt, args);
+    va_end(args);
+}
+
+// Start a reply in this thread's buffer
+RespBuf* resp_begin(const char *prefix) {
+    RespBuf *r = &t_resp;
+    r->len = 0;
+    r->failed = 0;
+    resp_append(r, prefix, strlen(prefix));
+    return r;
+}
+
+// Terminate the line and queue it; a huge listing goes out with the
+// same vectored sends as everything else. A reply that could not be
+// built whole is never sent in part.
+void resp_send(Connection *conn, RespBuf *r) {
+    resp_append(r, "\n", 1);
+    if (r->failed) {
+        send_response(conn, "ERROR|Out of memory\n");
+        return;
+    }
+    send_response_len(conn, r->data, r->len);
+}
+
+// =====================================================
+// PAGED LISTINGS
+// =====================================================
+
+#define LIST_DEFAULT_PAGE 50
+#define LIST_MAX_PAGE 500
+#define LIST_CHUNK_ROWS 50
+
+// Optional trailing "cursor|limit[|STREAM]" fields of a listing command.
+// A cursor is the last row id the client has seen. Rooms, auctions and
+// bids are never compacted (id N is always at index N - 1), so cursors
+// stay valid while rows are added and the handler can seek in O(1).
+typedef struct {
+    int paged;          // cursor given: limit applies and the reply has a trailer
+    int cursor;
+    int limit;
+    int stream;         // TAG_BEGIN / TAG_CHUNK... / TAG_END instead of one line
+} ListParams;
+
+// Paged reply: "TAG|row|row|END;<next>|" where next is 0 on the last page.
+// Streamed: "TAG_BEGIN|", one "TAG_CHUNK|row|...|" per LIST_CHUNK_ROWS rows,
+// then "TAG_END|<next>". Requests without a cursor get the legacy
+// unlimited "TAG|row|...|" line.
+typedef struct {
+    Connection *conn;
+    const char *tag;
+    ListParams params;
+    RespBuf *buf;
+    int rows;
+    int chunk_rows;
+    int last_id;
+    int next_cursor;
+} ListReply;
+
+// skip_fields: how many leading '|' fields belong to the command itself
+void list_params_parse(const char *data, int skip_fields, ListParams *p) {
+    char mode[16] = "";
+
+    memset(p, 0, sizeof(ListParams));
+    for (int i = 0; i < skip_fields && data != NULL; i++) {
+        data = strchr(data, '|');
+        if (data != NULL) data++;
+    }
+    if (data == NULL || sscanf(data, "%d|%d|%15s", &p->cursor, &p->limit, mode) < 1) {
+        return;
+    }
+
+    p->paged = 1;
+    if (p->cursor < 0) p->cursor = 0;
+    if (p->limit <= 0) p->limit = LIST_DEFAULT_PAGE;
+    if (p->limit > LIST_MAX_PAGE) p->limit = LIST_MAX_PAGE;
+    p->stream = strcmp(mode, "STREAM") == 0;
+}
+
+static void list_start_chunk(ListReply *lr) {
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s%s|", lr->tag, lr->params.stream ? "_CHUNK" : "");
+    lr->buf = resp_begin(prefix);
+    lr->chunk_rows = 0;
+}
+
+void list_begin(ListReply *lr, Connection *conn, const char *tag, const ListParams *params) {
+    lr->conn = conn;
+    lr->tag = tag;
+    lr->params = *params;
+    lr->rows = 0;
+    lr->last_id = 0;
+    lr->next_cursor = 0;
+
+    if (params->stream) {
+        char header[64];
+        snprintf(header, sizeof(header), "%s_BEGIN|\n", tag);
+        send_response(conn, header);
+    }
+    list_start_chunk(lr);
+}
+
+// Call before emitting a matching row. Returns 1 once the page is full,
+// which also means there is a next page starting after the last row sent.
+int list_full(ListReply *lr) {
+    if (!lr->params.paged || lr->rows < lr->params.limit) {
+        return 0;
+    }
+    lr->next_cursor = lr->last_id;
+    return 1;
+}
+
+void list_row(ListReply *lr, int id, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    resp_vappendf(lr->buf, fmt, args);
+    va_end(args);
+
+    lr->rows++;
+    lr->last_id = id;
+
+    if (lr->params.stream && ++lr->chunk_rows == LIST_CHUNK_ROWS) {
+        resp_send(lr->conn, lr->buf);
+        list_start_chunk(lr);
+    }
+}
+
+void list_end(ListReply *lr) {
+    if (lr->params.stream) {
+        char trailer[64];
+        if (lr->chunk_rows > 0) {
+            resp_send(lr->conn, lr->buf);
+        }
+        snprintf(trailer, sizeof(trailer), "%s_END|%d\n", lr->tag, lr->next_cursor);
+        send_response(lr->conn, trailer);
+        return;
+    }
+
+    if (lr->params.paged) {
+        resp_appendf(lr->buf, "END;%d|", lr->next_cursor);
+    }
+    resp_send(lr->conn, lr->buf);
+}
+
+// =====================================================
+// RESPONSE CACHE
+// =====================================================
+
+// Pre-serialized replies for hot read endpoints, keyed by (endpoint, key,
+// limit) and tagged with the version counter they were rendered at. A hit
+// only takes the slot lock, never the engine lock, and queues the cached bytes
+// by reference. Replies contain time_left in whole seconds, so an entry is
+// also only valid during the second it was rendered in.
+typedef enum {
+    CACHE_ROOM_LIST = 0,    // key = cursor, limit (0 = unpaged)
+    CACHE_ROOM_DETAIL,      // key = room_id
+    CACHE_ENDPOINTS
+} CacheEndpoint;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int endpoint;
+    int key;
+    int limit;
+    unsigned long version;
+    time_t tick;
+    SharedMsg *msg;
+} RespCacheEntry;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+} RespCacheStats;
+
+static const char *cache_endpoint_names[CACHE_ENDPOINTS] = { "LIST_ROOMS", "ROOM_DETAIL" };
+
+RespCacheEntry g_resp_cache[RESP_CACHE_SLOTS];
+RespCacheStats g_resp_cache_stats[CACHE_ENDPOINTS];
+
+void resp_cache_init() {
+    for (int i = 0; i < RESP_CACHE_SLOTS; i++) {
+        pthread_mutex_init(&g_resp_cache[i].lock, NULL);
+    }
+}
+
+static unsigned long cache_version(CacheEndpoint endpoint, int key) {
+    const unsigned long *v = endpoint == CACHE_ROOM_DETAIL ? &g_room_version[key - 1] : &g_rooms_version;
+    return __atomic_load_n(v, __ATOMIC_ACQUIRE);
+}
+
+static RespCacheEntry* cache_slot(CacheEndpoint endpoint, int key, int limit) {
+    unsigned h = (unsigned)endpoint * 2654435761u ^ (unsigned)key * 40503u ^ (unsigned)limit;
+    return &g_resp_cache[h % RESP_CACHE_SLOTS];
+}
+
+// Returns 1 and queues the cached reply if it is still current
+int resp_cache_serve(Connection *conn, CacheEndpoint endpoint, int key, int limit) {
+    RespCacheEntry *e = cache_slot(endpoint, key, limit);
+    unsigned long version = cache_version(endpoint, key);
+    SharedMsg *msg = NULL;
+
+    pthread_mutex_lock(&e->lock);
+    if (e->msg != NULL && e->endpoint == (int)endpoint && e->key == key && e->limit == limit &&
+        e->version == version && e->tick == clock_now(&g_clock)) {
+        msg = shared_msg_retain(e->msg);
+    }
+    pthread_mutex_unlock(&e->lock);
+
+    if (msg == NULL) {
+        __atomic_fetch_add(&g_resp_cache_stats[endpoint].misses, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    __atomic_fetch_add(&g_resp_cache_stats[endpoint].hits, 1, __ATOMIC_RELAXED);
+    send_response_msg(conn, msg);
+    shared_msg_release(msg);
+    return 1;
+}
+
+// Caller must hold the engine lock, so the version matches the rendered bytes
+void resp_cache_store(CacheEndpoint endpoint, int key, int limit, const char *data, size_t len,
+                      time_t tick) {
+    RespCacheEntry *e = cache_slot(endpoint, key, limit);
+    SharedMsg *msg = shared_msg_new(data, len);
+    if (msg == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&e->lock);
+    SharedMsg *old = e->msg;
+    e->endpoint = endpoint;
+    e->key = key;
+    e->limit = limit;
+    e->version = cache_version(endpoint, key);
+    e->tick = tick;
+    e->msg = msg;
+    pthread_mutex_unlock(&e->lock);
+
+    shared_msg_release(old);
+}
+
+void resp_cache_log_stats() {
+    for (int i = 0; i < CACHE_ENDPOINTS; i++) {
+        unsigned long hits = __atomic_load_n(&g_resp_cache_stats[i].hits, __ATOMIC_RELAXED);
+        unsigned long misses = __atomic_load_n(&g_resp_cache_stats[i].misses, __ATOMIC_RELAXED);
+        printf("[STATS] Response cache %s: hits=%lu misses=%lu hit_rate=%.1f%%\n",
+               cache_endpoint_names[i], hits, misses,
+               hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    }
+}
+
+// =====================================================
+// IDEMPOTENT REQUESTS
+// =====================================================
+
+// PLACE_BID and BUY_NOW take an optional trailing request id. The first
+// reply for (user, request id) is kept for DEDUP_TTL_SECONDS and a retry
+// gets that reply back instead of running the command again; a retry that
+// arrives while the first attempt is still running waits for it.
+
+typedef struct {
+    int user_id;                // 0 = empty
+    char request_id[PROTO_REQUEST_ID_LEN + 1];
+    int pending;                // first attempt still running, never evicted
+    time_t created;
+    int result;                 // engine result of the first attempt (bid id on success)
+    char reply[DEDUP_REPLY_LEN];
+} DedupEntry;
+
+typedef enum {
+    DEDUP_CLAIMED,              // new: run it, then dedup_finish
+    DEDUP_HIT,                  // answered before: reply / result filled in
+    DEDUP_PENDING,              // first attempt still running
+    DEDUP_UNTRACKED             // table window full of pending entries: run it untracked
+} DedupClaim;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long waits;
+    unsigned long evictions;
+} DedupStats;
+
+DedupEntry g_dedup[DEDUP_SLOTS];
+DedupStats g_dedup_stats;
+pthread_mutex_t dedup_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t dedup_cond = PTHREAD_COND_INITIALIZER;
+
+// Letters, digits, '-' and '_' only, so the id can never break framing
+int valid_request_id(const char *request_id) {
+    size_t len = strlen(request_id);
+    if (len == 0 || len > PROTO_REQUEST_ID_LEN) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = request_id[i];
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static unsigned dedup_hash(int user_id, const char *request_id) {
+    uint32_t h = 2166136261u ^ (uint32_t)user_id;
+    while (*request_id) {
+        h ^= (unsigned char)*request_id++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int dedup_live(const DedupEntry *e, time_t now) {
+    return e->user_id != 0 && (e->pending || now - e->created < DEDUP_TTL_SECONDS);
+}
+
+// Caller must hold dedup_mutex
+static DedupEntry* dedup_find_locked(int user_id, const char *request_id, time_t now) {
+    unsigned h = dedup_hash(user_id, request_id);
+    for (int i = 0; i < DEDUP_PROBE; i++) {
+        DedupEntry *e = &g_dedup[(h + i) & (DEDUP_SLOTS - 1)];
+        if (e->user_id == user_id && dedup_live(e, now) &&
+            strcmp(e->request_id, request_id) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Caller must hold dedup_mutex. A free or expired slot in the probe window,
+// else the oldest finished entry; NULL if every slot is mid-request.
+static DedupEntry* dedup_victim_locked(int user_id, const char *request_id, time_t now) {
+    unsigned h = dedup_hash(user_id, request_id);
+    DedupEntry *oldest = NULL;
+    for (int i = 0; i < DEDUP_PROBE; i++) {
+        DedupEntry *e = &g_dedup[(h + i) & (DEDUP_SLOTS - 1)];
+        if (!dedup_live(e, now)) {
+            return e;
+        }
+        if (!e->pending && (oldest == NULL || e->created < oldest->created)) {
+            oldest = e;
+        }
+    }
+    if (oldest != NULL) {
+        g_dedup_stats.evictions++;
+    }
+    return oldest;
+}
+
+// Caller must hold dedup_mutex. Never waits.
+static DedupClaim dedup_claim_locked(int user_id, const char *request_id, char *reply, size_t size,
+                                     int *result) {
+    time_t now = clock_now(&g_clock);
+    DedupEntry *e = dedup_find_locked(user_id, request_id, now);
+
+    if (e != NULL && e->pending) {
+        return DEDUP_PENDING;
+    }
+    if (e != NULL) {
+        g_dedup_stats.hits++;
+        snprintf(reply, size, "%s", e->reply);
+        if (result != NULL) *result = e->result;
+        return DEDUP_HIT;
+    }
+
+    g_dedup_stats.misses++;
+    e = dedup_victim_locked(user_id, request_id, now);
+    if (e == NULL) {
+        return DEDUP_UNTRACKED;
+    }
+    e->user_id = user_id;
+    snprintf(e->request_id, sizeof(e->request_id), "%s", request_id);
+    e->pending = 1;
+    e->created = now;
+    e->result = 0;
+    e->reply[0] = '\0';
+    return DEDUP_CLAIMED;
+}
+
+// Returns 1 and copies the original reply if this request id was already
+// answered, waiting for a first attempt that is still running. Otherwise
+// marks it in flight and returns 0; the caller must then call dedup_finish
+// with its reply. Must not be called while holding another claim.
+int dedup_begin(int user_id, const char *request_id, char *reply, size_t size) {
+    DedupClaim claim;
+
+    pthread_mutex_lock(&dedup_mutex);
+    while ((claim = dedup_claim_locked(user_id, request_id, reply, size, NULL)) == DEDUP_PENDING) {
+        g_dedup_stats.waits++;
+        pthread_cond_wait(&dedup_cond, &dedup_mutex);
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+    return claim == DEDUP_HIT;
+}
+
+// dedup_begin without the wait, for callers that claim several ids at once
+DedupClaim dedup_try_begin(int user_id, const char *request_id, char *reply, size_t size, int *result) {
+    pthread_mutex_lock(&dedup_mutex);
+    DedupClaim claim = dedup_claim_locked(user_id, request_id, reply, size, result);
+    pthread_mutex_unlock(&dedup_mutex);
+    return claim;
+}
+
+// Until the first attempt of this request id is no longer running
+void dedup_wait(int user_id, const char *request_id) {
+    pthread_mutex_lock(&dedup_mutex);
+    DedupEntry *e;
+    while ((e = dedup_find_locked(user_id, request_id, clock_now(&g_clock))) != NULL && e->pending) {
+        g_dedup_stats.waits++;
+        pthread_cond_wait(&dedup_cond, &dedup_mutex);
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+}
+
+// Gives up a DEDUP_CLAIMED id without answering it
+void dedup_release(int user_id, const char *request_id) {
+    pthread_mutex_lock(&dedup_mutex);
+    DedupEntry *e = dedup_find_locked(user_id, request_id, clock_now(&g_clock));
+    if (e != NULL && e->pending) {
+        e->user_id = 0;
+        e->pending = 0;
+        pthread_cond_broadcast(&dedup_cond);
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+}
+
+// result: the engine's result, returned to dedup_try_begin on a hit
+void dedup_finish(int user_id, const char *request_id, const char *reply, int result) {
+    pthread_mutex_lock(&dedup_mutex);
+    time_t now = clock_now(&g_clock);
+    DedupEntry *e = dedup_find_locked(user_id, request_id, now);
+    if (e != NULL && e->pending) {
+        snprintf(e->reply, sizeof(e->reply), "%s", reply);
+        e->result = result;
+        e->pending = 0;
+        e->created = now;
+        pthread_cond_broadcast(&dedup_cond);
+    }
+    pthread_mutex_unlock(&dedup_mutex);
+}
+
+void dedup_log_stats() {
+    pthread_mutex_lock(&dedup_mutex);
+    DedupStats stats = g_dedup_stats;
+    pthread_mutex_unlock(&dedup_mutex);
+
+    printf("[STATS] Request dedup: hits=%lu misses=%lu waits=%lu evictions=%lu hit_rate=%.1f%%\n",
+           stats.hits, stats.misses, stats.waits, stats.evictions,
+           stats.hits + stats.misses > 0 ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0.0);
+}
+
+// =====================================================
+// LIVE SUBSCRIPTIONS
+// =====================================================
+
+// A subscriber gets one SNAPSHOT of the current state, then a DELTA line
+// per change:
+//
+//   SNAPSHOT|ROOM|<room_id>|<seq>|<server_time>|row|row|...
+//   SNAPSHOT|AUCTION|<auction_id>|<seq>|<server_time>|row
+//   DELTA|<ROOM|AUCTION>|<id>|<seq>|NEW|row
+//   DELTA|<ROOM|AUCTION>|<id>|<seq>|BID|auction_id|price|total_bids|end_time
+//   DELTA|<ROOM|AUCTION>|<id>|<seq>|STATE|auction_id|status|price|winner_id
+//
+// row = id;title;price;buy_now;min_increment;total_bids;end_time;status
+//
+// Times are absolute server time, so clients count down locally. The
+// first delta after a snapshot carries seq + 1; a gap (e.g. events dropped
+// for a slow consumer) means the replica is stale and the client must
+// subscribe again. Snapshots and deltas are both produced under
+// the engine lock, which keeps them in order on the connection's queue.
+
+void append_auction_row(RespBuf *r, const Auction *a) {
+    resp_appendf(r, "%d;%s;%.2f;%.2f;%.2f;%d;%ld;%s|",
+                 a->auction_id, a->title, a->current_price, a->buy_now_price,
+                 a->min_bid_increment, a->total_bids, (long)a->end_time, a->status);
+}
+
+// Keep the delta for RESUME; the ring holds its own references
+static void record_room_event(int room_id, unsigned long seq, WireMsg *msg) {
+    if (msg->text == NULL) {
+        return;
+    }
+    if (g_room_events[room_id - 1] == NULL) {
+        g_room_events[room_id - 1] = calloc(ROOM_EVENT_RING, sizeof(RoomEvent));
+        if (g_room_events[room_id - 1] == NULL) {
+            return;
+        }
+    }
+
+    RoomEvent *ev = &g_room_events[room_id - 1][seq % ROOM_EVENT_RING];
+    wire_msg_release(&ev->msg);
+    ev->seq = seq;
+    ev->msg.text = shared_msg_retain(msg->text);
+    ev->msg.bin = msg->bin != NULL ? shared_msg_retain(msg->bin) : NULL;
+}
+
+// Queue the deltas after last_seq from the ring. Returns -1 if some of
+// them have already been overwritten and a snapshot is needed instead.
+static int replay_room_events(Connection *conn, int room_id, unsigned long last_seq) {
+    unsigned long current = g_room_seq[room_id - 1];
+    RoomEvent *ring = g_room_events[room_id - 1];
+
+    if (last_seq > current || current - last_seq > ROOM_EVENT_RING ||
+        (ring == NULL && current > last_seq)) {
+        return -1;
+    }
+
+    int need_wake = 0;
+    for (unsigned long seq = last_seq + 1; seq <= current; seq++) {
+        RoomEvent *ev = &ring[seq % ROOM_EVENT_RING];
+        if (ev->seq != seq) {
+            return -1;
+        }
+        need_wake |= conn_enqueue(conn, &ev->msg, MSG_TERMINAL, 0);
+    }
+    if (need_wake) {
+        flusher_wake();
+    }
+    return 0;
+}
+
+// Caller must hold the engine lock
+static void send_room_snapshot(Connection *conn, int room_id) {
+    RespBuf *r = resp_begin("SNAPSHOT|ROOM|");
+    resp_appendf(r, "%d|%lu|%ld|", room_id, g_room_seq[room_id - 1], (long)clock_now(&g_clock));
+    for (int i = 0; i < g_engine->auction_count; i++) {
+        if (g_engine->auctions[i].room_id == room_id && strcmp(g_engine->auctions[i].status, "active") == 0) {
+            append_auction_row(r, &g_engine->auctions[i]);
+        }
+    }
+    resp_send(conn, r);
+}
+
+void publish_auction_delta(const Auction *auction, DeltaKind kind) {
+    char body[512];
+    char line[600];
+    int need_wake = 0;
+    int recipients = 0;
+
+    switch (kind) {
+        case DELTA_NEW:
+            snprintf(body, sizeof(body), "NEW|%d;%s;%.2f;%.2f;%.2f;%d;%ld;%s|",
+                     auction->auction_id, auction->title, auction->current_price,
+                     auction->buy_now_price, auction->min_bid_increment,
+                     auction->total_bids, (long)auction->end_time, auction->status);
+            break;
+        case DELTA_BID:
+            snprintf(body, sizeof(body), "BID|%d|%.2f|%d|%ld",
+                     auction->auction_id, auction->current_price,
+                     auction->total_bids, (long)auction->end_time);
+            break;
+        case DELTA_STATE:
+            snprintf(body, sizeof(body), "STATE|%d|%s|%.2f|%d",
+                     auction->auction_id, auction->status,
+                     auction->current_price, auction->winner_id);
+            break;
+    }
+
+    // State changes are final and must reach the replica like AUCTION_ENDED
+    MsgClass cls = kind == DELTA_STATE ? MSG_TERMINAL : MSG_EVENT;
+    uint64_t span = trace_begin();
+
+    snprintf(line, sizeof(line), "DELTA|ROOM|%d|%lu|%s\n", auction->room_id,
+             ++g_room_seq[auction->room_id - 1], body);
+    WireMsg room_msg = wire_msg_text(line);
+
+    snprintf(line, sizeof(line), "DELTA|AUCTION|%d|%lu|%s\n", auction->auction_id,
+             ++g_auction_seq[auction->auction_id - 1], body);
+    WireMsg auction_msg = wire_msg_text(line);
+
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection *conn = &g_conns[i];
+        if (conn->sub_room_id == auction->room_id && room_msg.text != NULL) {
+            need_wake |= conn_enqueue(conn, &room_msg, cls, 0);
+            recipients++;
+        }
+        if (conn->sub_auction_id == auction->auction_id && auction_msg.text != NULL) {
+            need_wake |= conn_enqueue(conn, &auction_msg, cls, 0);
+            recipients++;
+        }
+    }
+    metrics_add(MET_DELTAS, 1);
+    metrics_add(MET_DELTA_RECIPIENTS, recipients);
+    t_request_cost.recipients += recipients;
+
+    record_room_event(auction->room_id, g_room_seq[auction->room_id - 1], &room_msg);
+    wire_msg_release(&room_msg);
+    wire_msg_release(&auction_msg);
+    trace_end("publish_delta", span);
+
+    if (need_wake) {
+        flusher_wake();
+    }
+}
+
+// =====================================================
+// PROTOCOL HANDLERS
+// =====================================================
+
+void handle_register(Connection *conn, char *data) {
+    char username[50] = "", password[256] = "", email[100] = "";
+    sscanf(data, "%49s %255s %99s", username, password, email);
+
+    int user_id = engine_register_user(g_engine, username, password, email);
+
+    char response[BUFFER_SIZE];
+    if (user_id > 0) {
+        sprintf(response, "REGISTER_SUCCESS|%d|%s\n", user_id, username);
+    } else if (user_id == -1) {
+        sprintf(response, "REGISTER_FAIL|Username already exists\n");
+    } else {
+        sprintf(response, "REGISTER_FAIL|Database full\n");
+    }
+
+    send_response(conn, response);
+}
+
+void handle_login(Connection *conn, char *data) {
+    char username[50] = "", password[256] = "";
+    sscanf(data, "%49s %255s", username, password);
+
+    int user_id = engine_authenticate_user(g_engine, username, password);
 
     char response[BUFFER_SIZE];
     if (user_id > 0) {
         // Check if user is already logged in
         if (is_user_logged_in(user_id)) {
             force_logout_user(user_id);
-            sleep(1); // Wait for force logout to complete
+            if (!g_replaying) {
+                sleep(1); // Wait for force logout to complete
+            }
         }
 
-        User *user = find_user_by_id(user_id);
-        sprintf(response, "LOGIN_SUCCESS|%d|%s|%.2f\n",
-                user_id, username, user->balance);
-        add_client(client_socket, user_id, username);
-        printf("[INFO] User %s logged in (socket %d)\n", username, client_socket);
+        User *user = engine_find_user(g_engine, user_id);
+        char token[RESUME_TOKEN_LEN + 1];
+        add_client(conn, user_id, username, token);
+        sprintf(response, "LOGIN_SUCCESS|%d|%s|%.2f|%s\n",
+                user_id, username, user->balance, token);
+        printf("[INFO] User %s logged in (socket %d)\n", username, conn->socket);
         
         // ✅ Log activity
         log_activity(user_id, username, "LOGIN", "Successful login", "127.0.0.1");
@@ -893,38 +2104,35 @@ void handle_login(int client_socket, char *data) {
         log_activity(0, username, "LOGIN_FAIL", "Account not active", "127.0.0.1");
     }
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_create_room(int client_socket, char *data) {
-    int creator_id, max_participants, duration;
-    char name[100], desc[200];
+void handle_create_room(Connection *conn, char *data) {
+    int creator_id = 0, max_participants = 0, duration = 0;
+    char name[100] = "", desc[200] = "";
 
-    sscanf(data, "%d|%[^|]|%[^|]|%d|%d",
+    sscanf(data, "%d|%99[^|]|%199[^|]|%d|%d",
            &creator_id, name, desc, &max_participants, &duration);
 
     // ✅ NEW: Check if user is already in a room
-    pthread_mutex_lock(&client_mutex);
-    ClientSession *creator_session = find_client_by_user_id(creator_id);
-    int current_room = (creator_session != NULL) ? creator_session->current_room_id : 0;
-    pthread_mutex_unlock(&client_mutex);
+    int current_room = engine_user_room(g_engine, creator_id);
 
     char response[BUFFER_SIZE];
     
     if (current_room > 0) {
         // User is already in a room, cannot create new room
         sprintf(response, "CREATE_ROOM_FAIL|You must leave your current room before creating a new one\n");
-        send(client_socket, response, strlen(response), 0);
+        send_response(conn, response);
         printf("[INFO] User %d tried to create room while in room %d - blocked\n", 
                creator_id, current_room);
         return;
     }
 
-    int room_id = create_room(creator_id, name, desc, max_participants, duration);
+    int room_id = engine_create_room(g_engine, creator_id, name, desc, max_participants, duration);
 
     if (room_id > 0) {
         // Auto-join creator to the room
-        int join_result = join_room(creator_id, room_id);
+        int join_result = engine_join_room(g_engine, creator_id, room_id);
         
         if (join_result == 0) {
             sprintf(response, "CREATE_ROOM_SUCCESS|%d|%s\n", room_id, name);
@@ -932,7 +2140,7 @@ void handle_create_room(int client_socket, char *data) {
                    room_id, name, creator_id);
             
             // ✅ Log room creation
-            User *creator = find_user_by_id(creator_id);
+            User *creator = engine_find_user(g_engine, creator_id);
             if (creator != NULL) {
                 char details[256];
                 sprintf(details, "Created room '%s' (ID:%d, Max:%d)", name, room_id, max_participants);
@@ -946,18 +2154,12 @@ void handle_create_room(int client_socket, char *data) {
         
         // Broadcast NEW_ROOM notification to all logged-in users
         char notification[512];
-        User *creator = find_user_by_id(creator_id);
+        User *creator = engine_find_user(g_engine, creator_id);
         sprintf(notification, "NEW_ROOM|%d|%s|%s|%d\n", 
                 room_id, name, creator ? creator->username : "Unknown", max_participants);
         
         // Broadcast to all active clients EXCEPT creator (already knows)
-        pthread_mutex_lock(&client_mutex);
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (g_clients[i].is_active && g_clients[i].socket != client_socket) {
-                send(g_clients[i].socket, notification, strlen(notification), 0);
-            }
-        }
-        pthread_mutex_unlock(&client_mutex);
+        broadcast_message_to_all(notification, conn, MSG_EVENT);
         
     } else if (room_id == -2) {
         sprintf(response, "CREATE_ROOM_FAIL|Room name already exists\n");
@@ -965,63 +2167,73 @@ void handle_create_room(int client_socket, char *data) {
         sprintf(response, "CREATE_ROOM_FAIL|Database full\n");
     }
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_list_rooms(int client_socket) {
-    pthread_mutex_lock(&data_mutex);
+void handle_list_rooms(Connection *conn, char *data) {
+    ListParams params;
+    ListReply reply;
+    list_params_parse(data, 0, &params);
 
-    char response[BUFFER_SIZE * 4] = "ROOM_LIST|";
-    time_t now = time(NULL);
+    // Streamed replies are several lines and are not cached
+    int cacheable = !params.stream;
+    if (cacheable && resp_cache_serve(conn, CACHE_ROOM_LIST, params.cursor, params.limit)) {
+        return;
+    }
 
-    for (int i = 0; i < g_room_count; i++) {
-        // Only show active and waiting rooms
-        if (strcmp(g_rooms[i].status, "ended") != 0 && g_rooms[i].end_time > now) {
-            char room_info[512];
-            int time_left = g_rooms[i].end_time - now;
-            sprintf(room_info, "%d;%s;%s;%d;%d;%s;%d;%d|",
-                    g_rooms[i].room_id,
-                    g_rooms[i].room_name,
-                    g_rooms[i].description,
-                    g_rooms[i].current_participants,
-                    g_rooms[i].max_participants,
-                    g_rooms[i].status,
-                    time_left,
-                    g_rooms[i].total_auctions);
+    engine_lock(g_engine);
 
-            strcat(response, room_info);
+    list_begin(&reply, conn, "ROOM_LIST", &params);
+    time_t now = clock_now(&g_clock);
+
+    for (int i = params.cursor; i < g_engine->room_count; i++) {
+        // Only show active and waiting rooms
+        if (strcmp(g_engine->rooms[i].status, "ended") != 0 && g_engine->rooms[i].end_time > now) {
+            if (list_full(&reply)) break;
+            int time_left = g_engine->rooms[i].end_time - now;
+            list_row(&reply, g_engine->rooms[i].room_id, "%d;%s;%s;%d;%d;%s;%d;%d|",
+                     g_engine->rooms[i].room_id,
+                     g_engine->rooms[i].room_name,
+                     g_engine->rooms[i].description,
+                     g_engine->rooms[i].current_participants,
+                     g_engine->rooms[i].max_participants,
+                     g_engine->rooms[i].status,
+                     time_left,
+                     g_engine->rooms[i].total_auctions);
         }
     }
 
-    pthread_mutex_unlock(&data_mutex);
-
-    strcat(response, "\n");
-    send(client_socket, response, strlen(response), 0);
+    list_end(&reply);
+    if (cacheable && !reply.buf->failed) {
+        resp_cache_store(CACHE_ROOM_LIST, params.cursor, params.limit,
+                         reply.buf->data, reply.buf->len, now);
+    }
+    engine_unlock(g_engine);
 }
 
-void handle_join_room(int client_socket, char *data) {
-    int user_id, room_id;
+void handle_join_room(Connection *conn, char *data) {
+    int user_id = 0, room_id = 0;
     sscanf(data, "%d|%d", &user_id, &room_id);
 
     printf("[DEBUG] handle_join_room: user_id=%d, room_id=%d\n", user_id, room_id);
 
-    int result = join_room(user_id, room_id);
+    int result = engine_join_room(g_engine, user_id, room_id);
 
     printf("[DEBUG] handle_join_room: join_room returned %d\n", result);
 
     char response[BUFFER_SIZE];
     if (result == 0) {
-        AuctionRoom *room = find_room_by_id(room_id);
+        AuctionRoom *room = engine_find_room(g_engine, room_id);
         if (room != NULL) {
             sprintf(response, "JOIN_ROOM_SUCCESS|%d|%s\n", room_id, room->room_name);
             printf("[INFO] User %d joined room %d (%s)\n", user_id, room_id, room->room_name);
             
             // Broadcast to room
-            User *user = find_user_by_id(user_id);
+            User *user = engine_find_user(g_engine, user_id);
             if (user != NULL) {
                 char notification[256];
                 sprintf(notification, "USER_JOINED|%s|%d\n", user->username, room_id);
-                broadcast_message_to_room(notification, room_id, client_socket);
+                broadcast_message_to_room(notification, room_id, conn, MSG_EVENT, 0);
                 
                 // ✅ Log join room
                 char details[256];
@@ -1045,55 +2257,66 @@ void handle_join_room(int client_socket, char *data) {
     }
 
     printf("[DEBUG] handle_join_room: Sending response: %s", response);
-    int sent = send(client_socket, response, strlen(response), 0);
-    printf("[DEBUG] handle_join_room: Sent %d bytes\n", sent);
+    send_response(conn, response);
 }
 
-void handle_leave_room(int client_socket, char *data) {
-    int user_id;
+void handle_leave_room(Connection *conn, char *data) {
+    int user_id = 0;
     sscanf(data, "%d", &user_id);
 
     ClientSession *client = find_client_by_user_id(user_id);
-    int old_room_id = (client != NULL) ? client->current_room_id : 0;
+    int old_room_id = (client != NULL) ? engine_user_room(g_engine, client->user_id) : 0;
 
-    int result = leave_room(user_id);
+    int result = engine_leave_room(g_engine, user_id);
 
     char response[BUFFER_SIZE];
     if (result == 0) {
         sprintf(response, "LEAVE_ROOM_SUCCESS|\n");
         printf("[INFO] User %d left room %d\n", user_id, old_room_id);
+
+        // Subscriptions only cover the room the user is in
+        engine_lock(g_engine);
+        conn->sub_room_id = 0;
+        conn->sub_auction_id = 0;
+        engine_unlock(g_engine);
         
         // Broadcast to room
         if (old_room_id > 0) {
-            User *user = find_user_by_id(user_id);
+            User *user = engine_find_user(g_engine, user_id);
             char notification[256];
             sprintf(notification, "USER_LEFT|%s|%d\n", user->username, old_room_id);
-            broadcast_message_to_room(notification, old_room_id, client_socket);
+            broadcast_message_to_room(notification, old_room_id, conn, MSG_EVENT, 0);
         }
     } else {
         sprintf(response, "LEAVE_ROOM_FAIL|Not in any room\n");
     }
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_room_detail(int client_socket, char *data) {
-    int room_id;
+void handle_room_detail(Connection *conn, char *data) {
+    int room_id = 0;
     sscanf(data, "%d", &room_id);
 
-    pthread_mutex_lock(&data_mutex);
-
-    AuctionRoom *room = find_room_by_id(room_id);
+    int cacheable = room_id > 0 && room_id <= MAX_ROOMS;
+    if (cacheable && resp_cache_serve(conn, CACHE_ROOM_DETAIL, room_id, 0)) {
+        return;
+    }
+
+    engine_lock(g_engine);
+
+    AuctionRoom *room = engine_find_room(g_engine, room_id);
+    time_t now = clock_now(&g_clock);
 
     char response[BUFFER_SIZE];
     if (room != NULL) {
-        User *creator = find_user_by_id(room->created_by);
+        User *creator = engine_find_user(g_engine, room->created_by);
         char creator_name[50] = "Unknown";
         if (creator != NULL) {
             strcpy(creator_name, creator->username);
         }
 
-        int time_left = room->end_time - time(NULL);
+        int time_left = room->end_time - now;
         if (time_left < 0) time_left = 0;
 
         sprintf(response, "ROOM_DETAIL|%d|%s|%s|%s|%d|%d|%s|%d|%d\n",
@@ -1106,25 +2329,29 @@ void handle_room_detail(int client_socket, char *data) {
                 room->status,
                 time_left,
                 room->total_auctions);
+        if (cacheable) {
+            resp_cache_store(CACHE_ROOM_DETAIL, room_id, 0, response, strlen(response), now);
+        }
     } else {
         sprintf(response, "ROOM_DETAIL_FAIL|Room not found\n");
     }
 
-    pthread_mutex_unlock(&data_mutex);
+    engine_unlock(g_engine);
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_my_room(int client_socket, char *data) {
-    int user_id;
+void handle_my_room(Connection *conn, char *data) {
+    int user_id = 0;
     sscanf(data, "%d", &user_id);
 
     ClientSession *client = find_client_by_user_id(user_id);
+    int room_id = client != NULL ? engine_user_room(g_engine, user_id) : 0;
 
     char response[BUFFER_SIZE];
-    if (client != NULL && client->current_room_id > 0) {
-        pthread_mutex_lock(&data_mutex);
-        AuctionRoom *room = find_room_by_id(client->current_room_id);
+    if (room_id > 0) {
+        engine_lock(g_engine);
+        AuctionRoom *room = engine_find_room(g_engine, room_id);
         
         if (room != NULL) {
             sprintf(response, "MY_ROOM|%d|%s|%d|%d\n",
@@ -1136,84 +2363,82 @@ void handle_my_room(int client_socket, char *data) {
             sprintf(response, "MY_ROOM|0|Not in any room|0|0\n");
         }
         
-        pthread_mutex_unlock(&data_mutex);
+        engine_unlock(g_engine);
     } else {
         sprintf(response, "MY_ROOM|0|Not in any room|0|0\n");
     }
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_list_auctions(int client_socket, char *data) {
-    int user_id;
+void handle_list_auctions(Connection *conn, char *data) {
+    int user_id = 0;
     sscanf(data, "%d", &user_id);
 
     // Get user's current room
     ClientSession *client = find_client_by_user_id(user_id);
-    if (client == NULL || client->current_room_id == 0) {
+    if (client == NULL || engine_user_room(g_engine, client->user_id) == 0) {
         char response[] = "AUCTION_LIST_FAIL|Not in any room\n";
-        send(client_socket, response, strlen(response), 0);
+        send_response(conn, response);
         return;
     }
 
-    int room_id = client->current_room_id;
+    int room_id = engine_user_room(g_engine, client->user_id);
 
-    pthread_mutex_lock(&data_mutex);
+    ListParams params;
+    ListReply reply;
+    list_params_parse(data, 1, &params);
 
-    char response[BUFFER_SIZE * 4] = "AUCTION_LIST|";
-    time_t now = time(NULL);
-    int count = 0;
+    engine_lock(g_engine);
 
-    for (int i = 0; i < g_auction_count; i++) {
-        if (g_auctions[i].room_id == room_id &&
-            strcmp(g_auctions[i].status, "active") == 0 &&
-            g_auctions[i].end_time > now) {
+    list_begin(&reply, conn, "AUCTION_LIST", &params);
+    time_t now = clock_now(&g_clock);
 
-            char auction_info[512];
-            int time_left = g_auctions[i].end_time - now;
-            sprintf(auction_info, "%d;%s;%.2f;%.2f;%d;%d|",
-                    g_auctions[i].auction_id,
-                    g_auctions[i].title,
-                    g_auctions[i].current_price,
-                    g_auctions[i].buy_now_price,
-                    time_left,
-                    g_auctions[i].total_bids);
+    for (int i = params.cursor; i < g_engine->auction_count; i++) {
+        if (g_engine->auctions[i].room_id == room_id &&
+            strcmp(g_engine->auctions[i].status, "active") == 0 &&
+            g_engine->auctions[i].end_time > now) {
 
-            strcat(response, auction_info);
-            count++;
+            if (list_full(&reply)) break;
+            int time_left = g_engine->auctions[i].end_time - now;
+            list_row(&reply, g_engine->auctions[i].auction_id, "%d;%s;%.2f;%.2f;%d;%d|",
+                     g_engine->auctions[i].auction_id,
+                     g_engine->auctions[i].title,
+                     g_engine->auctions[i].current_price,
+                     g_engine->auctions[i].buy_now_price,
+                     time_left,
+                     g_engine->auctions[i].total_bids);
         }
     }
 
-    pthread_mutex_unlock(&data_mutex);
-
-    strcat(response, "\n");
-    send(client_socket, response, strlen(response), 0);
+    list_end(&reply);
+    engine_unlock(g_engine);
 }
 
-void handle_auction_detail(int client_socket, char *data) {
-    int auction_id, user_id;
+void handle_auction_detail(Connection *conn, char *data) {
+    int auction_id = 0, user_id = 0;
     sscanf(data, "%d|%d", &auction_id, &user_id);
 
     // Validate user is in the same room
     ClientSession *client = find_client_by_user_id(user_id);
     
-    pthread_mutex_lock(&data_mutex);
+    engine_lock(g_engine);
 
-    Auction *auction = find_auction_by_id(auction_id);
+    Auction *auction = engine_find_auction(g_engine, auction_id);
 
     char response[BUFFER_SIZE];
     if (auction != NULL) {
         // Check room access
-        if (client == NULL || client->current_room_id != auction->room_id) {
+        if (client == NULL || engine_user_room(g_engine, client->user_id) != auction->room_id) {
             sprintf(response, "AUCTION_DETAIL_FAIL|Not in the same room\n");
         } else {
-            User *seller = find_user_by_id(auction->seller_id);
+            User *seller = engine_find_user(g_engine, auction->seller_id);
             char seller_name[50] = "Unknown";
             if (seller != NULL) {
                 strcpy(seller_name, seller->username);
             }
 
-            int time_left = auction->end_time - time(NULL);
+            int time_left = auction->end_time - clock_now(&g_clock);
             if (time_left < 0) time_left = 0;
 
             sprintf(response, "AUCTION_DETAIL|%d|%s|%s|%s|%.2f|%.2f|%.2f|%.2f|%d|%s|%d\n",
@@ -1233,489 +2458,1896 @@ void handle_auction_detail(int client_socket, char *data) {
         sprintf(response, "AUCTION_DETAIL_FAIL|Auction not found\n");
     }
 
-    pthread_mutex_unlock(&data_mutex);
+    engine_unlock(g_engine);
 
-    send(client_socket, response, strlen(response), 0);
+    send_response(conn, response);
 }
 
-void handle_create_auction(int client_socket, char *data) {
-    int user_id, room_id;
-    char title[200], desc[500];
-    double start_price, buy_now_price, min_increment;
-    int duration;
+// Log + room broadcast for a newly created auction (call without the engine lock)
+void notify_auction_created(Connection *conn, int user_id, int auction_id) {
+    engine_lock(g_engine);
+    Auction *auction = engine_find_auction(g_engine, auction_id);
+    if (auction == NULL) {
+        engine_unlock(g_engine);
+        return;
+    }
+    Auction copy = *auction;
+    engine_unlock(g_engine);
+
+    // ✅ Log auction creation
+    User *seller = engine_find_user(g_engine, user_id);
+    if (seller != NULL) {
+        char details[256];
+        snprintf(details, sizeof(details), "Created auction '%s' (ID:%d, Price:%.2f)",
+                 copy.title, auction_id, copy.start_price);
+        log_activity(user_id, seller->username, "CREATE_AUCTION", details, "127.0.0.1");
+    }
 
-    sscanf(data, "%d|%d|%[^|]|%[^|]|%lf|%lf|%lf|%d",
+    // Broadcast to room
+    char notification[1024];
+    int time_left = copy.end_time - clock_now(&g_clock);
+    snprintf(notification, sizeof(notification), "NEW_AUCTION|%d|%s|%.2f|%.2f|%.2f|%d\n",
+            auction_id, copy.title, copy.start_price, copy.buy_now_price,
+            copy.min_bid_increment, time_left);
+    broadcast_message_to_room(notification, copy.room_id, conn, MSG_EVENT, 0);
+}
+
+// Log + NEW_BID broadcast for an accepted bid (call without the engine lock)
+void notify_bid_placed(Connection *conn, int room_id, int auction_id, int user_id,
+                       double bid_amount, int total_bids, int time_left) {
+    User *bidder = engine_find_user(g_engine, user_id);
+
+    // ✅ Log bid placement
+    if (bidder != NULL) {
+        char details[256];
+        snprintf(details, sizeof(details), "Bid on auction %d: %.2f VND (Total bids: %d)",
+                auction_id, bid_amount, total_bids);
+        log_activity(user_id, bidder->username, "PLACE_BID", details, "127.0.0.1");
+    }
+
+    // Broadcast to room with extended info
+    char notification[512];
+    ProtoNewBid typed;
+    uint16_t flags = 0;
+
+    typed.auction_id = auction_id;
+    snprintf(typed.bidder, sizeof(typed.bidder), "%s", bidder ? bidder->username : "Unknown");
+    typed.amount = bid_amount;
+    typed.total_bids = total_bids;
+    typed.time_left = time_left;
+    
+    if (time_left < 30 && time_left > 0) {
+        flags = PROTO_FLAG_WARNING;
+        // Warning + bid notification
+        snprintf(notification, sizeof(notification), "NEW_BID_WARNING|%d|%s|%.2f|%d|%d\n",
+                auction_id, bidder ? bidder->username : "Unknown", 
+                bid_amount, total_bids, time_left);
+    } else {
+        snprintf(notification, sizeof(notification), "NEW_BID|%d|%s|%.2f|%d\n",
+                auction_id, bidder ? bidder->username : "Unknown", 
+                bid_amount, total_bids);
+    }
+    
+    WireMsg msg = wire_msg_text(notification);
+    unsigned char frame[PROTO_HEADER_SIZE + 128];
+    size_t frame_len = proto_encode_new_bid(frame, sizeof(frame), &typed, flags);
+    if (frame_len > 0) {
+        msg.bin = shared_msg_new((char*)frame, frame_len);
+    }
+    broadcast_wire_to_room(&msg, room_id, conn, MSG_EVENT,
+                           CONFLATE_KEY(CONFLATE_PRICE, auction_id));
+    wire_msg_release(&msg);
+}
+
+// Log + AUCTION_DELETED broadcast (call without the engine lock)
+void notify_auction_deleted(Connection *conn, int room_id, int auction_id, int user_id) {
+    // ✅ Log auction deletion
+    User *deleter = engine_find_user(g_engine, user_id);
+    if (deleter != NULL) {
+        char details[256];
+        sprintf(details, "Deleted auction %d", auction_id);
+        log_activity(user_id, deleter->username, "DELETE_AUCTION", details, "127.0.0.1");
+    }
+    
+    // Broadcast to room that auction was deleted
+    char notification[256];
+    sprintf(notification, "AUCTION_DELETED|%d\n", auction_id);
+    broadcast_message_to_room(notification, room_id, conn, MSG_TERMINAL, 0);
+}
+
+void handle_create_auction(Connection *conn, char *data) {
+    int user_id = 0, room_id = 0;
+    char title[200] = "", desc[500] = "";
+    double start_price = 0, buy_now_price = 0, min_increment = 0;
+    int duration = 0;
+
+    sscanf(data, "%d|%d|%199[^|]|%499[^|]|%lf|%lf|%lf|%d",
            &user_id, &room_id, title, desc, &start_price, &buy_now_price,
            &min_increment, &duration);
 
-    int auction_id = create_auction(user_id, room_id, title, desc, start_price,
+    int auction_id = engine_create_auction(g_engine, user_id, room_id, title, desc, start_price,
                                      buy_now_price, min_increment, duration);
 
     char response[BUFFER_SIZE];
     if (auction_id > 0) {
         sprintf(response, "CREATE_AUCTION_SUCCESS|%d|%s\n", auction_id, title);
+        notify_auction_created(conn, user_id, auction_id);
+    } else {
+        sprintf(response, "CREATE_AUCTION_FAIL|%s\n", engine_create_auction_error(auction_id));
+    }
+
+    send_response(conn, response);
+}
+
+// Every path that runs engine_place_bid* reports its result here
+static void count_bid_result(int result) {
+    if (result > 0) {
+        metrics_add(MET_BIDS_ACCEPTED, 1);
+    } else if (result >= -BID_REJECT_REASONS) {
+        metrics_add(MET_BIDS_REJECTED - result - 1, 1);
+    }
+}
+
+// Shared by the text PLACE_BID command and the binary OP_PLACE_BID frame.
+// A non-empty request_id makes retries of the same bid return the first reply.
+void place_bid_and_notify(Connection *conn, int auction_id, int user_id, double bid_amount,
+                          const char *request_id) {
+    int session_user = __atomic_load_n(&conn->user_id, __ATOMIC_RELAXED);
+    char response[BUFFER_SIZE];
+
+    if (request_id[0] != '\0') {
+        if (!valid_request_id(request_id)) {
+            send_response(conn, "BID_FAIL|Invalid request id\n");
+            return;
+        }
+        if (dedup_begin(session_user, request_id, response, sizeof(response))) {
+            send_response(conn, response);
+            return;
+        }
+    }
+
+    int result = engine_place_bid(g_engine, auction_id, user_id, bid_amount);
+    count_bid_result(result);
+
+    if (result > 0) {
+        // Get auction details for response
+        engine_lock(g_engine);
+        Auction *auction = engine_find_auction(g_engine, auction_id);
+        int time_left = auction ? (auction->end_time - clock_now(&g_clock)) : 0;
+        int total_bids = auction ? auction->total_bids : 0;
+        int room_id = auction ? auction->room_id : 0;
+        engine_unlock(g_engine);
+        
+        sprintf(response, "BID_SUCCESS|%d|%.2f|%d|%d\n", 
+                auction_id, bid_amount, total_bids, time_left);
+
+        if (auction != NULL) {
+            notify_bid_placed(conn, room_id, auction_id, user_id, bid_amount, total_bids, time_left);
+        }
+    } else {
+        sprintf(response, "BID_FAIL|%s\n", engine_place_bid_error(result));
+    }
+
+    if (request_id[0] != '\0') {
+        dedup_finish(session_user, request_id, response, result);
+    }
+    send_response(conn, response);
+}
 
-        // ✅ Log auction creation
-        User *seller = find_user_by_id(user_id);
-        if (seller != NULL) {
+void handle_place_bid(Connection *conn, char *data) {
+    int auction_id = 0, user_id = 0;
+    double bid_amount = 0;
+    char request_id[PROTO_REQUEST_ID_LEN + 2] = "";
+
+    sscanf(data, "%d|%d|%lf|%33[^|]", &auction_id, &user_id, &bid_amount, request_id);
+    place_bid_and_notify(conn, auction_id, user_id, bid_amount, request_id);
+}
+
+void handle_buy_now(Connection *conn, char *data) {
+    int auction_id = 0, user_id = 0;
+    char request_id[PROTO_REQUEST_ID_LEN + 2] = "";
+    sscanf(data, "%d|%d|%33[^|]", &auction_id, &user_id, request_id);
+
+    int session_user = __atomic_load_n(&conn->user_id, __ATOMIC_RELAXED);
+    char response[BUFFER_SIZE];
+
+    if (request_id[0] != '\0') {
+        if (!valid_request_id(request_id)) {
+            send_response(conn, "BUY_NOW_FAIL|Invalid request id\n");
+            return;
+        }
+        if (dedup_begin(session_user, request_id, response, sizeof(response))) {
+            send_response(conn, response);
+            return;
+        }
+    }
+
+    int result = engine_buy_now(g_engine, auction_id, user_id);
+
+    if (result == 0) {
+        sprintf(response, "BUY_NOW_SUCCESS|%d\n", auction_id);
+
+        // Get auction for logging and broadcast
+        Auction *auction = engine_find_auction(g_engine, auction_id);
+
+        // ✅ Log buy now
+        User *buyer = engine_find_user(g_engine, user_id);
+        if (buyer != NULL && auction != NULL) {
             char details[256];
-            sprintf(details, "Created auction '%s' (ID:%d, Price:%.2f)", title, auction_id, start_price);
-            log_activity(user_id, seller->username, "CREATE_AUCTION", details, "127.0.0.1");
+            sprintf(details, "Bought auction %d instantly: %.2f VND", 
+                    auction_id, auction->buy_now_price);
+            log_activity(user_id, buyer->username, "BUY_NOW", details, "127.0.0.1");
         }
 
         // Broadcast to room
-        Auction *new_auction = find_auction_by_id(auction_id);
-        if (new_auction != NULL) {
-            char notification[1024];
-            int time_left = new_auction->end_time - time(NULL);
-            sprintf(notification, "NEW_AUCTION|%d|%s|%.2f|%.2f|%.2f|%d\n",
-                    auction_id, title, start_price, buy_now_price, min_increment, time_left);
-            broadcast_message_to_room(notification, room_id, client_socket);
+        if (auction != NULL) {
+            char notification[512];
+            sprintf(notification, "AUCTION_ENDED|%d|buy_now\n", auction_id);
+            broadcast_message_to_room(notification, auction->room_id, conn, MSG_TERMINAL, 0);
+        }
+    } else {
+        sprintf(response, "BUY_NOW_FAIL|%s\n", engine_buy_now_error(result));
+    }
+
+    if (request_id[0] != '\0') {
+        dedup_finish(session_user, request_id, response, result);
+    }
+    send_response(conn, response);
+}
+
+// ✅ NEW: Handle delete auction request
+void handle_delete_auction(Connection *conn, char *data) {
+    int auction_id = 0, user_id = 0;
+    sscanf(data, "%d|%d", &auction_id, &user_id);
+
+    int result = engine_delete_auction(g_engine, auction_id, user_id);
+
+    char response[BUFFER_SIZE];
+    if (result == 0) {
+        sprintf(response, "DELETE_AUCTION_SUCCESS|%d\n", auction_id);
+        printf("[INFO] Auction %d deleted successfully by user %d\n", auction_id, user_id);
+
+        engine_lock(g_engine);
+        Auction *auction = engine_find_auction(g_engine, auction_id);
+        int room_id = auction ? auction->room_id : 0;
+        engine_unlock(g_engine);
+
+        if (auction != NULL) {
+            notify_auction_deleted(conn, room_id, auction_id, user_id);
+        }
+    } else {
+        sprintf(response, "DELETE_AUCTION_FAIL|%s\n", engine_delete_auction_error(result));
+    }
+
+    send_response(conn, response);
+}
+
+// =====================================================
+// BATCH COMMANDS
+// =====================================================
+
+typedef enum {
+    BATCH_OP_INVALID,
+    BATCH_OP_CREATE_AUCTION,
+    BATCH_OP_PLACE_BID,
+    BATCH_OP_DELETE_AUCTION
+} BatchOpKind;
+
+typedef struct {
+    BatchOpKind kind;
+    int result;
+    int user_id;
+    int room_id;
+    int auction_id;
+    char title[200];
+    char desc[500];
+    double amount;              // bid amount or start price
+    double buy_now_price;
+    double min_increment;
+    int duration;
+    int total_bids;             // after an accepted bid
+    int time_left;
+    char request_id[PROTO_REQUEST_ID_LEN + 2];  // PLACE_BID idempotency key, "" = none
+    int replayed;               // key seen before: result comes from reply / earlier item
+    int claimed;                // key held in the dedup table until batch_dedup_finish
+    char reply[DEDUP_REPLY_LEN];
+} BatchOp;
+
+static void batch_parse(BatchOp *op, char *line) {
+    char *data = strchr(line, '|');
+    op->kind = BATCH_OP_INVALID;
+    if (data == NULL) {
+        return;
+    }
+    *data++ = '\0';
+
+    if (strcmp(line, "CREATE_AUCTION") == 0 &&
+        sscanf(data, "%d|%d|%199[^|]|%499[^|]|%lf|%lf|%lf|%d",
+               &op->user_id, &op->room_id, op->title, op->desc, &op->amount,
+               &op->buy_now_price, &op->min_increment, &op->duration) == 8) {
+        op->kind = BATCH_OP_CREATE_AUCTION;
+    } else if (strcmp(line, "PLACE_BID") == 0 &&
+               sscanf(data, "%d|%d|%lf|%33[^|]", &op->auction_id, &op->user_id, &op->amount,
+                      op->request_id) >= 3) {
+        op->kind = BATCH_OP_PLACE_BID;
+    } else if (strcmp(line, "DELETE_AUCTION") == 0 &&
+               sscanf(data, "%d|%d", &op->auction_id, &op->user_id) == 2) {
+        op->kind = BATCH_OP_DELETE_AUCTION;
+    }
+}
+
+// Caller must hold the engine lock
+static void batch_execute_locked(BatchOp *op) {
+    Auction *auction;
+
+    switch (op->kind) {
+        case BATCH_OP_CREATE_AUCTION:
+            op->result = engine_create_auction_locked(g_engine, op->user_id, op->room_id, op->title, op->desc,
+                                                op->amount, op->buy_now_price,
+                                                op->min_increment, op->duration);
+            if (op->result > 0) {
+                op->auction_id = op->result;
+            }
+            break;
+        case BATCH_OP_PLACE_BID:
+            op->result = engine_place_bid_locked(g_engine, op->auction_id, op->user_id, op->amount);
+            count_bid_result(op->result);
+            auction = engine_find_auction(g_engine, op->auction_id);
+            if (op->result > 0 && auction != NULL) {
+                op->room_id = auction->room_id;
+                op->total_bids = auction->total_bids;
+                op->time_left = auction->end_time - clock_now(&g_clock);
+            }
+            break;
+        case BATCH_OP_DELETE_AUCTION:
+            op->result = engine_delete_auction_locked(g_engine, op->auction_id, op->user_id);
+            auction = engine_find_auction(g_engine, op->auction_id);
+            if (op->result == 0 && auction != NULL) {
+                op->room_id = auction->room_id;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static int batch_op_ok(const BatchOp *op) {
+    if (op->replayed) {
+        return 0;               // answered from its first run
+    }
+    if (op->kind == BATCH_OP_DELETE_AUCTION) {
+        return op->result == 0;
+    }
+    return op->kind != BATCH_OP_INVALID && op->result > 0;
+}
+
+// Keyed PLACE_BID items share the dedup table with the single command, so a
+// retried BATCH (or a bid retried as a BATCH item) runs at most once. A key
+// repeated inside one batch takes the result of its first item.
+//
+// Claims every key without waiting. If one is still running elsewhere, the
+// keys claimed so far are released and its index returned, so the caller
+// waits holding nothing; -1 once all are claimed or answered.
+static int batch_dedup_claim(BatchOp *ops, int count, int session_user) {
+    for (int i = 0; i < count; i++) {
+        BatchOp *op = &ops[i];
+        if (op->kind != BATCH_OP_PLACE_BID || op->request_id[0] == '\0') {
+            continue;
+        }
+        op->replayed = 0;
+        op->claimed = 0;
+        if (!valid_request_id(op->request_id)) {
+            op->replayed = 1;
+            snprintf(op->reply, sizeof(op->reply), "BID_FAIL|Invalid request id\n");
+            continue;
+        }
+
+        int repeated = 0;
+        for (int j = 0; j < i && !repeated; j++) {
+            repeated = ops[j].kind == BATCH_OP_PLACE_BID && strcmp(ops[j].request_id, op->request_id) == 0;
+        }
+        if (repeated) {
+            op->replayed = 1;
+            op->reply[0] = '\0';       // filled in by batch_dedup_finish
+            continue;
+        }
+
+        switch (dedup_try_begin(session_user, op->request_id, op->reply, sizeof(op->reply), &op->result)) {
+            case DEDUP_CLAIMED:
+                op->claimed = 1;
+                break;
+            case DEDUP_HIT:
+                op->replayed = 1;
+                break;
+            case DEDUP_PENDING:
+                for (int j = 0; j < i; j++) {
+                    if (ops[j].claimed) {
+                        dedup_release(session_user, ops[j].request_id);
+                        ops[j].claimed = 0;
+                    }
+                }
+                return i;
+            default:
+                break;
         }
+    }
+    return -1;
+}
+
+// The reply the single PLACE_BID would have given, stored for retries
+static void batch_dedup_finish(BatchOp *ops, int i, int session_user) {
+    BatchOp *op = &ops[i];
+    if (op->kind != BATCH_OP_PLACE_BID || op->request_id[0] == '\0') {
+        return;
+    }
+    if (op->replayed) {
+        if (op->reply[0] == '\0') {
+            for (int j = 0; j < i; j++) {
+                if (ops[j].kind == BATCH_OP_PLACE_BID && strcmp(ops[j].request_id, op->request_id) == 0) {
+                    memcpy(op->reply, ops[j].reply, sizeof(op->reply));
+                    op->result = ops[j].result;
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    if (op->result > 0) {
+        snprintf(op->reply, sizeof(op->reply), "BID_SUCCESS|%d|%.2f|%d|%d\n",
+                 op->auction_id, op->amount, op->total_bids, op->time_left);
+    } else {
+        snprintf(op->reply, sizeof(op->reply), "BID_FAIL|%s\n", engine_place_bid_error(op->result));
+    }
+    dedup_finish(session_user, op->request_id, op->reply, op->result);
+}
+
+// A replayed item reports what its first run reported: "OK;bid_id" or
+// "FAIL;reason"
+static void batch_append_replayed(RespBuf *r, const BatchOp *op) {
+    if (strncmp(op->reply, "BID_SUCCESS|", 12) == 0) {
+        resp_appendf(r, "OK;%d|", op->result);
+    } else if (strncmp(op->reply, "BID_FAIL|", 9) == 0) {
+        resp_appendf(r, "FAIL;%.*s|", (int)strcspn(op->reply + 9, "\n"), op->reply + 9);
     } else {
+        resp_appendf(r, "FAIL;%s|", "Unknown error");
+    }
+}
+
+// Run every collected item under one engine lock hold and one save, then
+// broadcast and answer with a single BATCH_RESULT line
+static void batch_run(Connection *conn) {
+    Batch *b = conn->batch;
+    BatchOp *ops = calloc(b->count, sizeof(BatchOp));
+    if (ops == NULL) {
+        batch_free(conn);
+        send_response(conn, "BATCH_FAIL|Out of memory\n");
+        return;
+    }
+
+    int session_user = __atomic_load_n(&conn->user_id, __ATOMIC_RELAXED);
+    for (int i = 0; i < b->count; i++) {
+        batch_parse(&ops[i], b->items[i]);
+    }
+    // Before the engine lock, and never waiting while holding a key
+    for (;;) {
+        int pending = batch_dedup_claim(ops, b->count, session_user);
+        if (pending < 0) break;
+        dedup_wait(session_user, ops[pending].request_id);
+    }
+
+    int ok = 0;
+    engine_lock(g_engine);
+    for (int i = 0; i < b->count; i++) {
+        if (!ops[i].replayed) {
+            batch_execute_locked(&ops[i]);
+        }
+        ok += batch_op_ok(&ops[i]);
+    }
+    if (ok > 0) {
+        engine_save(g_engine);
+    }
+    engine_unlock(g_engine);
+
+    for (int i = 0; i < b->count; i++) {
+        batch_dedup_finish(ops, i, session_user);
+        // a retried batch reports the same count as its first run
+        ok += ops[i].replayed && strncmp(ops[i].reply, "BID_SUCCESS|", 12) == 0;
+    }
+
+    for (int i = 0; i < b->count; i++) {
+        BatchOp *op = &ops[i];
+        if (!batch_op_ok(op)) continue;
+
+        switch (op->kind) {
+            case BATCH_OP_CREATE_AUCTION:
+                notify_auction_created(conn, op->user_id, op->auction_id);
+                break;
+            case BATCH_OP_PLACE_BID:
+                notify_bid_placed(conn, op->room_id, op->auction_id, op->user_id,
+                                  op->amount, op->total_bids, op->time_left);
+                break;
+            case BATCH_OP_DELETE_AUCTION:
+                notify_auction_deleted(conn, op->room_id, op->auction_id, op->user_id);
+                break;
+            default:
+                break;
+        }
+    }
+
+    RespBuf *r = resp_begin("BATCH_RESULT|");
+    resp_appendf(r, "%d|%d|", b->count, ok);
+    for (int i = 0; i < b->count; i++) {
+        BatchOp *op = &ops[i];
+        if (op->replayed) {
+            batch_append_replayed(r, op);
+            continue;
+        }
+        if (batch_op_ok(op)) {
+            resp_appendf(r, "OK;%d|", op->kind == BATCH_OP_PLACE_BID ? op->result : op->auction_id);
+            continue;
+        }
+
         const char *error_msg;
-        switch(auction_id) {
-            case -1: error_msg = "Database full"; break;
-            case -2: error_msg = "Room not found"; break;
-            case -3: error_msg = "You must be in the room to create auction"; break;
-            case -4: error_msg = "Only room creator can create auction"; break;
-            default: error_msg = "Unknown error"; break;
+        switch (op->kind) {
+            case BATCH_OP_CREATE_AUCTION: error_msg = engine_create_auction_error(op->result); break;
+            case BATCH_OP_PLACE_BID:      error_msg = engine_place_bid_error(op->result); break;
+            case BATCH_OP_DELETE_AUCTION: error_msg = engine_delete_auction_error(op->result); break;
+            default:                      error_msg = "Unsupported command"; break;
         }
-        sprintf(response, "CREATE_AUCTION_FAIL|%s\n", error_msg);
+        resp_appendf(r, "FAIL;%s|", error_msg);
+    }
+
+    printf("[INFO] Batch of %d items: %d succeeded\n", b->count, ok);
+    conn->corr_id = b->corr_id;
+    free(ops);
+    batch_free(conn);
+    resp_send(conn, r);
+}
+
+// BATCH|n starts collecting; the next n command lines are the items
+void handle_batch(Connection *conn, char *data) {
+    int n = atoi(data);
+    if (conn->batch != NULL) {
+        send_response(conn, "BATCH_FAIL|Batch already open\n");
+        return;
+    }
+    if (n <= 0 || n > BATCH_MAX_ITEMS) {
+        char response[256];
+        sprintf(response, "BATCH_FAIL|Item count must be 1-%d\n", BATCH_MAX_ITEMS);
+        send_response(conn, response);
+        return;
+    }
+
+    conn->batch = calloc(1, sizeof(Batch));
+    if (conn->batch == NULL) {
+        send_response(conn, "BATCH_FAIL|Out of memory\n");
+        return;
+    }
+    conn->batch->expected = n;
+    conn->batch->corr_id = conn->corr_id;
+}
+
+// Takes one item line while a batch is open; runs it once complete
+void batch_collect(Connection *conn, const char *line) {
+    Batch *b = conn->batch;
+    b->items[b->count] = strdup(line);
+    if (b->items[b->count] == NULL) {
+        batch_free(conn);
+        send_response(conn, "BATCH_FAIL|Out of memory\n");
+        return;
+    }
+    if (++b->count == b->expected) {
+        batch_run(conn);
+    }
+}
+
+void handle_bid_history(Connection *conn, char *data) {
+    int auction_id = 0, user_id = 0;
+    sscanf(data, "%d|%d", &auction_id, &user_id);
+
+    // Validate room access
+    ClientSession *client = find_client_by_user_id(user_id);
+
+    // Newest first: the cursor is the oldest bid id already shown
+    ListParams params;
+    ListReply reply;
+    list_params_parse(data, 2, &params);
+    
+    engine_lock(g_engine);
+
+    Auction *auction = engine_find_auction(g_engine, auction_id);
+    
+    if (auction == NULL || client == NULL || engine_user_room(g_engine, client->user_id) != auction->room_id) {
+        char response[] = "BID_HISTORY_FAIL|Not in the same room\n";
+        send_response(conn, response);
+        engine_unlock(g_engine);
+        return;
+    }
+
+    list_begin(&reply, conn, "BID_HISTORY", &params);
+    int start = params.cursor > 0 && params.cursor <= g_engine->bid_count ? params.cursor - 2
+                                                                          : g_engine->bid_count - 1;
+    int stop = params.paged ? 0 : g_engine->bid_count - 20;    // legacy: scan the last 20 bids
+
+    for (int i = start; i >= 0 && i >= stop; i--) {
+        if (g_engine->bids[i].auction_id == auction_id) {
+            if (list_full(&reply)) break;
+            User *bidder = engine_find_user(g_engine, g_engine->bids[i].user_id);
+
+            char time_str[64];
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S",
+                     localtime(&g_engine->bids[i].bid_time));
+
+            list_row(&reply, g_engine->bids[i].bid_id, "%s;%.2f;%s|",
+                     bidder ? bidder->username : "Unknown",
+                     g_engine->bids[i].bid_amount,
+                     time_str);
+        }
+    }
+
+    list_end(&reply);
+    engine_unlock(g_engine);
+}
+
+void handle_my_auctions(Connection *conn, char *data) {
+    int user_id = 0;
+    sscanf(data, "%d", &user_id);
+
+    ListParams params;
+    ListReply reply;
+    list_params_parse(data, 1, &params);
+
+    engine_lock(g_engine);
+
+    list_begin(&reply, conn, "MY_AUCTIONS", &params);
+    time_t now = clock_now(&g_clock);
+
+    for (int i = params.cursor; i < g_engine->auction_count; i++) {
+        if (g_engine->auctions[i].seller_id == user_id) {
+            if (list_full(&reply)) break;
+            int time_left = g_engine->auctions[i].end_time - now;
+            if (time_left < 0) time_left = 0;
+
+            list_row(&reply, g_engine->auctions[i].auction_id, "%d;%s;%.2f;%.2f;%d;%s;%d|",
+                     g_engine->auctions[i].auction_id,
+                     g_engine->auctions[i].title,
+                     g_engine->auctions[i].current_price,
+                     g_engine->auctions[i].buy_now_price,
+                     time_left,
+                     g_engine->auctions[i].status,
+                     g_engine->auctions[i].total_bids);
+        }
+    }
+
+    list_end(&reply);
+    engine_unlock(g_engine);
+}
+
+void handle_auction_history(Connection *conn, char *data) {
+    int user_id = 0;
+    sscanf(data, "%d", &user_id);
+
+    ListParams params;
+    ListReply reply;
+    list_params_parse(data, 1, &params);
+
+    engine_lock(g_engine);
+
+    list_begin(&reply, conn, "AUCTION_HISTORY", &params);
+
+    for (int i = params.cursor; i < g_engine->auction_count; i++) {
+        if (strcmp(g_engine->auctions[i].status, "ended") == 0) {
+            if (list_full(&reply)) break;
+            char winner_name[50] = "No winner";
+            char win_method[20] = "no_bids";
+            
+            if (g_engine->auctions[i].winner_id > 0) {
+                User *winner = engine_find_user(g_engine, g_engine->auctions[i].winner_id);
+                if (winner != NULL) {
+                    strncpy(winner_name, winner->username, 49);
+                    winner_name[49] = '\0';
+                }
+                
+                // Determine win method
+                if (g_engine->auctions[i].current_price == g_engine->auctions[i].buy_now_price 
+                    && g_engine->auctions[i].buy_now_price > 0) {
+                    strcpy(win_method, "buy_now");
+                } else {
+                    strcpy(win_method, "bid");
+                }
+            }
+
+            list_row(&reply, g_engine->auctions[i].auction_id, "%d;%s;%.2f;%s;%s|",
+                     g_engine->auctions[i].auction_id,
+                     g_engine->auctions[i].title,
+                     g_engine->auctions[i].current_price,
+                     winner_name,
+                     win_method);
+        }
+    }
+
+    list_end(&reply);
+    engine_unlock(g_engine);
+}
+
+// SUBSCRIBE_ROOM|room_id - the user must be in the room, as for LIST_AUCTIONS
+void handle_subscribe_room(Connection *conn, char *data) {
+    int room_id = 0;
+    sscanf(data, "%d", &room_id);
+
+    engine_lock(g_engine);
+    client_lock();
+    ClientSession *client = find_client_by_user_id(conn->user_id);
+    int in_room = client != NULL && room_id > 0 && engine_user_room(g_engine, client->user_id) == room_id;
+    client_unlock();
+
+    if (!in_room) {
+        engine_unlock(g_engine);
+        send_response(conn, "SUBSCRIBE_FAIL|Not in this room\n");
+        return;
+    }
+
+    conn->sub_room_id = room_id;
+    send_room_snapshot(conn, room_id);
+
+    engine_unlock(g_engine);
+}
+
+// SUBSCRIBE_AUCTION|auction_id
+void handle_subscribe_auction(Connection *conn, char *data) {
+    int auction_id = 0;
+    sscanf(data, "%d", &auction_id);
+
+    engine_lock(g_engine);
+    Auction *auction = engine_find_auction(g_engine, auction_id);
+
+    client_lock();
+    ClientSession *client = find_client_by_user_id(conn->user_id);
+    int in_room = client != NULL && auction != NULL && engine_user_room(g_engine, client->user_id) == auction->room_id;
+    client_unlock();
+
+    if (!in_room) {
+        engine_unlock(g_engine);
+        send_response(conn, auction == NULL ? "SUBSCRIBE_FAIL|Auction not found\n"
+                                            : "SUBSCRIBE_FAIL|Not in this room\n");
+        return;
+    }
+
+    RespBuf *r = resp_begin("SNAPSHOT|AUCTION|");
+    resp_appendf(r, "%d|%lu|%ld|", auction_id, g_auction_seq[auction_id - 1], (long)clock_now(&g_clock));
+    append_auction_row(r, auction);
+    conn->sub_auction_id = auction_id;
+    resp_send(conn, r);
+
+    engine_unlock(g_engine);
+}
+
+// UNSUBSCRIBE|[ROOM|AUCTION] - no argument drops both
+void handle_unsubscribe(Connection *conn, char *data) {
+    char scope[16] = "";
+    sscanf(data, "%15[^|\n]", scope);
+
+    engine_lock(g_engine);
+    if (strcmp(scope, "AUCTION") != 0) {
+        conn->sub_room_id = 0;
+    }
+    if (strcmp(scope, "ROOM") != 0) {
+        conn->sub_auction_id = 0;
+    }
+    engine_unlock(g_engine);
+
+    send_response(conn, "UNSUBSCRIBE_SUCCESS|\n");
+}
+
+// RESUME|token|last_seq - reattach a session to this connection.
+// The session keeps its room. A client with a room replica (last_seq > 0)
+// is subscribed again and gets the deltas after last_seq replayed, or a
+// fresh SNAPSHOT if the ring no longer has them all.
+void handle_resume(Connection *conn, char *data) {
+    char token[RESUME_TOKEN_LEN + 1] = "";
+    unsigned long last_seq = 0;
+    sscanf(data, "%32[^|]|%lu", token, &last_seq);
+
+    engine_lock(g_engine);
+    client_lock();
+
+    ClientSession *client = NULL;
+    for (int i = 0; i < MAX_CLIENTS && token[0] != '\0'; i++) {
+        if (g_clients[i].is_active && strcmp(g_clients[i].resume_token, token) == 0) {
+            client = &g_clients[i];
+            break;
+        }
+    }
+
+    if (client == NULL || conn->user_id != 0) {
+        client_unlock();
+        engine_unlock(g_engine);
+        send_response(conn, "RESUME_FAIL|Session expired\n");
+        return;
+    }
+
+    // The old connection may be half-open and not noticed yet; the token
+    // proves ownership, so take the session over
+    if (client->conn != NULL && client->conn != conn) {
+        __atomic_store_n(&client->conn->user_id, 0, __ATOMIC_RELAXED);
+        conn_close_after_flush(client->conn);
+    }
+
+    client->conn = conn;
+    client->detached_at = 0;
+    issue_resume_token(conn, client->resume_token);
+    __atomic_store_n(&conn->user_id, client->user_id, __ATOMIC_RELAXED);
+
+    int user_id = client->user_id;
+    int room_id = engine_user_room(g_engine, client->user_id);
+    User *user = engine_find_user(g_engine, user_id);
+    char response[256];
+    snprintf(response, sizeof(response), "RESUME_SUCCESS|%d|%s|%.2f|%d|%s\n",
+             user_id, client->username, user != NULL ? user->balance : 0.0,
+             room_id, client->resume_token);
+
+    client_unlock();
+
+    send_response(conn, response);
+    if (room_id > 0 && last_seq > 0) {
+        conn->sub_room_id = room_id;
+        if (replay_room_events(conn, room_id, last_seq) != 0) {
+            send_room_snapshot(conn, room_id);
+        }
+    }
+
+    engine_unlock(g_engine);
+
+    printf("[INFO] User %d resumed session (room %d, last_seq %lu)\n", user_id, room_id, last_seq);
+}
+
+// Switch the connection to the binary protocol. The reply is still text;
+// everything after it is BIN1 frames.
+void handle_hello(Connection *conn, char *data) {
+    if (strcmp(data, "BIN1") != 0) {
+        send_response(conn, "HELLO_FAIL|Unsupported protocol\n");
+        return;
+    }
+
+    send_response(conn, "HELLO_OK|BIN1\n");
+
+    pthread_mutex_lock(&conn->out_lock);
+    conn->proto = PROTO_BIN1;
+    pthread_mutex_unlock(&conn->out_lock);
+
+    printf("[INFO] Socket %d switched to binary protocol\n", conn->socket);
+}
+
+// Writes the sampled spans to --trace-file (never a client-chosen path)
+void handle_trace_dump(Connection *conn, char *data) {
+    char response[512];
+
+    if (!trace_enabled()) {
+        send_response(conn, "TRACE_DUMP_FAIL|Tracing is off, start with --trace-sample=N\n");
+        return;
+    }
+
+    int spans = trace_dump(g_trace_path);
+    if (spans < 0) {
+        snprintf(response, sizeof(response), "TRACE_DUMP_FAIL|Could not write %s\n", g_trace_path);
+    } else {
+        snprintf(response, sizeof(response), "TRACE_DUMP|%s|%d\n", g_trace_path, spans);
+        printf("[INFO] Wrote %d trace spans to %s\n", spans, g_trace_path);
+    }
+    send_response(conn, response);
+}
+
+// LOCK_STATS|[RESET]: per call site wait and hold times of the engine lock
+// and client_mutex, busiest first (see lockprof.h for the fields)
+void handle_lock_stats(Connection *conn, char *data) {
+#ifdef NO_LOCK_PROFILE
+    send_response(conn, "LOCK_STATS_FAIL|Lock profiling not compiled in (LOCK_PROFILE=0)\n");
+#else
+    if (strcmp(data, "RESET") == 0) {
+        lockprof_reset(&g_engine->lock_prof, &g_engine->lock);
+        lockprof_reset(&g_client_lock_prof, &client_mutex);
+        send_response(conn, "LOCK_STATS_RESET\n");
+        return;
+    }
+
+    size_t size = 16384;
+    LockProfile *snap = malloc(sizeof(LockProfile));
+    char *response = malloc(size);
+    if (snap == NULL || response == NULL) {
+        free(snap);
+        free(response);
+        send_response(conn, "LOCK_STATS_FAIL|Out of memory\n");
+        return;
+    }
+
+    size_t len = snprintf(response, size, "LOCK_STATS");
+    lockprof_snapshot(&g_engine->lock_prof, &g_engine->lock, snap);
+    len = lockprof_format(snap, '|', response, len, size - 2);
+    lockprof_snapshot(&g_client_lock_prof, &client_mutex, snap);
+    len = lockprof_format(snap, '|', response, len, size - 2);
+    response[len++] = '\n';
+    response[len] = '\0';
+
+    send_response_len(conn, response, len);
+    free(snap);
+    free(response);
+#endif
+}
+
+void lock_log_stats_one(LockProfile *p, pthread_mutex_t *m) {
+    LockProfile *snap = malloc(sizeof(LockProfile));
+    uint64_t acquisitions = 0, contended = 0, wait_ns = 0, hold_ns = 0;
+    const char *busiest = NULL;
+    uint64_t busiest_ns = 0;
+
+    if (snap == NULL) {
+        return;
+    }
+    lockprof_snapshot(p, m, snap);
+
+    for (int i = 0; i <= LOCKPROF_MAX_SITES; i++) {
+        const LockSite *site = &snap->sites[i];
+        acquisitions += site->acquisitions;
+        contended += site->contended;
+        wait_ns += site->wait.total_ns;
+        hold_ns += site->hold.total_ns;
+        if (site->hold.total_ns > busiest_ns) {
+            busiest_ns = site->hold.total_ns;
+            busiest = site->site;
+        }
+    }
+    if (acquisitions > 0) {
+        printf("[STATS] Lock %s: acquisitions=%lu contended=%.1f%% wait=%.1fms hold=%.1fms "
+               "busiest=%s (%.1fms)\n",
+               snap->name, (unsigned long)acquisitions, 100.0 * contended / acquisitions,
+               wait_ns / 1e6, hold_ns / 1e6, busiest ? busiest : "-", busiest_ns / 1e6);
+    }
+    free(snap);
+}
+
+void lock_log_stats() {
+#ifndef NO_LOCK_PROFILE
+    lock_log_stats_one(&g_engine->lock_prof, &g_engine->lock);
+    lock_log_stats_one(&g_client_lock_prof, &client_mutex);
+#endif
+}
+
+// =====================================================
+// COMMAND REGISTRY
+// =====================================================
+
+typedef enum {
+    CMD_READ,
+    CMD_WRITE
+} CommandAccess;
+
+typedef enum {
+    SESSION_ANY,            // allowed before LOGIN
+    SESSION_LOGGED_IN,
+    SESSION_LOCAL           // admin: loopback connections only
+} SessionRequirement;
+
+typedef enum {
+    RATE_NONE,
+    RATE_AUTH,
+    RATE_READ,
+    RATE_WRITE,
+    RATE_BID
+} RateClass;
+
+// Every text command in one place: the opcode enum, the dispatch table,
+// HELP and the per-command counters are all generated from this list.
+//   X(name, handler, access, session, rate class, arguments)
+#define COMMAND_LIST(X) \
+    X(HELLO,             handle_hello,             CMD_READ,  SESSION_ANY,       RATE_NONE,  "BIN1") \
+    X(HELP,              handle_help,              CMD_READ,  SESSION_ANY,       RATE_NONE,  "") \
+    X(QUIT,              NULL,                     CMD_READ,  SESSION_ANY,       RATE_NONE,  "") \
+    X(REGISTER,          handle_register,          CMD_WRITE, SESSION_ANY,       RATE_AUTH,  "username password email") \
+    X(LOGIN,             handle_login,             CMD_WRITE, SESSION_ANY,       RATE_AUTH,  "username password") \
+    X(RESUME,            handle_resume,            CMD_WRITE, SESSION_ANY,       RATE_AUTH,  "token,last_seq") \
+    X(CREATE_ROOM,       handle_create_room,       CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "user_id,name,description,max_participants,duration_minutes") \
+    X(LIST_ROOMS,        handle_list_rooms,        CMD_READ,  SESSION_ANY,       RATE_READ,  "[cursor,limit,STREAM]") \
+    X(JOIN_ROOM,         handle_join_room,         CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "user_id,room_id") \
+    X(LEAVE_ROOM,        handle_leave_room,        CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "user_id") \
+    X(ROOM_DETAIL,       handle_room_detail,       CMD_READ,  SESSION_ANY,       RATE_READ,  "room_id") \
+    X(MY_ROOM,           handle_my_room,           CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "user_id") \
+    X(LIST_AUCTIONS,     handle_list_auctions,     CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "user_id,[cursor,limit,STREAM]") \
+    X(MY_AUCTIONS,       handle_my_auctions,       CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "user_id,[cursor,limit,STREAM]") \
+    X(AUCTION_DETAIL,    handle_auction_detail,    CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "auction_id,user_id") \
+    X(CREATE_AUCTION,    handle_create_auction,    CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "user_id,room_id,title,description,start_price,buy_now_price,min_increment,duration_minutes") \
+    X(PLACE_BID,         handle_place_bid,         CMD_WRITE, SESSION_LOGGED_IN, RATE_BID,   "auction_id,user_id,amount,[request_id]") \
+    X(BUY_NOW,           handle_buy_now,           CMD_WRITE, SESSION_LOGGED_IN, RATE_BID,   "auction_id,user_id,[request_id]") \
+    X(DELETE_AUCTION,    handle_delete_auction,    CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "auction_id,user_id") \
+    X(BATCH,             handle_batch,             CMD_WRITE, SESSION_LOGGED_IN, RATE_WRITE, "count") \
+    X(BID_HISTORY,       handle_bid_history,       CMD_READ,  SESSION_ANY,       RATE_READ,  "auction_id,user_id,[cursor,limit,STREAM]") \
+    X(AUCTION_HISTORY,   handle_auction_history,   CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "user_id,[cursor,limit,STREAM]") \
+    X(SUBSCRIBE_ROOM,    handle_subscribe_room,    CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "room_id") \
+    X(SUBSCRIBE_AUCTION, handle_subscribe_auction, CMD_READ,  SESSION_LOGGED_IN, RATE_READ,  "auction_id") \
+    X(UNSUBSCRIBE,       handle_unsubscribe,       CMD_READ,  SESSION_ANY,       RATE_NONE,  "[ROOM,AUCTION]") \
+    X(TRACE_DUMP,        handle_trace_dump,        CMD_READ,  SESSION_LOCAL,     RATE_NONE,  "") \
+    X(LOCK_STATS,        handle_lock_stats,        CMD_READ,  SESSION_LOCAL,     RATE_NONE,  "[RESET]") \
+    X(STATS,             handle_stats,             CMD_READ,  SESSION_LOCAL,     RATE_NONE,  "") \
+    X(SLOWLOG,           handle_slowlog,           CMD_READ,  SESSION_LOCAL,     RATE_NONE,  "[count|RESET]")
+
+#define CMD_ENUM(name, handler, access, session, rate, args) CMD_##name,
+typedef enum {
+    COMMAND_LIST(CMD_ENUM)
+    CMD_COUNT
+} CommandId;
+#undef CMD_ENUM
+
+typedef void (*CommandHandler)(Connection *conn, char *data);
+
+typedef struct {
+    const char *name;
+    CommandHandler handler;     // NULL for QUIT
+    CommandAccess access;
+    SessionRequirement session;
+    RateClass rate_class;
+    const char *args;
+} CommandInfo;
+
+void handle_help(Connection *conn, char *data);
+void handle_stats(Connection *conn, char *data);
+void handle_slowlog(Connection *conn, char *data);
+
+#define CMD_ENTRY(name, handler, access, session, rate, args) \
+    { #name, handler, access, session, rate, args },
+static const CommandInfo g_commands[CMD_COUNT] = {
+    COMMAND_LIST(CMD_ENTRY)
+};
+#undef CMD_ENTRY
+
+static const char *g_rate_class_names[] = { "none", "auth", "read", "write", "bid" };
+
+// Open-addressed FNV-1a table, filled once at startup
+#define CMD_HASH_SIZE 64
+static struct {
+    uint32_t hash;
+    int id;                     // -1 = empty
+} g_command_hash[CMD_HASH_SIZE];
+
+static unsigned long g_command_calls[CMD_COUNT];
+static unsigned long g_command_rejected[CMD_COUNT];
+
+static uint32_t command_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Returns -1 if two command names hash the same (lookups compare the full
+// hash before the name, so this keeps every lookup to one strcmp)
+int command_registry_init() {
+    for (int i = 0; i < CMD_HASH_SIZE; i++) {
+        g_command_hash[i].id = -1;
+    }
+
+    for (int id = 0; id < CMD_COUNT; id++) {
+        uint32_t h = command_hash(g_commands[id].name);
+        unsigned slot = h & (CMD_HASH_SIZE - 1);
+
+        while (g_command_hash[slot].id >= 0) {
+            if (g_command_hash[slot].hash == h) {
+                printf("[ERROR] Command hash collision: %s / %s\n",
+                       g_commands[id].name, g_commands[g_command_hash[slot].id].name);
+                return -1;
+            }
+            slot = (slot + 1) & (CMD_HASH_SIZE - 1);
+        }
+        g_command_hash[slot].hash = h;
+        g_command_hash[slot].id = id;
+    }
+
+    return 0;
+}
+
+static const CommandInfo* command_lookup(const char *name) {
+    uint32_t h = command_hash(name);
+    unsigned slot = h & (CMD_HASH_SIZE - 1);
+
+    while (g_command_hash[slot].id >= 0) {
+        if (g_command_hash[slot].hash == h) {
+            const CommandInfo *cmd = &g_commands[g_command_hash[slot].id];
+            return strcmp(cmd->name, name) == 0 ? cmd : NULL;
+        }
+        slot = (slot + 1) & (CMD_HASH_SIZE - 1);
+    }
+    return NULL;
+}
+
+// Counts the call; replies and returns 0 if the session may not run it
+static int command_allowed(Connection *conn, const CommandInfo *cmd) {
+    int id = cmd - g_commands;
+    __atomic_fetch_add(&g_command_calls[id], 1, __ATOMIC_RELAXED);
+
+    if (cmd->session == SESSION_LOGGED_IN && __atomic_load_n(&conn->user_id, __ATOMIC_RELAXED) == 0) {
+        __atomic_fetch_add(&g_command_rejected[id], 1, __ATOMIC_RELAXED);
+        char response[256];
+        sprintf(response, "ERROR|Login required: %s\n", cmd->name);
+        send_response(conn, response);
+        return 0;
+    }
+    if (cmd->session == SESSION_LOCAL && strcmp(conn->ip, "127.0.0.1") != 0) {
+        __atomic_fetch_add(&g_command_rejected[id], 1, __ATOMIC_RELAXED);
+        char response[256];
+        sprintf(response, "ERROR|Local connections only: %s\n", cmd->name);
+        send_response(conn, response);
+        return 0;
+    }
+    return 1;
+}
+
+void handle_help(Connection *conn, char *data) {
+    char response[BUFFER_SIZE] = "HELP|";
+    size_t len = strlen(response);
+
+    for (int id = 0; id < CMD_COUNT; id++) {
+        const CommandInfo *cmd = &g_commands[id];
+        len += snprintf(response + len, sizeof(response) - len, "%s;%s;%s;%s;%s|",
+                        cmd->name,
+                        cmd->access == CMD_WRITE ? "write" : "read",
+                        cmd->session == SESSION_LOGGED_IN ? "login" :
+                        cmd->session == SESSION_LOCAL ? "local" : "any",
+                        g_rate_class_names[cmd->rate_class],
+                        cmd->args);
+        if (len >= sizeof(response) - 1) {
+            len = sizeof(response) - 2;
+            break;
+        }
+    }
+
+    response[len++] = '\n';
+    response[len] = '\0';
+    send_response(conn, response);
+}
+
+void command_log_stats() {
+    char line[BUFFER_SIZE];
+    size_t len = 0;
+
+    for (int id = 0; id < CMD_COUNT && len < sizeof(line) - 64; id++) {
+        unsigned long calls = __atomic_load_n(&g_command_calls[id], __ATOMIC_RELAXED);
+        unsigned long rejected = __atomic_load_n(&g_command_rejected[id], __ATOMIC_RELAXED);
+        if (calls == 0) continue;
+        len += snprintf(line + len, sizeof(line) - len, " %s=%lu", g_commands[id].name, calls);
+        if (rejected > 0) {
+            len += snprintf(line + len, sizeof(line) - len, "(%lu rejected)", rejected);
+        }
+    }
+
+    if (len > 0) {
+        printf("[STATS] Commands:%s\n", line);
+    }
+}
+
+// =====================================================
+// METRICS (STATS, --metrics-port)
+// =====================================================
+
+static const char *g_status_names[] = { "waiting", "active", "ended", "deleted", "other" };
+#define STATUS_KINDS 5
+
+// Gauges read from the tables and queues when asked; the counters and
+// command histograms come from the per-thread shards
+typedef struct {
+    int connections;
+    int sessions;
+    int rooms[STATUS_KINDS];
+    int auctions[STATUS_KINDS];
+    size_t outq_bytes;
+    unsigned outq_msgs;
+    size_t outq_max_bytes;      // deepest single connection
+    LatencyHist save;
+} MetricsSnapshot;
+
+static int status_index(const char *status) {
+    for (int i = 0; i < STATUS_KINDS - 1; i++) {
+        if (strcmp(status, g_status_names[i]) == 0) {
+            return i;
+        }
+    }
+    return STATUS_KINDS - 1;
+}
+
+void metrics_collect(MetricsSnapshot *m) {
+    memset(m, 0, sizeof(*m));
+
+    engine_lock(g_engine);
+    for (int i = 0; i < g_engine->room_count; i++) {
+        m->rooms[status_index(g_engine->rooms[i].status)]++;
+    }
+    for (int i = 0; i < g_engine->auction_count; i++) {
+        m->auctions[status_index(g_engine->auctions[i].status)]++;
+    }
+    m->save = g_engine->save_latency;
+    engine_unlock(g_engine);
+
+    client_lock();
+    m->sessions = g_client_count;
+    client_unlock();
+
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        pthread_mutex_lock(&g_conns[i].out_lock);
+        if (g_conns[i].socket >= 0) {
+            m->connections++;
+            m->outq_bytes += g_conns[i].out_bytes;
+            m->outq_msgs += g_conns[i].outq_count;
+            if (g_conns[i].out_bytes > m->outq_max_bytes) {
+                m->outq_max_bytes = g_conns[i].out_bytes;
+            }
+        }
+        pthread_mutex_unlock(&g_conns[i].out_lock);
+    }
+}
+
+// Called once per timer tick
+void metrics_update_rates() {
+    static uint64_t last_bids = 0;
+    static int64_t last_ms = 0;
+
+    uint64_t bids = metrics_counter(MET_BIDS_ACCEPTED);
+    int64_t now = clock_mono_ms();
+    if (last_ms > 0 && now > last_ms) {
+        g_bids_per_sec = (bids - last_bids) * 1000.0 / (now - last_ms);
+    }
+    last_bids = bids;
+    last_ms = now;
+}
+
+static void append_latency(RespBuf *r, const char *key, const LatencyHist *h) {
+    resp_appendf(r, "%s=%lu;%.1f;%.1f;%.1f|", key, (unsigned long)latency_count(h),
+                 latency_percentile_ns(h, 50) / 1000.0, latency_percentile_ns(h, 99) / 1000.0,
+                 h->max_ns / 1000.0);
+}
+
+// STATS|key=value|... ; latencies are count;p50;p99;max in microseconds
+void handle_stats(Connection *conn, char *data) {
+    MetricsSnapshot m;
+    metrics_collect(&m);
+
+    RespBuf *r = resp_begin("STATS|");
+    resp_appendf(r, "connections=%d|sessions=%d|", m.connections, m.sessions);
+    for (int i = 0; i < STATUS_KINDS; i++) {
+        if (m.rooms[i] > 0) resp_appendf(r, "rooms_%s=%d|", g_status_names[i], m.rooms[i]);
+    }
+    for (int i = 0; i < STATUS_KINDS; i++) {
+        if (m.auctions[i] > 0) resp_appendf(r, "auctions_%s=%d|", g_status_names[i], m.auctions[i]);
+    }
+
+    resp_appendf(r, "bids=%lu|bids_per_sec=%.1f|bids_rejected=",
+                 (unsigned long)metrics_counter(MET_BIDS_ACCEPTED), g_bids_per_sec);
+    for (int i = 0; i < BID_REJECT_REASONS; i++) {
+        resp_appendf(r, "%s%d:%lu", i > 0 ? ";" : "", -(i + 1),
+                     (unsigned long)metrics_counter(MET_BIDS_REJECTED + i));
+    }
+    resp_appendf(r, "|broadcasts=%lu|broadcast_recipients=%lu|deltas=%lu|delta_recipients=%lu|",
+                 (unsigned long)metrics_counter(MET_BROADCASTS),
+                 (unsigned long)metrics_counter(MET_BROADCAST_RECIPIENTS),
+                 (unsigned long)metrics_counter(MET_DELTAS),
+                 (unsigned long)metrics_counter(MET_DELTA_RECIPIENTS));
+    resp_appendf(r, "outq_bytes=%zu|outq_msgs=%u|outq_max_conn_bytes=%zu|outq_dropped=%lu|outq_evictions=%lu|",
+                 m.outq_bytes, m.outq_msgs, m.outq_max_bytes,
+                 __atomic_load_n(&g_outq_stats.dropped, __ATOMIC_RELAXED),
+                 __atomic_load_n(&g_outq_stats.evictions, __ATOMIC_RELAXED));
+
+    append_latency(r, "save_us", &m.save);
+    for (int id = 0; id < CMD_COUNT; id++) {
+        LatencyHist h;
+        char key[64];
+        metrics_histogram(id, &h);
+        if (latency_count(&h) == 0) continue;
+        snprintf(key, sizeof(key), "cmd_us.%s", g_commands[id].name);
+        append_latency(r, key, &h);
     }
 
-    send(client_socket, response, strlen(response), 0);
+    resp_send(conn, r);
 }
 
-void handle_place_bid(int client_socket, char *data) {
-    int auction_id, user_id;
-    double bid_amount;
-
-    sscanf(data, "%d|%d|%lf", &auction_id, &user_id, &bid_amount);
-
-    int result = place_bid(auction_id, user_id, bid_amount);
+// Prometheus text exposition format 0.0.4
 
-    char response[BUFFER_SIZE];
-    if (result > 0) {
-        // Get auction details for response
-        pthread_mutex_lock(&data_mutex);
-        Auction *auction = find_auction_by_id(auction_id);
-        int time_left = auction ? (auction->end_time - time(NULL)) : 0;
-        int total_bids = auction ? auction->total_bids : 0;
-        pthread_mutex_unlock(&data_mutex);
-        
-        sprintf(response, "BID_SUCCESS|%d|%.2f|%d|%d\n", 
-                auction_id, bid_amount, total_bids, time_left);
+static void prom_header(RespBuf *r, const char *name, const char *type, const char *help) {
+    resp_appendf(r, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
 
-        // ✅ Log bid placement
-        User *bidder = find_user_by_id(user_id);
-        if (bidder != NULL) {
-            char details[256];
-            sprintf(details, "Bid on auction %d: %.2f VND (Total bids: %d)", 
-                    auction_id, bid_amount, total_bids);
-            log_activity(user_id, bidder->username, "PLACE_BID", details, "127.0.0.1");
-        }
+// Buckets below 1us are folded into the first one
+#define PROM_FIRST_BUCKET 9
 
-        // Broadcast to room with extended info
-        if (auction != NULL) {
-            User *bidder = find_user_by_id(user_id);
-            char notification[512];
-            
-            if (time_left < 30 && time_left > 0) {
-                // Warning + bid notification
-                sprintf(notification, "NEW_BID_WARNING|%d|%s|%.2f|%d|%d\n",
-                        auction_id, bidder ? bidder->username : "Unknown", 
-                        bid_amount, total_bids, time_left);
-            } else {
-                sprintf(notification, "NEW_BID|%d|%s|%.2f|%d\n",
-                        auction_id, bidder ? bidder->username : "Unknown", 
-                        bid_amount, total_bids);
-            }
-            
-            broadcast_message_to_room(notification, auction->room_id, client_socket);
-        }
-    } else {
-        const char *error_msg;
-        switch(result) {
-            case -1: error_msg = "Auction not found"; break;
-            case -2: error_msg = "Auction not active"; break;
-            case -3: error_msg = "Auction ended"; break;
-            case -4: error_msg = "Bid too low"; break;
-            case -5: error_msg = "Cannot bid on own auction"; break;
-            case -6: error_msg = "Insufficient balance"; break;
-            case -8: error_msg = "Not in the same room"; break;
-            default: error_msg = "Unknown error"; break;
-        }
-        sprintf(response, "BID_FAIL|%s\n", error_msg);
+static void prom_histogram(RespBuf *r, const char *name, const char *labels, const LatencyHist *h) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        cumulative += h->counts[i];
+        if (i < PROM_FIRST_BUCKET) continue;
+        resp_appendf(r, "%s_bucket{%s%sle=\"%.10g\"} %lu\n", name, labels, labels[0] ? "," : "",
+                     (latency_bucket_ns(i) + 1) / 1e9, (unsigned long)cumulative);
     }
-
-    send(client_socket, response, strlen(response), 0);
+    uint64_t count = latency_count(h);
+    resp_appendf(r, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, labels[0] ? "," : "",
+                 (unsigned long)count);
+    const char *open = labels[0] ? "{" : "";
+    const char *close = labels[0] ? "}" : "";
+    resp_appendf(r, "%s_sum%s%s%s %.9f\n", name, open, labels, close, h->total_ns / 1e9);
+    resp_appendf(r, "%s_count%s%s%s %lu\n", name, open, labels, close, (unsigned long)count);
 }
 
-void handle_buy_now(int client_socket, char *data) {
-    int auction_id, user_id;
-    sscanf(data, "%d|%d", &auction_id, &user_id);
+void metrics_render_prometheus(RespBuf *r) {
+    MetricsSnapshot m;
+    metrics_collect(&m);
 
-    int result = buy_now(auction_id, user_id);
+    prom_header(r, "auction_connections", "gauge", "Open client connections");
+    resp_appendf(r, "auction_connections %d\n", m.connections);
+    prom_header(r, "auction_sessions", "gauge", "Logged-in sessions");
+    resp_appendf(r, "auction_sessions %d\n", m.sessions);
 
-    char response[BUFFER_SIZE];
-    if (result == 0) {
-        sprintf(response, "BUY_NOW_SUCCESS|%d\n", auction_id);
+    prom_header(r, "auction_rooms", "gauge", "Rooms by state");
+    for (int i = 0; i < STATUS_KINDS; i++) {
+        resp_appendf(r, "auction_rooms{state=\"%s\"} %d\n", g_status_names[i], m.rooms[i]);
+    }
+    prom_header(r, "auction_auctions", "gauge", "Auctions by state");
+    for (int i = 0; i < STATUS_KINDS; i++) {
+        resp_appendf(r, "auction_auctions{state=\"%s\"} %d\n", g_status_names[i], m.auctions[i]);
+    }
 
-        // Get auction for logging and broadcast
-        Auction *auction = find_auction_by_id(auction_id);
+    prom_header(r, "auction_bids_total", "counter", "Accepted bids");
+    resp_appendf(r, "auction_bids_total %lu\n", (unsigned long)metrics_counter(MET_BIDS_ACCEPTED));
+    prom_header(r, "auction_bids_per_second", "gauge", "Accepted bids per second over the last tick");
+    resp_appendf(r, "auction_bids_per_second %.1f\n", g_bids_per_sec);
+    prom_header(r, "auction_bids_rejected_total", "counter", "Rejected bids by place_bid result code");
+    for (int i = 0; i < BID_REJECT_REASONS; i++) {
+        resp_appendf(r, "auction_bids_rejected_total{code=\"%d\",reason=\"%s\"} %lu\n",
+                     -(i + 1), engine_place_bid_error(-(i + 1)),
+                     (unsigned long)metrics_counter(MET_BIDS_REJECTED + i));
+    }
 
-        // ✅ Log buy now
-        User *buyer = find_user_by_id(user_id);
-        if (buyer != NULL && auction != NULL) {
-            char details[256];
-            sprintf(details, "Bought auction %d instantly: %.2f VND", 
-                    auction_id, auction->buy_now_price);
-            log_activity(user_id, buyer->username, "BUY_NOW", details, "127.0.0.1");
+    prom_header(r, "auction_broadcasts_total", "counter", "Room and server-wide broadcasts");
+    resp_appendf(r, "auction_broadcasts_total %lu\n", (unsigned long)metrics_counter(MET_BROADCASTS));
+    prom_header(r, "auction_broadcast_recipients_total", "counter", "Messages queued by broadcasts");
+    resp_appendf(r, "auction_broadcast_recipients_total %lu\n",
+                 (unsigned long)metrics_counter(MET_BROADCAST_RECIPIENTS));
+    prom_header(r, "auction_deltas_total", "counter", "Auction deltas published to subscribers");
+    resp_appendf(r, "auction_deltas_total %lu\n", (unsigned long)metrics_counter(MET_DELTAS));
+    prom_header(r, "auction_delta_recipients_total", "counter", "Messages queued by deltas");
+    resp_appendf(r, "auction_delta_recipients_total %lu\n",
+                 (unsigned long)metrics_counter(MET_DELTA_RECIPIENTS));
+
+    prom_header(r, "auction_outq_bytes", "gauge", "Bytes queued for all connections");
+    resp_appendf(r, "auction_outq_bytes %zu\n", m.outq_bytes);
+    prom_header(r, "auction_outq_messages", "gauge", "Messages queued for all connections");
+    resp_appendf(r, "auction_outq_messages %u\n", m.outq_msgs);
+    prom_header(r, "auction_outq_max_connection_bytes", "gauge", "Deepest single outbound queue");
+    resp_appendf(r, "auction_outq_max_connection_bytes %zu\n", m.outq_max_bytes);
+    prom_header(r, "auction_outq_dropped_total", "counter", "Messages dropped for slow consumers");
+    resp_appendf(r, "auction_outq_dropped_total %lu\n",
+                 __atomic_load_n(&g_outq_stats.dropped, __ATOMIC_RELAXED));
+    prom_header(r, "auction_outq_evictions_total", "counter", "Slow consumers disconnected");
+    resp_appendf(r, "auction_outq_evictions_total %lu\n",
+                 __atomic_load_n(&g_outq_stats.evictions, __ATOMIC_RELAXED));
+
+    prom_header(r, "auction_save_seconds", "histogram", "engine_save duration");
+    prom_histogram(r, "auction_save_seconds", "", &m.save);
+
+    prom_header(r, "auction_command_seconds", "histogram", "Command latency, parse to reply queued");
+    for (int id = 0; id < CMD_COUNT; id++) {
+        LatencyHist h;
+        char labels[64];
+        metrics_histogram(id, &h);
+        if (latency_count(&h) == 0) continue;
+        snprintf(labels, sizeof(labels), "command=\"%s\"", g_commands[id].name);
+        prom_histogram(r, "auction_command_seconds", labels, &h);
+    }
+}
+
+// One scrape per connection, served in turn: GET /metrics, anything else 404
+void* metrics_server(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+
+    while (server_running) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
         }
 
-        // Broadcast to room
-        if (auction != NULL) {
-            char notification[512];
-            sprintf(notification, "AUCTION_ENDED|%d|buy_now\n", auction_id);
-            broadcast_message_to_room(notification, auction->room_id, client_socket);
+        struct timeval tv = { 2, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char request[1024];
+        ssize_t n = recv(fd, request, sizeof(request) - 1, 0);
+        request[n > 0 ? n : 0] = '\0';
+
+        RespBuf *r = resp_begin("");
+        const char *status = "200 OK";
+        if (strncmp(request, "GET /metrics", 12) == 0 &&
+            (request[12] == ' ' || request[12] == '?')) {
+            metrics_render_prometheus(r);
+        } else {
+            status = "404 Not Found";
+            resp_appendf(r, "Not found, try /metrics\n");
         }
-    } else {
-        const char *error_msg;
-        switch(result) {
-            case -1: error_msg = "Auction not available"; break;
-            case -2: error_msg = "Buy now not available"; break;
-            case -3: error_msg = "Insufficient balance"; break;
-            case -4: error_msg = "Not in the same room"; break;
-            default: error_msg = "Unknown error"; break;
+        if (r->failed) {
+            status = "500 Internal Server Error";
+            r->len = 0;
         }
-        sprintf(response, "BUY_NOW_FAIL|%s\n", error_msg);
+
+        char header[256];
+        int len = snprintf(header, sizeof(header),
+                           "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, r->len);
+        send(fd, header, len, MSG_NOSIGNAL);
+        send(fd, r->data, r->len, MSG_NOSIGNAL);
+        close(fd);
     }
 
-    send(client_socket, response, strlen(response), 0);
+    return NULL;
 }
 
-// ✅ NEW: Handle delete auction request
-void handle_delete_auction(int client_socket, char *data) {
-    int auction_id, user_id;
-    sscanf(data, "%d|%d", &auction_id, &user_id);
-
-    int result = delete_auction(auction_id, user_id);
+// Loopback only: the metrics carry nothing secret but nothing for the
+// outside world either
+int metrics_start(int port) {
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
 
-    char response[BUFFER_SIZE];
-    if (result == 0) {
-        sprintf(response, "DELETE_AUCTION_SUCCESS|%d\n", auction_id);
-        printf("[INFO] Auction %d deleted successfully by user %d\n", auction_id, user_id);
-        
-        // ✅ Log auction deletion
-        User *deleter = find_user_by_id(user_id);
-        if (deleter != NULL) {
-            char details[256];
-            sprintf(details, "Deleted auction %d", auction_id);
-            log_activity(user_id, deleter->username, "DELETE_AUCTION", details, "127.0.0.1");
-        }
-        
-        // Broadcast to room that auction was deleted
-        Auction *auction = find_auction_by_id(auction_id);
-        if (auction != NULL) {
-            char notification[256];
-            sprintf(notification, "AUCTION_DELETED|%d\n", auction_id);
-            broadcast_message_to_room(notification, auction->room_id, client_socket);
-        }
-    } else {
-        const char *error_msg;
-        switch(result) {
-            case -1: error_msg = "Auction not found"; break;
-            case -2: error_msg = "Cannot delete - auction already started or ended"; break;
-            case -3: error_msg = "Room not found"; break;
-            case -4: error_msg = "No permission - only seller or room creator can delete"; break;
-            default: error_msg = "Unknown error"; break;
-        }
-        sprintf(response, "DELETE_AUCTION_FAIL|%s\n", error_msg);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("Metrics listener failed");
+        close(fd);
+        return -1;
     }
 
-    send(client_socket, response, strlen(response), 0);
+    pthread_t thread;
+    pthread_create(&thread, NULL, metrics_server, (void*)(intptr_t)fd);
+    pthread_detach(thread);
+    printf("[INFO] Prometheus metrics on http://127.0.0.1:%d/metrics\n", port);
+    return 0;
 }
 
-void handle_bid_history(int client_socket, char *data) {
-    int auction_id, user_id;
-    sscanf(data, "%d|%d", &auction_id, &user_id);
+// =====================================================
+// SLOW LOG (--slow-ms, SLOWLOG)
+// =====================================================
 
-    // Validate room access
-    ClientSession *client = find_client_by_user_id(user_id);
-    
-    pthread_mutex_lock(&data_mutex);
+#define SLOWLOG_ENTRIES 128
+#define SLOWLOG_ARGS_LEN 64
 
-    Auction *auction = find_auction_by_id(auction_id);
-    
-    if (auction == NULL || client == NULL || client->current_room_id != auction->room_id) {
-        char response[] = "BID_HISTORY_FAIL|Not in the same room\n";
-        send(client_socket, response, strlen(response), 0);
-        pthread_mutex_unlock(&data_mutex);
-        return;
-    }
+typedef struct {
+    unsigned long id;
+    int64_t time_ms;
+    int user_id;
+    char command[32];
+    char args[SLOWLOG_ARGS_LEN];
+    uint64_t total_ns;
+    uint64_t parse_ns;
+    uint64_t lock_wait_ns;
+    uint64_t logic_ns;          // total minus parse, lock waits and disk writes
+    uint64_t save_ns;
+    uint64_t bytes_sent;
+    uint32_t recipients;
+} SlowLogEntry;
+
+// Last SLOWLOG_ENTRIES slow commands, slot id % SLOWLOG_ENTRIES (slowlog_mutex)
+static SlowLogEntry g_slowlog[SLOWLOG_ENTRIES];
+static unsigned long g_slowlog_next = 0;
+static pthread_mutex_t slowlog_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Arguments of the running command, copied before the handler (which may
+// tokenize them in place) runs
+static __thread char t_slow_args[SLOWLOG_ARGS_LEN];
+
+static void request_cost_lock_wait(uint64_t wait_ns) {
+    t_request_cost.lock_wait_ns += wait_ns;
+}
 
-    char response[BUFFER_SIZE * 2] = "BID_HISTORY|";
+static void on_engine_saved(void *ctx, uint64_t elapsed_ns) {
+    t_request_cost.save_ns += elapsed_ns;
+}
 
-    for (int i = g_bid_count - 1; i >= 0 && i >= g_bid_count - 20; i--) {
-        if (g_bids[i].auction_id == auction_id) {
-            User *bidder = find_user_by_id(g_bids[i].user_id);
-            char bid_info[256];
+static void request_cost_begin(uint64_t start) {
+    memset(&t_request_cost, 0, sizeof(t_request_cost));
+    t_request_cost.start_ns = start;
+    t_slow_args[0] = '\0';
+}
 
-            char time_str[64];
-            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S",
-                     localtime(&g_bids[i].bid_time));
+// End of parsing: stamp it and keep the arguments (never credentials)
+static void request_cost_parsed(const CommandInfo *cmd, const char *data) {
+    if (g_slow_ms <= 0) {
+        return;
+    }
+    t_request_cost.parse_ns = metrics_now_ns() - t_request_cost.start_ns;
+    snprintf(t_slow_args, sizeof(t_slow_args), "%s", cmd->rate_class == RATE_AUTH ? "-" : data);
+    for (char *p = t_slow_args; *p; p++) {
+        if (*p == '|') *p = ' ';
+        else if (*p == ';') *p = ',';
+    }
+}
 
-            sprintf(bid_info, "%s;%.2f;%s|",
-                    bidder ? bidder->username : "Unknown",
-                    g_bids[i].bid_amount,
-                    time_str);
+static void slowlog_record(Connection *conn, const CommandInfo *cmd, uint64_t total_ns) {
+    const RequestCost *c = &t_request_cost;
+    uint64_t accounted = c->parse_ns + c->lock_wait_ns + c->save_ns;
+
+    pthread_mutex_lock(&slowlog_mutex);
+    SlowLogEntry *e = &g_slowlog[g_slowlog_next % SLOWLOG_ENTRIES];
+    e->id = ++g_slowlog_next;
+    e->time_ms = clock_now_ms(&g_clock);
+    e->user_id = __atomic_load_n(&conn->user_id, __ATOMIC_RELAXED);
+    snprintf(e->command, sizeof(e->command), "%s", cmd->name);
+    snprintf(e->args, sizeof(e->args), "%s", t_slow_args);
+    e->total_ns = total_ns;
+    e->parse_ns = c->parse_ns;
+    e->lock_wait_ns = c->lock_wait_ns;
+    e->logic_ns = total_ns > accounted ? total_ns - accounted : 0;
+    e->save_ns = c->save_ns;
+    e->bytes_sent = c->bytes_sent;
+    e->recipients = c->recipients;
+    pthread_mutex_unlock(&slowlog_mutex);
+
+    printf("[WARNING] Slow command %s: %.2fms (parse %.2f, lock %.2f, logic %.2f, save %.2f ms; "
+           "%lu bytes, %u recipients)\n",
+           cmd->name, total_ns / 1e6, c->parse_ns / 1e6, c->lock_wait_ns / 1e6,
+           (total_ns > accounted ? total_ns - accounted : 0) / 1e6, c->save_ns / 1e6,
+           (unsigned long)c->bytes_sent, c->recipients);
+}
 
-            strcat(response, bid_info);
-        }
+// A command finished: latency histogram, and the slow log if over --slow-ms
+static void command_done(Connection *conn, const CommandInfo *cmd, uint64_t start) {
+    uint64_t elapsed = metrics_now_ns() - start;
+    metrics_observe_ns(cmd - g_commands, elapsed);
+    if (g_slow_ms > 0 && elapsed >= g_slow_ms * 1e6) {
+        slowlog_record(conn, cmd, elapsed);
+    }
+}
+
+// SLOWLOG|[count|RESET]: newest first, "id;time_ms;command;user_id;total;
+// parse;lock_wait;logic;save (us);bytes;recipients;args"
+void handle_slowlog(Connection *conn, char *data) {
+    if (g_slow_ms <= 0) {
+        send_response(conn, "SLOWLOG_FAIL|Slow log is off, start with --slow-ms=N\n");
+        return;
+    }
+    if (strcmp(data, "RESET") == 0) {
+        pthread_mutex_lock(&slowlog_mutex);
+        g_slowlog_next = 0;
+        pthread_mutex_unlock(&slowlog_mutex);
+        send_response(conn, "SLOWLOG_RESET\n");
+        return;
     }
 
-    pthread_mutex_unlock(&data_mutex);
+    int count = data[0] != '\0' ? atoi(data) : 10;
+    if (count <= 0 || count > SLOWLOG_ENTRIES) {
+        count = SLOWLOG_ENTRIES;
+    }
 
-    strcat(response, "\n");
-    send(client_socket, response, strlen(response), 0);
+    RespBuf *r = resp_begin("SLOWLOG|");
+    pthread_mutex_lock(&slowlog_mutex);
+    for (unsigned long n = g_slowlog_next; n > 0 && count > 0 && g_slowlog_next - n < SLOWLOG_ENTRIES;
+         n--, count--) {
+        const SlowLogEntry *e = &g_slowlog[(n - 1) % SLOWLOG_ENTRIES];
+        resp_appendf(r, "%lu;%lld;%s;%d;%.1f;%.1f;%.1f;%.1f;%.1f;%lu;%u;%s|",
+                     e->id, (long long)e->time_ms, e->command, e->user_id,
+                     e->total_ns / 1000.0, e->parse_ns / 1000.0, e->lock_wait_ns / 1000.0,
+                     e->logic_ns / 1000.0, e->save_ns / 1000.0,
+                     (unsigned long)e->bytes_sent, e->recipients, e->args);
+    }
+    pthread_mutex_unlock(&slowlog_mutex);
+    resp_send(conn, r);
 }
 
-void handle_my_auctions(int client_socket, char *data) {
-    int user_id;
-    sscanf(data, "%d", &user_id);
+// =====================================================
+// CLIENT HANDLER THREAD
+// =====================================================
 
-    pthread_mutex_lock(&data_mutex);
+static int run_command(Connection *conn, char *line, uint64_t req, const CommandInfo **cmd_out) {
+    if (conn->batch != NULL) {
+        *cmd_out = &g_commands[CMD_BATCH];
+        batch_collect(conn, line);
+        return 0;
+    }
 
-    char response[BUFFER_SIZE * 4] = "MY_AUCTIONS|";
-    time_t now = time(NULL);
+    // Parse command
+    char *data = strchr(line, '|');
 
-    for (int i = 0; i < g_auction_count; i++) {
-        if (g_auctions[i].seller_id == user_id) {
-            char auction_info[512];
-            int time_left = g_auctions[i].end_time - now;
-            if (time_left < 0) time_left = 0;
+    if (data != NULL) {
+        *data = '\0';
+        data++;
+    } else {
+        data = "";
+    }
 
-            sprintf(auction_info, "%d;%s;%.2f;%.2f;%d;%s;%d|",
-                    g_auctions[i].auction_id,
-                    g_auctions[i].title,
-                    g_auctions[i].current_price,
-                    g_auctions[i].buy_now_price,
-                    time_left,
-                    g_auctions[i].status,
-                    g_auctions[i].total_bids);
+    const CommandInfo *cmd = command_lookup(line);
+    *cmd_out = cmd;
+    if (cmd == NULL) {
+        char response[256];
+        snprintf(response, sizeof(response), "ERROR|Unknown command: %.50s\n", line);
+        send_response(conn, response);
+        return 0;
+    }
+    trace_end("parse", req);
+    request_cost_parsed(cmd, data);
 
-            strcat(response, auction_info);
-        }
+    if (!command_allowed(conn, cmd)) {
+        return 0;
+    }
+    if (cmd->handler == NULL) {
+        return -1;      // QUIT
     }
 
-    pthread_mutex_unlock(&data_mutex);
+    cmd->handler(conn, data);
+    return 0;
+}
 
-    strcat(response, "\n");
-    send(client_socket, response, strlen(response), 0);
+// Run one command line. Returns -1 when the client asked to quit.
+static int dispatch_command(Connection *conn, char *line) {
+    const CommandInfo *cmd = NULL;
+    uint64_t start = metrics_now_ns();
+    uint64_t req = trace_request_begin();
+    request_cost_begin(start);
+    int rc = run_command(conn, line, req, &cmd);
+    trace_request_end(cmd != NULL ? cmd->name : "unknown", req);
+    if (cmd != NULL) {
+        command_done(conn, cmd, start);
+    }
+    return rc;
 }
 
-void handle_auction_history(int client_socket, char *data) {
-    int user_id;
-    sscanf(data, "%d", &user_id);
+// A text command may start with "@<id> "; every reply line to it then
+// carries the same prefix, so a client can pipeline requests and still
+// tell replies apart from pushed events. BIN1 uses the header corr_id.
+static int dispatch_text_line(Connection *conn, char *line) {
+    conn->corr_id = 0;
+    if (line[0] == '@') {
+        char *end;
+        unsigned long id = strtoul(line + 1, &end, 10);
+        if (end > line + 1 && *end == ' ' && id <= UINT32_MAX) {
+            conn->corr_id = (uint32_t)id;
+            line = end + 1;
+        }
+    }
 
-    pthread_mutex_lock(&data_mutex);
+    int rc = dispatch_command(conn, line);
+    conn->corr_id = 0;
+    return rc;
+}
 
-    char response[BUFFER_SIZE * 4] = "AUCTION_HISTORY|";
+// Run one BIN1 frame; OP_TEXT goes through the text dispatcher
+static int dispatch_frame(Connection *conn, const ProtoHeader *h, char *payload) {
+    char line[PROTO_MAX_PAYLOAD + 1];
+    char response[256];
+
+    conn->corr_id = h->corr_id;
+
+    switch (h->opcode) {
+        case OP_TEXT:
+            memcpy(line, payload, h->len);
+            line[h->len] = '\0';
+            return dispatch_command(conn, line);
+        case OP_PLACE_BID: {
+            ProtoPlaceBid bid;
+            uint64_t start = metrics_now_ns();
+            uint64_t req = trace_request_begin();
+            request_cost_begin(start);
+            if (!command_allowed(conn, &g_commands[CMD_PLACE_BID])) {
+                // rejected and answered
+            } else if (proto_decode_place_bid(payload, h->len, &bid) != 0) {
+                send_response(conn, "ERROR|Malformed frame\n");
+            } else if (conn->batch != NULL) {
+                snprintf(line, sizeof(line), "PLACE_BID|%d|%d|%.2f%s%s", bid.auction_id, bid.user_id,
+                         bid.amount, bid.request_id[0] ? "|" : "", bid.request_id);
+                batch_collect(conn, line);
+            } else {
+                trace_end("parse", req);
+                snprintf(line, sizeof(line), "%d|%d|%.2f%s%s", bid.auction_id, bid.user_id,
+                         bid.amount, bid.request_id[0] ? "|" : "", bid.request_id);
+                request_cost_parsed(&g_commands[CMD_PLACE_BID], line);
+                place_bid_and_notify(conn, bid.auction_id, bid.user_id, bid.amount, bid.request_id);
+            }
+            trace_request_end("PLACE_BID", req);
+            command_done(conn, &g_commands[CMD_PLACE_BID], start);
+            return 0;
+        }
+        default:
+            sprintf(response, "ERROR|Unknown opcode: %u\n", h->opcode);
+            send_response(conn, response);
+            return 0;
+    }
+}
 
-    for (int i = 0; i < g_auction_count; i++) {
-        if (strcmp(g_auctions[i].status, "ended") == 0) {
-            char auction_info[512];
-            char winner_name[50] = "No winner";
-            char win_method[20] = "no_bids";
-            
-            if (g_auctions[i].winner_id > 0) {
-                User *winner = find_user_by_id(g_auctions[i].winner_id);
-                if (winner != NULL) {
-                    strncpy(winner_name, winner->username, 49);
-                    winner_name[49] = '\0';
-                }
-                
-                // Determine win method
-                if (g_auctions[i].current_price == g_auctions[i].buy_now_price 
-                    && g_auctions[i].buy_now_price > 0) {
-                    strcpy(win_method, "buy_now");
-                } else {
-                    strcpy(win_method, "bid");
-                }
+// Execute every complete command in the buffer, in order, and keep a
+// trailing partial command for the next recv(). Returns -1 on QUIT or
+// on a binary frame we cannot resynchronise after.
+static int process_input(Connection *conn, InBuf *in) {
+    size_t start = 0;
+    int rc = 0;
+
+    while (rc == 0 && start < in->len) {
+        if (conn->proto == PROTO_BIN1) {
+            ProtoHeader h;
+            int ready = proto_parse_header(in->data + start, in->len - start, PROTO_MAX_PAYLOAD, &h);
+            if (ready < 0) {
+                conn->corr_id = h.corr_id;
+                send_response(conn, "ERROR|Frame too large\n");
+                return -1;
+            }
+            if (ready == 0 || in->len - start < PROTO_HEADER_SIZE + h.len) {
+                break;
             }
+            capture_record(conn, CAP_FRAME, 0, in->data + start, PROTO_HEADER_SIZE + h.len);
+            rc = dispatch_frame(conn, &h, in->data + start + PROTO_HEADER_SIZE);
+            start += PROTO_HEADER_SIZE + h.len;
+            continue;
+        }
 
-            sprintf(auction_info, "%d;%s;%.2f;%s;%s|",
-                    g_auctions[i].auction_id,
-                    g_auctions[i].title,
-                    g_auctions[i].current_price,
-                    winner_name,
-                    win_method);
+        char *nl = memchr(in->data + start, '\n', in->len - start);
+        if (nl == NULL) {
+            break;
+        }
 
-            strcat(response, auction_info);
+        size_t end = nl - in->data;
+        if (in->discarding) {
+            in->discarding = 0;
+        } else if (end - start > MAX_FRAME_SIZE) {
+            send_response(conn, "ERROR|Command too long\n");
+        } else {
+            *nl = '\0';
+            if (end > start && in->data[end - 1] == '\r') {
+                in->data[end - 1] = '\0';
+            }
+            capture_record(conn, CAP_TEXT, 0, in->data + start, strlen(in->data + start));
+            rc = dispatch_text_line(conn, in->data + start);
         }
+        start = end + 1;
     }
 
-    pthread_mutex_unlock(&data_mutex);
+    size_t rest = in->len - start;
+    if (rc == 0 && conn->proto == PROTO_TEXT && (in->discarding || rest > MAX_FRAME_SIZE)) {
+        // No newline within the frame limit: reject once, then drop bytes
+        // until the command finally ends
+        if (!in->discarding) {
+            send_response(conn, "ERROR|Command too long\n");
+            in->discarding = 1;
+        }
+        rest = 0;
+        start = in->len;
+    }
 
-    strcat(response, "\n");
-    send(client_socket, response, strlen(response), 0);
+    memmove(in->data, in->data + start, rest);
+    in->len = rest;
+    return rc;
 }
 
-// =====================================================
-// CLIENT HANDLER THREAD
-// =====================================================
-
 void* handle_client(void *arg) {
-    int client_socket = *(int*)arg;
-    free(arg);
+    Connection *conn = (Connection*)arg;
+    int client_socket = conn->socket;
 
-    char buffer[BUFFER_SIZE];
+    InBuf in;
+    in.len = 0;
+    in.discarding = 0;
 
     printf("[INFO] New client connected: socket %d\n", client_socket);
+    trace_thread_name("client");
 
+    int dropped = 0;
     while (1) {
-        memset(buffer, 0, BUFFER_SIZE);
-        int bytes_received = recv(client_socket, buffer, BUFFER_SIZE - 1, 0);
+        ssize_t bytes_received = recv(client_socket, in.data + in.len, INBUF_SIZE - in.len, 0);
 
         if (bytes_received <= 0) {
+            dropped = 1;    // not a QUIT: keep the session resumable
             break;
         }
+        in.len += bytes_received;
 
-        buffer[bytes_received] = '\0';
-
-        // Remove newline
-        char *newline = strchr(buffer, '\n');
-        if (newline) *newline = '\0';
-
-        printf("[DEBUG] Received: %s\n", buffer);
+        // Replies to everything that arrived together go out together
+        conn_cork(conn);
+        int rc = process_input(conn, &in);
+        conn_uncork(conn);
 
-        // Parse command
-        char command[50];
-        char *data = strchr(buffer, '|');
-
-        if (data != NULL) {
-            *data = '\0';
-            data++;
-            strcpy(command, buffer);
-        } else {
-            strcpy(command, buffer);
-            data = "";
-        }
-
-        // Handle commands
-        if (strcmp(command, "REGISTER") == 0) {
-            handle_register(client_socket, data);
-        } else if (strcmp(command, "LOGIN") == 0) {
-            handle_login(client_socket, data);
-        } else if (strcmp(command, "CREATE_ROOM") == 0) {
-            handle_create_room(client_socket, data);
-        } else if (strcmp(command, "LIST_ROOMS") == 0) {
-            handle_list_rooms(client_socket);
-        } else if (strcmp(command, "JOIN_ROOM") == 0) {
-            handle_join_room(client_socket, data);
-        } else if (strcmp(command, "LEAVE_ROOM") == 0) {
-            handle_leave_room(client_socket, data);
-        } else if (strcmp(command, "ROOM_DETAIL") == 0) {
-            handle_room_detail(client_socket, data);
-        } else if (strcmp(command, "MY_ROOM") == 0) {
-            handle_my_room(client_socket, data);
-        } else if (strcmp(command, "LIST_AUCTIONS") == 0) {
-            handle_list_auctions(client_socket, data);
-        } else if (strcmp(command, "MY_AUCTIONS") == 0) {
-            handle_my_auctions(client_socket, data);
-        } else if (strcmp(command, "AUCTION_DETAIL") == 0) {
-            handle_auction_detail(client_socket, data);
-        } else if (strcmp(command, "CREATE_AUCTION") == 0) {
-            handle_create_auction(client_socket, data);
-        } else if (strcmp(command, "PLACE_BID") == 0) {
-            handle_place_bid(client_socket, data);
-        } else if (strcmp(command, "BUY_NOW") == 0) {
-            handle_buy_now(client_socket, data);
-        } else if (strcmp(command, "DELETE_AUCTION") == 0) {
-            handle_delete_auction(client_socket, data);
-        } else if (strcmp(command, "BID_HISTORY") == 0) {
-            handle_bid_history(client_socket, data);
-        } else if (strcmp(command, "AUCTION_HISTORY") == 0) {
-            handle_auction_history(client_socket, data);
-        } else if (strcmp(command, "QUIT") == 0) {
+        if (rc < 0) {
             break;
-        } else {
-            char response[256];
-            sprintf(response, "ERROR|Unknown command: %s\n", command);
-            send(client_socket, response, strlen(response), 0);
         }
     }
 
     printf("[INFO] Client disconnected: socket %d\n", client_socket);
-    remove_client(client_socket);
-    close(client_socket);
+    capture_record(conn, CAP_CLOSE, dropped, NULL, 0);
+    remove_client(conn, dropped);
+    conn_close(conn);
 
     return NULL;
 }
 
 // =====================================================
-// AUCTION TIMER THREAD
+// ENGINE EVENTS
 // =====================================================
+// Callbacks from the auction engine, called with the engine lock held
 
-void* auction_timer(void *arg) {
-    while (server_running) {
-        sleep(5); // Check every 5 seconds
+// Invalidates cached LIST_ROOMS/ROOM_DETAIL
+static void on_room_changed(void *ctx, int room_id) {
+    __atomic_add_fetch(&g_room_version[room_id - 1], 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&g_rooms_version, 1, __ATOMIC_RELEASE);
+}
 
-        pthread_mutex_lock(&data_mutex);
-        time_t now = time(NULL);
+static void on_auction_changed(void *ctx, const Auction *auction, DeltaKind kind) {
+    publish_auction_delta(auction, kind);
+}
 
-        for (int i = 0; i < g_auction_count; i++) {
-            if (strcmp(g_auctions[i].status, "active") == 0) {
-                int time_left = g_auctions[i].end_time - now;
-                
-                // Check if auction ended
-                if (time_left <= 0) {
-                    strcpy(g_auctions[i].status, "ended");
-
-                    // Get winner information
-                    char winner_name[50] = "No bids";
-                    double final_price = g_auctions[i].current_price;
-                    int total_bids = g_auctions[i].total_bids;
-                    
-                    if (g_auctions[i].winner_id > 0) {
-                        User *winner = find_user_by_id(g_auctions[i].winner_id);
-                        if (winner != NULL) {
-                            strcpy(winner_name, winner->username);
-                        }
-                    }
+// Detailed winner announcement
+static void on_auction_ended(void *ctx, const Auction *auction, const User *winner) {
+    char notification[512];
+    sprintf(notification, "AUCTION_ENDED|%d|%s|%s|%.2f|%d\n",
+            auction->auction_id,
+            auction->title,
+            winner ? winner->username : "No bids",
+            auction->current_price,
+            auction->total_bids);
+    broadcast_message_to_room(notification, auction->room_id, NULL, MSG_TERMINAL, 0);
+}
 
-                    // Send detailed winner announcement
-                    char notification[512];
-                    sprintf(notification, "AUCTION_ENDED|%d|%s|%s|%.2f|%d\n",
-                            g_auctions[i].auction_id,
-                            g_auctions[i].title,
-                            winner_name,
-                            final_price,
-                            total_bids);
-                    broadcast_message_to_room(notification, g_auctions[i].room_id, -1);
-
-                    printf("[INFO] Auction %d ended - Winner: %s, Price: %.2f, Bids: %d\n", 
-                           g_auctions[i].auction_id, winner_name, final_price, total_bids);
-                }
-                // ✅ NEW: Send warning when 30 seconds left
-                else if (time_left <= 30 && time_left > 25) {
-                    // Send warning in this 5-second window
-                    char warning[512];
-                    sprintf(warning, "AUCTION_WARNING|%d|%s|%.2f|%d\n",
-                            g_auctions[i].auction_id,
-                            g_auctions[i].title,
-                            g_auctions[i].current_price,
-                            time_left);
-                    broadcast_message_to_room(warning, g_auctions[i].room_id, -1);
-                    
-                    printf("[INFO] Auction %d warning: %d seconds left\n", 
-                           g_auctions[i].auction_id, time_left);
-                }
-            }
-        }
+static void on_auction_warning(void *ctx, const Auction *auction, int time_left) {
+    char warning[512];
+    sprintf(warning, "AUCTION_WARNING|%d|%s|%.2f|%d\n",
+            auction->auction_id,
+            auction->title,
+            auction->current_price,
+            time_left);
+    broadcast_message_to_room(warning, auction->room_id, NULL, MSG_EVENT,
+                              CONFLATE_KEY(CONFLATE_WARNING, auction->auction_id));
+}
+
+// data_dir NULL: no persistence (replay)
+int server_engine_init(const char *data_dir) {
+    EngineConfig config;
+    memset(&config, 0, sizeof(config));
+    config.data_dir = data_dir;
+    config.max_users = MAX_USERS;
+    config.max_rooms = MAX_ROOMS;
+    config.max_auctions = MAX_AUCTIONS;
+    config.max_bids = MAX_BIDS;
+    config.fixed_buffers = 1;
+    config.clock = &g_clock;
+    config.callbacks.auction_changed = on_auction_changed;
+    config.callbacks.room_changed = on_room_changed;
+    config.callbacks.auction_ended = on_auction_ended;
+    config.callbacks.auction_warning = on_auction_warning;
+    config.callbacks.saved = on_engine_saved;
+
+    g_engine = engine_create(&config);
+    if (g_engine == NULL) {
+        return -1;
+    }
+    g_engine->lock_prof.on_wait = request_cost_lock_wait;
+    g_client_lock_prof.on_wait = request_cost_lock_wait;
+    engine_load(g_engine);
+    return 0;
+}
 
-        pthread_mutex_unlock(&data_mutex);
+// =====================================================
+// AUCTION TIMER THREAD
+// =====================================================
+
+void* auction_timer(void *arg) {
+    trace_thread_name("timer");
+
+    while (server_running) {
+        clock_sleep_ms(&g_clock, ENGINE_TICK_SECONDS * 1000);
+        capture_record(NULL, CAP_TICK, 0, NULL, 0);
+
+        uint64_t req = trace_request_begin();
+        engine_tick(g_engine, clock_now(&g_clock));
+        expire_detached_sessions();
+        trace_request_end("auction_tick", req);
+
+        capture_flush();
+        metrics_update_rates();
+        if (g_trace_dump_requested) {
+            g_trace_dump_requested = 0;
+            printf("[INFO] Wrote %d trace spans to %s\n", trace_dump(g_trace_path), g_trace_path);
+        }
     }
 
     return NULL;
@@ -1725,31 +4357,218 @@ void* auction_timer(void *arg) {
 // SIGNAL HANDLER
 // =====================================================
 
+// SIGUSR1: dump the trace from the timer thread, not from the handler
+void trace_signal_handler(int sig) {
+    g_trace_dump_requested = 1;
+}
+
+// SIGINT/SIGTERM: only async-signal-safe work here. The signal may land on
+// a thread holding the engine lock or an out_lock, so the accept loop does
+// the logging and the final save (server_shutdown).
 void signal_handler(int sig) {
-    printf("\n[INFO] Server shutting down...\n");
+    uint64_t one = 1;
     server_running = 0;
-    save_all_data();
+    if (write(g_shutdown_fd, &one, sizeof(one)) < 0) {
+        // nothing to do: accept also checks server_running
+    }
+}
+
+void server_shutdown() {
+    printf("\n[INFO] Server shutting down...\n");
+    outq_log_stats();
+    command_log_stats();
+    resp_cache_log_stats();
+    dedup_log_stats();
+    lock_log_stats();
+    engine_lock(g_engine);
+    engine_save(g_engine);
+    engine_unlock(g_engine);
+    capture_flush();
     close(server_socket);
     exit(0);
 }
 
+// =====================================================
+// COMMAND LINE OPTIONS
+// =====================================================
+
+void print_usage(const char *prog) {
+    printf("Usage: %s [options]\n", prog);
+    printf("  --io-backend=MODE   auto | uring | posix (default: auto)\n");
+    printf("  --outq-max-kb=N     Outbound queue budget per connection (default: %d)\n",
+           OUTQ_DEFAULT_MAX_BYTES / 1024);
+    printf("  --slow-consumer=P   drop | disconnect (default: disconnect)\n");
+    printf("  --no-conflation     Deliver every price update, even to slow clients\n");
+    printf("  --record=FILE       Record inbound traffic for bench/replay\n");
+    printf("  --clock-speed=X     Run auction time X times faster than real time\n");
+    printf("  --trace-sample=N    Trace 1 request in N (TRACE_DUMP or SIGUSR1 writes it)\n");
+    printf("  --trace-file=PATH   Chrome trace output (default: %s)\n", TRACE_DEFAULT_FILE);
+    printf("  --metrics-port=N    Serve Prometheus metrics on 127.0.0.1:N/metrics\n");
+    printf("  --slow-ms=N         Log commands slower than N ms (SLOWLOG lists them)\n");
+    printf("  --help              Show this help\n");
+}
+
+int parse_options(int argc, char **argv) {
+    static struct option long_options[] = {
+        {"io-backend", required_argument, 0, 'b'},
+        {"outq-max-kb", required_argument, 0, 'q'},
+        {"slow-consumer", required_argument, 0, 's'},
+        {"no-conflation", no_argument,       0, 'c'},
+        {"record",     required_argument, 0, 'r'},
+        {"clock-speed", required_argument, 0, 'k'},
+        {"trace-sample", required_argument, 0, 't'},
+        {"trace-file", required_argument, 0, 'T'},
+        {"metrics-port", required_argument, 0, 'm'},
+        {"slow-ms",    required_argument, 0, 'l'},
+        {"help",       no_argument,       0, 'h'},
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b':
+                if (strcmp(optarg, "auto") != 0 && strcmp(optarg, "uring") != 0 &&
+                    strcmp(optarg, "posix") != 0) {
+                    printf("[ERROR] Unknown I/O backend: %s\n", optarg);
+                    return -1;
+                }
+                g_io_backend_mode = optarg;
+                break;
+            case 'q':
+                if (atoi(optarg) <= 0) {
+                    printf("[ERROR] Invalid outbound queue size: %s\n", optarg);
+                    return -1;
+                }
+                g_outq_max_bytes = (size_t)atoi(optarg) * 1024;
+                break;
+            case 's':
+                if (strcmp(optarg, "drop") == 0) {
+                    g_slow_policy = SLOW_POLICY_DROP;
+                } else if (strcmp(optarg, "disconnect") == 0) {
+                    g_slow_policy = SLOW_POLICY_DISCONNECT;
+                } else {
+                    printf("[ERROR] Unknown slow consumer policy: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'c':
+                g_conflation_enabled = 0;
+                break;
+            case 'r':
+                g_record_path = optarg;
+                break;
+            case 't':
+                if (atoi(optarg) < 0) {
+                    printf("[ERROR] Invalid trace sample rate: %s\n", optarg);
+                    return -1;
+                }
+                g_trace_sample = (unsigned)atoi(optarg);
+                break;
+            case 'T':
+                g_trace_path = optarg;
+                break;
+            case 'l':
+                g_slow_ms = atof(optarg);
+                if (g_slow_ms < 0) {
+                    printf("[ERROR] Invalid slow log threshold: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'm':
+                g_metrics_port = atoi(optarg);
+                if (g_metrics_port <= 0 || g_metrics_port > 65535) {
+                    printf("[ERROR] Invalid metrics port: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'k':
+                g_clock_speed = atof(optarg);
+                if (g_clock_speed <= 0) {
+                    printf("[ERROR] Invalid clock speed: %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'h':
+            default:
+                print_usage(argv[0]);
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
 // =====================================================
 // MAIN FUNCTION
 // =====================================================
 
-int main() {
+// SERVER_NO_MAIN: bench/engine_bench and bench/replay include this file and
+// call the business logic and the dispatcher directly
+#ifndef SERVER_NO_MAIN
+int main(int argc, char **argv) {
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len = sizeof(client_addr);
 
+    if (parse_options(argc, argv) != 0) {
+        return EXIT_FAILURE;
+    }
+
     // Setup signal handler
+    g_shutdown_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (g_shutdown_fd < 0) {
+        perror("Shutdown eventfd failed");
+        exit(EXIT_FAILURE);
+    }
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGUSR1, trace_signal_handler);
+
+    trace_init(g_trace_sample);
+    if (g_trace_sample > 0) {
+        printf("[INFO] Tracing 1 in %u requests to %s\n", g_trace_sample, g_trace_path);
+    }
+
+    // Probe io_uring (falls back to plain syscalls)
+    if (io_backend_init(g_io_backend_mode) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (command_registry_init() != 0) {
+        exit(EXIT_FAILURE);
+    }
+    metrics_init(MET_COUNTERS, CMD_COUNT);
+    if (g_slow_ms > 0) {
+        printf("[INFO] Logging commands slower than %gms\n", g_slow_ms);
+    }
+
+    if (g_clock_speed > 0) {
+        clock_init_scaled(&g_clock, clock_wall_ms(), g_clock_speed);
+        printf("[INFO] Auction clock runs %gx real time\n", g_clock_speed);
+    } else {
+        clock_init_real(&g_clock);
+    }
 
     // Initialize data storage
-    init_data_storage();
+    if (server_engine_init(DATA_DIR) != 0) {
+        printf("[ERROR] Could not allocate the auction engine\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (g_record_path != NULL && capture_start(g_record_path) != 0) {
+        exit(EXIT_FAILURE);
+    }
 
     // Initialize client sessions
     memset(g_clients, 0, sizeof(g_clients));
+    conn_table_init();
+    resp_cache_init();
+
+    if (flusher_init() != 0) {
+        perror("Flusher setup failed");
+        exit(EXIT_FAILURE);
+    }
 
     // Create socket
     server_socket = socket(AF_INET, SOCK_STREAM, 0);
@@ -1791,25 +4610,53 @@ int main() {
     pthread_t timer_thread;
     pthread_create(&timer_thread, NULL, auction_timer, NULL);
 
-    // Accept clients
+    // Start outbound flusher thread
+    pthread_t flusher_thread;
+    pthread_create(&flusher_thread, NULL, io_flusher, NULL);
+
+    if (g_metrics_port > 0 && metrics_start(g_metrics_port) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Accept clients until a signal pokes g_shutdown_fd
+    struct pollfd fds[2] = {
+        { .fd = server_socket, .events = POLLIN },
+        { .fd = g_shutdown_fd, .events = POLLIN }
+    };
     while (server_running) {
-        int *client_socket = malloc(sizeof(int));
-        *client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
+        if (poll(fds, 2, -1) < 0 || !server_running || fds[1].revents != 0) {
+            continue;
+        }
+        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &client_len);
 
-        if (*client_socket < 0) {
-            free(client_socket);
+        if (client_socket < 0) {
             continue;
         }
 
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+
+        // Replies are already batched per input burst; Nagle would only
+        // hold back the tail of a pipelined batch until the peer ACKs
+        int nodelay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        Connection *conn = conn_open(client_socket, ip);
+        if (conn == NULL) {
+            char response[] = "ERROR|Server full\n";
+            send(client_socket, response, strlen(response), MSG_DONTWAIT | MSG_NOSIGNAL);
+            close(client_socket);
+            continue;
+        }
+        capture_open(conn);
+
         // Create thread for client
         pthread_t thread_id;
-        pthread_create(&thread_id, NULL, handle_client, client_socket);
+        pthread_create(&thread_id, NULL, handle_client, conn);
         pthread_detach(thread_id);
     }
 
-    // Cleanup
-    save_all_data();
-    close(server_socket);
-
+    server_shutdown();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,175 @@
+/*
+ * =====================================================
+ * TRACE.C - SAMPLED REQUEST SPANS (CHROME TRACE FORMAT)
+ * =====================================================
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "trace.h"
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    uint32_t request;           // sampled request the span belongs to
+} TraceEvent;
+
+typedef struct {
+    TraceEvent events[TRACE_RING_EVENTS];
+    uint64_t head;              // spans ever written; published with release
+    char name[32];
+    int in_use;                 // owned by a live thread (trace_mutex)
+} TraceRing;
+
+static unsigned g_sample_every = 0;
+static uint32_t g_next_request = 0;
+static TraceRing *g_rings[TRACE_MAX_THREADS];
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t g_ring_key;
+
+static __thread TraceRing *t_ring;
+static __thread uint32_t t_request;         // 0 = current request not sampled
+static __thread unsigned t_countdown;
+static __thread const char *t_name = "thread";
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Thread exit: the ring (and its spans) stays for the next thread
+static void ring_release(void *arg) {
+    TraceRing *ring = arg;
+    pthread_mutex_lock(&trace_mutex);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+static TraceRing* ring_acquire() {
+    TraceRing *ring = NULL;
+
+    pthread_mutex_lock(&trace_mutex);
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        if (g_rings[i] == NULL) {
+            g_rings[i] = calloc(1, sizeof(TraceRing));
+        }
+        if (g_rings[i] != NULL && !g_rings[i]->in_use) {
+            ring = g_rings[i];
+            ring->in_use = 1;
+            snprintf(ring->name, sizeof(ring->name), "%s", t_name);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trace_mutex);
+
+    if (ring != NULL) {
+        pthread_setspecific(g_ring_key, ring);
+    }
+    return ring;
+}
+
+void trace_init(unsigned sample_every) {
+    pthread_key_create(&g_ring_key, ring_release);
+    g_sample_every = sample_every;
+}
+
+int trace_enabled(void) {
+    return g_sample_every > 0;
+}
+
+void trace_thread_name(const char *name) {
+    t_name = name;
+}
+
+uint64_t trace_request_begin(void) {
+    if (g_sample_every == 0 || t_request != 0) {
+        return 0;
+    }
+    if (t_countdown == 0) {
+        // Random phase, so threads with lockstep traffic do not all
+        // sample the same request type
+        t_countdown = 1 + (unsigned)(now_ns() / 1000) % g_sample_every;
+    }
+    if (--t_countdown > 0) {
+        return 0;
+    }
+    t_countdown = g_sample_every;
+
+    if (t_ring == NULL && (t_ring = ring_acquire()) == NULL) {
+        return 0;
+    }
+    t_request = __atomic_add_fetch(&g_next_request, 1, __ATOMIC_RELAXED);
+    return now_ns();
+}
+
+void trace_request_end(const char *name, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    trace_end(name, start);
+    t_request = 0;
+}
+
+uint64_t trace_begin(void) {
+    return t_request != 0 ? now_ns() : 0;
+}
+
+void trace_end(const char *name, uint64_t start) {
+    if (start == 0) {
+        return;
+    }
+    TraceRing *ring = t_ring;
+    uint64_t head = ring->head;
+    TraceEvent *e = &ring->events[head % TRACE_RING_EVENTS];
+    e->name = name;
+    e->start_ns = start;
+    e->dur_ns = now_ns() - start;
+    e->request = t_request;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int trace_dump(const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    int count = 0;
+    int lines = 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int i = 0; i < TRACE_MAX_THREADS; i++) {
+        pthread_mutex_lock(&trace_mutex);
+        TraceRing *ring = g_rings[i];
+        pthread_mutex_unlock(&trace_mutex);
+        if (ring == NULL) {
+            break;
+        }
+
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == 0) {
+            continue;
+        }
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", lines++ > 0 ? ",\n" : "", i + 1, ring->name);
+
+        uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+        for (uint64_t n = first; n < head; n++) {
+            TraceEvent e = ring->events[n % TRACE_RING_EVENTS];
+            if (e.name == NULL) continue;
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"auction\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":1,\"tid\":%d,\"args\":{\"req\":%u}}",
+                    e.name, e.start_ns / 1000.0, e.dur_ns / 1000.0, i + 1, e.request);
+            count++;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    return count;
+}
@@ -0,0 +1,45 @@
+/*
+ * =====================================================
+ * TRACE.H - SAMPLED REQUEST SPANS (CHROME TRACE FORMAT)
+ * =====================================================
+ * One request in every N is traced: while it runs, trace_begin/trace_end
+ * pairs on that thread record named spans (parse, engine lock wait, disk
+ * save, broadcast, reply) into the thread's own ring buffer, so recording
+ * takes no locks. Unsampled requests pay one thread-local load per span.
+ *
+ * trace_dump() writes the rings as Chrome trace JSON, which loads in
+ * chrome://tracing and ui.perfetto.dev. Rings keep the last
+ * TRACE_RING_EVENTS spans per thread; a dump taken under load may show a
+ * few torn events at the oldest end.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_EVENTS 4096
+#define TRACE_MAX_THREADS 256
+
+// Trace one request in every sample_every; 0 turns tracing off
+void trace_init(unsigned sample_every);
+int trace_enabled(void);
+
+// Label for this thread's ring in the dump ("client", "flusher", ...)
+void trace_thread_name(const char *name);
+
+// Start a request on this thread. Returns a start stamp if this request is
+// sampled, 0 otherwise (or if one is already running); pass it back to
+// trace_request_end with the request's name.
+uint64_t trace_request_begin(void);
+void trace_request_end(const char *name, uint64_t start);
+
+// A span inside the current request; no-ops unless it is sampled.
+// name must be a string literal or otherwise outlive the trace.
+uint64_t trace_begin(void);
+void trace_end(const char *name, uint64_t start);
+
+// Returns the number of spans written, -1 if path cannot be written
+int trace_dump(const char *path);
+
+#endif